@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2023-2024 Intel Corporation. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <types.h>
+#include <rtl.h>
+#include <asm/cpu.h>
+#include <asm/io.h>
+#include <irq.h>
+#include <asm/irq.h>
+#include <asm/init.h>
+#include <asm/mem.h>
+#include <asm/fdt.h>
+#include <asm/aia.h>
+#include <asm/lib/bits.h>
+#include <asm/lib/spinlock.h>
+#include <debug/logmsg.h>
+
+/*
+ * Host side of the AIA: the S-level APLIC runs in MSI delivery mode and
+ * forwards every source to the S-level IMSIC file of a hart, using the
+ * source number as interrupt identity. Sources are left inactive until
+ * the hypervisor enables them or a guest routes them to its own guest
+ * interrupt file through the vAPLIC.
+ */
+struct acrn_aia {
+	spinlock_t lock;
+	void *aplic;
+	bool available;
+	uint32_t geilen;
+	uint32_t guest_bits;
+};
+
+static struct acrn_aia aia;
+
+/* guest interrupt files in use on each pCPU, bit n is file n */
+static uint64_t imsic_files[NR_CPUS];
+
+bool aia_available(void)
+{
+	return aia.available;
+}
+
+static inline void aplic_write(uint32_t value, uint32_t offset)
+{
+	mmio_writel(value, aia.aplic + offset);
+}
+
+static inline uint32_t aplic_read(uint32_t offset)
+{
+	return mmio_readl(aia.aplic + offset);
+}
+
+static inline uint32_t aplic_sourcecfg(uint32_t irq)
+{
+	return APLIC_SOURCECFG_BASE + ((irq - 1U) << 2U);
+}
+
+static inline uint32_t aplic_target(uint32_t irq)
+{
+	return APLIC_TARGET_BASE + ((irq - 1U) << 2U);
+}
+
+static inline void imsic_csr_write(uint32_t reg, uint64_t value)
+{
+	cpu_csr_write(CSR_SISELECT, reg);
+	cpu_csr_write(CSR_SIREG, value);
+}
+
+struct aia_probe {
+	/* node being parsed */
+	const char *node;
+	bool imsic;
+	bool aplic;
+	uint64_t base;
+	uint32_t guest_bits;
+
+	bool has_imsic;
+	bool has_aplic;
+	uint32_t imsic_guest_bits;
+};
+
+static void commit_aia_node(struct aia_probe *probe)
+{
+	if (probe->node != NULL) {
+		if (probe->imsic && (probe->base == CONFIG_IMSIC_BASE)) {
+			probe->has_imsic = true;
+			probe->imsic_guest_bits = probe->guest_bits;
+		} else if (probe->aplic && (probe->base == CONFIG_APLIC_BASE)) {
+			probe->has_aplic = true;
+		} else {
+			/* M-level or unrelated node */
+		}
+	}
+	probe->node = NULL;
+}
+
+static void probe_aia_prop(const struct fdt_prop *prop, void *data)
+{
+	struct aia_probe *probe = (struct aia_probe *)data;
+	const uint32_t *cells = (const uint32_t *)prop->value;
+
+	if (prop->nodes[prop->depth] != probe->node) {
+		commit_aia_node(probe);
+		probe->node = prop->nodes[prop->depth];
+		probe->imsic = false;
+		probe->aplic = false;
+		probe->base = 0UL;
+		probe->guest_bits = 0U;
+	}
+
+	if (strcmp(prop->name, "compatible") == 0) {
+		probe->imsic = fdt_prop_has_string(prop, "riscv,imsics");
+		probe->aplic = fdt_prop_has_string(prop, "riscv,aplic");
+	} else if ((strcmp(prop->name, "reg") == 0) && (prop->len >= 8U)) {
+		/* #address-cells is 2 under /soc on QEMU virt */
+		probe->base = ((uint64_t)fdt32_to_cpu(cells[0]) << 32U) | fdt32_to_cpu(cells[1]);
+	} else if ((strcmp(prop->name, "riscv,guest-index-bits") == 0) && (prop->len == 4U)) {
+		probe->guest_bits = fdt32_to_cpu(cells[0]);
+	} else {
+		/* not interesting */
+	}
+}
+
+/*
+ * Look for the S-level APLIC and IMSIC of the board in the device tree, and
+ * for guest interrupt files (hgeie.GEILEN). Must run on the BSP before the
+ * interrupt controller is set up.
+ */
+bool aia_probe(void)
+{
+	const void *fdt = get_host_fdt();
+	struct aia_probe probe = { .node = NULL, .has_imsic = false, .has_aplic = false };
+	uint64_t hgeie;
+
+	if ((CONFIG_IMSIC_BASE != 0UL) && (fdt != NULL) && (fdt_walk(fdt, probe_aia_prop, &probe) == 0)) {
+		commit_aia_node(&probe);
+		if (probe.has_imsic && probe.has_aplic) {
+			/* GEILEN is the number of writable bits, from bit 1 up */
+			cpu_csr_write(hgeie, ~0UL);
+			hgeie = cpu_csr_read(hgeie);
+			cpu_csr_write(hgeie, 0UL);
+
+			aia.geilen = bit_weight(hgeie);
+			aia.guest_bits = probe.imsic_guest_bits;
+			aia.available = true;
+		}
+	}
+
+	return aia.available;
+}
+
+/* Per hart: deliver all host identities through the S-level file */
+void aia_init_hart(void)
+{
+	uint32_t id;
+
+	if (aia.available) {
+		imsic_csr_write(IMSIC_EIDELIVERY, 1UL);
+		imsic_csr_write(IMSIC_EITHRESHOLD, 0UL);
+		/* eie registers are 64 bits wide on RV64, only even ones exist */
+		for (id = 0U; id < APLIC_NUM_SOURCES; id += 64U) {
+			imsic_csr_write(IMSIC_EIE0 + (id >> 5U), ~0UL);
+		}
+
+		/* SGEI only wakes up halted vCPUs, hgeie is armed on demand */
+		cpu_csr_write(hgeie, 0UL);
+		cpu_csr_set(sie, SIE_SGEIE);
+	}
+}
+
+uint32_t imsic_guest_index_bits(void)
+{
+	return aia.guest_bits;
+}
+
+static inline uint32_t imsic_nr_guest_files(void)
+{
+	uint32_t nr = (1U << aia.guest_bits) - 1U;
+
+	return min(min(nr, aia.geilen), IMSIC_MAX_GUEST_FILES);
+}
+
+/*
+ * Hand out a free guest interrupt file of @pcpu_id, 0 if there is none.
+ * The file number is what goes into hstatus.VGEIN.
+ */
+uint32_t imsic_alloc_guest_file(uint16_t pcpu_id)
+{
+	uint32_t file, ret = 0U;
+
+	for (file = 1U; file <= imsic_nr_guest_files(); file++) {
+		if (!bitmap_test_and_set_lock((uint16_t)file, &imsic_files[pcpu_id])) {
+			ret = file;
+			break;
+		}
+	}
+
+	return ret;
+}
+
+void imsic_free_guest_file(uint16_t pcpu_id, uint32_t file)
+{
+	bitmap_clear_lock((uint16_t)file, &imsic_files[pcpu_id]);
+}
+
+/* file 0 is the hart's S-level file, guest files follow it page by page */
+uint64_t imsic_file_hpa(uint16_t pcpu_id, uint32_t file)
+{
+	return CONFIG_IMSIC_BASE + ((uint64_t)pcpu_id << (aia.guest_bits + PAGE_SHIFT)) +
+		((uint64_t)file << PAGE_SHIFT);
+}
+
+void imsic_send_msi(uint16_t pcpu_id, uint32_t file, uint32_t eiid)
+{
+	mmio_writel(eiid, hpa2hva(imsic_file_hpa(pcpu_id, file)) + IMSIC_SETEIPNUM_LE);
+}
+
+/*
+ * Let the APLIC send @irq to interrupt file @file of @pcpu_id. With a guest
+ * file, the hypervisor is not involved at all until the route changes.
+ */
+void aplic_route(uint32_t irq, uint32_t sm, uint16_t pcpu_id, uint32_t file, uint32_t eiid)
+{
+	uint64_t flags;
+
+	spin_lock_irqsave(&aia.lock, &flags);
+	aplic_write(sm, aplic_sourcecfg(irq));
+	aplic_write(((uint32_t)pcpu_id << APLIC_TARGET_HART_SHIFT) |
+		((file & APLIC_TARGET_GUEST_MASK) << APLIC_TARGET_GUEST_SHIFT) |
+		(eiid & APLIC_TARGET_EIID_MASK), aplic_target(irq));
+	spin_unlock_irqrestore(&aia.lock, flags);
+}
+
+void aplic_release(uint32_t irq)
+{
+	uint64_t flags;
+
+	spin_lock_irqsave(&aia.lock, &flags);
+	aplic_write(irq, APLIC_CLRIENUM);
+	aplic_write(APLIC_SM_INACTIVE, aplic_sourcecfg(irq));
+	spin_unlock_irqrestore(&aia.lock, flags);
+}
+
+void aplic_set_enable(uint32_t irq, bool enable)
+{
+	aplic_write(irq, enable ? APLIC_SETIENUM : APLIC_CLRIENUM);
+}
+
+/* a level source in MSI mode is only pended again on request */
+void aplic_retrigger(uint32_t irq)
+{
+	aplic_write(irq, APLIC_SETIPNUM_LE);
+}
+
+void aplic_clear_pending(uint32_t irq)
+{
+	aplic_write(irq, APLIC_CLRIPNUM);
+}
+
+uint32_t aplic_read_pending(uint32_t word)
+{
+	return aplic_read(APLIC_SETIP_BASE + (word << 2U));
+}
+
+static void aia_set_irq_mask(__unused struct irq_desc *desc, __unused uint32_t priority)
+{
+}
+
+static void aia_set_irq_priority(__unused struct irq_desc *desc, __unused uint32_t priority)
+{
+	/* IMSIC priorities are the identities themselves */
+}
+
+/* claim the highest priority pending identity of this hart */
+static uint32_t aia_get_irq(void)
+{
+	uint64_t topei;
+
+	/* csrrw on stopei (0x15c) */
+	asm volatile ("csrrw %0, 0x15c, zero" : "=r"(topei) : : "memory");
+
+	return (uint32_t)(topei >> IMSIC_TOPEI_ID_SHIFT);
+}
+
+static void aia_irq_enable(struct irq_desc *desc)
+{
+	aplic_route(desc->irq, APLIC_SM_LEVEL_HIGH, irq_get_affinity(desc->irq), 0U, desc->irq);
+	aplic_set_enable(desc->irq, true);
+	clear_bit(IRQ_DISABLED, &((struct arch_irq_desc *)desc->arch_data)->status);
+}
+
+static void aia_irq_disable(struct irq_desc *desc)
+{
+	aplic_set_enable(desc->irq, false);
+	set_bit(IRQ_DISABLED, &((struct arch_irq_desc *)desc->arch_data)->status);
+}
+
+static void aia_eoi_irq(struct irq_desc *desc)
+{
+	aplic_retrigger(desc->irq);
+}
+
+/* only for host interrupts, the vAPLIC routes the others itself */
+static void aia_irq_set_affinity(struct irq_desc *desc, uint16_t pcpu_id)
+{
+	if (irq_is_host_owned(desc->irq)) {
+		aplic_route(desc->irq, APLIC_SM_LEVEL_HIGH, pcpu_id, 0U, desc->irq);
+	}
+}
+
+struct acrn_irqchip_ops aia_ops = {
+	.name			= "riscv-aia",
+	.init			= aia_init,
+	.set_irq_mask		= aia_set_irq_mask,
+	.set_irq_priority	= aia_set_irq_priority,
+	.get_irq		= aia_get_irq,
+	.enable			= aia_irq_enable,
+	.disable		= aia_irq_disable,
+	.eoi			= aia_eoi_irq,
+	.set_affinity		= aia_irq_set_affinity,
+};
+
+void aia_init(void)
+{
+	uint32_t irq;
+
+	acrn_irqchip = &aia_ops;
+	spinlock_init(&aia.lock);
+	aia.aplic = hpa2hva(CONFIG_APLIC_BASE);
+
+	aplic_write(0U, APLIC_DOMAINCFG);
+	for (irq = 1U; irq < APLIC_NUM_SOURCES; irq++) {
+		aplic_write(APLIC_SM_INACTIVE, aplic_sourcecfg(irq));
+	}
+	aplic_write(APLIC_DOMAINCFG_IE | APLIC_DOMAINCFG_DM, APLIC_DOMAINCFG);
+
+	aia_init_hart();
+	pr_info("aia: aplic %lx imsic %lx, %u guest files per hart", CONFIG_APLIC_BASE,
+		CONFIG_IMSIC_BASE, imsic_nr_guest_files());
+}
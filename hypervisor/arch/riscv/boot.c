@@ -11,13 +11,15 @@
 #include <asm/config.h>
 #include <asm/boot.h>
 
+/* device tree passed in a1 by the previous boot stage */
+paddr_t fw_dtb = 0UL;
+
 #ifndef CONFIG_EFI_BOOT
 
 #define DTB_IMAGE_SIZE		CONFIG_SOS_DTB_SIZE
 
 #ifdef CONFIG_MACRN
 struct fw_dynamic_info *fw_dinfo = NULL;
-paddr_t fw_dtb = 0UL;
 #define KERNEL_IMAGE_SIZE	0x10000000
 
 void get_kernel_info(struct kernel_info *info)
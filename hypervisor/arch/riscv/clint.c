@@ -13,6 +13,7 @@
 #include <asm/smp.h>
 #include <asm/io.h>
 #include <asm/per_cpu.h>
+#include <trace.h>
 
 static int do_swi(int cpu)
 {
@@ -27,7 +28,8 @@ static int do_swi(int cpu)
 
 static void send_single_swi(uint16_t pcpu_id, uint64_t vector)
 {
-	set_bit(vector, &per_cpu(swi_vector, pcpu_id).type);
+	TRACE_2L(TRACE_IPI_SEND, pcpu_id, vector);
+	bitmap_set_lock((uint16_t)vector, &per_cpu(swi_vector, pcpu_id).type);
 	do_swi(pcpu_id);
 }
 
@@ -37,8 +39,6 @@ static void send_dest_ipi_mask(uint64_t dest_mask, uint64_t vector)
 	uint64_t mask = dest_mask;
 
 	pcpu_id = ffs64(mask);
-	if (pcpu_id--)
-		return;
 	while (pcpu_id < NR_CPUS) {
 		clear_bit(pcpu_id, &mask);
 		send_single_swi(pcpu_id, vector);
@@ -57,8 +57,12 @@ static inline void send_rfence_mask(uint64_t dest_mask, uint64_t addr, uint64_t
 static inline void send_hfence_mask(uint64_t dest_mask, uint64_t addr, uint64_t size)
 {}
 
+static inline void send_hfence_vmid_mask(uint64_t dest_mask, uint64_t addr, uint64_t size, uint16_t vmid)
+{}
+
 static struct smp_ops clint_smp_ops =
-	{do_swi, send_single_swi, send_dest_ipi_mask, ipi_start_cpu, send_rfence_mask, send_hfence_mask};
+	{do_swi, send_single_swi, send_dest_ipi_mask, ipi_start_cpu, send_rfence_mask, send_hfence_mask,
+	 send_hfence_vmid_mask};
 
 static void clint_preinit_timer(void)
 {
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2023-2024 Intel Corporation. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <types.h>
+#include <errno.h>
+#include <rtl.h>
+#include <asm/config.h>
+#include <asm/mem.h>
+#include <asm/boot.h>
+#include <asm/fdt.h>
+
+/*
+ * Minimal read-only flattened device tree walker, enough to pick up host
+ * properties (ISA string, interrupt contexts, ...) early at boot.
+ */
+
+static bool fdt_valid(const void *fdt)
+{
+	const struct fdt_header *hdr = (const struct fdt_header *)fdt;
+
+	return (fdt != NULL) && (fdt32_to_cpu(hdr->magic) == FDT_MAGIC);
+}
+
+/*
+ * The device tree handed over by the firmware, or the one prepared for
+ * the Service VM if the firmware didn't pass any.
+ */
+const void *get_host_fdt(void)
+{
+	const void *fdt = NULL;
+
+	if ((fw_dtb != 0UL) && fdt_valid(hpa2hva(fw_dtb))) {
+		fdt = hpa2hva(fw_dtb);
+	} else if (fdt_valid(hpa2hva(CONFIG_SOS_DTB_BASE))) {
+		fdt = hpa2hva(CONFIG_SOS_DTB_BASE);
+	} else {
+		/* no device tree */
+	}
+
+	return fdt;
+}
+
+static inline uint32_t fdt_align(uint32_t off)
+{
+	return (off + 3U) & ~3U;
+}
+
+/*
+ * Call @cb for every property in @fdt, in tree order. Properties of a node
+ * always come before its subnodes.
+ */
+int32_t fdt_walk(const void *fdt, fdt_prop_cb_t cb, void *data)
+{
+	const struct fdt_header *hdr = (const struct fdt_header *)fdt;
+	const uint8_t *base = (const uint8_t *)fdt;
+	const char *strings;
+	const uint8_t *dt;
+	struct fdt_prop prop;
+	uint32_t off = 0U, size, token, level = 0U;
+	int32_t ret = -EINVAL;
+
+	if (!fdt_valid(fdt)) {
+		return -ENODEV;
+	}
+
+	dt = base + fdt32_to_cpu(hdr->off_dt_struct);
+	size = fdt32_to_cpu(hdr->size_dt_struct);
+	strings = (const char *)(base + fdt32_to_cpu(hdr->off_dt_strings));
+
+	while ((off + 4U) <= size) {
+		token = fdt32_to_cpu(*(const uint32_t *)(dt + off));
+		off += 4U;
+
+		if (token == FDT_BEGIN_NODE) {
+			if (level < FDT_MAX_DEPTH) {
+				prop.nodes[level] = (const char *)(dt + off);
+			}
+			level++;
+			off = fdt_align(off + (uint32_t)strnlen_s((const char *)(dt + off), size - off) + 1U);
+		} else if (token == FDT_END_NODE) {
+			if (level == 0U) {
+				break;
+			}
+			level--;
+		} else if (token == FDT_PROP) {
+			prop.len = fdt32_to_cpu(*(const uint32_t *)(dt + off));
+			prop.name = strings + fdt32_to_cpu(*(const uint32_t *)(dt + off + 4U));
+			prop.value = dt + off + 8U;
+			off = fdt_align(off + 8U + prop.len);
+			/* deeper nodes are skipped, nobody looks that far */
+			if ((level > 0U) && (level <= FDT_MAX_DEPTH)) {
+				prop.depth = level - 1U;
+				cb(&prop, data);
+			}
+		} else if (token == FDT_NOP) {
+			/* nothing */
+		} else if (token == FDT_END) {
+			ret = 0;
+			break;
+		} else {
+			break;
+		}
+	}
+
+	return ret;
+}
+
+/*
+ * Whether the node at @depth of @prop's path is named @name, ignoring the
+ * unit address ("cpu" matches "cpu@1").
+ */
+bool fdt_node_is(const struct fdt_prop *prop, uint32_t depth, const char *name)
+{
+	size_t len = strnlen_s(name, FDT_NODE_NAME_MAX);
+	const char *node;
+
+	if (depth > prop->depth) {
+		return false;
+	}
+
+	node = prop->nodes[depth];
+	return (strncmp(node, name, len) == 0) && ((node[len] == '\0') || (node[len] == '@'));
+}
+
+/* unit address of a node name, "cpu@3" is 3; 0 if it has none */
+uint64_t fdt_unit_address(const char *node)
+{
+	uint32_t i;
+	uint64_t addr = 0UL;
+
+	for (i = 0U; (i < FDT_NODE_NAME_MAX) && (node[i] != '\0'); i++) {
+		if (node[i] == '@') {
+			addr = strtoul_hex(node + i + 1U);
+			break;
+		}
+	}
+
+	return addr;
+}
+
+/* Whether the string list in @prop (e.g. "compatible") contains @str */
+bool fdt_prop_has_string(const struct fdt_prop *prop, const char *str)
+{
+	const char *list = (const char *)prop->value;
+	size_t len = strnlen_s(str, FDT_NODE_NAME_MAX) + 1U;
+	uint32_t off = 0U;
+	bool found = false;
+
+	while (off < prop->len) {
+		if (strncmp(list + off, str, len) == 0) {
+			found = true;
+			break;
+		}
+		off += (uint32_t)strnlen_s(list + off, prop->len - off) + 1U;
+	}
+
+	return found;
+}
@@ -8,13 +8,331 @@
  */
 
 #include <types.h>
+#include <rtl.h>
+#include <asm/cpu.h>
+#include <asm/fdt.h>
+#include <asm/float.h>
+#include <asm/cache.h>
+#include <asm/page.h>
+#include <asm/guest/vpmu.h>
+#include <logmsg.h>
+
+#define CSR_VLENB	0xc22
+
+struct float_caps float_caps;
+
+/*
+ * The helpers below switch sstatus.FS/VS on before touching the registers.
+ * That sstatus value doesn't outlive the switch: the next guest entry loads
+ * the vCPU's own sstatus, see load_guest_state().
+ */
+void fp_save(struct fp_context *ctx)
+{
+	asm volatile (
+		"csrs sstatus, %1\n\t"
+		"fsd f0, 0(%0)\n\t"
+		"fsd f1, 8(%0)\n\t"
+		"fsd f2, 16(%0)\n\t"
+		"fsd f3, 24(%0)\n\t"
+		"fsd f4, 32(%0)\n\t"
+		"fsd f5, 40(%0)\n\t"
+		"fsd f6, 48(%0)\n\t"
+		"fsd f7, 56(%0)\n\t"
+		"fsd f8, 64(%0)\n\t"
+		"fsd f9, 72(%0)\n\t"
+		"fsd f10, 80(%0)\n\t"
+		"fsd f11, 88(%0)\n\t"
+		"fsd f12, 96(%0)\n\t"
+		"fsd f13, 104(%0)\n\t"
+		"fsd f14, 112(%0)\n\t"
+		"fsd f15, 120(%0)\n\t"
+		"fsd f16, 128(%0)\n\t"
+		"fsd f17, 136(%0)\n\t"
+		"fsd f18, 144(%0)\n\t"
+		"fsd f19, 152(%0)\n\t"
+		"fsd f20, 160(%0)\n\t"
+		"fsd f21, 168(%0)\n\t"
+		"fsd f22, 176(%0)\n\t"
+		"fsd f23, 184(%0)\n\t"
+		"fsd f24, 192(%0)\n\t"
+		"fsd f25, 200(%0)\n\t"
+		"fsd f26, 208(%0)\n\t"
+		"fsd f27, 216(%0)\n\t"
+		"fsd f28, 224(%0)\n\t"
+		"fsd f29, 232(%0)\n\t"
+		"fsd f30, 240(%0)\n\t"
+		"fsd f31, 248(%0)\n\t"
+		"frcsr t0\n\t"
+		"sd t0, 256(%0)\n\t"
+		:: "r"(ctx), "r"(SSTATUS_FS_INITIAL) : "t0", "memory"
+	);
+}
+
+void fp_restore(const struct fp_context *ctx)
+{
+	asm volatile (
+		"csrs sstatus, %1\n\t"
+		"fld f0, 0(%0)\n\t"
+		"fld f1, 8(%0)\n\t"
+		"fld f2, 16(%0)\n\t"
+		"fld f3, 24(%0)\n\t"
+		"fld f4, 32(%0)\n\t"
+		"fld f5, 40(%0)\n\t"
+		"fld f6, 48(%0)\n\t"
+		"fld f7, 56(%0)\n\t"
+		"fld f8, 64(%0)\n\t"
+		"fld f9, 72(%0)\n\t"
+		"fld f10, 80(%0)\n\t"
+		"fld f11, 88(%0)\n\t"
+		"fld f12, 96(%0)\n\t"
+		"fld f13, 104(%0)\n\t"
+		"fld f14, 112(%0)\n\t"
+		"fld f15, 120(%0)\n\t"
+		"fld f16, 128(%0)\n\t"
+		"fld f17, 136(%0)\n\t"
+		"fld f18, 144(%0)\n\t"
+		"fld f19, 152(%0)\n\t"
+		"fld f20, 160(%0)\n\t"
+		"fld f21, 168(%0)\n\t"
+		"fld f22, 176(%0)\n\t"
+		"fld f23, 184(%0)\n\t"
+		"fld f24, 192(%0)\n\t"
+		"fld f25, 200(%0)\n\t"
+		"fld f26, 208(%0)\n\t"
+		"fld f27, 216(%0)\n\t"
+		"fld f28, 224(%0)\n\t"
+		"fld f29, 232(%0)\n\t"
+		"fld f30, 240(%0)\n\t"
+		"fld f31, 248(%0)\n\t"
+		"ld t0, 256(%0)\n\t"
+		"fscsr t0\n\t"
+		:: "r"(ctx), "r"(SSTATUS_FS_INITIAL) : "t0", "memory"
+	);
+}
+
+/*
+ * Whole register loads/stores don't depend on vl/vtype, so the vector
+ * registers are moved in 4 groups of 8 and vl/vtype are restored last.
+ * They do honour vstart though: save clears it once it is read, and
+ * restore writes it back last. Offsets follow struct vector_context.
+ */
+void vector_save(struct vector_context *ctx)
+{
+	uint64_t group = float_caps.vlenb * 8UL;
+
+	asm volatile (
+		".option push\n\t"
+		".option arch, +v\n\t"
+		"csrs sstatus, %2\n\t"
+		"csrr t0, vstart\n\t"
+		"sd t0, 0(%0)\n\t"
+		"csrw vstart, zero\n\t"
+		"csrr t0, vl\n\t"
+		"sd t0, 8(%0)\n\t"
+		"csrr t0, vtype\n\t"
+		"sd t0, 16(%0)\n\t"
+		"csrr t0, vcsr\n\t"
+		"sd t0, 24(%0)\n\t"
+		"addi t0, %0, 32\n\t"
+		"vs8r.v v0, (t0)\n\t"
+		"add t0, t0, %1\n\t"
+		"vs8r.v v8, (t0)\n\t"
+		"add t0, t0, %1\n\t"
+		"vs8r.v v16, (t0)\n\t"
+		"add t0, t0, %1\n\t"
+		"vs8r.v v24, (t0)\n\t"
+		".option pop\n\t"
+		:: "r"(ctx), "r"(group), "r"(SSTATUS_VS_INITIAL) : "t0", "memory"
+	);
+}
+
+void vector_restore(const struct vector_context *ctx)
+{
+	uint64_t group = float_caps.vlenb * 8UL;
+
+	asm volatile (
+		".option push\n\t"
+		".option arch, +v\n\t"
+		"csrs sstatus, %2\n\t"
+		"addi t0, %0, 32\n\t"
+		"vl8re8.v v0, (t0)\n\t"
+		"add t0, t0, %1\n\t"
+		"vl8re8.v v8, (t0)\n\t"
+		"add t0, t0, %1\n\t"
+		"vl8re8.v v16, (t0)\n\t"
+		"add t0, t0, %1\n\t"
+		"vl8re8.v v24, (t0)\n\t"
+		"ld t0, 8(%0)\n\t"
+		"ld t1, 16(%0)\n\t"
+		"vsetvl x0, t0, t1\n\t"
+		"ld t0, 0(%0)\n\t"
+		"csrw vstart, t0\n\t"
+		"ld t0, 24(%0)\n\t"
+		"csrw vcsr, t0\n\t"
+		".option pop\n\t"
+		:: "r"(ctx), "r"(group), "r"(SSTATUS_VS_INITIAL) : "t0", "t1", "memory"
+	);
+}
+
+#ifndef CONFIG_MACRN
+struct isa_probe {
+	/* cpu node being parsed */
+	const char *node;
+	uint64_t hartid;
+	bool fpu;
+	bool vector;
+	bool zicboz;
+	bool sscofpmf;
+	uint32_t cboz_block;
+
+	/* over all harts the hypervisor runs on */
+	uint32_t harts;
+	bool all_fpu;
+	bool all_vector;
+	bool all_zicboz;
+	bool all_sscofpmf;
+	uint32_t min_cboz_block;
+};
+
+/*
+ * Single letter extensions come right after the base in "riscv,isa",
+ * e.g. "rv64imafdcvh_zicsr_zifencei".
+ */
+static bool isa_has_ext(const char *isa, uint32_t len, char ext)
+{
+	uint32_t i;
+	bool found = false;
+
+	if ((len > 4U) && (strncmp(isa, "rv64", 4U) == 0)) {
+		for (i = 4U; (i < len) && (isa[i] != '\0') && (isa[i] != '_'); i++) {
+			if (isa[i] == ext) {
+				found = true;
+				break;
+			}
+		}
+	}
+
+	return found;
+}
+
+/* multi-letter extensions follow, each one after an underscore */
+static bool isa_has_multi_ext(const char *isa, uint32_t len, const char *ext)
+{
+	size_t ext_len = strnlen_s(ext, 16U);
+	uint32_t i;
+	bool found = false;
+
+	for (i = 0U; (i < len) && (isa[i] != '\0'); i++) {
+		if ((isa[i] == '_') && ((i + 1U + ext_len) <= len) && (strncmp(&isa[i + 1U], ext, ext_len) == 0) &&
+				((isa[i + 1U + ext_len] == '_') || (isa[i + 1U + ext_len] == '\0'))) {
+			found = true;
+			break;
+		}
+	}
+
+	return found;
+}
+
+static void commit_cpu_isa(struct isa_probe *probe)
+{
+	/* harts below the BSP are parked at boot and never used */
+	if ((probe->node != NULL) && (probe->hartid >= BSP_CPU_ID) && (probe->hartid < NR_CPUS)) {
+		probe->harts++;
+		probe->all_fpu = probe->all_fpu && probe->fpu;
+		probe->all_vector = probe->all_vector && probe->vector;
+		probe->all_zicboz = probe->all_zicboz && probe->zicboz;
+		probe->all_sscofpmf = probe->all_sscofpmf && probe->sscofpmf;
+		probe->min_cboz_block = min(probe->min_cboz_block, probe->cboz_block);
+	}
+	probe->node = NULL;
+}
+
+static void probe_isa_prop(const struct fdt_prop *prop, void *data)
+{
+	struct isa_probe *probe = (struct isa_probe *)data;
+	const uint32_t *cells = (const uint32_t *)prop->value;
+	const char *isa = (const char *)prop->value;
+
+	if ((prop->depth != 2U) || !fdt_node_is(prop, 1U, "cpus") || !fdt_node_is(prop, 2U, "cpu")) {
+		return;
+	}
+
+	if (prop->nodes[2] != probe->node) {
+		commit_cpu_isa(probe);
+		probe->node = prop->nodes[2];
+		probe->hartid = ~0UL;
+		probe->fpu = false;
+		probe->vector = false;
+		probe->zicboz = false;
+		probe->sscofpmf = false;
+		/* the block size of QEMU, if the device tree doesn't say */
+		probe->cboz_block = 64U;
+	}
+
+	if ((strcmp(prop->name, "reg") == 0) && (prop->len >= 4U)) {
+		/* the hart ID is in the last cell whatever #address-cells is */
+		probe->hartid = fdt32_to_cpu(cells[(prop->len / 4U) - 1U]);
+	} else if (strcmp(prop->name, "riscv,isa") == 0) {
+		probe->fpu = isa_has_ext(isa, prop->len, 'g') || isa_has_ext(isa, prop->len, 'd');
+		probe->vector = isa_has_ext(isa, prop->len, 'v');
+		probe->zicboz = isa_has_multi_ext(isa, prop->len, "zicboz");
+		probe->sscofpmf = isa_has_multi_ext(isa, prop->len, "sscofpmf");
+	} else if ((strcmp(prop->name, "riscv,cboz-block-size") == 0) && (prop->len == 4U)) {
+		probe->cboz_block = fdt32_to_cpu(cells[0]);
+	} else {
+		/* not interesting */
+	}
+}
+
+/*
+ * Find out whether guests can be given F/D and V. The hypervisor itself is
+ * built for rv64g, so F/D are assumed when there is no device tree to say
+ * otherwise. V is only used if sstatus.VS is writable and the vector length
+ * fits the per-vCPU save area. The same walk tells whether clear_page() can
+ * use cbo.zero, which needs Zicboz on every hart, and whether counter
+ * overflows can be passed on to guests (Sscofpmf on every hart).
+ */
+void probe_float_caps(void)
+{
+	const void *fdt = get_host_fdt();
+	struct isa_probe probe = { .node = NULL, .harts = 0U, .all_fpu = true, .all_vector = true,
+		.all_zicboz = true, .all_sscofpmf = true, .min_cboz_block = ~0U };
+	bool vector = false;
+
+	float_caps.fpu = true;
+	if ((fdt != NULL) && (fdt_walk(fdt, probe_isa_prop, &probe) == 0)) {
+		commit_cpu_isa(&probe);
+		if (probe.harts != 0U) {
+			float_caps.fpu = probe.all_fpu;
+			vector = probe.all_vector;
+			has_sscofpmf = probe.all_sscofpmf;
+			if (probe.all_zicboz && (probe.min_cboz_block >= 16U) && (probe.min_cboz_block <= PAGE_SIZE) &&
+					((probe.min_cboz_block & (probe.min_cboz_block - 1U)) == 0U)) {
+				cboz_block_size = probe.min_cboz_block;
+			}
+		}
+	}
+
+	if (vector) {
+		cpu_csr_set(sstatus, SSTATUS_VS_INITIAL);
+		if ((cpu_csr_read(sstatus) & SSTATUS_VS) != 0UL) {
+			float_caps.vlenb = cpu_csr_read(CSR_VLENB);
+			float_caps.vector = (float_caps.vlenb != 0UL) && (float_caps.vlenb <= CONFIG_MAX_VLENB);
+		}
+		cpu_csr_clear(sstatus, SSTATUS_VS);
+	}
+
+	pr_info("guest fpu %d, vector %d (vlenb %lu), cbo.zero block %lu", float_caps.fpu, float_caps.vector,
+		float_caps.vlenb, cboz_block_size);
+}
 
 void init_float(void)
 {
-	uint64_t m = 0x2000;
+	uint64_t m = SSTATUS_FS_INITIAL;
 
 	asm volatile (
 		"csrs sstatus, %0\n\t"
 		::"r"(m):
 	);
 }
+#endif
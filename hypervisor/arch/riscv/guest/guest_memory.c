@@ -10,6 +10,9 @@
 #include <types.h>
 #include <errno.h>
 #include <asm/vmx.h>
+#include <asm/cpu.h>
+#include <asm/per_cpu.h>
+#include <asm/pgtable.h>
 #include <asm/guest/guest_memory.h>
 #include <asm/guest/vcpu.h>
 #include <asm/guest/vm.h>
@@ -17,186 +20,170 @@
 #include <asm/guest/s2vm.h>
 #include <logmsg.h>
 
+/* vsatp.MODE, and the guest privilege and status bits a walk depends on */
+#define VSATP_MODE_SHIFT	60U
+#define VSATP_MODE_SV39		8UL
+#define VSATP_MODE_SV48		9UL
+#define VSATP_MODE_SV57		10UL
+#define SSTATUS_SUM		(1UL << 18U)
+#define SSTATUS_MXR		(1UL << 19U)
+#define HSTATUS_SPVP		(1UL << 8U)
+#define MSTATUS_MPP		(3UL << 11U)
+
 struct page_walk_info {
-	uint64_t top_entry;	/* Top level paging structure entry */
+	uint64_t top_entry;	/* GPA of the root page table */
 	uint32_t level;
-	uint32_t width;
 	bool is_user_mode_access;
 	bool is_write_access;
 	bool is_inst_fetch;
-	bool pse;		/* CR4.PSE for 32bit paing,
-				 * true for PAE/4-level paing */
-	bool wp;		/* CR0.WP */
-	bool nxe;		/* MSR_IA32_EFER_NXE_BIT */
-
-	bool is_smap_on;
-	bool is_smep_on;
+	bool sum;		/* vsstatus.SUM */
+	bool mxr;		/* vsstatus.MXR */
 };
 
+static uint32_t satp_levels(uint64_t satp)
+{
+	uint32_t levels;
+
+	switch (satp >> VSATP_MODE_SHIFT) {
+	case VSATP_MODE_SV39:
+		levels = 3U;
+		break;
+	case VSATP_MODE_SV48:
+		levels = 4U;
+		break;
+	case VSATP_MODE_SV57:
+		levels = 5U;
+		break;
+	default:
+		/* Bare, the hart does not accept any other mode */
+		levels = 0U;
+		break;
+	}
+
+	return levels;
+}
+
 enum vm_paging_mode get_vcpu_paging_mode(struct acrn_vcpu *vcpu)
 {
-	enum vm_paging_mode ret = PAGING_MODE_0_LEVEL;	/* non-paging */
+	return (enum vm_paging_mode)satp_levels(vcpu_get_vs_csr(vcpu, VS_CSR_SATP));
+}
+
+/* the privilege the guest ran at when it last exited */
+static bool is_guest_user_mode(const struct acrn_vcpu *vcpu)
+{
+	const struct cpu_regs *regs = &vcpu->arch.contexts[vcpu->arch.cur_context].run_ctx.cpu_gp_regs.regs;
 
-	if (is_paging_enabled(vcpu)) {
-		if (is_pae(vcpu)) {
-			if (is_long_mode(vcpu)) {
-				ret = PAGING_MODE_4_LEVEL;	/* 4-level paging */
-			} else {
-				ret = PAGING_MODE_3_LEVEL;	/* PAE paging */
-			}
+#ifdef CONFIG_MACRN
+	return ((regs->status & MSTATUS_MPP) == 0UL);
+#else
+	return ((regs->hstatus & HSTATUS_SPVP) == 0UL);
+#endif
+}
+
+/*
+ * Permission check on a leaf PTE. A and D are not updated by the walker:
+ * like a hart without Svadu, a clear A, or a clear D on a write, faults and
+ * the guest sets them in its handler.
+ */
+static bool is_pte_access_allowed(const struct page_walk_info *pw_info, uint64_t pte)
+{
+	bool allowed;
+
+	if ((pte & PAGE_U) != 0UL) {
+		/* SUM never allows S-mode to execute from a U page */
+		allowed = pw_info->is_user_mode_access || (pw_info->sum && !pw_info->is_inst_fetch);
+	} else {
+		allowed = !pw_info->is_user_mode_access;
+	}
+
+	if (allowed) {
+		if (pw_info->is_inst_fetch) {
+			allowed = ((pte & PAGE_X) != 0UL);
+		} else if (pw_info->is_write_access) {
+			allowed = ((pte & PAGE_W) != 0UL);
 		} else {
-			ret = PAGING_MODE_2_LEVEL;	/* 32-bit paging */
+			allowed = ((pte & PAGE_R) != 0UL) || (pw_info->mxr && ((pte & PAGE_X) != 0UL));
 		}
 	}
 
-	return ret;
+	if (allowed) {
+		allowed = ((pte & PAGE_A) != 0UL) && (!pw_info->is_write_access || ((pte & PAGE_D) != 0UL));
+	}
+
+	return allowed;
 }
 
-/* TODO: Add code to check for Revserved bits, SMAP and PKE when do translation
- * during page walk */
-static int32_t local_gva2gpa_common(struct acrn_vcpu *vcpu, const struct page_walk_info *pw_info,
-	uint64_t gva, uint64_t *gpa, uint32_t *err_code)
+/*
+ * Sv39/Sv48/Sv57 walk of the guest page tables. On success, the leaf PTE
+ * is returned in @leaf.
+ */
+static int32_t local_gva2gpa(struct acrn_vcpu *vcpu, const struct page_walk_info *pw_info,
+	uint64_t gva, uint64_t *gpa, uint64_t *leaf)
 {
-	uint32_t i;
-	uint64_t index;
+	uint32_t va_bits = PAGE_SHIFT + (pw_info->level * PG_TABLE_SHIFT);
+	uint32_t i = pw_info->level;
 	uint32_t shift;
-	void *base;
-	uint64_t entry = 0U;
-	uint64_t addr;
-	uint64_t page_size = PAGE_SIZE;
-	int32_t ret = 0;
-	int32_t fault = 0;
-	bool is_user_mode_addr = true;
-	bool is_page_rw_flags_on = true;
-
-	if (pw_info->level < 1U) {
-		ret = -EINVAL;
-	} else {
-		addr = pw_info->top_entry;
-		i = pw_info->level;
-//		stac();
+	uint64_t addr = pw_info->top_entry;
+	uint64_t pte;
+	uint64_t *base;
+	int32_t ret = -EFAULT;
 
-		while ((i != 0U) && (fault == 0)) {
+	/* bits above the VA width must all equal its most significant bit */
+	if ((uint64_t)(((int64_t)(gva << (64U - va_bits))) >> (64U - va_bits)) == gva) {
+		while (i != 0U) {
 			i--;
 
-//			addr = addr & IA32E_REF_MASK;
-			base = gpa2hva(vcpu->vm, addr);
+			base = (uint64_t *)gpa2hva(vcpu->vm, addr);
 			if (base == NULL) {
-				fault = 1;
-			} else {
-				shift = (i * pw_info->width) + 12U;
-				index = (gva >> shift) & ((1UL << pw_info->width) - 1UL);
-				page_size = 1UL << shift;
-
-				if (pw_info->width == 10U) {
-					uint32_t *base32 = (uint32_t *)base;
-					/* 32bit entry */
-					entry = (uint64_t)(*(base32 + index));
-				} else {
-					uint64_t *base64 = (uint64_t *)base;
-					entry = *(base64 + index);
-				}
-
-				/* check if the entry present */
-				if ((entry & PAGE_V) == 0U) {
-					fault = 1;
-				}
-
-					/* check for R/W */
-				if ((fault == 0) && ((entry & PAGE_RW_RW) == 0U)) {
-					if (pw_info->is_write_access  &&
-					    (pw_info->is_user_mode_access || pw_info->wp)) {
-						/* Case1: Supermode and wp is 1
-						 * Case2: Usermode */
-						fault = 1;
-					}
-					is_page_rw_flags_on = false;
-				}
+				break;
 			}
 
-			/* check for U/S */
-			if ((fault == 0) && ((entry & PAGE_U) == 0U)) {
-				is_user_mode_addr = false;
+			shift = PAGE_SHIFT + (i * PG_TABLE_SHIFT);
+			pte = base[(gva >> shift) & (PTRS_PER_PTE - 1UL)];
+			if (((pte & PAGE_V) == 0UL) || ((pte & (PAGE_R | PAGE_W)) == PAGE_W)) {
+				break;
+			}
 
-				if (pw_info->is_user_mode_access) {
-					fault = 1;
+			if ((pte & (PAGE_R | PAGE_X)) != 0UL) {
+				/* a superpage must not have PPN bits below its level */
+				if ((((pte >> PTE_PPN_SHIFT) & ((1UL << (i * PG_TABLE_SHIFT)) - 1UL)) == 0UL) &&
+						is_pte_access_allowed(pw_info, pte)) {
+					*gpa = (((pte & PTE_PPN_MASK) >> PTE_PPN_SHIFT) << PAGE_SHIFT) |
+						(gva & ((1UL << shift) - 1UL));
+					*leaf = pte;
+					ret = 0;
 				}
+				break;
 			}
 
-			addr = entry;
-		}
-
-		/* instruction fetch from user-mode address, smep on */
-		if ((fault == 0) && pw_info->is_smep_on && (!pw_info->is_user_mode_access) &&
-			is_user_mode_addr && pw_info->is_inst_fetch) {
-			fault = 1;
-		}
-
-		if (fault == 0) {
-			entry >>= shift;
-			/* shift left 12bit more and back to clear XD/Prot Key/Ignored bits */
-			entry <<= (shift + 12U);
-			entry >>= 12U;
-			*gpa = entry | (gva & (page_size - 1UL));
-		}
-
-//		clac();
-		if (fault != 0) {
-			ret = -EFAULT;
-			*err_code |= PAGE_FAULT_P_FLAG;
+			/* a pointer to the next level, there is none below the last */
+			addr = ((pte & PTE_PPN_MASK) >> PTE_PPN_SHIFT) << PAGE_SHIFT;
 		}
 	}
+
 	return ret;
 }
 
 /*
- * AndreiW FIXME: Bogus, just unwedge the build.
+ * The guest changes its page tables, vsatp and sfence.vma without trapping,
+ * so translations are only cached while it is out of the guest: this is
+ * called on every VM exit, and when the hypervisor itself changes vsatp or
+ * emulates a remote fence.
  */
-static inline uint64_t get_pae_pdpt_addr(uint64_t cr3)
+void gva_cache_flush(struct acrn_vcpu *vcpu)
 {
-        return (cr3 & 0xFFFFFFE0UL);
+	vcpu->arch.gva_cache.epoch++;
 }
 
-static int32_t local_gva2gpa_pae(struct acrn_vcpu *vcpu, struct page_walk_info *pw_info,
-	uint64_t gva, uint64_t *gpa, uint32_t *err_code)
-{
-	int32_t index;
-	uint64_t *base;
-	uint64_t entry;
-	uint64_t addr;
-	int32_t ret = -EFAULT;
-
-	addr = get_pae_pdpt_addr(pw_info->top_entry);
-	base = (uint64_t *)gpa2hva(vcpu->vm, addr);
-	if (base != NULL) {
-		index = (gva >> 30U) & 0x3UL;
-//		stac();
-		entry = base[index];
-//		clac();
-
-		if ((entry & PAGE_V) != 0U) {
-			pw_info->level = 2U;
-			pw_info->top_entry = entry;
-			ret = local_gva2gpa_common(vcpu, pw_info, gva, gpa, err_code);
-		}
-	}
-
-	return ret;
-}
-
-/* Refer to SDM Vol.3A 6-39 section 6.15 for the format of paging fault error
- * code.
+/* The page fault error code is the one of x86, SDM Vol.3A section 6.15.
  *
  * Caller should set the contect of err_code properly according to the address
  * usage when calling this function:
  * - If it is an address for write, set PAGE_FAULT_WR_FLAG in err_code.
  * - If it is an address for instruction featch, set PAGE_FAULT_ID_FLAG in
  *   err_code.
- * Caller should check the return value to confirm if the function success or
- * not.
- * If a protection volation detected during page walk, this function still will
- * give the gpa translated, it is up to caller to decide if it need to inject a
- * #PF or not.
+ * The access is checked at the privilege the guest ran at when it exited,
+ * with its vsstatus.SUM and vsstatus.MXR.
  * - Return 0 for success.
  * - Return -EINVAL for invalid parameter.
  * - Return -EFAULT for paging fault, and refer to err_code for paging fault
@@ -205,8 +192,10 @@ static int32_t local_gva2gpa_pae(struct acrn_vcpu *vcpu, struct page_walk_info *
 int32_t gva2gpa(struct acrn_vcpu *vcpu, uint64_t gva, uint64_t *gpa,
 	uint32_t *err_code)
 {
-	enum vm_paging_mode pm = get_vcpu_paging_mode(vcpu);
+	struct gva_cache *cache = &vcpu->arch.gva_cache;
+	struct gva_cache_entry *entry;
 	struct page_walk_info pw_info;
+	uint64_t satp, status, leaf;
 	int32_t ret = 0;
 
 	if ((gpa == NULL) || (err_code == NULL)) {
@@ -214,31 +203,39 @@ int32_t gva2gpa(struct acrn_vcpu *vcpu, uint64_t gva, uint64_t *gpa,
 	} else {
 		*gpa = 0UL;
 
-		pw_info.top_entry = cpu_csr_read(vsatp);
-		pw_info.level = (uint32_t)pm;
+		satp = vcpu_get_vs_csr(vcpu, VS_CSR_SATP);
+		status = vcpu_get_status(vcpu);
+		pw_info.top_entry = (satp & SATP_PPN_MASK) << PAGE_SHIFT;
+		pw_info.level = satp_levels(satp);
 		pw_info.is_write_access = ((*err_code & PAGE_FAULT_WR_FLAG) != 0U);
 		pw_info.is_inst_fetch = ((*err_code & PAGE_FAULT_ID_FLAG) != 0U);
-
-		pw_info.is_user_mode_access = true;
-		pw_info.pse = true;
+		pw_info.is_user_mode_access = is_guest_user_mode(vcpu);
+		pw_info.sum = ((status & SSTATUS_SUM) != 0UL);
+		pw_info.mxr = ((status & SSTATUS_MXR) != 0UL);
 
 		*err_code &=  ~PAGE_FAULT_P_FLAG;
 
-		if (pm == PAGING_MODE_4_LEVEL) {
-			pw_info.width = 9U;
-			ret = local_gva2gpa_common(vcpu, &pw_info, gva, gpa, err_code);
-		} else if (pm == PAGING_MODE_3_LEVEL) {
-			pw_info.width = 9U;
-			ret = local_gva2gpa_pae(vcpu, &pw_info, gva, gpa, err_code);
-		} else if (pm == PAGING_MODE_2_LEVEL) {
-			pw_info.width = 10U;
-			pw_info.nxe = false;
-			ret = local_gva2gpa_common(vcpu, &pw_info, gva, gpa, err_code);
-		} else {
+		if (pw_info.level == 0U) {
 			*gpa = gva;
+		} else {
+			entry = &cache->entries[(gva >> PAGE_SHIFT) % GVA_CACHE_SIZE];
+			if ((entry->epoch == cache->epoch) && (entry->vpn == (gva >> PAGE_SHIFT)) &&
+					(entry->satp == satp) && is_pte_access_allowed(&pw_info, entry->pte)) {
+				*gpa = entry->gpa | (gva & (PAGE_SIZE - 1UL));
+			} else {
+				ret = local_gva2gpa(vcpu, &pw_info, gva, gpa, &leaf);
+				if (ret == 0) {
+					entry->vpn = gva >> PAGE_SHIFT;
+					entry->gpa = *gpa & PAGE_MASK;
+					entry->pte = leaf;
+					entry->satp = satp;
+					entry->epoch = cache->epoch;
+				}
+			}
 		}
 
 		if (ret == -EFAULT) {
+			*err_code |= PAGE_FAULT_P_FLAG;
 			if (pw_info.is_user_mode_access) {
 				*err_code |= PAGE_FAULT_US_FLAG;
 			}
@@ -248,6 +245,130 @@ int32_t gva2gpa(struct acrn_vcpu *vcpu, uint64_t gva, uint64_t *gpa,
 	return ret;
 }
 
+#ifndef CONFIG_MACRN
+extern void unpriv_trap(void);
+
+/*
+ * hlv/hlvx loads of guest memory, translated by the hart at the guest's
+ * privilege. They must run with stvec at unpriv_trap, which stores scause
+ * of a fault at the address in a0 and resumes after the load.
+ */
+static inline uint64_t hlv_d(uint64_t gva, uint64_t *cause)
+{
+	register uint64_t taddr asm("a0") = (uint64_t)cause;
+	register uint64_t ttmp asm("a1");
+	uint64_t val;
+
+	asm volatile ("hlv.d %0, (%3)"
+		: "=&r"(val), "+&r"(taddr), "=&r"(ttmp) : "r"(gva) : "memory");
+
+	return val;
+}
+
+static inline uint64_t hlv_bu(uint64_t gva, uint64_t *cause)
+{
+	register uint64_t taddr asm("a0") = (uint64_t)cause;
+	register uint64_t ttmp asm("a1");
+	uint64_t val;
+
+	asm volatile ("hlv.bu %0, (%3)"
+		: "=&r"(val), "+&r"(taddr), "=&r"(ttmp) : "r"(gva) : "memory");
+
+	return val;
+}
+
+static inline uint64_t hlvx_hu(uint64_t gva, uint64_t *cause)
+{
+	register uint64_t taddr asm("a0") = (uint64_t)cause;
+	register uint64_t ttmp asm("a1");
+	uint64_t val;
+
+	asm volatile ("hlvx.hu %0, (%3)"
+		: "=&r"(val), "+&r"(taddr), "=&r"(ttmp) : "r"(gva) : "memory");
+
+	return val;
+}
+
+/*
+ * Point stvec at unpriv_trap, and hstatus.SPVP at the guest's privilege.
+ * A fault on the loads enters unpriv_trap from HS mode, which leaves
+ * hstatus.SPV clear for its sret.
+ */
+static void unpriv_access_begin(uint64_t guest_hstatus, uint64_t *stvec, uint64_t *hstatus, uint64_t *flags)
+{
+	CPU_INT_ALL_DISABLE(flags);
+	*stvec = cpu_csr_read(stvec);
+	*hstatus = cpu_csr_read(hstatus);
+	cpu_csr_write(stvec, (uint64_t)unpriv_trap);
+	cpu_csr_write(hstatus, guest_hstatus);
+}
+
+static void unpriv_access_end(uint64_t stvec, uint64_t hstatus, uint64_t flags)
+{
+	cpu_csr_write(hstatus, hstatus);
+	cpu_csr_write(stvec, stvec);
+	CPU_INT_ALL_RESTORE(flags);
+}
+
+/*
+ * Read the instruction at @pc in the guest, one parcel at a time as it may
+ * only be 2-byte aligned. Returns 0 if the fetch faults.
+ */
+uint32_t fetch_guest_instruction(uint64_t guest_hstatus, uint64_t pc)
+{
+	uint64_t stvec, hstatus, flags, lo, hi = 0UL, cause = 0UL;
+
+	unpriv_access_begin(guest_hstatus, &stvec, &hstatus, &flags);
+	lo = hlvx_hu(pc, &cause);
+	if ((cause == 0UL) && ((lo & 0x3UL) == 0x3UL)) {
+		hi = hlvx_hu(pc + 2UL, &cause);
+	}
+	unpriv_access_end(stvec, hstatus, flags);
+
+	return (cause == 0UL) ? (uint32_t)(lo | (hi << 16U)) : 0U;
+}
+
+/*
+ * The hart can only translate for the vCPU running on it, once its vsatp
+ * and vsstatus hold what the hypervisor last wrote to them.
+ */
+static bool can_copy_with_hlv(struct acrn_vcpu *vcpu)
+{
+	return (get_running_vcpu(get_pcpu_id()) == vcpu) && (get_cpu_var(vs_owner) == vcpu) &&
+		((vcpu->reg_updated & ((1UL << VS_CSR_SATP) | (1UL << CPU_REG_STATUS))) == 0UL);
+}
+
+/* Returns how many bytes were copied before a load faulted */
+static uint32_t copy_from_gva_hlv(struct acrn_vcpu *vcpu, uint8_t *h_ptr, uint64_t gva, uint32_t size)
+{
+	uint64_t stvec, hstatus, flags, val, cause = 0UL;
+	uint32_t done = 0U;
+
+	unpriv_access_begin(vcpu->arch.contexts[vcpu->arch.cur_context].run_ctx.cpu_gp_regs.regs.hstatus,
+		&stvec, &hstatus, &flags);
+	while (done < size) {
+		if ((((gva + done) & 0x7UL) == 0UL) && ((size - done) >= 8U)) {
+			val = hlv_d(gva + done, &cause);
+			if (cause != 0UL) {
+				break;
+			}
+			(void)memcpy_s(h_ptr + done, 8U, &val, 8U);
+			done += 8U;
+		} else {
+			val = hlv_bu(gva + done, &cause);
+			if (cause != 0UL) {
+				break;
+			}
+			h_ptr[done] = (uint8_t)val;
+			done++;
+		}
+	}
+	unpriv_access_end(stvec, hstatus, flags);
+
+	return done;
+}
+#endif
+
 static inline uint32_t local_copy_gpa(struct acrn_vm *vm, void *h_ptr, uint64_t gpa,
 	uint32_t size, uint32_t fix_pg_size, bool cp_from_vm)
 {
@@ -320,6 +441,16 @@ static inline int32_t copy_gva(struct acrn_vcpu *vcpu, void *h_ptr_arg, uint64_t
 	uint64_t gva = gva_arg;
 	uint32_t size = size_arg;
 
+#ifndef CONFIG_MACRN
+	/* the walk below picks up from a faulting load, and reports the fault */
+	if (cp_from_vm && can_copy_with_hlv(vcpu)) {
+		len = copy_from_gva_hlv(vcpu, (uint8_t *)h_ptr, gva, size);
+		gva += len;
+		h_ptr += len;
+		size -= len;
+	}
+#endif
+
 	while ((size > 0U) && (ret == 0)) {
 		ret = gva2gpa(vcpu, gva, &gpa, err_code);
 		if (ret >= 0) {
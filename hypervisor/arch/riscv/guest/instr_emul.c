@@ -7,19 +7,25 @@
  */
 
 #include <errno.h>
+#include <asm/lib/string.h>
 #include <asm/guest/instr_emul.h>
 #include <asm/guest/vcpu.h>
 
-#define INS16_OPCODE_MASK	0xC000
-#define INS16_OPRD_MASK		0x1C
-#define INS16_OPRS2_MASK	0x1C
+#define INS16_FUNCT3_MASK	0xE000
+#define INS16_FUNCT3_SHIFT	13
+#define INS16_QUADRANT_MASK	0x3
+#define INS16_RDP_MASK		0x1C	/* rd' of a quadrant 0 load */
+#define INS16_RS2P_MASK		0x1C	/* rs2' of a quadrant 0 store */
+#define INS16_RD_MASK		0xF80	/* rd of a quadrant 2 load */
+#define INS16_RS2_MASK		0x7C	/* rs2 of a quadrant 2 store */
 
-#define INS16_OPCODE_LQ		0x1
-#define INS16_OPCODE_LW		0x2
-#define INS16_OPCODE_LD		0x3
-#define INS16_OPCODE_SQ		0x5
-#define INS16_OPCODE_SW		0x6
-#define INS16_OPCODE_SD		0x7
+#define INS16_QUADRANT_0	0x0
+#define INS16_QUADRANT_2	0x2
+
+#define INS16_FUNCT3_LW		0x2
+#define INS16_FUNCT3_LD		0x3
+#define INS16_FUNCT3_SW		0x6
+#define INS16_FUNCT3_SD		0x7
 
 #define INS32_OPCODE_MASK	0x7F
 #define INS32_OPRD_MASK		0xF80
@@ -29,23 +35,28 @@
 
 #define INS32_OPCODE_LD		0x3
 #define INS32_OPCODE_ST		0x23
+/* transformed compressed load/store reported in htinst, bit 1 cleared */
+#define INS32_OPCODE_C_LD	0x1
+#define INS32_OPCODE_C_ST	0x21
+
 #define INS32_OPSIZE_BYTE	0x0
 #define INS32_OPSIZE_HALF	0x1
 #define INS32_OPSIZE_WORD	0x2
 #define INS32_OPSIZE_DWORD	0x3
 #define INS32_OPSIZE_UBYTE	0x4
 #define INS32_OPSIZE_UHALF	0x5
-#define INS32_OPSIZE_UWORD	0x7
+#define INS32_OPSIZE_UWORD	0x6
+
+/* htinst pseudo-instructions for implicit VS-stage page-table accesses */
+#define INS_PSEUDO_WRITE	0x20
+#define INS_PSEUDO_LD32		0x2000
+#define INS_PSEUDO_LD64		0x3000
 
 #define BIT64_MASK		0xffffffffffffffff
 #define BIT32_MASK		0xffffffff
-#define BIT32_U_MASK		0xffffffff00000000
 #define BIT16_MASK		0xffff
-#define BIT16_U_MASK		0xffff0000
 #define BIT8_MASK		0xff
-#define BIT8_U_MASK		0xff00
 
-#ifdef CONFIG_MACRN
 static inline uint64_t get_mask(uint32_t size)
 {
 	uint64_t mask;
@@ -69,267 +80,200 @@ static inline uint64_t get_mask(uint32_t size)
 	return mask;
 }
 
-static int32_t emulate_ins16(struct acrn_vcpu *vcpu, uint32_t ins, uint32_t size)
+/*
+ * Complete the load/store described by vcpu->arch.mmio_desc: for a store,
+ * fetch the value to be written, for a load, write the (sign-extended)
+ * value back to rd. The guest PC is moved past the instruction.
+ *
+ * x0 shares its slot with the PC in the register file, so it is never
+ * written and reads as zero.
+ */
+int32_t emulate_instruction(struct acrn_vcpu *vcpu)
 {
 	struct acrn_mmio_request *mmio_req = &vcpu->req.reqs.mmio_request;
-	uint64_t pc;
-	int32_t reg, rc = 0;
-	uint64_t mask = get_mask(size);
-
-	pc = vcpu_get_gpreg(vcpu, CPU_REG_IP);
-	vcpu_set_gpreg(vcpu, CPU_REG_IP, pc + 2);
-
-	if ((INS16_OPCODE_MASK & ins) <= 0x8000) {
-		reg = (ins & INS16_OPRD_MASK) >> 2;
-		vcpu_set_gpreg(vcpu, reg + 0x8, (mmio_req->value) & mask);
-	} else {
-		reg = (ins & INS16_OPRS2_MASK) >> 2;
-		mmio_req->value = vcpu_get_gpreg(vcpu, reg + 0x8) & mask;
-	}
-
-	return rc;
-}
+	const struct mmio_access_desc *desc = &vcpu->arch.mmio_desc;
+	uint64_t mask = get_mask(desc->size);
+	uint64_t pc, value;
+	int32_t rc = 0;
 
-int32_t emulate_ins32(struct acrn_vcpu *vcpu, uint32_t ins, uint32_t size)
-{
-	struct acrn_mmio_request *mmio_req = &vcpu->req.reqs.mmio_request;
-	uint64_t pc;
-	int32_t reg, rc = 0;
-	int64_t mask = get_mask(size);
-
-	pc = vcpu_get_gpreg(vcpu, CPU_REG_IP);
-	vcpu_set_gpreg(vcpu, CPU_REG_IP, pc + 4);
-
-	if ((INS32_OPCODE_MASK & ins) == 0x3) {
-		reg = (ins & INS32_OPRD_MASK) >> 7;
-		vcpu_set_gpreg(vcpu, reg, (mmio_req->value) & mask);
-	} else if ((INS32_OPCODE_MASK & ins) == 0x23) {
-		reg = (ins & INS32_OPRS2_MASK) >> 20;
-		mmio_req->value = vcpu_get_gpreg(vcpu, reg) & mask;
-	} else {
+	if (desc->pseudo) {
 		rc = -EFAULT;
+	} else if (desc->is_write) {
+		value = (desc->reg != 0U) ? vcpu_get_gpreg(vcpu, desc->reg) : 0UL;
+		mmio_req->value = value & mask;
+	} else {
+		value = mmio_req->value & mask;
+		if (desc->sign_extend && (desc->size < 8U)) {
+			uint32_t shift = 64U - (desc->size << 3U);
+
+			value = (uint64_t)(((int64_t)(value << shift)) >> shift);
+		}
+		if (desc->reg != 0U) {
+			vcpu_set_gpreg(vcpu, desc->reg, value);
+		}
 	}
 
-	return rc;
-}
-
-int32_t emulate_instruction(struct acrn_vcpu *vcpu)
-{
-	uint32_t ins, xlen, size;
-	struct run_context *ctx;
-
-	ctx = &vcpu->arch.contexts[vcpu->arch.cur_context].run_ctx;
-	ins = get_instruction(ctx, &xlen);
-	size = vcpu->req.reqs.mmio_request.size;
-
-	if (xlen == 32)
-		return emulate_ins32(vcpu, ins, size);
-	else
-		return emulate_ins16(vcpu, ins, size);
-}
-
-static int32_t decode_ins16(struct acrn_vcpu *vcpu, uint32_t ins)
-{
-	int size = (ins & INS16_OPCODE_MASK) >> 13;
-
-	switch (size) {
-	case INS16_OPCODE_LQ:
-	case INS16_OPCODE_SQ:
-		size = 16;
-		break;
-	case INS16_OPCODE_LW:
-	case INS16_OPCODE_SW:
-		size = 4;
-		break;
-	case INS16_OPCODE_LD:
-	case INS16_OPCODE_SD:
-	default:
-		size = 8;
-		break;
-	}
-
-	return size;
-}
-
-static int32_t decode_ins32(struct acrn_vcpu *vcpu, uint32_t ins)
-{
-	int size = (ins & INS32_OPSIZE_MASK) >> 12;
-
-	switch (size) {
-	case INS32_OPSIZE_BYTE:
-		size = 1;
-		break;
-	case INS32_OPSIZE_HALF:
-		size = 2;
-		break;
-	case INS32_OPSIZE_WORD:
-		size = 4;
-		break;
-	case INS32_OPSIZE_DWORD:
-	default:
-		size = 8;
-		break;
+	if (rc == 0) {
+		pc = vcpu_get_gpreg(vcpu, CPU_REG_IP);
+		vcpu_set_gpreg(vcpu, CPU_REG_IP, pc + desc->ins_len);
 	}
 
-	return size;
-}
-
-int32_t decode_instruction(struct acrn_vcpu *vcpu, uint32_t ins, uint32_t xlen)
-{
-	if (xlen == 32)
-		return decode_ins32(vcpu, ins);
-	else
-		return decode_ins16(vcpu, ins);
-}
-
-#else /* !CONFIG_MACRN */
-
-int32_t emulate_pseudo(struct acrn_vcpu *vcpu, uint32_t ins, uint32_t size)
-{
-	int32_t rc = 0;
-
 	return rc;
 }
 
-static inline uint64_t get_mask(uint32_t ins)
+/* implicit access of a guest page-table walk, there is no register operand */
+static int32_t decode_pseudo(uint32_t ins, struct mmio_access_desc *desc)
 {
-	uint64_t mask;
-
-	int size = (ins & INS32_OPSIZE_MASK) >> 12;
+	int32_t ret = -EFAULT;
 
-	switch (size) {
-	case INS32_OPSIZE_BYTE:
-	case INS32_OPSIZE_UBYTE:
-		mask = BIT8_MASK;
-		break;
-	case INS32_OPSIZE_HALF:
-	case INS32_OPSIZE_UHALF:
-		mask = BIT16_MASK;
-		break;
-	case INS32_OPSIZE_WORD:
-	case INS32_OPSIZE_UWORD:
-		mask = BIT32_MASK;
-		break;
-	case INS32_OPSIZE_DWORD:
-	default:
-		mask = BIT64_MASK;
-		break;
+	if ((ins & ~INS_PSEUDO_WRITE) == INS_PSEUDO_LD32) {
+		ret = 4;
+	} else if ((ins & ~INS_PSEUDO_WRITE) == INS_PSEUDO_LD64) {
+		ret = 8;
+	} else {
+		/* not a valid pseudo-instruction */
 	}
 
-	return mask;
-}
-
-int32_t emulate_ins32(struct acrn_vcpu *vcpu, uint32_t ins, uint32_t size)
-{
-	struct acrn_mmio_request *mmio_req = &vcpu->req.reqs.mmio_request;
-	uint64_t pc;
-	uint32_t reg, op;
-	int32_t rc = 0;
-	int64_t mask = get_mask(ins);
-	int32_t xlen = (ins & 0x3) == 0x1 ? 2: 4;
-
-	pc = vcpu_get_gpreg(vcpu, CPU_REG_IP);
-	vcpu_set_gpreg(vcpu, CPU_REG_IP, pc + xlen);
-
-	op = INS32_OPCODE_MASK & ins;
-	if (op == 0x3 || op == 0x1) {
-		reg = (ins & INS32_OPRD_MASK) >> 7;
-		vcpu_set_gpreg(vcpu, reg, (mmio_req->value) & mask);
-	} else if (op == 0x23 || op == 0x21) {
-		reg = (ins & INS32_OPRS2_MASK) >> 20;
-		mmio_req->value = (vcpu_get_gpreg(vcpu, reg) & mask);
-	} else {
-		rc = -EFAULT;
+	if (ret > 0) {
+		desc->pseudo = true;
+		desc->is_write = ((ins & INS_PSEUDO_WRITE) != 0U);
+		desc->ins_len = 0U;
+		desc->reg = 0U;
 	}
 
-	return rc;
+	return ret;
 }
 
-int32_t emulate_instruction(struct acrn_vcpu *vcpu)
+/* c.lw/c.ld/c.sw/c.sd and their sp-relative forms, as fetched from the guest */
+static int32_t decode_ins16(uint32_t ins, struct mmio_access_desc *desc)
 {
-	uint32_t ins, xlen, size, ret = 0;
-	struct run_context *ctx;
-
-	ctx = &vcpu->arch.contexts[vcpu->arch.cur_context].run_ctx;
-	ins = get_instruction(ctx, &xlen);
-	size = vcpu->req.reqs.mmio_request.size;
-
-	xlen = ins & 0x3;
-	switch (xlen) {
-		case 0x0:
-			ret = emulate_pseudo(vcpu, ins, size);
+	uint32_t funct3 = (ins & INS16_FUNCT3_MASK) >> INS16_FUNCT3_SHIFT;
+	uint32_t quadrant = ins & INS16_QUADRANT_MASK;
+	int32_t ret = -EFAULT;
+
+	if ((quadrant == INS16_QUADRANT_0) || (quadrant == INS16_QUADRANT_2)) {
+		switch (funct3) {
+		case INS16_FUNCT3_LW:
+		case INS16_FUNCT3_SW:
+			ret = 4;
 			break;
-		case 0x1:
-		case 0x3:
-			ret = emulate_ins32(vcpu, ins, size);
+		case INS16_FUNCT3_LD:
+		case INS16_FUNCT3_SD:
+			ret = 8;
 			break;
 		default:
+			/* floating-point loads/stores and non-memory instructions */
 			break;
+		}
 	}
 
-	return ret;
-}
-
-static int32_t decode_pseudo(struct acrn_vcpu *vcpu, uint32_t ins)
-{
-	int size = (ins & INS32_OPSIZE_MASK) >> 12;
-
-	switch (size) {
-	case INS32_OPSIZE_WORD:
-		size = 4;
-		break;
-	case INS32_OPSIZE_DWORD:
-	default:
-		size = 8;
-		break;
+	if (ret > 0) {
+		desc->is_write = (funct3 == INS16_FUNCT3_SW) || (funct3 == INS16_FUNCT3_SD);
+		desc->sign_extend = (ret == 4);
+		desc->ins_len = 2U;
+		if (quadrant == INS16_QUADRANT_0) {
+			/* rd'/rs2' encode x8 - x15 */
+			desc->reg = (uint8_t)(((ins & INS16_RDP_MASK) >> 2U) + 8U);
+		} else if (desc->is_write) {
+			desc->reg = (uint8_t)((ins & INS16_RS2_MASK) >> 2U);
+		} else {
+			desc->reg = (uint8_t)((ins & INS16_RD_MASK) >> 7U);
+		}
 	}
 
-	return size;
+	return ret;
 }
 
-static int32_t decode_ins32(struct acrn_vcpu *vcpu, uint32_t ins)
+/* standard loads/stores, including the transformed form of compressed ones */
+static int32_t decode_ins32(uint32_t ins, struct mmio_access_desc *desc)
 {
-	int size = (ins & INS32_OPSIZE_MASK) >> 12;
+	uint32_t op = ins & INS32_OPCODE_MASK;
+	uint32_t funct3 = (ins & INS32_OPSIZE_MASK) >> 12U;
+	int32_t ret = -EFAULT;
+
+	if ((op == INS32_OPCODE_LD) || (op == INS32_OPCODE_C_LD)) {
+		desc->is_write = false;
+		desc->reg = (uint8_t)((ins & INS32_OPRD_MASK) >> 7U);
+	} else if ((op == INS32_OPCODE_ST) || (op == INS32_OPCODE_C_ST)) {
+		desc->is_write = true;
+		desc->reg = (uint8_t)((ins & INS32_OPRS2_MASK) >> 20U);
+	} else {
+		return ret;
+	}
 
-	switch (size) {
+	switch (funct3) {
 	case INS32_OPSIZE_BYTE:
 	case INS32_OPSIZE_UBYTE:
-		size = 1;
+		ret = 1;
 		break;
 	case INS32_OPSIZE_HALF:
 	case INS32_OPSIZE_UHALF:
-		size = 2;
+		ret = 2;
 		break;
 	case INS32_OPSIZE_WORD:
 	case INS32_OPSIZE_UWORD:
-		size = 4;
+		ret = 4;
 		break;
 	case INS32_OPSIZE_DWORD:
+		ret = 8;
+		break;
 	default:
-		size = 8;
 		break;
 	}
 
-	return size;
+	/* unsigned loads have bit 2 of funct3 set, stores only use 0 - 3 */
+	if (desc->is_write && (funct3 > INS32_OPSIZE_DWORD)) {
+		ret = -EFAULT;
+	}
+	desc->sign_extend = !desc->is_write && (funct3 < INS32_OPSIZE_DWORD);
+	desc->ins_len = ((ins & 0x3U) == 0x3U) ? 4U : 2U;
+
+	return ret;
 }
 
-int32_t decode_instruction(struct acrn_vcpu *vcpu, uint32_t ins, uint32_t xlen)
+/*
+ * Decode the load/store that trapped on an MMIO access into
+ * vcpu->arch.mmio_desc, which emulate_instruction() then works on.
+ *
+ * \p transformed tells whether \p ins comes from htinst, where compressed
+ * instructions are already expanded and bits [1:0] == 0 denote a
+ * pseudo-instruction, or was fetched from guest memory as is.
+ *
+ * Decoded descriptors are kept in a small per-vCPU cache keyed by the guest
+ * PC and instruction word, so an MMIO access executed in a loop is only
+ * decoded once.
+ *
+ * @return the access size in bytes, or -EFAULT if \p ins is not a supported
+ * load/store.
+ */
+int32_t decode_instruction(struct acrn_vcpu *vcpu, uint32_t ins, bool transformed)
 {
-	int32_t ret = -1;
-
-	xlen = ins & 0x3;
-	switch (xlen) {
-		case 0x0:
-			ret = decode_pseudo(vcpu, ins);
-			break;
-		case 0x1:
-		case 0x3:
-			ret = decode_ins32(vcpu, ins);
-			break;
-		default:
-			break;
+	struct mmio_access_desc *desc = &vcpu->arch.mmio_desc;
+	struct mmio_access_desc *cached;
+	uint64_t pc = vcpu_get_gpreg(vcpu, CPU_REG_IP);
+	int32_t ret;
+
+	cached = &vcpu->arch.mmio_desc_cache[(pc >> 1U) & (MMIO_DESC_CACHE_SIZE - 1U)];
+	if ((cached->ins == ins) && (cached->pc == pc) && (ins != 0U)) {
+		*desc = *cached;
+		ret = (int32_t)desc->size;
+	} else {
+		(void)memset(desc, 0U, sizeof(*desc));
+		if (transformed && ((ins & 0x3U) == 0x0U)) {
+			ret = decode_pseudo(ins, desc);
+		} else if (transformed || ((ins & 0x3U) == 0x3U)) {
+			ret = decode_ins32(ins, desc);
+		} else {
+			ret = decode_ins16(ins, desc);
+		}
+
+		if (ret > 0) {
+			desc->pc = pc;
+			desc->ins = ins;
+			desc->size = (uint8_t)ret;
+			*cached = *desc;
+		}
 	}
 
 	return ret;
 }
-#endif
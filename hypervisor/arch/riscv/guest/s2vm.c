@@ -19,6 +19,8 @@
 #include <asm/smp.h>
 #include <asm/cpumask.h>
 #include <asm/guest/vm.h>
+#include <acrn_hv_defs.h>
+#include <util.h>
 
 unsigned int s2vm_inital_level;
 
@@ -70,38 +72,50 @@ static inline uint64_t generate_satp(uint16_t vmid, uint64_t addr)
 void setup_virt_paging(void)
 {
 	s2vm_inital_level = 0;
+	init_s2pt_page_pool();
 }
 
 /*
- * Force a synchronous TLB flush.
+ * Force a synchronous TLB flush of the whole VMID, on the pCPUs in
+ * s2pt_cpu_mask only, see s2pt_flush_range().
  */
 void s2pt_flush_guest(struct acrn_vm *vm)
 {
-	unsigned long flags = 0;
-	uint64_t osatp;
-	uint64_t s2pt_satp = vm->arch_vm.s2pt_satp;
-
-	osatp = cpu_csr_read(hgatp);
-	if (osatp != s2pt_satp)
-	{
-		local_irq_save(&flags);
-
-		cpu_csr_write(hgatp, s2pt_satp);
+	s2pt_flush_range(vm, 0UL, 0UL);
+}
 
-		/* Ensure hsatp is synchronized before flushing the TLBs */
-		isb();
+/*
+ * Invalidate the G-stage translations of [gpa, gpa + size) for this VM.
+ *
+ * Only the pCPUs recorded in s2pt_cpu_mask can hold TLB entries tagged with
+ * this VMID, so the remote fence is limited to them. Ranges larger than
+ * CONFIG_S2PT_FLUSH_THRESHOLD flush the whole VMID instead of walking it
+ * page by page.
+ */
+void s2pt_flush_range(struct acrn_vm *vm, uint64_t gpa, uint64_t size)
+{
+	uint16_t pcpu_id = get_pcpu_id();
+	uint16_t vmid = vm->vm_id;
+	uint64_t mask;
+	bool full = (size == 0UL) || (size > CONFIG_S2PT_FLUSH_THRESHOLD);
+
+	/* order the page table update before sampling the pCPU mask */
+	smp_mb();
+	mask = vm->arch_vm.s2pt_cpu_mask & cpu_online_map;
+
+	if (test_bit(pcpu_id, mask)) {
+		if (full)
+			flush_guest_tlb_vmid(vmid);
+		else
+			flush_guest_tlb_range_vmid(gpa, size, vmid);
+		clear_bit(pcpu_id, &mask);
 	}
 
-	flush_guest_tlb_local();
-	if (smp_ops)
-		smp_ops->hfence(cpu_online_map, 0, 0);
-
-	if (osatp != s2pt_satp)
-	{
-		cpu_csr_write(hgatp, s2pt_satp);
-		/* Ensure hsatp is back in place before continuing. */
-		isb();
-		local_irq_restore(flags);
+	if (smp_ops && (mask != 0UL)) {
+		if (full)
+			smp_ops->hfence_vmid(mask, 0UL, 0UL, vmid);
+		else
+			smp_ops->hfence_vmid(mask, gpa, size, vmid);
 	}
 }
 
@@ -133,58 +147,198 @@ int s2pt_init(struct acrn_vm *vm)
 {
 	int rc = 0;
 
-	spinlock_init(&vm->s2pt_lock);
+	spinlock_init_class(&vm->s2pt_lock, LOCK_CLASS_S2PT);
+	vm->arch_vm.s2pt_cpu_mask = 0UL;
 
 	s2pt_setup_satp(vm);
 
 	return rc;
 }
 
-void s2pt_add_mr(struct acrn_vm *vm, uint64_t *vpn3_page,
-	uint64_t hpa, uint64_t gpa, uint64_t size, uint64_t prot_orig)
+/*
+ * Tear down the whole stage-2 mapping of the VM so that its table pages go
+ * back to the shared pool.
+ */
+void s2pt_deinit(struct acrn_vm *vm)
 {
-	uint64_t prot = prot_orig;
-
-	pr_info("%s, vm[%d] hpa: 0x%016lx gpa: 0x%016lx size: 0x%016lx prot: 0x%016x\n",
-			__func__, vm->vm_id, hpa, gpa, size, prot);
+	const struct memory_ops *mem_ops = &vm->arch_vm.s2pt_mem_ops;
 
 	spin_lock(&vm->s2pt_lock);
-	mmu_add(vpn3_page, hpa, gpa, size, prot, &vm->arch_vm.s2pt_mem_ops);
+	(void)mmu_modify_or_del((uint64_t *)vm->arch_vm.s2ptp, 0UL, mem_ops->info->s2pt.top_address_space,
+			0UL, 0UL, mem_ops, MR_DEL);
+	s2pt_flush_guest(vm);
 	spin_unlock(&vm->s2pt_lock);
+}
 
-	s2pt_flush_guest(vm);
+static int32_t s2pt_txn_apply(struct s2pt_txn *txn, const struct s2pt_op *op)
+{
+	const struct memory_ops *mem_ops = &txn->vm->arch_vm.s2pt_mem_ops;
+	int32_t ret;
+
+	switch (op->type) {
+	case MR_ADD:
+		ret = mmu_add(txn->vpn3_page, op->hpa, op->gpa, op->size, op->prot_set, mem_ops);
+		break;
+	case MR_MODIFY:
+		ret = mmu_modify_or_del(txn->vpn3_page, op->gpa, op->size,
+				op->prot_set, op->prot_clr, mem_ops, MR_MODIFY);
+		break;
+	default:
+		ret = mmu_modify_or_del(txn->vpn3_page, op->gpa, op->size, 0UL, 0UL, mem_ops, MR_DEL);
+		break;
+	}
+
+	return ret;
 }
 
-void s2pt_modify_mr(struct acrn_vm *vm, uint64_t *vpn3_page,
-		uint64_t gpa, uint64_t size,
-		uint64_t prot_set, uint64_t prot_clr)
+void s2pt_txn_begin(struct s2pt_txn *txn, struct acrn_vm *vm, uint64_t *vpn3_page)
 {
-	uint64_t local_prot = prot_set;
+	txn->vm = vm;
+	txn->vpn3_page = vpn3_page;
+	txn->nr_ops = 0U;
+	txn->ret = 0;
+}
 
-	pr_dbg("%s,vm[%d] gpa 0x%lx size 0x%lx\n", __func__, vm->vm_id, gpa, size);
+/*
+ * Apply all queued operations under a single s2pt_lock hold, then issue one
+ * invalidation spanning the union of the touched GPA ranges.
+ *
+ * Modify and delete operations may have split large pages, so the touched
+ * range is also given a chance to collapse back into large pages before the
+ * invalidation. The flush is done before dropping the lock so that a freed
+ * table page cannot be reused while stale walks may still reference it.
+ * A ranged hfence.gvma only drops leaf translations, so once a table page
+ * has been freed, or a promotion has replaced one with a large leaf, the
+ * whole VMID is flushed instead.
+ *
+ * The first operation that runs out of table pages stops the commit, the
+ * ones after it are dropped. Returns -ENOMEM then, and keeps returning it
+ * for the rest of the transaction, including its early commits.
+ */
+int32_t s2pt_txn_commit(struct s2pt_txn *txn)
+{
+	struct acrn_vm *vm = txn->vm;
+	const struct pgtable_stats *stats = vm->arch_vm.s2pt_mem_ops.stats;
+	uint64_t start = ~0UL, end = 0UL, frees, merges;
+	bool promote = false;
+	uint32_t i;
+	int32_t ret = 0;
+
+	if (txn->nr_ops == 0U)
+		return txn->ret;
 
 	spin_lock(&vm->s2pt_lock);
+	frees = stats->frees;
+	merges = stats->merges;
+	for (i = 0U; (i < txn->nr_ops) && (ret == 0); i++) {
+		const struct s2pt_op *op = &txn->ops[i];
+
+		ret = s2pt_txn_apply(txn, op);
+		start = min(start, op->gpa);
+		end = max(end, op->gpa + op->size);
+		promote = promote || (op->type != MR_ADD);
+	}
 
-	mmu_modify_or_del(vpn3_page, gpa, size, local_prot, prot_clr, &(vm->arch_vm.s2pt_mem_ops), MR_MODIFY);
+	if (promote)
+		mmu_promote(txn->vpn3_page, start, end - start, &vm->arch_vm.s2pt_mem_ops);
 
+	/* size 0 flushes the whole VMID */
+	s2pt_flush_range(vm, start, ((stats->frees != frees) || (stats->merges != merges)) ?
+			0UL : (end - start));
 	spin_unlock(&vm->s2pt_lock);
 
-	s2pt_flush_guest(vm);
+	if (ret != 0) {
+		pr_err("%s: vm%hu out of stage-2 table pages", __func__, vm->vm_id);
+		txn->ret = ret;
+	}
+	txn->nr_ops = 0U;
+	return txn->ret;
+}
+
+/* A full queue is committed early, so callers never have to check for room. */
+static struct s2pt_op *s2pt_txn_next_op(struct s2pt_txn *txn)
+{
+	if (txn->nr_ops == S2PT_TXN_MAX_OPS)
+		(void)s2pt_txn_commit(txn);
+
+	return &txn->ops[txn->nr_ops++];
+}
+
+void s2pt_txn_add_mr(struct s2pt_txn *txn, uint64_t hpa, uint64_t gpa,
+		uint64_t size, uint64_t prot)
+{
+	struct s2pt_op *op = s2pt_txn_next_op(txn);
+
+	op->type = MR_ADD;
+	op->hpa = hpa;
+	op->gpa = gpa;
+	op->size = size;
+	op->prot_set = prot;
+	op->prot_clr = 0UL;
+}
+
+void s2pt_txn_modify_mr(struct s2pt_txn *txn, uint64_t gpa, uint64_t size,
+		uint64_t prot_set, uint64_t prot_clr)
+{
+	struct s2pt_op *op = s2pt_txn_next_op(txn);
+
+	op->type = MR_MODIFY;
+	op->hpa = 0UL;
+	op->gpa = gpa;
+	op->size = size;
+	op->prot_set = prot_set;
+	op->prot_clr = prot_clr;
+}
+
+void s2pt_txn_del_mr(struct s2pt_txn *txn, uint64_t gpa, uint64_t size)
+{
+	struct s2pt_op *op = s2pt_txn_next_op(txn);
+
+	op->type = MR_DEL;
+	op->hpa = 0UL;
+	op->gpa = gpa;
+	op->size = size;
+	op->prot_set = 0UL;
+	op->prot_clr = 0UL;
+}
+
+int32_t s2pt_add_mr(struct acrn_vm *vm, uint64_t *vpn3_page,
+	uint64_t hpa, uint64_t gpa, uint64_t size, uint64_t prot_orig)
+{
+	struct s2pt_txn txn;
+
+	pr_info("%s, vm[%d] hpa: 0x%016lx gpa: 0x%016lx size: 0x%016lx prot: 0x%016x\n",
+			__func__, vm->vm_id, hpa, gpa, size, prot_orig);
+
+	s2pt_txn_begin(&txn, vm, vpn3_page);
+	s2pt_txn_add_mr(&txn, hpa, gpa, size, prot_orig);
+	return s2pt_txn_commit(&txn);
+}
+
+int32_t s2pt_modify_mr(struct acrn_vm *vm, uint64_t *vpn3_page,
+		uint64_t gpa, uint64_t size,
+		uint64_t prot_set, uint64_t prot_clr)
+{
+	struct s2pt_txn txn;
+
+	pr_dbg("%s,vm[%d] gpa 0x%lx size 0x%lx\n", __func__, vm->vm_id, gpa, size);
+
+	s2pt_txn_begin(&txn, vm, vpn3_page);
+	s2pt_txn_modify_mr(&txn, gpa, size, prot_set, prot_clr);
+	return s2pt_txn_commit(&txn);
 }
 /**
  * @pre [gpa,gpa+size) has been mapped into host physical memory region
  */
-void s2pt_del_mr(struct acrn_vm *vm, uint64_t *vpn3_page, uint64_t gpa, uint64_t size)
+int32_t s2pt_del_mr(struct acrn_vm *vm, uint64_t *vpn3_page, uint64_t gpa, uint64_t size)
 {
-	pr_info("%s,vm[%d] gpa 0x%lx size 0x%lx\n", __func__, vm->vm_id, gpa, size);
+	struct s2pt_txn txn;
 
-	spin_lock(&vm->s2pt_lock);
-
-	mmu_modify_or_del(vpn3_page, gpa, size, 0UL, 0UL, &vm->arch_vm.s2pt_mem_ops, MR_DEL);
-
-	spin_unlock(&vm->s2pt_lock);
+	pr_info("%s,vm[%d] gpa 0x%lx size 0x%lx\n", __func__, vm->vm_id, gpa, size);
 
-	s2pt_flush_guest(vm);
+	s2pt_txn_begin(&txn, vm, vpn3_page);
+	s2pt_txn_del_mr(&txn, gpa, size);
+	return s2pt_txn_commit(&txn);
 }
 
 /**
@@ -244,45 +398,27 @@ void walk_s2pt_table(struct acrn_vm *vm, pge_handler cb)
 	}
 }
 
+/*
+ * Switch hgatp to the VM of @vcpu and record that this pCPU may now cache
+ * G-stage translations for its VMID. The first time a pCPU joins the mask
+ * its TLB is flushed for the VMID, which drops any entry left over from a
+ * previous VM that used the same VMID.
+ */
 void s2vm_restore_state(struct acrn_vcpu *vcpu)
 {
-#if 0
-	uint8_t *last_vcpu_ran;
 	struct acrn_vm *vm = vcpu->vm;
-	uint64_t satp = vm->arch_vm.s2pt_satp;
+	uint16_t pcpu_id = get_pcpu_id();
+	uint64_t s2pt_satp = vm->arch_vm.s2pt_satp;
 
-	//if ( is_idle_vcpu(n) )
-	  //  return;
-	WRITE_SYSREG(vcpu->arch.sctlr, SCTLR_EL1);
-	WRITE_SYSREG(vcpu->arch.hcr_el2, HCR_EL2);
+	if (!test_bit(pcpu_id, vm->arch_vm.s2pt_cpu_mask)) {
+		bitmap_set_lock(pcpu_id, &vm->arch_vm.s2pt_cpu_mask);
+		smp_mb();
+		flush_guest_tlb_vmid(vm->vm_id);
+	}
 
-	/*
-	 * ARM64_WORKAROUND_AT_SPECULATE: VTTBR_EL2 should be restored after all
-	 * registers associated to EL1/EL0 translations regime have been
-	 * synchronized.
-	 */
-	asm volatile("isb");
-	WRITE_SYSREG64(satp, VTTBR_EL2);
-
-	//last_vcpu_ran = &p2m->last_vcpu_ran[smp_processor_id()];
-
-	///*
-	// * While we are restoring an out-of-context translation regime
-	// * we still need to ensure:
-	// *  - VTTBR_EL2 is synchronized before flushing the TLBs
-	// *  - All registers for EL1 are synchronized before executing an AT
-	// *  instructions targeting S1/S2.
-	// */
-	isb();
-
-	flush_guest_tlb_local();
-	///*
-	// * Flush local TLB for the domain to prevent wrong TLB translation
-	// * when running multiple vCPU of the same domain on a single pCPU.
-	// */
-	//if ( *last_vcpu_ran != INVALID_VCPU_ID && *last_vcpu_ran != n->vcpu_id )
-	//	flush_guest_tlb_local();
-
-	//*last_vcpu_ran = n->vcpu_id;
-#endif
+	if (cpu_csr_read(hgatp) != s2pt_satp) {
+		cpu_csr_write(hgatp, s2pt_satp);
+		/* Ensure hgatp is synchronized before entering the guest */
+		isb();
+	}
 }
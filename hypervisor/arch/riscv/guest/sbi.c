@@ -14,11 +14,15 @@
 #include <asm/irq.h>
 #include <asm/tlb.h>
 #include <asm/smp.h>
+#include <asm/per_cpu.h>
 #include <asm/notify.h>
 #include <asm/cache.h>
 #include <asm/guest/vcpu.h>
 #include <asm/guest/vm.h>
 #include <asm/guest/vclint.h>
+#include <asm/guest/vmexit.h>
+#include <asm/guest/vpmu.h>
+#include <trace.h>
 #include "sbi.h"
 #include "rpmi.h"
 #include "tee.h"
@@ -32,6 +36,7 @@ static void sbi_ecall_base_probe(unsigned long id, unsigned long *out_val)
 	case SBI_ID_RFENCE:
 	case SBI_ID_TIMER:
 	case SBI_ID_HSM:
+	case SBI_ID_PMU:
 	case SBI_ID_MPXY:
 		*out_val = 1;
 		break;
@@ -130,9 +135,18 @@ static void sbi_timer_handler(struct acrn_vcpu *vcpu, struct cpu_regs *regs)
 	sstc = !!(cpu_csr_read(menvcfg) & 0x8000000000000000);
 #endif
 	if (funcid == SBI_TYPE_TIME_SET_TIMER) {
+		vpmu_fw_event(vcpu, SBI_PMU_FW_SET_TIMER);
 		if (sstc) {
 			cpu_csr_write(stimecmp, regs->a0);
 			*ret = SBI_SUCCESS;
+		} else if (vcpu->arch.direct_timer) {
+			/*
+			 * VSTIP follows vstimecmp in hardware, loaded on the
+			 * next VM entry: no hv_timer and no injection needed.
+			 */
+			vcpu_set_vs_csr(vcpu, VS_CSR_TIMECMP, regs->a0);
+			ctx->sip &= ~CLINT_VECTOR_STI;
+			*ret = SBI_SUCCESS;
 		} else {
 			ctx->sip &= ~CLINT_VECTOR_STI;
 #ifdef CONFIG_MACRN
@@ -150,18 +164,32 @@ static void sbi_timer_handler(struct acrn_vcpu *vcpu, struct cpu_regs *regs)
 
 static void send_vipi_mask(struct acrn_vcpu *vcpu, uint64_t mask, uint64_t base)
 {
+	uint64_t vcpu_mask = 0UL;
 	uint16_t offset;
 
+	/* hart_mask_base -1: all harts */
+	if (base == ~0UL) {
+		mask = ~0UL;
+		base = 0UL;
+	}
+
 	offset = ffs64(mask);
 
 	while ((offset + base) < vcpu->vm->hw.created_vcpus) {
 		struct acrn_vcpu *t = &vcpu->vm->hw.vcpu[base + offset];
-		struct acrn_vclint *vclint = vcpu_vclint(t);
 
 		clear_bit(offset, &mask);
-		vclint_send_ipi(vclint, base + offset);
+		TRACE_2L(TRACE_VMEXIT_VIPI, base + offset, 0UL);
+		vpmu_fw_event(vcpu, SBI_PMU_FW_IPI_SENT);
+		vpmu_fw_event(t, SBI_PMU_FW_IPI_RECVD);
+		vcpu_mask |= 1UL << (base + offset);
 		offset = ffs64(mask);
 	}
+
+	/* one vCLINT lock and at most one physical IPI for the whole multicast */
+	if (vcpu_mask != 0UL) {
+		vclint_send_ipi_mask(vcpu_vclint(vcpu), vcpu_mask);
+	}
 }
 
 static void sbi_ipi_handler(struct acrn_vcpu *vcpu, struct cpu_regs *regs)
@@ -179,93 +207,185 @@ static void sbi_ipi_handler(struct acrn_vcpu *vcpu, struct cpu_regs *regs)
 	return;
 }
 
-static void sbi_rcall_sfence_vma(struct sbi_rfence_call *rcall)
+/*
+ * Run the fence on this pCPU. hgatp must hold rcall->vm, so hfence.vvma
+ * hits the guest's VMID.
+ */
+static void sbi_rfence_flush_local(const struct sbi_rfence_call *rcall)
 {
-	uint64_t base = rcall->base;
-	uint64_t size = rcall->size;
-	uint64_t i;
+	uint64_t va, end;
 
-	if ((base == 0 && size == 0) || (size == SBI_RFENCE_FLUSH_ALL)) {
-		flush_guest_tlb_local();
+	if (rcall->flush_all) {
+		if (rcall->use_asid) {
+			flush_vs_tlb_asid(rcall->asid);
+		} else {
+			flush_vs_tlb_all();
+		}
 		return;
 	}
 
-	for (i = 0; i < size; i += PAGE_SIZE)
-		flush_tlb_addr(base + i);
+	end = rcall->base + rcall->size;
+	for (va = rcall->base & PAGE_MASK; va < end; va += PAGE_SIZE) {
+		if (rcall->use_asid) {
+			flush_vs_tlb_addr_asid(va, rcall->asid);
+		} else {
+			flush_vs_tlb_addr(va);
+		}
+	}
 }
 
-static void sbi_rcall_sfence_vma_asid(struct sbi_rfence_call *rcall)
+/* Make every vCPU of @vm on @pcpu_id flush its VS-stage TLB at the next VM entry */
+static void sbi_rfence_defer(struct acrn_vm *vm, uint16_t pcpu_id)
 {
-	uint64_t base = rcall->base;
-	uint64_t size  = rcall->size;
-	uint64_t asid  = rcall->asid;
-	uint64_t i;
+	struct acrn_vcpu *vcpu;
+	uint16_t i;
 
-	if (base == 0 && size == 0) {
-		flush_guest_tlb_local();
-		return;
+	foreach_vcpu(i, vm, vcpu) {
+		if (pcpuid_from_vcpu(vcpu) == pcpu_id) {
+			bitmap_set_lock(ACRN_REQUEST_VPID_FLUSH, &vcpu->arch.pending_req);
+		}
 	}
+}
 
-	if (size == SBI_RFENCE_FLUSH_ALL) {
-		flush_tlb_asid(asid);
-		return;
-	}
+/*
+ * Cross-call handler on a pCPU that had a target vCPU running. If that
+ * VM is no longer loaded here, the fence is deferred to its next entry.
+ */
+static void sbi_rcall_sfence_vma(void *data)
+{
+	struct sbi_rfence_call *rcall = (struct sbi_rfence_call *)data;
+	uint16_t pcpu_id = get_pcpu_id();
+	struct acrn_vcpu *curr = get_running_vcpu(pcpu_id);
 
-	for (i = 0; i < size; i += PAGE_SIZE)
-		flush_tlb_addr_asid(base + i, asid);
+	if ((curr != NULL) && (curr->vm == rcall->vm) &&
+			(per_cpu(vcpu_run, pcpu_id) == (void *)curr)) {
+		sbi_rfence_flush_local(rcall);
+	} else {
+		sbi_rfence_defer(rcall->vm, pcpu_id);
+	}
 }
 
-static void sbi_rcall_fence_i(struct sbi_rfence_call *rcall)
+static void sbi_rcall_icache_flush(__unused void *data)
 {
 	invalidate_icache_local();
 }
 
+/*
+ * fence.i carries no data: a request that finds one still queued on a
+ * target pCPU piggybacks on it.
+ */
+static struct smp_call_coalesced rfence_fence_i = { .func = sbi_rcall_icache_flush };
+
+/*
+ * Remote sfence.vma(_asid). Target vCPUs are handled in one of three ways:
+ *  - on this pCPU: flushed here, with no IPI.
+ *  - running on another pCPU: flushed there by one cross call per pCPU.
+ *  - not running: a VPID_FLUSH request is set and the vCPU flushes its
+ *    whole VMID before the next VM entry.
+ * Ranges over CONFIG_RFENCE_FLUSH_THRESHOLD pages become one full ASID or
+ * VMID flush instead of a loop of per-page fences.
+ */
+static void sbi_rfence_sfence_vma(struct acrn_vcpu *vcpu, uint64_t vcpu_mask,
+		struct sbi_rfence_call *rcall)
+{
+	struct acrn_vm *vm = vcpu->vm;
+	struct acrn_vcpu *target;
+	struct smp_call_token token;
+	uint16_t self = get_pcpu_id();
+	uint64_t ipi_mask = 0UL;
+	bool local = false;
+	uint16_t vcpu_id, pcpu_id;
+
+	rcall->vm = vm;
+	rcall->flush_all = ((rcall->base == 0UL) && (rcall->size == 0UL)) ||
+			(rcall->size == SBI_RFENCE_FLUSH_ALL) ||
+			(rcall->size > (CONFIG_RFENCE_FLUSH_THRESHOLD * PAGE_SIZE));
+
+	vcpu_id = ffs64(vcpu_mask);
+	while (vcpu_id < vm->hw.created_vcpus) {
+		clear_bit(vcpu_id, &vcpu_mask);
+		target = vcpu_from_vid(vm, vcpu_id);
+		pcpu_id = pcpuid_from_vcpu(target);
+		gva_cache_flush(target);
+		vpmu_fw_event(vcpu, rcall->use_asid ? SBI_PMU_FW_SFENCE_VMA_ASID_SENT : SBI_PMU_FW_SFENCE_VMA_SENT);
+		vpmu_fw_event(target, rcall->use_asid ? SBI_PMU_FW_SFENCE_VMA_ASID_RCVD : SBI_PMU_FW_SFENCE_VMA_RCVD);
+
+		if (pcpu_id == self) {
+			/* same VMID on the same hart, one local fence covers it */
+			local = true;
+		} else if (get_running_vcpu(pcpu_id) == target) {
+			set_bit(pcpu_id, &ipi_mask);
+		} else {
+			bitmap_set_lock(ACRN_REQUEST_VPID_FLUSH, &target->arch.pending_req);
+			cpu_memory_barrier();
+			/* it may have been scheduled in before the request was visible */
+			if (get_running_vcpu(pcpu_id) == target) {
+				set_bit(pcpu_id, &ipi_mask);
+			}
+		}
+		vcpu_id = ffs64(vcpu_mask);
+	}
+
+	if (ipi_mask != 0UL) {
+		smp_call_function_async(ipi_mask, sbi_rcall_sfence_vma, rcall, &token);
+	}
+	if (local) {
+		sbi_rfence_flush_local(rcall);
+	}
+	if (ipi_mask != 0UL) {
+		smp_call_wait(&token);
+	}
+}
+
 static void sbi_rfence_handler(struct acrn_vcpu *vcpu, struct cpu_regs *regs)
 {
 	uint64_t *ret = &regs->a0;
 	uint64_t funcid = regs->a6;
 	uint64_t mask = regs->a0;
 	uint64_t base = regs->a1;
-	uint64_t rcall_mask = 0;
-	smp_call_func_t func = NULL;
+	uint64_t vcpu_mask = 0UL;
+	uint64_t rcall_mask = 0UL;
 	struct sbi_rfence_call rcall;
 	uint16_t offset;
 
 	*ret = SBI_SUCCESS;
-	switch (funcid) {
-	case SBI_TYPE_RFENCE_FNECE_I:
-		func = (smp_call_func_t)sbi_rcall_fence_i;
-		break;
-	case SBI_TYPE_RFENCE_SFNECE_VMA:
-		func = (smp_call_func_t)sbi_rcall_sfence_vma;
-		rcall.base = regs->a2;
-		rcall.size = regs->a3;
-		break;
-	case SBI_TYPE_RFENCE_SFNECE_VMA_ASID:
-		func = (smp_call_func_t)sbi_rcall_sfence_vma_asid;
-		rcall.base = regs->a2;
-		rcall.size = regs->a3;
-		rcall.asid = regs->a4;
-		break;
-	default:
+	if ((funcid != SBI_TYPE_RFENCE_FNECE_I) &&
+			(funcid != SBI_TYPE_RFENCE_SFNECE_VMA) &&
+			(funcid != SBI_TYPE_RFENCE_SFNECE_VMA_ASID)) {
 		*ret = SBI_ENOTSUPP;
-		break;
-	}
-
-	if (func == NULL)
 		return;
-	offset = ffs64(mask);
-	while ((offset + base) < vcpu->vm->hw.created_vcpus) {
-		uint16_t t = offset + base;
+	}
 
-		clear_bit(offset, &mask);
-		t = vcpu->vm->hw.vcpu[t].pcpu_id;
-		set_bit(t, &rcall_mask);
+	if (base == (uint64_t)-1) {
+		/* hart_mask_base of -1 selects all harts */
+		vcpu_mask = (1UL << vcpu->vm->hw.created_vcpus) - 1UL;
+	} else {
 		offset = ffs64(mask);
+		while ((offset + base) < vcpu->vm->hw.created_vcpus) {
+			clear_bit(offset, &mask);
+			set_bit(offset + base, &vcpu_mask);
+			offset = ffs64(mask);
+		}
 	}
-	smp_call_function(rcall_mask, func, (void *)&rcall);
 
-	return;
+	if (funcid == SBI_TYPE_RFENCE_FNECE_I) {
+		offset = ffs64(vcpu_mask);
+		while (offset < vcpu->vm->hw.created_vcpus) {
+			clear_bit(offset, &vcpu_mask);
+			set_bit(vcpu->vm->hw.vcpu[offset].pcpu_id, &rcall_mask);
+			vpmu_fw_event(vcpu, SBI_PMU_FW_FENCE_I_SENT);
+			vpmu_fw_event(&vcpu->vm->hw.vcpu[offset], SBI_PMU_FW_FENCE_I_RECVD);
+			offset = ffs64(vcpu_mask);
+		}
+		smp_call_function_coalesced(rcall_mask, &rfence_fence_i);
+		return;
+	}
+
+	rcall.base = regs->a2;
+	rcall.size = regs->a3;
+	rcall.use_asid = (funcid == SBI_TYPE_RFENCE_SFNECE_VMA_ASID);
+	rcall.asid = rcall.use_asid ? regs->a4 : 0UL;
+	sbi_rfence_sfence_vma(vcpu, vcpu_mask, &rcall);
 }
 
 static void sbi_hsm_handler(struct acrn_vcpu *vcpu, struct cpu_regs *regs)
@@ -277,10 +397,8 @@ static void sbi_hsm_handler(struct acrn_vcpu *vcpu, struct cpu_regs *regs)
 	uint64_t saddr = regs->a1;
 	uint64_t arg1 = regs->a2;
 	struct acrn_vcpu *target;
-	struct guest_cpu_context *ctx;
 
 	target = &vcpu->vm->hw.vcpu[hartid];
-	ctx = &target->arch.contexts[target->arch.cur_context];
 	*ret = SBI_SUCCESS;
 	*out_val = 0;
 	switch (funcid) {
@@ -288,8 +406,8 @@ static void sbi_hsm_handler(struct acrn_vcpu *vcpu, struct cpu_regs *regs)
 		vcpu_set_rip(target, saddr);
 		vcpu_set_gpreg(target, CPU_REG_A0, target->vcpu_id);
 		vcpu_set_gpreg(target, CPU_REG_A1, arg1);
-		ctx->run_ctx.satp = 0;
-		ctx->run_ctx.sstatus &= ~0x2UL;
+		vcpu_set_vs_csr(target, VS_CSR_SATP, 0UL);
+		vcpu_set_status(target, vcpu_get_status(target) & ~0x2UL);
 		launch_vcpu(target);
 		break;
 	case SBI_TYPE_HSM_HART_GET_STATUS:
@@ -315,9 +433,7 @@ static void sbi_srst_handler(struct acrn_vcpu *vcpu, struct cpu_regs *regs)
 
 static void sbi_pmu_handler(struct acrn_vcpu *vcpu, struct cpu_regs *regs)
 {
-	regs->a0 = SBI_ENOTSUPP;
-
-	return;
+	vpmu_sbi_handler(vcpu, regs);
 }
 
 static void sbi_mpxy_get_shm_size(struct acrn_vcpu *vcpu, struct cpu_regs *regs)
@@ -463,6 +579,20 @@ static const struct sbi_ecall_dispatch sbi_dispatch_table[NR_HX_EXIT_REASONS] =
 		.handler = sbi_undefined_handler},
 };
 
+/* the extension counted in exit_stats.sbi_calls[slot], ~0UL for the catch-all */
+uint64_t sbi_exit_stats_ext_id(uint32_t slot)
+{
+	uint64_t id = 0UL;
+
+	if (slot < SBI_MAX_TYPES) {
+		id = sbi_dispatch_table[slot].ext_id;
+	} else if (slot == SBI_MAX_TYPES) {
+		id = ~0UL;
+	}
+
+	return id;
+}
+
 int sbi_ecall_handler(struct acrn_vcpu *vcpu)
 {
 	struct run_context *ctx =
@@ -478,6 +608,8 @@ int sbi_ecall_handler(struct acrn_vcpu *vcpu)
 		}
 	}
 
+	vcpu->arch.exit_stats.sbi_calls[d - sbi_dispatch_table]++;
+	TRACE_2L(TRACE_VMEXIT_SBI, id, regs->a6);
 	d->handler(vcpu, regs);
 
 	return 0;
@@ -40,9 +40,12 @@ struct sbi_ecall_dispatch {
 };
 
 struct sbi_rfence_call {
+	struct acrn_vm *vm;
 	uint64_t base;
 	uint64_t size;
 	uint64_t asid;
+	bool use_asid;
+	bool flush_all;
 };
 
 #endif /* __RISCV_GUEST_SBI_H__ */
@@ -0,0 +1,487 @@
+/*
+ * Copyright (C) 2023-2024 Intel Corporation. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#define pr_prefix		"vaplic: "
+
+#include <types.h>
+#include <errno.h>
+#include <irq.h>
+#include <asm/cpu.h>
+#include <asm/per_cpu.h>
+#include <asm/pgtable.h>
+#include <asm/aia.h>
+#include <asm/lib/bits.h>
+#include <asm/guest/s2vm.h>
+#include <asm/guest/vaplic.h>
+#include <asm/guest/vm.h>
+#include <asm/guest/vcpu.h>
+#include <io_req.h>
+#include <logmsg.h>
+
+/*
+ * The guest programs a virtual APLIC in MSI mode. Sources the hypervisor
+ * does not own are mirrored into the physical APLIC and delivered by it
+ * straight into the guest interrupt file of the target vCPU; virtual
+ * sources (vUART, HSM notification, ...) are written into that file by
+ * vaplic_accept_intr(). Either way, the guest takes and completes the
+ * interrupt through its VS-level IMSIC without leaving the guest.
+ */
+
+static inline bool vaplic_test(const uint32_t *map, uint32_t irq)
+{
+	return (map[irq >> 5U] & (1U << (irq & 0x1fU))) != 0U;
+}
+
+static inline void vaplic_set(uint32_t *map, uint32_t irq)
+{
+	map[irq >> 5U] |= 1U << (irq & 0x1fU);
+}
+
+static inline void vaplic_clear(uint32_t *map, uint32_t irq)
+{
+	map[irq >> 5U] &= ~(1U << (irq & 0x1fU));
+}
+
+static inline uint32_t vaplic_sm(const struct acrn_vaplic *vaplic, uint32_t irq)
+{
+	return vaplic->sourcecfg[irq] & APLIC_SOURCECFG_SM_MASK;
+}
+
+static inline bool vaplic_active(const struct acrn_vaplic *vaplic, uint32_t irq)
+{
+	return (irq != 0U) && (irq < APLIC_NUM_SOURCES) && (vaplic_sm(vaplic, irq) != APLIC_SM_INACTIVE);
+}
+
+static inline bool vaplic_domain_enabled(const struct acrn_vaplic *vaplic)
+{
+	return (vaplic->domaincfg & APLIC_DOMAINCFG_IE) != 0U;
+}
+
+/* guest physical address of the S-level interrupt file of @vcpu_id */
+static inline uint64_t vaplic_imsic_gpa(uint16_t vcpu_id)
+{
+	return CONFIG_IMSIC_BASE + ((uint64_t)vcpu_id << (imsic_guest_index_bits() + PAGE_SHIFT));
+}
+
+static struct acrn_vcpu *vaplic_target_vcpu(const struct acrn_vaplic *vaplic, uint32_t irq)
+{
+	uint32_t hart = vaplic->target[irq] >> APLIC_TARGET_HART_SHIFT;
+	struct acrn_vcpu *vcpu = NULL;
+
+	if (hart < vaplic->vm->hw.created_vcpus) {
+		vcpu = vcpu_from_vid(vaplic->vm, (uint16_t)hart);
+		if (vcpu->arch.imsic_file == 0U) {
+			vcpu = NULL;
+		}
+	}
+
+	return vcpu;
+}
+
+/*
+ * Send @irq to its target if it is pending and enabled. In MSI mode the
+ * pending bit goes away as soon as the MSI is sent.
+ *
+ * @pre vaplic->lock is held
+ */
+static void vaplic_deliver(struct acrn_vaplic *vaplic, uint32_t irq)
+{
+	uint32_t eiid = vaplic->target[irq] & APLIC_TARGET_EIID_MASK;
+	struct acrn_vcpu *vcpu;
+
+	if (vaplic_domain_enabled(vaplic) && vaplic_test(vaplic->ie, irq) && vaplic_test(vaplic->pending, irq)) {
+		vcpu = vaplic_target_vcpu(vaplic, irq);
+		if ((vcpu != NULL) && (eiid != 0U)) {
+			vaplic_clear(vaplic->pending, irq);
+			imsic_send_msi(pcpuid_from_vcpu(vcpu), vcpu->arch.imsic_file, eiid);
+		}
+	}
+}
+
+/*
+ * Mirror the guest configuration of a passthrough source into the
+ * physical APLIC.
+ *
+ * @pre vaplic->lock is held
+ */
+static void vaplic_sync_passthru(const struct acrn_vaplic *vaplic, uint32_t irq)
+{
+	uint32_t sm = vaplic_sm(vaplic, irq);
+	struct acrn_vcpu *vcpu;
+
+	if (vaplic_test(vaplic->passthru, irq)) {
+		vcpu = vaplic_target_vcpu(vaplic, irq);
+		if ((sm == APLIC_SM_INACTIVE) || (sm == APLIC_SM_DETACHED) || (vcpu == NULL)) {
+			aplic_release(irq);
+		} else {
+			aplic_route(irq, sm, pcpuid_from_vcpu(vcpu), vcpu->arch.imsic_file,
+				vaplic->target[irq] & APLIC_TARGET_EIID_MASK);
+			aplic_set_enable(irq, vaplic_domain_enabled(vaplic) && vaplic_test(vaplic->ie, irq));
+		}
+	}
+}
+
+/* @pre vaplic->lock is held */
+static void vaplic_set_pending(struct acrn_vaplic *vaplic, uint32_t irq)
+{
+	if (vaplic_active(vaplic, irq)) {
+		if (vaplic_test(vaplic->passthru, irq)) {
+			/* the physical APLIC applies the level rules itself */
+			aplic_retrigger(irq);
+		} else if (!aplic_sm_is_level(vaplic_sm(vaplic, irq))) {
+			vaplic_set(vaplic->pending, irq);
+			vaplic_deliver(vaplic, irq);
+		} else {
+			/* virtual level sources are pended again by their device on every assertion */
+		}
+	}
+}
+
+/* @pre vaplic->lock is held */
+static void vaplic_clear_pending(struct acrn_vaplic *vaplic, uint32_t irq)
+{
+	if (vaplic_active(vaplic, irq)) {
+		if (vaplic_test(vaplic->passthru, irq)) {
+			aplic_clear_pending(irq);
+		}
+		vaplic_clear(vaplic->pending, irq);
+	}
+}
+
+/* @pre vaplic->lock is held */
+static void vaplic_set_enable(struct acrn_vaplic *vaplic, uint32_t irq, bool enable)
+{
+	if (vaplic_active(vaplic, irq)) {
+		if (enable) {
+			vaplic_set(vaplic->ie, irq);
+		} else {
+			vaplic_clear(vaplic->ie, irq);
+		}
+
+		if (vaplic_test(vaplic->passthru, irq)) {
+			aplic_set_enable(irq, enable && vaplic_domain_enabled(vaplic));
+		}
+		vaplic_deliver(vaplic, irq);
+	}
+}
+
+/* @pre vaplic->lock is held */
+static void vaplic_write_domaincfg(struct acrn_vaplic *vaplic, uint32_t val)
+{
+	uint32_t irq;
+
+	/* only IE is writable, the domain always runs in MSI mode */
+	vaplic->domaincfg = val & APLIC_DOMAINCFG_IE;
+	for (irq = 1U; irq < APLIC_NUM_SOURCES; irq++) {
+		if (vaplic_active(vaplic, irq)) {
+			vaplic_sync_passthru(vaplic, irq);
+			vaplic_deliver(vaplic, irq);
+		}
+	}
+}
+
+/* @pre vaplic->lock is held */
+static void vaplic_write_sourcecfg(struct acrn_vaplic *vaplic, uint32_t irq, uint32_t val)
+{
+	uint32_t sm = val & APLIC_SOURCECFG_SM_MASK;
+
+	/* there are no child domains, delegating or a reserved mode turns the source off */
+	if (((val & APLIC_SOURCECFG_D) != 0U) || (sm == 2U) || (sm == 3U)) {
+		sm = APLIC_SM_INACTIVE;
+	}
+
+	vaplic->sourcecfg[irq] = sm;
+	if (sm == APLIC_SM_INACTIVE) {
+		vaplic_clear(vaplic->pending, irq);
+		vaplic_clear(vaplic->ie, irq);
+		vaplic->target[irq] = 0U;
+	}
+	vaplic_sync_passthru(vaplic, irq);
+}
+
+/* @pre vaplic->lock is held */
+static void vaplic_write_target(struct acrn_vaplic *vaplic, uint32_t irq, uint32_t val)
+{
+	if (vaplic_active(vaplic, irq)) {
+		/* the guest index field is read-only zero, guests have no guests */
+		vaplic->target[irq] = val & ((~0U << APLIC_TARGET_HART_SHIFT) | APLIC_TARGET_EIID_MASK);
+		vaplic_sync_passthru(vaplic, irq);
+		vaplic_deliver(vaplic, irq);
+	}
+}
+
+/* @pre vaplic->lock is held */
+static void vaplic_genmsi(const struct acrn_vaplic *vaplic, uint32_t val)
+{
+	uint32_t hart = val >> APLIC_TARGET_HART_SHIFT;
+	struct acrn_vcpu *vcpu;
+
+	if (hart < vaplic->vm->hw.created_vcpus) {
+		vcpu = vcpu_from_vid(vaplic->vm, (uint16_t)hart);
+		if (vcpu->arch.imsic_file != 0U) {
+			imsic_send_msi(pcpuid_from_vcpu(vcpu), vcpu->arch.imsic_file, val & APLIC_TARGET_EIID_MASK);
+		}
+	}
+}
+
+/* source number of the per-source register at @offset, 0 if there is none */
+static inline uint32_t vaplic_source(uint32_t offset, uint32_t base)
+{
+	uint32_t irq = 0U;
+
+	if ((offset >= base) && (((offset - base) >> 2U) < (APLIC_NUM_SOURCES - 1U))) {
+		irq = ((offset - base) >> 2U) + 1U;
+	}
+
+	return irq;
+}
+
+/* index of the bitmap word at @offset, APLIC_NUM_WORDS if there is none */
+static inline uint32_t vaplic_word(uint32_t offset, uint32_t base)
+{
+	uint32_t word = APLIC_NUM_WORDS;
+
+	if ((offset >= base) && (((offset - base) >> 2U) < APLIC_NUM_WORDS)) {
+		word = (offset - base) >> 2U;
+	}
+
+	return word;
+}
+
+static uint32_t vaplic_read(const struct acrn_vaplic *vaplic, uint32_t offset)
+{
+	uint32_t irq, word, val = 0U;
+
+	if (offset == APLIC_DOMAINCFG) {
+		val = vaplic->domaincfg | APLIC_DOMAINCFG_RDONLY | APLIC_DOMAINCFG_DM;
+	} else if ((irq = vaplic_source(offset, APLIC_SOURCECFG_BASE)) != 0U) {
+		val = vaplic->sourcecfg[irq];
+	} else if ((irq = vaplic_source(offset, APLIC_TARGET_BASE)) != 0U) {
+		val = vaplic->target[irq];
+	} else if ((word = vaplic_word(offset, APLIC_SETIP_BASE)) < APLIC_NUM_WORDS) {
+		val = vaplic->pending[word];
+		if (vaplic->passthru[word] != 0U) {
+			val |= aplic_read_pending(word) & vaplic->passthru[word];
+		}
+	} else if ((word = vaplic_word(offset, APLIC_SETIE_BASE)) < APLIC_NUM_WORDS) {
+		val = vaplic->ie[word];
+	} else {
+		/* in_clrip, msiaddrcfg, genmsi (never busy) and the write-only registers */
+	}
+
+	return val;
+}
+
+static void vaplic_write(struct acrn_vaplic *vaplic, uint32_t offset, uint32_t val)
+{
+	uint32_t irq, word, bits;
+
+	if (offset == APLIC_DOMAINCFG) {
+		vaplic_write_domaincfg(vaplic, val);
+	} else if ((irq = vaplic_source(offset, APLIC_SOURCECFG_BASE)) != 0U) {
+		vaplic_write_sourcecfg(vaplic, irq, val);
+	} else if ((irq = vaplic_source(offset, APLIC_TARGET_BASE)) != 0U) {
+		vaplic_write_target(vaplic, irq, val);
+	} else if ((offset == APLIC_SETIPNUM) || (offset == APLIC_SETIPNUM_LE)) {
+		vaplic_set_pending(vaplic, val);
+	} else if (offset == APLIC_SETIPNUM_BE) {
+		vaplic_set_pending(vaplic, __builtin_bswap32(val));
+	} else if (offset == APLIC_CLRIPNUM) {
+		vaplic_clear_pending(vaplic, val);
+	} else if (offset == APLIC_SETIENUM) {
+		vaplic_set_enable(vaplic, val, true);
+	} else if (offset == APLIC_CLRIENUM) {
+		vaplic_set_enable(vaplic, val, false);
+	} else if (offset == APLIC_GENMSI) {
+		vaplic_genmsi(vaplic, val);
+	} else if (((word = vaplic_word(offset, APLIC_SETIP_BASE)) < APLIC_NUM_WORDS) ||
+			((word = vaplic_word(offset, APLIC_CLRIP_BASE)) < APLIC_NUM_WORDS) ||
+			((word = vaplic_word(offset, APLIC_SETIE_BASE)) < APLIC_NUM_WORDS) ||
+			((word = vaplic_word(offset, APLIC_CLRIE_BASE)) < APLIC_NUM_WORDS)) {
+		bits = val;
+		while (bits != 0U) {
+			irq = (word << 5U) + ffs64(bits);
+			bits &= bits - 1U;
+			if (offset < APLIC_CLRIP_BASE) {
+				vaplic_set_pending(vaplic, irq);
+			} else if (offset < APLIC_SETIE_BASE) {
+				vaplic_clear_pending(vaplic, irq);
+			} else if (offset < APLIC_CLRIE_BASE) {
+				vaplic_set_enable(vaplic, irq, true);
+			} else {
+				vaplic_set_enable(vaplic, irq, false);
+			}
+		}
+	} else {
+		/* read-only or reserved */
+	}
+}
+
+static int32_t vaplic_access_handler(struct io_request *io_req, void *private_data)
+{
+	struct acrn_vaplic *vaplic = (struct acrn_vaplic *)private_data;
+	struct acrn_mmio_request *mmio = &io_req->reqs.mmio_request;
+	uint32_t offset = (uint32_t)(mmio->address - vaplic->base);
+	uint64_t flags;
+	int32_t ret = 0;
+
+	if ((mmio->size == 4UL) && ((offset & 0x3U) == 0U)) {
+		spin_lock_irqsave(&vaplic->lock, &flags);
+		if (mmio->direction == ACRN_IOREQ_DIR_READ) {
+			mmio->value = vaplic_read(vaplic, offset);
+		} else {
+			vaplic_write(vaplic, offset, (uint32_t)mmio->value);
+		}
+		spin_unlock_irqrestore(&vaplic->lock, flags);
+	} else {
+		pr_err("All RW to APLIC must be aligned and 32-bits in size");
+		ret = -EINVAL;
+	}
+
+	return ret;
+}
+
+/*
+ * Raise (@level true) or lower a virtual source. Lowering only matters for
+ * level sources, whose pending bit follows the line.
+ */
+void vaplic_accept_intr(struct acrn_vm *vm, uint32_t irq, bool level)
+{
+	struct acrn_vaplic *vaplic = &vm->vaplic;
+	uint64_t flags;
+
+	if (vaplic->enabled) {
+		spin_lock_irqsave(&vaplic->lock, &flags);
+		if (vaplic_active(vaplic, irq)) {
+			if (level) {
+				vaplic_set(vaplic->pending, irq);
+				vaplic_deliver(vaplic, irq);
+			} else if (aplic_sm_is_level(vaplic_sm(vaplic, irq))) {
+				vaplic_clear(vaplic->pending, irq);
+			} else {
+				/* edge sources ignore the falling line */
+			}
+		}
+		spin_unlock_irqrestore(&vaplic->lock, flags);
+	}
+}
+
+/*
+ * Arm the SGEI of the guest interrupt file of @vcpu, the current vCPU of
+ * this pCPU, before it halts. Returns false if an interrupt is already
+ * pending in the file, in which case the vCPU must not wait.
+ */
+bool vaplic_arm_wakeup(struct acrn_vcpu *vcpu)
+{
+	uint64_t bit;
+	bool armed = true;
+
+	if (vcpu->arch.imsic_file != 0U) {
+		bit = 1UL << vcpu->arch.imsic_file;
+		cpu_csr_set(hgeie, bit);
+		/* hgeip is level, so anything that came in before is visible here */
+		armed = ((cpu_csr_read(hgeip) & bit) == 0UL);
+	}
+
+	return armed;
+}
+
+bool vaplic_has_pending(const struct acrn_vcpu *vcpu)
+{
+	return (vcpu->arch.imsic_file != 0U) && ((cpu_csr_read(hgeip) & (1UL << vcpu->arch.imsic_file)) != 0UL);
+}
+
+void vaplic_cancel_wakeup(struct acrn_vcpu *vcpu)
+{
+	if (vcpu->arch.imsic_file != 0U) {
+		cpu_csr_clear(hgeie, 1UL << vcpu->arch.imsic_file);
+	}
+}
+
+/* SGEI: wake up the halted vCPUs whose guest interrupt file has something pending */
+void vaplic_handle_sgei(void)
+{
+	uint16_t pcpu_id = get_pcpu_id();
+	uint64_t pending = cpu_csr_read(hgeip) & cpu_csr_read(hgeie);
+	struct acrn_vcpu *vcpu;
+	uint16_t vm_id;
+
+	/* hgeip stays set until the guest claims, disarm it or we loop here */
+	cpu_csr_clear(hgeie, pending);
+	for (vm_id = 0U; (vm_id < CONFIG_MAX_VM_NUM) && (pending != 0UL); vm_id++) {
+		vcpu = per_cpu(vcpu_array, pcpu_id)[vm_id];
+		if ((vcpu != NULL) && (vcpu->arch.imsic_file != 0U) &&
+				((pending & (1UL << vcpu->arch.imsic_file)) != 0UL)) {
+			pending &= ~(1UL << vcpu->arch.imsic_file);
+			signal_event(&vcpu->events[VCPU_EVENT_VIRTUAL_INTERRUPT]);
+		}
+	}
+}
+
+void vaplic_free_vcpu(struct acrn_vcpu *vcpu)
+{
+	if (vcpu->arch.imsic_file != 0U) {
+		imsic_free_guest_file(pcpuid_from_vcpu(vcpu), vcpu->arch.imsic_file);
+		vcpu->arch.imsic_file = 0U;
+	}
+}
+
+/*
+ * Give every vCPU of @vm a guest interrupt file, map it where the guest
+ * expects its S-level file and emulate the APLIC in front of them.
+ *
+ * @pre the vCPUs of @vm are created
+ */
+void vaplic_init(struct acrn_vm *vm)
+{
+	struct acrn_vaplic *vaplic = &vm->vaplic;
+	struct acrn_vcpu *vcpu;
+	struct s2pt_txn txn;
+	uint16_t i, pcpu_id;
+	uint32_t irq;
+	bool ready = true;
+
+	spinlock_init_class(&vaplic->lock, LOCK_CLASS_VAPLIC);
+	vaplic->vm = vm;
+	vaplic->base = CONFIG_APLIC_BASE;
+	vaplic->domaincfg = 0U;
+	(void)memset(vaplic->sourcecfg, 0U, sizeof(vaplic->sourcecfg));
+	(void)memset(vaplic->target, 0U, sizeof(vaplic->target));
+	(void)memset(vaplic->pending, 0U, sizeof(vaplic->pending));
+	(void)memset(vaplic->ie, 0U, sizeof(vaplic->ie));
+	(void)memset(vaplic->passthru, 0U, sizeof(vaplic->passthru));
+
+	if (is_service_vm(vm)) {
+		for (irq = 1U; irq < APLIC_NUM_SOURCES; irq++) {
+			if (!irq_is_host_owned(irq)) {
+				vaplic_set(vaplic->passthru, irq);
+			}
+		}
+	}
+
+	s2pt_txn_begin(&txn, vm, vm->arch_vm.s2ptp);
+	/* the guest must never see the host's files or those of other guests */
+	s2pt_txn_del_mr(&txn, CONFIG_IMSIC_BASE, (uint64_t)NR_CPUS << (imsic_guest_index_bits() + PAGE_SHIFT));
+	foreach_vcpu(i, vm, vcpu) {
+		pcpu_id = pcpuid_from_vcpu(vcpu);
+		vcpu->arch.imsic_file = imsic_alloc_guest_file(pcpu_id);
+		if (vcpu->arch.imsic_file == 0U) {
+			pr_err("no guest interrupt file left on pcpu%hu for vm%hu", pcpu_id, vm->vm_id);
+			ready = false;
+		} else {
+			s2pt_txn_add_mr(&txn, imsic_file_hpa(pcpu_id, vcpu->arch.imsic_file),
+				vaplic_imsic_gpa(vcpu->vcpu_id), PAGE_SIZE, PAGE_RW_RW | PAGE_ATTR_IO);
+		}
+	}
+	if (s2pt_txn_commit(&txn) != 0) {
+		ready = false;
+	}
+
+	register_mmio_emulation_handler(vm, vaplic_access_handler, vaplic->base,
+		vaplic->base + CONFIG_APLIC_SIZE, (void *)vaplic, false);
+
+	vaplic->enabled = ready;
+}
@@ -74,6 +74,7 @@ static inline void vclint_dump_isr(__unused const struct acrn_vclint *vclint, __
  * sending an 'ipinum' to interrupt the 'hostcpu'.
  */
 static void vclint_timer_expired(void *data);
+static void vclint_wakeup_expired(void *data);
 
 static inline bool vclint_enabled(const struct acrn_vclint *vclint)
 {
@@ -96,6 +97,9 @@ static void vclint_init_timer(struct acrn_vclint *vclint, uint32_t idx)
 	initialize_timer(&vtimer->timer,
 			vclint_timer_expired, vcpu,
 			0UL, 0UL);
+	initialize_timer(&vtimer->wakeup,
+			vclint_wakeup_expired, vcpu,
+			0UL, 0UL);
 }
 
 /**
@@ -120,11 +124,61 @@ void vclint_write_tmr(struct acrn_vclint *vclint, uint32_t index, uint64_t data)
 
 	del_timer(timer);
 	timer->mode = TICK_MODE_ONESHOT;
-	timer->timeout = data;
+	/* the guest deadline is in guest time */
+	timer->timeout = data - vclint->vm->arch_vm.htimedelta;
 	timer->period_in_cycle = 0UL;
 	(void)add_timer(timer);
 }
 
+/* interrupt context */
+static void vclint_wakeup_expired(void *data)
+{
+	struct acrn_vcpu *vcpu = data;
+
+	signal_event(&(vcpu->events[VCPU_EVENT_VIRTUAL_INTERRUPT]));
+}
+
+/* vstimecmp of a direct_timer vCPU, in host ticks */
+static uint64_t vclint_guest_deadline(struct acrn_vcpu *vcpu)
+{
+	return vcpu_get_vs_csr(vcpu, VS_CSR_TIMECMP) - vcpu->vm->arch_vm.htimedelta;
+}
+
+bool vclint_deadline_passed(struct acrn_vcpu *vcpu)
+{
+	return vclint_guest_deadline(vcpu) <= get_tick();
+}
+
+/*
+ * A vCPU using the direct (vstimecmp) timer has no hv_timer behind its
+ * guest timer. Before it blocks, arm one that only wakes it up: the
+ * interrupt itself is raised by the hardware once vstimecmp is loaded.
+ * Returns false if the deadline has already passed.
+ */
+bool vclint_arm_wakeup(struct acrn_vcpu *vcpu)
+{
+	struct acrn_vclint *vclint = vcpu_vclint(vcpu);
+	struct hv_timer *timer = &vclint->vtimer[vcpu->vcpu_id].wakeup;
+	uint64_t deadline = vclint_guest_deadline(vcpu);
+	bool ret = false;
+
+	if (deadline > get_tick()) {
+		del_timer(timer);
+		timer->mode = TICK_MODE_ONESHOT;
+		timer->timeout = deadline;
+		timer->period_in_cycle = 0UL;
+		(void)add_timer(timer);
+		ret = true;
+	}
+
+	return ret;
+}
+
+void vclint_cancel_wakeup(struct acrn_vcpu *vcpu)
+{
+	del_timer(&vcpu_vclint(vcpu)->vtimer[vcpu->vcpu_id].wakeup);
+}
+
 uint64_t vclint_get_tsc_deadline_csr(const struct acrn_vclint *vclint)
 {
 	/*
@@ -208,6 +262,20 @@ static int32_t vclint_read(struct acrn_vclint *vclint, uint32_t offset_arg, uint
 	return ret;
 }
 
+#ifndef CONFIG_MACRN
+/* A restored guest sets its clock: keep it as the htimedelta offset */
+static void vclint_set_guest_time(struct acrn_vm *vm, uint64_t now)
+{
+	struct acrn_vcpu *vcpu;
+	uint16_t i;
+
+	vm->arch_vm.htimedelta = now - get_tick();
+	foreach_vcpu(i, vm, vcpu) {
+		vcpu_set_vs_csr(vcpu, VS_CSR_TIMEDELTA, vm->arch_vm.htimedelta);
+	}
+}
+#endif
+
 static int32_t vclint_write(struct acrn_vclint *vclint, uint64_t offset, uint64_t data)
 {
 	struct clint_regs *clint = &(vclint->clint_page);
@@ -233,6 +301,9 @@ static int32_t vclint_write(struct acrn_vclint *vclint, uint64_t offset, uint64_
 			break;
 		case CLINT_OFFSET_MTIME:
 			clint->mtime = data;
+#ifndef CONFIG_MACRN
+			vclint_set_guest_time(vclint->vm, data);
+#endif
 			for (int i = 0; i < 5; i++)
 				del_timer(&vclint->vtimer[i].timer);
 			pr_info("vclint mtime %x\n", data);
@@ -261,6 +332,45 @@ void vclint_send_ipi(struct acrn_vclint *vclint, uint32_t cpu)
 	return;
 }
 
+/*
+ * Multicast version of vclint_send_ipi(): raise the software interrupt of
+ * every vCPU in vcpu_mask under one lock, then kick the pCPUs that run one
+ * of them with a single IPI. A vCPU whose msip is still set already has a
+ * request on its way, and one not running picks the request up from
+ * signal_event() or its next VM entry.
+ */
+void vclint_send_ipi_mask(struct acrn_vclint *vclint, uint64_t vcpu_mask)
+{
+	struct clint_regs *clint = &(vclint->clint_page);
+	struct acrn_vcpu *vcpu;
+	uint64_t mask = vcpu_mask, kick = 0UL;
+	uint64_t flags;
+	uint16_t vcpu_id, pcpu_id;
+
+	spin_lock_irqsave(&vclint->lock, &flags);
+	for (vcpu_id = ffs64(mask); vcpu_id < vclint->vm->hw.created_vcpus; vcpu_id = ffs64(mask)) {
+		clear_bit(vcpu_id, &mask);
+		if ((clint->msip[vcpu_id] & 0x1U) != 0U) {
+			continue;
+		}
+		clint->msip[vcpu_id] = 0x1U;
+
+		vcpu = vcpu_from_vid(vclint->vm, vcpu_id);
+		signal_event(&(vcpu->events[VCPU_EVENT_VIRTUAL_INTERRUPT]));
+		bitmap_set_lock(ACRN_REQUEST_EVENT, &vcpu->arch.pending_req);
+		pcpu_id = pcpuid_from_vcpu(vcpu);
+		/* the sender's own pCPU checks the requests before its next VM entry */
+		if ((per_cpu(vcpu_run, pcpu_id) == vcpu) && (pcpu_id != get_pcpu_id())) {
+			kick |= 1UL << pcpu_id;
+		}
+	}
+	spin_unlock_irqrestore(&vclint->lock, flags);
+
+	if (kick != 0UL) {
+		kick_pcpus(kick);
+	}
+}
+
 /*
  * @pre vclint != NULL && ops != NULL
  */
@@ -328,8 +438,10 @@ void vclint_free(struct acrn_vcpu *vcpu)
 {
 	struct acrn_vclint *vclint = vcpu_vclint(vcpu);
 
-	for (int i = 0; i < 5; i++)
+	for (int i = 0; i < 5; i++) {
 		del_timer(&vclint->vtimer[i].timer);
+		del_timer(&vclint->vtimer[i].wakeup);
+	}
 }
 
 /**
@@ -456,7 +568,7 @@ void vclint_init(struct acrn_vm *vm)
 		PAGE_U | PAGE_ATTR_IO);
 #endif
 
-	spinlock_init(&vclint->lock);
+	spinlock_init_class(&vclint->lock, LOCK_CLASS_VCLINT);
 	vclint->vm = vm;
 	vclint->clint_base = DEFAULT_CLINT_BASE;
 	vclint->ops = &acrn_vclint_ops;
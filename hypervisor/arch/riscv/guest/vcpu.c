@@ -19,6 +19,7 @@
 #include <asm/guest/virq.h>
 #include <asm/guest/vmcs.h>
 #include <asm/guest/vcsr.h>
+#include <asm/guest/vmexit.h>
 //#include <mmu.h>
 //#include <schedule.h>
 #include <sprintf.h>
@@ -95,24 +96,12 @@ void vcpu_set_sp(struct acrn_vcpu *vcpu, uint64_t val)
 
 uint64_t vcpu_get_status(struct acrn_vcpu *vcpu)
 {
-	struct run_context *ctx =
-		&vcpu->arch.contexts[vcpu->arch.cur_context].run_ctx;
-
-#ifndef CONFIG_MACRN
-	if (!bitmap_test(CPU_REG_STATUS, &vcpu->reg_updated) &&
-		!bitmap_test_and_set_lock(CPU_REG_STATUS,
-			&vcpu->reg_cached) && vcpu->launched) {
-		ctx->sstatus = cpu_csr_read(vsstatus);
-	}
-#endif
-
-	return ctx->sstatus;
+	return vcpu_get_vs_csr(vcpu, CPU_REG_STATUS);
 }
 
 void vcpu_set_status(struct acrn_vcpu *vcpu, uint64_t val)
 {
-	vcpu->arch.contexts[vcpu->arch.cur_context].run_ctx.sstatus = val;
-	bitmap_set_lock(CPU_REG_STATUS, &vcpu->reg_updated);
+	vcpu_set_vs_csr(vcpu, CPU_REG_STATUS, val);
 }
 
 uint64_t vcpu_get_guest_csr(const struct acrn_vcpu *vcpu, uint32_t csr)
@@ -194,6 +183,8 @@ static void vcpu_reset_internal(struct acrn_vcpu *vcpu, enum reset_mode mode)
 
 	vcpu->arch.exception_info.exception = VECTOR_INVALID;
 	vcpu->arch.cur_context = NORMAL_WORLD;
+	vcpu->arch.exit_stats.exit_tsc = 0UL;
+	vcpu->arch.halt_poll_window = 0UL;
 
 	for (i = 0; i < NR_WORLD; i++) {
 		(void)memset((void *)(&vcpu->arch.contexts[i]), 0U,
@@ -202,6 +193,7 @@ static void vcpu_reset_internal(struct acrn_vcpu *vcpu, enum reset_mode mode)
 
 	vclint = vcpu_vclint(vcpu);
 	vclint_reset(vclint, vclint_ops, mode);
+	vpmu_reset(vcpu);
 
 	reset_vcpu_gp_regs(vcpu);
 
@@ -322,6 +314,11 @@ int32_t run_vcpu(struct acrn_vcpu *vcpu)
 	int32_t status = 0;
 	const struct run_context *ctx =
 		&vcpu->arch.contexts[vcpu->arch.cur_context].run_ctx;
+	struct vcpu_exit_stats *stats = &vcpu->arch.exit_stats;
+
+	if (stats->exit_tsc != 0UL) {
+		exit_stats_hist_add(stats->roundtrip_hist, cpu_ticks() - stats->exit_tsc);
+	}
 
 	/* If this VCPU is not already launched, launch it */
 	if (!vcpu->launched) {
@@ -356,8 +353,10 @@ int32_t run_vcpu(struct acrn_vcpu *vcpu)
 		status = vmx_vmrun(vcpu);
 		save_vmcs(vcpu);
 	}
+	stats->exit_tsc = cpu_ticks();
 	ASSERT(current != 0);
 	vcpu->reg_cached = 0UL;
+	gva_cache_flush(vcpu);
 
 	/* Obtain current VCPU instruction length */
 	vcpu->arch.inst_len = 64;
@@ -385,6 +384,18 @@ void offline_vcpu(struct acrn_vcpu *vcpu)
 {
 	vclint_free(vcpu);
 	per_cpu(ever_run_vcpu, pcpuid_from_vcpu(vcpu)) = NULL;
+	/* drop its live VS CSRs and FP state rather than save them into a dead context */
+	if (per_cpu(vs_owner, pcpuid_from_vcpu(vcpu)) == vcpu) {
+		per_cpu(vs_owner, pcpuid_from_vcpu(vcpu)) = NULL;
+	}
+	if (per_cpu(fp_owner, pcpuid_from_vcpu(vcpu)) == vcpu) {
+		per_cpu(fp_owner, pcpuid_from_vcpu(vcpu)) = NULL;
+	}
+	/* its host counters are released when the next vCPU enters, see vpmu_load() */
+	if (per_cpu(pmu_owner, pcpuid_from_vcpu(vcpu)) == vcpu) {
+		per_cpu(pmu_owner, pcpuid_from_vcpu(vcpu)) = NULL;
+	}
+	vaplic_free_vcpu(vcpu);
 
 	/* This operation must be atomic to avoid contention with posted interrupt handler */
 	per_cpu(vcpu_array, pcpuid_from_vcpu(vcpu))[vcpu->vm->vm_id] = NULL;
@@ -402,6 +413,19 @@ void kick_vcpu(struct acrn_vcpu *vcpu)
 	}
 }
 
+/* kick_vcpu() for the vCPUs running on the pCPUs in pcpu_mask, in one IPI */
+void kick_pcpus(uint64_t pcpu_mask)
+{
+	uint64_t mask = pcpu_mask;
+	uint16_t pcpu_id;
+
+	for (pcpu_id = ffs64(mask); pcpu_id < NR_CPUS; pcpu_id = ffs64(mask)) {
+		clear_bit(pcpu_id, &mask);
+		bitmap_set_lock(NOTIFY_VCPU_SWI, &per_cpu(swi_vector, pcpu_id).type);
+	}
+	smp_ops->send_dest_ipi_mask(pcpu_mask, NOTIFY_VCPU_SWI);
+}
+
 /* NOTE:
  * vcpu should be paused before call this function.
  * @pre vcpu != NULL
@@ -436,10 +460,10 @@ void zombie_vcpu(struct acrn_vcpu *vcpu, enum vcpu_state new_state)
 	}
 }
 
-/* TODO:
- * Now we have switch_out and switch_in callbacks for each thread_object, and schedule
- * will call them every thread switch. We can implement lazy context swtich , which
- * only do context swtich when really need.
+/*
+ * VS CSRs are not switched here: they stay in the hart until another vCPU
+ * actually enters the guest on this pCPU, see load_guest_state(). Switching
+ * to the idle thread and back therefore costs nothing.
  */
 static void context_switch_out(struct thread_object *prev)
 {
@@ -44,7 +44,7 @@ emulate_pio_complete(struct acrn_vcpu *vcpu, const struct io_request *io_req)
 }
 
 #ifdef CONFIG_MACRN
-uint32_t get_instruction(struct run_context *ctx, uint32_t *xlen)
+uint32_t get_instruction(struct run_context *ctx, bool *transformed)
 {
 	uint64_t m = 0xa0000;
 	register uint32_t ins;
@@ -68,11 +68,9 @@ uint32_t get_instruction(struct run_context *ctx, uint32_t *xlen)
 	local_irq_enable();
 
 	if ((ins & 0x3) != 0x3) {
-		*xlen = 16;
 		ins &= 0xffff;
-	} else {
-		*xlen = 32;
 	}
+	*transformed = false;
 
 	return ins;
 }
@@ -104,11 +102,19 @@ static uint64_t get_gpa(struct run_context *ctx, __unused uint64_t gva)
 	return (ctx->cpu_gp_regs.regs.htval << 2) | (ctx->cpu_gp_regs.regs.tval & 0x3);
 }
 
-uint32_t get_instruction(struct run_context *ctx, __unused uint32_t *len)
+/*
+ * htinst holds the trapped instruction in transformed form, or a
+ * pseudo-instruction for implicit page-table accesses. It may also be 0 if
+ * the hart does not report it, then the instruction is read from the guest.
+ */
+uint32_t get_instruction(struct run_context *ctx, bool *transformed)
 {
-	uint64_t ins = ctx->cpu_gp_regs.regs.htinst;
+	uint32_t ins = (uint32_t)ctx->cpu_gp_regs.regs.htinst;
 
-	*len = ((ins & 0x3) == 0x1)? 16: 32;
+	*transformed = (ins != 0U);
+	if (ins == 0U) {
+		ins = fetch_guest_instruction(ctx->cpu_gp_regs.regs.hstatus, ctx->cpu_gp_regs.regs.ip);
+	}
 
 	return ins;
 }
@@ -125,7 +131,8 @@ int32_t mmio_access_vmexit_handler(struct acrn_vcpu *vcpu)
 	int32_t status = -1;
 	uint64_t exit_qual;
 	uint64_t gva, gpa;
-	uint32_t ins, xlen = 0;
+	uint32_t ins;
+	bool transformed;
 	struct io_request *io_req = &vcpu->req;
 	struct acrn_mmio_request *mmio_req = &io_req->reqs.mmio_request;
 	struct run_context *ctx =
@@ -133,7 +140,7 @@ int32_t mmio_access_vmexit_handler(struct acrn_vcpu *vcpu)
 
 	/* Handle page fault from guest */
 	exit_qual = vcpu->arch.exit_qualification;
-	ins = get_instruction(ctx, &xlen);
+	ins = get_instruction(ctx, &transformed);
 	gva = ctx->cpu_gp_regs.regs.tval;
 	if (need_pagetable_walk(ctx->satp))
 		gpa = get_gpa(ctx, gva);
@@ -149,11 +156,13 @@ int32_t mmio_access_vmexit_handler(struct acrn_vcpu *vcpu)
 		/* Write operation */
 		mmio_req->direction = ACRN_IOREQ_DIR_WRITE;
 		mmio_req->value = 0UL;
+		vpmu_fw_event(vcpu, SBI_PMU_FW_ACCESS_STORE);
 		break;
 	case HX_EXIT_PF_GUEST_LOAD:
 	case HX_EXIT_LOAD_ACCESS:
 		/* Read operation */
 		mmio_req->direction = ACRN_IOREQ_DIR_READ;
+		vpmu_fw_event(vcpu, SBI_PMU_FW_ACCESS_LOAD);
 		break;
 	default:
 		status = -1;
@@ -163,7 +172,13 @@ int32_t mmio_access_vmexit_handler(struct acrn_vcpu *vcpu)
 	}
 
 	mmio_req->address = gpa;
-	ret = decode_instruction(vcpu, ins, xlen);
+	TRACE_2L(TRACE_VMEXIT_MMIO, gpa, mmio_req->direction);
+	ret = decode_instruction(vcpu, ins, transformed);
+	if ((ret > 0) && vcpu->arch.mmio_desc.pseudo) {
+		/* the guest keeps its page tables in emulated MMIO, cannot be emulated */
+		pr_acrnlog("implicit page-table access to MMIO, htinst: 0x%x", ins);
+		ret = -EINVAL;
+	}
 	if (ret > 0) {
 		mmio_req->size = (uint64_t)ret;
 		if (gpa == INVALID_HPA) {
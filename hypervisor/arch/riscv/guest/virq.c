@@ -16,12 +16,19 @@
 #include <asm/guest/vmcs.h>
 #include <asm/guest/vm.h>
 #include <asm/guest/virq.h>
+#include <asm/guest/s2vm.h>
+#include <asm/tlb.h>
 #include <trace.h>
 #include <logmsg.h>
 
 #define EXCEPTION_ERROR_CODE_VALID  8U
 #define DBG_LEVEL_INTR	6U
 
+#define SSTATUS_SIE		(1UL << 1U)
+#define SSTATUS_SPIE		(1UL << 5U)
+#define SSTATUS_SPP		(1UL << 8U)
+#define HSTATUS_SPVP		(1UL << 8U)
+
 static const uint16_t exception_type[32] = {
 	[0] = HX_INT_TYPE_HW_EXP,
 	[1] = HX_INT_TYPE_HW_EXP,
@@ -60,10 +67,8 @@ static const uint16_t exception_type[32] = {
 static bool is_guest_irq_enabled(struct acrn_vcpu *vcpu)
 {
 	uint64_t ie = 0;
-	struct run_context *ctx =
-		&vcpu->arch.contexts[vcpu->arch.cur_context].run_ctx;
 
-	ie = ctx->sie & 0x222;
+	ie = vcpu_get_vs_csr(vcpu, VS_CSR_SIE) & 0x222;
 	pr_dbg("%s: ie 0x%lx", __func__, ie);
 
 	return !!ie;
@@ -182,6 +187,38 @@ void vcpu_inject_ss(struct acrn_vcpu *vcpu)
 {
 }
 
+#ifndef CONFIG_MACRN
+/*
+ * Hand a synchronous exception taken in VS/VU-mode back to the guest, as if
+ * the hart had delegated it: vsepc/vscause/vstval take the trap, vsstatus.SIE
+ * moves to SPIE, SPP records the guest privilege, and the guest resumes in
+ * VS-mode at vstvec. Exceptions always use the vstvec base.
+ */
+void vcpu_redirect_exception(struct acrn_vcpu *vcpu, uint64_t cause, uint64_t tval)
+{
+	struct cpu_regs *regs = &vcpu->arch.contexts[vcpu->arch.cur_context].run_ctx.cpu_gp_regs.regs;
+	uint64_t status = vcpu_get_vs_csr(vcpu, CPU_REG_STATUS);
+	uint64_t new_status = status & ~(SSTATUS_SPP | SSTATUS_SPIE | SSTATUS_SIE);
+
+	if ((status & SSTATUS_SIE) != 0UL) {
+		new_status |= SSTATUS_SPIE;
+	}
+	if ((regs->status & SSTATUS_SPP) != 0UL) {
+		new_status |= SSTATUS_SPP;
+	}
+
+	vcpu_set_vs_csr(vcpu, CPU_REG_STATUS, new_status);
+	vcpu_set_vs_csr(vcpu, VS_CSR_SEPC, regs->ip);
+	vcpu_set_vs_csr(vcpu, VS_CSR_SCAUSE, cause);
+	vcpu_set_vs_csr(vcpu, VS_CSR_STVAL, tval);
+
+	/* sret from the exit lands in VS-mode */
+	regs->status |= SSTATUS_SPP;
+	regs->hstatus |= HSTATUS_SPVP;
+	vcpu_set_gpreg(vcpu, CPU_REG_IP, vcpu_get_vs_csr(vcpu, VS_CSR_STVEC) & ~3UL);
+}
+#endif
+
 int32_t interrupt_window_vmexit_handler(struct acrn_vcpu *vcpu)
 {
 	/* Disable interrupt-window exiting first.
@@ -252,13 +289,20 @@ int32_t acrn_handle_pending_request(struct acrn_vcpu *vcpu)
 		}
 
 		if (bitmap_test_and_clear_lock(ACRN_REQUEST_VPID_FLUSH,	pending_req_bits)) {
-			//flush_vpid_single(arch->vpid);
+			/* deferred guest remote sfence.vma, hfence.vvma needs the VM in hgatp */
+			s2vm_restore_state(vcpu);
+			flush_vs_tlb_all();
 		}
 
 		if (bitmap_test_and_clear_lock(ACRN_REQUEST_EOI_EXIT_BITMAP_UPDATE, pending_req_bits)) {
 			vcpu_set_vmcs_eoi_exit(vcpu);
 		}
 
+		if (bitmap_test_and_clear_lock(ACRN_REQUEST_LCOFI, pending_req_bits)) {
+			/* raised through hvip on entry, the guest clears it in sip */
+			vcpu->arch.contexts[vcpu->arch.cur_context].run_ctx.sip |= SIP_LCOFIP;
+		}
+
 		/*
 		 * Inject pending exception prior pending interrupt to complete the previous instruction.
 		 */
@@ -160,3 +160,18 @@ vm_exit:
 	cpu_enable_irq
 	li a0, 0
 	ret
+
+/*
+ * stvec while the hypervisor loads from the guest with hlv/hlvx: scause of
+ * a fault is stored at the address in a0, and the 4-byte load is skipped.
+ * a1 is clobbered.
+ */
+	.balign 4
+	.global unpriv_trap
+unpriv_trap:
+	csrr a1, scause
+	sd a1, 0(a0)
+	csrr a1, sepc
+	addi a1, a1, 4
+	csrw sepc, a1
+	sret
@@ -238,7 +238,9 @@ static void allocate_guest_memory(struct acrn_vm *vm, struct kernel_info *info)
 {
 	uint64_t gpa = info->mem_start_gpa;
 	uint64_t hpa = gpa;
-	s2pt_add_mr(vm, vm->arch_vm.s2ptp, hpa, gpa, info->mem_size_gpa, PAGE_V | PAGE_RW_RW | PAGE_X);
+	if (s2pt_add_mr(vm, vm->arch_vm.s2ptp, hpa, gpa, info->mem_size_gpa, PAGE_V | PAGE_RW_RW | PAGE_X) != 0) {
+		pr_fatal("vm%hu: unable to map guest memory", vm->vm_id);
+	}
 }
 
 #ifndef CONFIG_MACRN
@@ -266,10 +268,16 @@ static int map_irq_to_vm(struct acrn_vm *vm, unsigned int irq)
 
 static void passthru_devices_to_vm(struct acrn_vm *vm)
 {
-	s2pt_add_mr(vm, vm->arch_vm.s2ptp, SOS_DEVICE_MMIO_START, SOS_DEVICE_MMIO_START,
+	struct s2pt_txn txn;
+
+	s2pt_txn_begin(&txn, vm, vm->arch_vm.s2ptp);
+	s2pt_txn_add_mr(&txn, SOS_DEVICE_MMIO_START, SOS_DEVICE_MMIO_START,
 			CONFIG_PLIC_BASE, PAGE_V | PAGE_ATTR_IO);
-	s2pt_add_mr(vm, vm->arch_vm.s2ptp, CONFIG_UART_BASE + 0x1000, CONFIG_UART_BASE + 0x1000,
+	s2pt_txn_add_mr(&txn, CONFIG_UART_BASE + 0x1000, CONFIG_UART_BASE + 0x1000,
 			SOS_DEVICE_MMIO_SIZE - (CONFIG_UART_BASE + 0x1000), PAGE_V | PAGE_ATTR_IO);
+	if (s2pt_txn_commit(&txn) != 0) {
+		pr_err("vm%hu: unable to map the pass-through devices", vm->vm_id);
+	}
 
 	for (int irq = 32; irq < 992; irq++) {
 		map_irq_to_vm(vm, irq);
@@ -303,7 +311,7 @@ int create_vm(struct acrn_vm *vm)
 	s2pt_init(vm);
 
 	pr_info("allocate memory for guest");
-	spinlock_init(&vm->emul_mmio_lock);
+	spinlock_init_class(&vm->emul_mmio_lock, LOCK_CLASS_EMUL_MMIO);
 
 	allocate_guest_memory(vm, kinfo);
 	pr_info("load kernel and dtb");
@@ -319,7 +327,7 @@ int create_vm(struct acrn_vm *vm)
 #endif
 
 	vclint_init(vm);
-	if (is_service_vm(vm))
+	if (is_service_vm(vm) && !aia_available())
 		vplic_init(vm);
 
 	for (i = 0 ; i < CONFIG_MAX_VCPU; /*vm->max_vcpu*/ i++) {
@@ -327,6 +335,10 @@ int create_vm(struct acrn_vm *vm)
 		pr_info("create_vcpu\n");
 	}
 
+	/* guest interrupt files are per vCPU */
+	if (is_service_vm(vm) && aia_available())
+		vaplic_init(vm);
+
 	if (is_service_vm(vm)) {
 		vcpu = &vm->hw.vcpu[0];
 		ctx = &vcpu->arch.contexts[vcpu->arch.cur_context];
@@ -381,6 +393,7 @@ int32_t shutdown_vm(struct acrn_vm *vm)
 	offline_vcpu(&vm->hw.vcpu[0]);
 
 	deinit_vuarts(vm);
+	s2pt_deinit(vm);
 
 	/* Return status to caller */
 	return 0;
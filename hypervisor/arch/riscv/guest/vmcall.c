@@ -16,6 +16,7 @@
 #include <asm/guest/virq.h>
 #include <acrn_hv_defs.h>
 #include <hypercall.h>
+#include <common/sbuf.h>
 #include <trace.h>
 #include <logmsg.h>
 #include "sbi.h"
@@ -36,6 +37,43 @@ int32_t hcall_set_irqline(__unused struct acrn_vcpu *vcpu, struct acrn_vm *targe
 	return ret;
 }
 
+int32_t hcall_setup_sbuf(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm,
+	__unused uint64_t param1, uint64_t param2)
+{
+	struct acrn_vm *vm = vcpu->vm;
+	struct acrn_sbuf_param asp;
+	uint64_t *hva;
+	int32_t ret = -1;
+
+	if (copy_from_gpa(vm, &asp, param2, sizeof(asp)) == 0) {
+		if (asp.gpa != 0U) {
+			hva = (uint64_t *)gpa2hva(vm, asp.gpa);
+			ret = sbuf_setup_common(target_vm, asp.cpu_id, asp.sbuf_id, hva);
+		}
+	}
+
+	return ret;
+}
+
+int32_t hcall_get_vcpu_exit_stats(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm,
+	__unused uint64_t param1, uint64_t param2)
+{
+	struct acrn_vm *vm = vcpu->vm;
+	struct acrn_vcpu_exit_stats stats;
+	int32_t ret = -1;
+
+	if ((copy_from_gpa(vm, &stats.vcpu_id, param2, sizeof(stats.vcpu_id)) == 0) &&
+			(stats.vcpu_id < target_vm->hw.created_vcpus)) {
+		stats.reserved[0] = 0U;
+		stats.reserved[1] = 0U;
+		stats.reserved[2] = 0U;
+		vcpu_exit_stats_snapshot(vcpu_from_vid(target_vm, stats.vcpu_id), &stats);
+		ret = copy_to_gpa(vm, &stats, param2, sizeof(stats));
+	}
+
+	return ret;
+}
+
 static int32_t dispatch_sos_hypercall(struct acrn_vcpu *vcpu, uint64_t hypcall_id)
 {
 	struct acrn_vm *sos_vm = vcpu->vm;
@@ -139,6 +177,17 @@ static int32_t dispatch_sos_hypercall(struct acrn_vcpu *vcpu, uint64_t hypcall_i
 		}
 		break;
 
+	case HC_SETUP_SBUF:
+		ret = hcall_setup_sbuf(vcpu, sos_vm, param1, param2);
+		break;
+
+	case HC_GET_VCPU_EXIT_STATS:
+		/* param1: relative vmid to sos, vm_id: absolute vmid */
+		if ((vm_id < CONFIG_MAX_VM_NUM) && !is_poweroff_vm(target_vm)) {
+			ret = hcall_get_vcpu_exit_stats(vcpu, target_vm, param1, param2);
+		}
+		break;
+
 	case HC_VM_SET_MEMORY_REGIONS:
 		ret = hcall_set_vm_memory_regions(vcpu, sos_vm, param1, param2);
 		break;
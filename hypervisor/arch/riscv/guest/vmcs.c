@@ -16,6 +16,8 @@
 #include <asm/pgtable.h>
 #include <asm/per_cpu.h>
 #include <asm/init.h>
+#include <asm/float.h>
+#include <asm/aia.h>
 //#include <cpu_caps.h>
 //#include <cpufeatures.h>
 #include <asm/guest/vcsr.h>
@@ -23,63 +25,358 @@
 #include <asm/guest/s2vm.h>
 #include <logmsg.h>
 
+static uint64_t *vs_csr_field(struct run_context *ctx, uint32_t idx)
+{
+	uint64_t *field;
+
+	switch (idx) {
+	case CPU_REG_STATUS:
+		field = &ctx->sstatus;
+		break;
+	case VS_CSR_SEPC:
+		field = &ctx->sepc;
+		break;
+	case VS_CSR_SIE:
+		field = &ctx->sie;
+		break;
+	case VS_CSR_STVEC:
+		field = &ctx->stvec;
+		break;
+	case VS_CSR_SSCRATCH:
+		field = &ctx->sscratch;
+		break;
+	case VS_CSR_STVAL:
+		field = &ctx->stval;
+		break;
+	case VS_CSR_SCAUSE:
+		field = &ctx->scause;
+		break;
+	case VS_CSR_SATP:
+		field = &ctx->satp;
+		break;
+	case VS_CSR_TIMECMP:
+		field = &ctx->vstimecmp;
+		break;
+	default:
+		field = &ctx->htimedelta;
+		break;
+	}
+
+	return field;
+}
+
 #ifndef CONFIG_MACRN
+#define HSTATUS_VTW		(1UL << 21U)
+
+/*
+ * VS CSRs are switched lazily. They stay live in the hart across VM exits
+ * and are only saved when another vCPU enters on the same pCPU (vs_owner).
+ * Between exits, the run_context copy is refreshed on demand through
+ * reg_cached, and hypervisor writes flagged in reg_updated are written
+ * back on the next entry. Only vsip/hvip, the interrupt injection channel,
+ * are still synced on every exit and entry.
+ */
+#define VS_CSR_LAZY_MASK	((1UL << CPU_REG_STATUS) | (1UL << VS_CSR_SEPC) |	\
+				 (1UL << VS_CSR_SIE) | (1UL << VS_CSR_STVEC) |		\
+				 (1UL << VS_CSR_SSCRATCH) | (1UL << VS_CSR_STVAL) |	\
+				 (1UL << VS_CSR_SCAUSE) | (1UL << VS_CSR_SATP) |	\
+				 (1UL << VS_CSR_TIMEDELTA))
+
+static inline uint64_t vs_csr_mask(const struct acrn_vcpu *vcpu)
+{
+	uint64_t mask = VS_CSR_LAZY_MASK;
+
+	if (vcpu->arch.direct_timer) {
+		mask |= (1UL << VS_CSR_TIMECMP);
+	}
+
+	return mask;
+}
+
+static uint64_t read_vs_csr(uint32_t idx)
+{
+	uint64_t val;
+
+	switch (idx) {
+	case CPU_REG_STATUS:
+		val = cpu_csr_read(vsstatus);
+		break;
+	case VS_CSR_SEPC:
+		val = cpu_csr_read(vsepc);
+		break;
+	case VS_CSR_SIE:
+		val = cpu_csr_read(vsie);
+		break;
+	case VS_CSR_STVEC:
+		val = cpu_csr_read(vstvec);
+		break;
+	case VS_CSR_SSCRATCH:
+		val = cpu_csr_read(vsscratch);
+		break;
+	case VS_CSR_STVAL:
+		val = cpu_csr_read(vstval);
+		break;
+	case VS_CSR_SCAUSE:
+		val = cpu_csr_read(vscause);
+		break;
+	case VS_CSR_SATP:
+		val = cpu_csr_read(vsatp);
+		break;
+	case VS_CSR_TIMECMP:
+		val = cpu_csr_read(CSR_VSTIMECMP);
+		break;
+	default:
+		val = cpu_csr_read(htimedelta);
+		break;
+	}
+
+	return val;
+}
+
+static void write_vs_csr(uint32_t idx, uint64_t value)
+{
+	switch (idx) {
+	case CPU_REG_STATUS:
+		cpu_csr_write(vsstatus, value);
+		break;
+	case VS_CSR_SEPC:
+		cpu_csr_write(vsepc, value);
+		break;
+	case VS_CSR_SIE:
+		cpu_csr_write(vsie, value);
+		break;
+	case VS_CSR_STVEC:
+		cpu_csr_write(vstvec, value);
+		break;
+	case VS_CSR_SSCRATCH:
+		cpu_csr_write(vsscratch, value);
+		break;
+	case VS_CSR_STVAL:
+		cpu_csr_write(vstval, value);
+		break;
+	case VS_CSR_SCAUSE:
+		cpu_csr_write(vscause, value);
+		break;
+	case VS_CSR_SATP:
+		cpu_csr_write(vsatp, value);
+		break;
+	case VS_CSR_TIMECMP:
+		cpu_csr_write(CSR_VSTIMECMP, value);
+		break;
+	default:
+		cpu_csr_write(htimedelta, value);
+		break;
+	}
+}
+
+static inline bool is_vs_state_live(const struct acrn_vcpu *vcpu)
+{
+	return (get_cpu_var(vs_owner) == vcpu);
+}
+
+/*
+ * @pre idx is CPU_REG_STATUS or an enum vs_csr_name
+ */
+uint64_t vcpu_get_vs_csr(struct acrn_vcpu *vcpu, uint32_t idx)
+{
+	uint64_t *field = vs_csr_field(&vcpu->arch.contexts[vcpu->arch.cur_context].run_ctx, idx);
+
+	if (is_vs_state_live(vcpu) && ((vs_csr_mask(vcpu) & (1UL << idx)) != 0UL) &&
+			!bitmap_test((uint16_t)idx, &vcpu->reg_updated) &&
+			!bitmap_test_and_set_lock((uint16_t)idx, &vcpu->reg_cached)) {
+		*field = read_vs_csr(idx);
+	}
+
+	return *field;
+}
+
+void vcpu_set_vs_csr(struct acrn_vcpu *vcpu, uint32_t idx, uint64_t val)
+{
+	*vs_csr_field(&vcpu->arch.contexts[vcpu->arch.cur_context].run_ctx, idx) = val;
+	bitmap_set_lock((uint16_t)idx, &vcpu->reg_updated);
+	if (idx == VS_CSR_SATP) {
+		gva_cache_flush(vcpu);
+	}
+}
+
+/* Pull everything of @vcpu that is only live in the hart into its context */
+static void save_vs_state(struct acrn_vcpu *vcpu)
+{
+	struct run_context *ctx = &vcpu->arch.contexts[vcpu->arch.cur_context].run_ctx;
+	uint64_t stale = vs_csr_mask(vcpu) & ~(vcpu->reg_updated | vcpu->reg_cached);
+	uint16_t idx;
+
+	idx = ffs64(stale);
+	while (idx < 64U) {
+		bitmap_clear_nolock(idx, &stale);
+		*vs_csr_field(ctx, idx) = read_vs_csr(idx);
+		idx = ffs64(stale);
+	}
+}
+
+/*
+ * Make @vcpu the owner of this hart's VS CSRs. A previous owner is saved
+ * first, unless @vcpu itself still owns them (re-initialization).
+ * Returns the CSRs that have to be written from @vcpu's context.
+ */
+static uint64_t claim_vs_state(struct acrn_vcpu *vcpu, bool force)
+{
+	struct acrn_vcpu **owner = &get_cpu_var(vs_owner);
+	uint64_t mask = vs_csr_mask(vcpu);
+	uint64_t dirty = vcpu->reg_updated & mask;
+
+	if (*owner != vcpu) {
+		if (*owner != NULL) {
+			save_vs_state(*owner);
+		}
+		*owner = vcpu;
+		dirty = mask;
+	} else if (force) {
+		dirty = mask;
+	} else {
+		/* still live, only what the hypervisor changed */
+	}
+
+	return dirty;
+}
+
+static void restore_vs_state(struct acrn_vcpu *vcpu, uint64_t dirty)
+{
+	struct run_context *ctx = &vcpu->arch.contexts[vcpu->arch.cur_context].run_ctx;
+	uint16_t idx;
+
+	idx = ffs64(dirty);
+	while (idx < 64U) {
+		bitmap_clear_nolock(idx, &dirty);
+		(void)bitmap_test_and_clear_lock(idx, &vcpu->reg_updated);
+		write_vs_csr(idx, *vs_csr_field(ctx, idx));
+		idx = ffs64(dirty);
+	}
+}
+
+/*
+ * FP and vector registers are switched lazily too, driven by the guest's
+ * HS-level sstatus.FS/VS (regs.status): with V=1, any write to them also
+ * marks that field Dirty. They are only saved when another vCPU enters on
+ * the same pCPU (fp_owner), and only if the owner modified them since its
+ * last save. Guest vsstatus.FS/VS is left entirely to the guest.
+ */
+static void save_fp_state(struct acrn_vcpu *vcpu)
+{
+	uint64_t *status = &vcpu->arch.contexts[vcpu->arch.cur_context].run_ctx.cpu_gp_regs.regs.status;
+
+	if ((*status & SSTATUS_FS) == SSTATUS_FS_DIRTY) {
+		fp_save(&vcpu->arch.fp);
+		*status = (*status & ~SSTATUS_FS) | SSTATUS_FS_CLEAN;
+	}
+
+	if ((*status & SSTATUS_VS) == SSTATUS_VS_DIRTY) {
+		vector_save(&vcpu->arch.vec);
+		*status = (*status & ~SSTATUS_VS) | SSTATUS_VS_CLEAN;
+	}
+}
+
+static void restore_fp_state(struct acrn_vcpu *vcpu)
+{
+	uint64_t status = vcpu->arch.contexts[vcpu->arch.cur_context].run_ctx.cpu_gp_regs.regs.status;
+
+	/* Initial still restores, the hart holds whatever the last owner left */
+	if ((status & SSTATUS_FS) != 0UL) {
+		fp_restore(&vcpu->arch.fp);
+	}
+
+	if ((status & SSTATUS_VS) != 0UL) {
+		vector_restore(&vcpu->arch.vec);
+	}
+}
+
+static void claim_fp_state(struct acrn_vcpu *vcpu, bool force)
+{
+	struct acrn_vcpu **owner = &get_cpu_var(fp_owner);
+
+	if (*owner != vcpu) {
+		if (*owner != NULL) {
+			save_fp_state(*owner);
+		}
+		*owner = vcpu;
+		restore_fp_state(vcpu);
+	} else if (force) {
+		restore_fp_state(vcpu);
+	} else {
+		/* still live */
+	}
+}
+
+/*
+ * Let the hypervisor itself use the FP/vector registers of this pCPU: save
+ * the owner's state if it modified it, and have its next entry restore it.
+ *
+ * @pre interrupts are disabled
+ */
+void release_fp_state(void)
+{
+	struct acrn_vcpu **owner = &get_cpu_var(fp_owner);
+
+	if (*owner != NULL) {
+		save_fp_state(*owner);
+		*owner = NULL;
+	}
+}
+
+/* VSSIP/VSTIP/VSEIP sit one bit up in hvip, LCOFI at its own bit (hvien) */
+static inline uint64_t sip_to_hvip(uint64_t sip)
+{
+	return ((sip & 0x222UL) << 1) | (sip & SIP_LCOFIP);
+}
+
 static void init_guest_state(struct acrn_vcpu *vcpu)
 {
 	struct guest_cpu_context *ctx = &vcpu->arch.contexts[vcpu->arch.cur_context];
 
 	vcpu_set_gpreg(vcpu, OFFSET_REG_A0, vcpu->vcpu_id);
-	cpu_csr_write(vsstatus, ctx->run_ctx.sstatus);
-	cpu_csr_write(vsepc, ctx->run_ctx.sepc);
+	(void)memset(&vcpu->arch.fp, 0U, sizeof(vcpu->arch.fp));
+	(void)memset(&vcpu->arch.vec, 0U, sizeof(vcpu->arch.vec));
+	claim_fp_state(vcpu, true);
+	ctx->run_ctx.htimedelta = vcpu->vm->arch_vm.htimedelta;
+	/* the vstimecmp reset value is unspecified, keep the timer quiet until set */
+	ctx->run_ctx.vstimecmp = ~0UL;
+	restore_vs_state(vcpu, claim_vs_state(vcpu, true));
 	cpu_csr_write(vsip, ctx->run_ctx.sip);
-	cpu_csr_write(hvip, (ctx->run_ctx.sip & 0x202) << 1);
-	cpu_csr_write(vsie, ctx->run_ctx.sie);
-	cpu_csr_write(hie, (ctx->run_ctx.sie & 0x222) << 1);
-	cpu_csr_write(vstvec, ctx->run_ctx.stvec);
-	cpu_csr_write(vsscratch, ctx->run_ctx.sscratch);
-	cpu_csr_write(vstval, ctx->run_ctx.stval);
-	cpu_csr_write(vscause, ctx->run_ctx.scause);
-	cpu_csr_write(vsatp, ctx->run_ctx.satp);
+	cpu_csr_write(hvip, sip_to_hvip(ctx->run_ctx.sip));
 }
 
 static void load_guest_state(struct acrn_vcpu *vcpu)
 {
 	struct guest_cpu_context *ctx = &vcpu->arch.contexts[vcpu->arch.cur_context];
 
-	cpu_csr_write(vsstatus, ctx->run_ctx.sstatus);
-	cpu_csr_write(vsepc, ctx->run_ctx.sepc);
-	cpu_csr_write(hvip, (ctx->run_ctx.sip & 0x202) << 1);
-	cpu_csr_write(hie, (ctx->run_ctx.sie & 0x222) << 1);
-	cpu_csr_write(vstvec, ctx->run_ctx.stvec);
-	cpu_csr_write(vsscratch, ctx->run_ctx.sscratch);
-	cpu_csr_write(vstval, ctx->run_ctx.stval);
-	cpu_csr_write(vscause, ctx->run_ctx.scause);
-	cpu_csr_write(vsatp, ctx->run_ctx.satp);
+	restore_vs_state(vcpu, claim_vs_state(vcpu, false));
+	claim_fp_state(vcpu, false);
+	vpmu_load(vcpu);
+	cpu_csr_write(hvip, sip_to_hvip(ctx->run_ctx.sip));
 }
 
 static void save_guest_state(struct acrn_vcpu *vcpu)
 {
 	struct guest_cpu_context *ctx = &vcpu->arch.contexts[vcpu->arch.cur_context];
 
-	ctx->run_ctx.sstatus = cpu_csr_read(vsstatus);
-	ctx->run_ctx.sepc = cpu_csr_read(vsepc);
+	/* the rest stays live in the hart, see vcpu_get_vs_csr() */
 	ctx->run_ctx.sip = cpu_csr_read(vsip);
-	ctx->run_ctx.sie = cpu_csr_read(vsie);
-	ctx->run_ctx.stvec = cpu_csr_read(vstvec);
-	ctx->run_ctx.sscratch = cpu_csr_read(vsscratch);
-	ctx->run_ctx.stval = cpu_csr_read(vstval);
-	ctx->run_ctx.scause = cpu_csr_read(vscause);
-	ctx->run_ctx.satp = cpu_csr_read(vsatp);
+	/*
+	 * With a guest interrupt file, vsip.SEIP mirrors hgeip[VGEIN] and has
+	 * no vPLIC to clear it: never latch it into hvip.VSEIP.
+	 */
+	if (vcpu->arch.imsic_file != 0U) {
+		ctx->run_ctx.sip &= ~CLINT_VECTOR_SEI;
+	}
+	/* likewise vsip.STIP follows vstimecmp when the guest owns the timer */
+	if (vcpu->arch.direct_timer) {
+		ctx->run_ctx.sip &= ~CLINT_VECTOR_STI;
+	}
 }
 
 static void load_host_state(struct acrn_vcpu *vcpu)
 {
-	uint64_t osatp;
-	uint64_t s2pt_satp = vcpu->vm->arch_vm.s2pt_satp;
-
-	osatp = cpu_csr_read(hgatp);
-	if (osatp != s2pt_satp)
-		s2pt_flush_guest(vcpu->vm);
+	s2vm_restore_state(vcpu);
 }
 
 static void init_host_state(struct acrn_vcpu *vcpu)
@@ -89,11 +386,21 @@ static void init_host_state(struct acrn_vcpu *vcpu)
 
 	pr_dbg("Initialize host state");
 	value64 = 0x200000180;
+	/* trap guest WFI so a halted vCPU gives up its pCPU, see hlt_vmexit_handler() */
+	value64 |= HSTATUS_VTW;
+	/* VS-level external interrupts come straight from the guest interrupt file */
+	value64 |= (uint64_t)vcpu->arch.imsic_file << HSTATUS_VGEIN_SHIFT;
 	cpu_csr_set(hstatus, value64);
 	ctx->run_ctx.cpu_gp_regs.regs.hstatus = value64;
 
 	/* must set the SPP in order to enter into guest s-mode */
-	value64 = 0x2000C2100;
+	value64 = 0x2000C0100;
+	if (has_fpu()) {
+		value64 |= SSTATUS_FS_INITIAL;
+	}
+	if (has_vector()) {
+		value64 |= SSTATUS_VS_INITIAL;
+	}
 	cpu_csr_set(sstatus, value64);
 	ctx->run_ctx.cpu_gp_regs.regs.status = value64;
 
@@ -103,13 +410,20 @@ static void init_host_state(struct acrn_vcpu *vcpu)
 	value64 = 0xf0bfff;
 	cpu_csr_write(hedeleg, value64);
 
-	value64 = 0xc000000000000000;
+#ifdef CONFIG_GUEST_SSTC
+	value64 = HENVCFG_STCE | HENVCFG_PBMTE;
+#else
+	value64 = HENVCFG_PBMTE;
+#endif
 	cpu_csr_write(henvcfg, value64);
+	/* STCE is WARL and reads back as 0 on harts without Sstc */
+	vcpu->arch.direct_timer = ((cpu_csr_read(henvcfg) & HENVCFG_STCE) != 0UL);
 
+	/* cycle, time and instret, vpmu_load() adds the counters the guest set up */
 	value64 = 0x7;
 	cpu_csr_write(hcounteren, value64);
 
-	s2pt_flush_guest(vcpu->vm);
+	s2vm_restore_state(vcpu);
 }
 
 static inline void load_guest_pmp(struct acrn_vcpu *vcpu) {}
@@ -162,6 +476,20 @@ static void save_guest_state(struct acrn_vcpu *vcpu)
 	ctx->run_ctx.satp = cpu_csr_read(satp);
 }
 
+/* the guest runs in real S-mode and its CSRs are switched eagerly */
+uint64_t vcpu_get_vs_csr(struct acrn_vcpu *vcpu, uint32_t idx)
+{
+	return *vs_csr_field(&vcpu->arch.contexts[vcpu->arch.cur_context].run_ctx, idx);
+}
+
+void vcpu_set_vs_csr(struct acrn_vcpu *vcpu, uint32_t idx, uint64_t val)
+{
+	*vs_csr_field(&vcpu->arch.contexts[vcpu->arch.cur_context].run_ctx, idx) = val;
+	if (idx == VS_CSR_SATP) {
+		gva_cache_flush(vcpu);
+	}
+}
+
 #define load_host_state(vcpu) do {} while(0)
 
 static void init_host_state(struct acrn_vcpu *vcpu)
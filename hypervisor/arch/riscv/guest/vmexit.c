@@ -17,6 +17,9 @@
 #include <asm/guest/vio.h>
 #include <asm/guest/s2vm.h>
 #include <asm/guest/vcsr.h>
+#include <asm/guest/guest_memory.h>
+#include <schedule.h>
+#include <ticks.h>
 #include <trace.h>
 #include <logmsg.h>
 
@@ -29,11 +32,83 @@ static int32_t unhandled_vmexit_handler(struct acrn_vcpu *vcpu)
 	return 0;
 }
 
+#define HALT_POLL_START_US	10U
+
+/* anything that would end the halt, without arming a wake-up for it */
+static bool halt_has_wakeup(struct acrn_vcpu *vcpu)
+{
+	return (vcpu->arch.pending_req != 0UL) || vclint_has_pending_intr(vcpu) ||
+		vcpu->events[VCPU_EVENT_VIRTUAL_INTERRUPT].set || vaplic_has_pending(vcpu) ||
+		(vcpu->arch.direct_timer && vclint_deadline_passed(vcpu));
+}
+
+/* spin for up to window ticks, interrupts on, unless another thread wants the pCPU */
+static bool halt_poll(struct acrn_vcpu *vcpu, uint64_t window)
+{
+	uint16_t pcpu_id = pcpuid_from_vcpu(vcpu);
+	uint64_t end = cpu_ticks() + window;
+	bool woken;
+
+	do {
+		woken = halt_has_wakeup(vcpu);
+		if (woken || need_reschedule(pcpu_id)) {
+			break;
+		}
+		cpu_relax();
+	} while (cpu_ticks() < end);
+
+	return woken;
+}
+
+/*
+ * Like KVM halt polling: the window grows while wake-ups come in shortly
+ * after it ends, and shrinks once the vCPU sleeps for longer than the
+ * largest window anyway.
+ */
+static void halt_poll_adjust(struct acrn_vcpu *vcpu, uint64_t halted)
+{
+	uint64_t window = vcpu->arch.halt_poll_window;
+	uint64_t max = us_to_ticks(CONFIG_HALT_POLL_MAX_US);
+
+	if (halted <= window) {
+		/* the poll caught it */
+	} else if (halted > max) {
+		window >>= 1U;
+	} else if (window < max) {
+		window = (window == 0UL) ? us_to_ticks(HALT_POLL_START_US) : (window << 1U);
+		window = min(window, max);
+	} else {
+		/* already at the largest window */
+	}
+	vcpu->arch.halt_poll_window = window;
+}
+
 static int32_t hlt_vmexit_handler(struct acrn_vcpu *vcpu)
 {
-	if ((vcpu->arch.pending_req == 0UL) && (!vclint_has_pending_intr(vcpu))) {
-		wait_event(&vcpu->events[VCPU_EVENT_VIRTUAL_INTERRUPT]);
+	struct vcpu_exit_stats *stats = &vcpu->arch.exit_stats;
+	uint64_t window = vcpu->arch.halt_poll_window;
+	uint64_t start = cpu_ticks();
+
+	if ((window != 0UL) && halt_poll(vcpu, window)) {
+		stats->halt_poll_hits++;
+	} else {
+		if (window != 0UL) {
+			stats->halt_poll_misses++;
+		}
+		if ((vcpu->arch.pending_req == 0UL) && (!vclint_has_pending_intr(vcpu))) {
+			if ((!vcpu->arch.direct_timer || vclint_arm_wakeup(vcpu)) && vaplic_arm_wakeup(vcpu)) {
+				wait_event(&vcpu->events[VCPU_EVENT_VIRTUAL_INTERRUPT]);
+			} else {
+				/* vstimecmp already expired or the guest interrupt file has something pending */
+			}
+			if (vcpu->arch.direct_timer) {
+				vclint_cancel_wakeup(vcpu);
+			}
+			vaplic_cancel_wakeup(vcpu);
+		}
 	}
+
+	halt_poll_adjust(vcpu, cpu_ticks() - start);
 	return 0;
 }
 
@@ -138,6 +213,8 @@ static const struct vm_exit_dispatch interrupt_dispatch_table[NR_HX_EXIT_IRQ_REA
 		.handler = mexti_vmexit_handler},
 	[HX_EXIT_IRQ_GUEST_SEXT] = {
 		.handler = unhandled_vmexit_handler},
+	[HX_EXIT_IRQ_LCOF] = {
+		.handler = undefined_vmexit_handler},
 };
 
 static const struct vm_exit_dispatch exception_dispatch_table[NR_HX_EXIT_REASONS] = {
@@ -186,6 +263,35 @@ static const struct vm_exit_dispatch exception_dispatch_table[NR_HX_EXIT_REASONS
 };
 
 #else /* !CONFIG_MACRN */
+#define INSN_WFI	0x10500073U
+#define HSTATUS_SPVP	(1UL << 8U)
+
+/*
+ * hstatus.VTW traps guest WFI, the only virtual instruction a guest has any
+ * use for. WFI from VS-mode halts the vCPU; anything else, WFI from VU-mode
+ * included, is what the guest would see as an illegal instruction natively.
+ */
+static int32_t virtual_ins_vmexit_handler(struct acrn_vcpu *vcpu)
+{
+	const struct cpu_regs *regs = &vcpu->arch.contexts[vcpu->arch.cur_context].run_ctx.cpu_gp_regs.regs;
+	uint32_t ins = (uint32_t)regs->tval;
+	int32_t ret;
+
+	/* stval may read 0 instead of the instruction */
+	if (ins == 0U) {
+		ins = fetch_guest_instruction(regs->hstatus, regs->ip);
+	}
+
+	if ((ins == INSN_WFI) && ((regs->hstatus & HSTATUS_SPVP) != 0UL)) {
+		vcpu_set_gpreg(vcpu, CPU_REG_IP, regs->ip + 4UL);
+		ret = hlt_vmexit_handler(vcpu);
+	} else {
+		vcpu_redirect_exception(vcpu, HX_EXIT_INS_ILLEGAL, ins);
+		ret = 0;
+	}
+	return ret;
+}
+
 static int32_t sswi_vmexit_handler(struct acrn_vcpu *vcpu)
 {
 	return 0;
@@ -197,6 +303,18 @@ static int32_t sti_vmexit_handler(struct acrn_vcpu *vcpu)
 	return 0;
 }
 
+/* the SGEI is taken by sgei_handler() once interrupts are enabled again */
+static int32_t sgei_vmexit_handler(__unused struct acrn_vcpu *vcpu)
+{
+	return 0;
+}
+
+/* a counter overflow, vpmu_handle_overflow() takes it the same way */
+static int32_t lcofi_vmexit_handler(__unused struct acrn_vcpu *vcpu)
+{
+	return 0;
+}
+
 /* VM Dispatch table for Exit condition handling */
 static const struct vm_exit_dispatch interrupt_dispatch_table[NR_HX_EXIT_IRQ_REASONS] = {
 	[HX_EXIT_IRQ_RSV] = {
@@ -220,7 +338,9 @@ static const struct vm_exit_dispatch interrupt_dispatch_table[NR_HX_EXIT_IRQ_REA
 	[HX_EXIT_IRQ_MEXT] = {
 		.handler = mexti_vmexit_handler},
 	[HX_EXIT_IRQ_GUEST_SEXT] = {
-		.handler = unhandled_vmexit_handler},
+		.handler = sgei_vmexit_handler},
+	[HX_EXIT_IRQ_LCOF] = {
+		.handler = lcofi_vmexit_handler},
 };
 
 static const struct vm_exit_dispatch exception_dispatch_table[NR_HX_EXIT_REASONS] = {
@@ -261,7 +381,7 @@ static const struct vm_exit_dispatch exception_dispatch_table[NR_HX_EXIT_REASONS
 	[HX_EXIT_PF_GUEST_LOAD] = {
 		.handler = mmio_access_vmexit_handler},
 	[HX_EXIT_VIRT_INS] = {
-		.handler = hlt_vmexit_handler},
+		.handler = virtual_ins_vmexit_handler},
 	[HX_EXIT_PF_GUEST_STORE] = {
 		.handler = mmio_access_vmexit_handler},
 };
@@ -275,6 +395,9 @@ int32_t vmexit_handler(struct acrn_vcpu *vcpu)
 	uint16_t basic_exit_reason, exit_type;
 	int32_t ret;
 	const struct vm_exit_dispatch *dispatch_table;
+	const struct cpu_regs *regs;
+	struct vcpu_exit_stats *stats = &vcpu->arch.exit_stats;
+	uint64_t start;
 
 	if (get_pcpu_id() != pcpuid_from_vcpu(vcpu)) {
 		pr_fatal("vcpu is not running on its pcpu!");
@@ -298,6 +421,10 @@ int32_t vmexit_handler(struct acrn_vcpu *vcpu)
 			pr_info("Invalid Exit Reason: 0x%016lx ", vcpu->arch.exit_reason);
 			ret = -EINVAL;
 		} else {
+			regs = &vcpu->arch.contexts[vcpu->arch.cur_context].run_ctx.cpu_gp_regs.regs;
+			TRACE_2L((exit_type ? TRACE_VMEXIT_RV_IRQ : TRACE_VMEXIT_RV_EXCP) + basic_exit_reason,
+				regs->tval, regs->htval);
+
 			/* Calculate dispatch table entry */
 			dispatch = (struct vm_exit_dispatch *)(dispatch_table + basic_exit_reason);
 			/* See if an exit qualification is necessary for this exit handler */
@@ -307,9 +434,49 @@ int32_t vmexit_handler(struct acrn_vcpu *vcpu)
 				vcpu->arch.exit_qualification = basic_exit_reason;
 			}
 
+			if (exit_type) {
+				stats->interrupt[basic_exit_reason]++;
+			} else {
+				stats->exception[basic_exit_reason]++;
+			}
+			start = cpu_ticks();
 			ret = dispatch->handler(vcpu);
+			exit_stats_hist_add(stats->handler_hist, cpu_ticks() - start);
 		}
 	}
 
 	return ret;
 }
+
+void vcpu_exit_stats_snapshot(const struct acrn_vcpu *vcpu, struct acrn_vcpu_exit_stats *stats)
+{
+	const struct vcpu_exit_stats *s = &vcpu->arch.exit_stats;
+	uint32_t i;
+
+	(void)memcpy_s(stats->exception, sizeof(stats->exception), s->exception, sizeof(s->exception));
+	(void)memcpy_s(stats->interrupt, sizeof(stats->interrupt), s->interrupt, sizeof(s->interrupt));
+	(void)memcpy_s(stats->sbi_calls, sizeof(stats->sbi_calls), s->sbi_calls, sizeof(s->sbi_calls));
+	(void)memcpy_s(stats->handler_hist, sizeof(stats->handler_hist), s->handler_hist, sizeof(s->handler_hist));
+	(void)memcpy_s(stats->roundtrip_hist, sizeof(stats->roundtrip_hist),
+		s->roundtrip_hist, sizeof(s->roundtrip_hist));
+	stats->halt_poll_hits = s->halt_poll_hits;
+	stats->halt_poll_misses = s->halt_poll_misses;
+	stats->halt_poll_window = vcpu->arch.halt_poll_window;
+	for (i = 0U; i < ACRN_EXIT_STATS_SBI_NUM; i++) {
+		stats->sbi_ext_id[i] = sbi_exit_stats_ext_id(i);
+	}
+}
+
+/* exit_tsc is left alone, the vCPU may be in the middle of an exit */
+void vcpu_exit_stats_reset(struct acrn_vcpu *vcpu)
+{
+	struct vcpu_exit_stats *s = &vcpu->arch.exit_stats;
+
+	(void)memset(s->exception, 0U, sizeof(s->exception));
+	(void)memset(s->interrupt, 0U, sizeof(s->interrupt));
+	(void)memset(s->sbi_calls, 0U, sizeof(s->sbi_calls));
+	(void)memset(s->handler_hist, 0U, sizeof(s->handler_hist));
+	(void)memset(s->roundtrip_hist, 0U, sizeof(s->roundtrip_hist));
+	s->halt_poll_hits = 0UL;
+	s->halt_poll_misses = 0UL;
+}
@@ -21,6 +21,7 @@
 #include <asm/guest/vplic.h>
 #include <asm/vmx.h>
 #include <asm/guest/vm.h>
+#include <asm/system.h>
 #include <ptdev.h>
 #include <trace.h>
 #include <logmsg.h>
@@ -68,76 +69,212 @@ static inline void vplic_dump_regs(__unused const struct acrn_vplic *vplic) {}
 
 const struct acrn_apicv_ops *vplic_ops;
 
-static void vplic_reg_set_bit(volatile void *p, uint32_t nr)
+static inline bool vplic_context_valid(const struct acrn_vplic *vplic, uint32_t context_id)
 {
-	*(uint32_t *)p |= (1 << nr);
+	return context_id < vplic->vm->hw.created_vcpus;
 }
 
-static void vplic_reg_clear_bit(volatile void *p, uint32_t nr)
+/*
+ * Put @irq in the priority bucket of @context_id it belongs to now, or in
+ * none if it cannot be delivered there.
+ *
+ * @pre vplic->ctx[context_id].lock is held
+ */
+static void vplic_ctx_update(struct acrn_vplic *vplic, uint32_t context_id, uint32_t irq)
 {
-	*(uint32_t *)p &= ~(1 << nr);
+	struct plic_regs *regs = &vplic->regs;
+	struct vplic_context *ctx = &vplic->ctx[context_id];
+	uint32_t word = irq >> 5U, bit = 1U << (irq & 31U);
+	uint32_t old = ctx->prio[irq], prio = 0U, i;
+
+	/* source 0 does not exist, claiming it means nothing is pending */
+	if ((irq != 0U) && ((regs->pending[word] & ~regs->claimed[word] & regs->enable[context_id][word] & bit) != 0U)) {
+		prio = regs->source_priority[irq];
+	}
+
+	if (prio != old) {
+		if (old != 0U) {
+			ctx->ready[old][word] &= ~bit;
+			for (i = 0U; (i < PLIC_NUM_FIELDS) && (ctx->ready[old][i] == 0U); i++) {}
+			if (i == PLIC_NUM_FIELDS) {
+				ctx->levels &= ~(1U << old);
+			}
+		}
+		if (prio != 0U) {
+			ctx->ready[prio][word] |= bit;
+			ctx->levels |= 1U << prio;
+		}
+		ctx->prio[irq] = (uint8_t)prio;
+	}
 }
 
-static void vplic_set_pending(struct plic_regs *regs, uint32_t irq)
+/*
+ * Highest priority bucket above the threshold, lowest source number in it.
+ *
+ * @pre vplic->ctx[context_id].lock is held
+ */
+static uint32_t vplic_ctx_best(const struct acrn_vplic *vplic, uint32_t context_id)
 {
-        vplic_reg_set_bit(&regs->pending[irq >> 5], irq & 31);
+	const struct vplic_context *ctx = &vplic->ctx[context_id];
+	uint32_t levels = ctx->levels & ~((2U << vplic->regs.target_priority[context_id]) - 1U);
+	uint32_t level, i, irq = 0U;
+
+	if (levels != 0U) {
+		level = (uint32_t)fls(levels) - 1U;
+		for (i = 0U; i < PLIC_NUM_FIELDS; i++) {
+			if (ctx->ready[level][i] != 0U) {
+				irq = (i << 5U) + (uint32_t)ffs(ctx->ready[level][i]) - 1U;
+				break;
+			}
+		}
+	}
+
+	return irq;
 }
 
-static void vplic_clear_pending(struct plic_regs *regs, uint32_t irq)
+/*
+ * Recompute the best deliverable source of @context_id and return the
+ * previous one.
+ *
+ * @pre vplic->ctx[context_id].lock is held
+ */
+static uint32_t vplic_ctx_refresh(struct acrn_vplic *vplic, uint32_t context_id)
 {
-        vplic_reg_clear_bit(&regs->pending[irq >> 5], irq & 31);
+	struct vplic_context *ctx = &vplic->ctx[context_id];
+	uint32_t old = ctx->best;
+
+	ctx->best = vplic_ctx_best(vplic, context_id);
+	return old;
 }
 
-static void vplic_set_claimed(struct plic_regs *regs, uint32_t irq)
+/*
+ * Only a context going from nothing to deliver to something, or back, needs
+ * its vCPU to look at SEIP again; a halted vCPU is only woken for the former.
+ */
+static void vplic_ctx_notify(struct acrn_vplic *vplic, uint32_t context_id, uint32_t old, uint32_t best)
 {
-        vplic_reg_set_bit(&regs->claimed[irq >> 5], irq & 31);
+	struct acrn_vcpu *vcpu;
+
+	if (vplic_context_valid(vplic, context_id) && ((old == 0U) != (best == 0U))) {
+		vcpu = vcpu_from_vid(vplic->vm, (uint16_t)context_id);
+		if (best != 0U) {
+			signal_event(&(vcpu->events[VCPU_EVENT_VIRTUAL_INTERRUPT]));
+		}
+		vcpu_make_request(vcpu, ACRN_REQUEST_EXTINT);
+	}
 }
 
-static void vplic_clear_claimed(struct plic_regs *regs, uint32_t irq)
+/* Propagate a change of the pending, claimed or priority state of @irq */
+static void vplic_sync_source(struct acrn_vplic *vplic, uint32_t irq)
 {
-        vplic_reg_clear_bit(&regs->claimed[irq >> 5], irq & 31);
+	struct vplic_context *ctx;
+	uint32_t context_id, old, best;
+	uint64_t flags;
+
+	/*
+	 * Order the caller's pending store before the unlocked enable/priority
+	 * loads below. Pairs with the barrier in vplic_write_enable(): either
+	 * that path sees the new pending bit or this one sees the new enable.
+	 */
+	smp_mb();
+	for (context_id = 0U; context_id < vplic->vm->hw.created_vcpus; context_id++) {
+		ctx = &vplic->ctx[context_id];
+		/* a context disabling @irq moves it out of its buckets by itself */
+		if ((ctx->prio[irq] != 0U) ||
+				bitmap32_test((uint16_t)(irq & 31U), &vplic->regs.enable[context_id][irq >> 5U])) {
+			spin_lock_irqsave(&ctx->lock, &flags);
+			vplic_ctx_update(vplic, context_id, irq);
+			old = vplic_ctx_refresh(vplic, context_id);
+			best = ctx->best;
+			spin_unlock_irqrestore(&ctx->lock, flags);
+
+			vplic_ctx_notify(vplic, context_id, old, best);
+		}
+	}
 }
 
-static uint32_t vplic_get_deliverable_irq(struct acrn_vplic *vplic, uint32_t context_id)
+/* Claim the best deliverable source of @context_id, 0 if there is none */
+static uint32_t vplic_claim(struct acrn_vplic *vplic, uint32_t context_id)
 {
-	uint32_t max_irq = 0;
 	struct plic_regs *regs = &vplic->regs;
-	uint32_t max_prio = regs->target_priority[context_id];
+	struct vplic_context *ctx = &vplic->ctx[context_id];
+	uint32_t irq, old, best;
+	bool claimed = false;
+	uint64_t flags;
 
-	for (int i = 0; i < PLIC_NUM_FIELDS; i++) {
-		uint32_t pending_enabled_not_claimed = (regs->pending[i] & ~regs->claimed[i]) &
-							regs->enable[context_id][i];
+	spin_lock_irqsave(&ctx->lock, &flags);
+	do {
+		irq = vplic_ctx_best(vplic, context_id);
+		if (irq == 0U) {
+			break;
+		}
+		/* another context may have claimed it since it was bucketed */
+		claimed = bitmap32_test_and_clear_lock((uint16_t)(irq & 31U), &regs->pending[irq >> 5U]);
+		if (claimed) {
+			bitmap32_set_lock((uint16_t)(irq & 31U), &regs->claimed[irq >> 5U]);
+		}
+		vplic_ctx_update(vplic, context_id, irq);
+	} while (!claimed);
+	old = vplic_ctx_refresh(vplic, context_id);
+	best = ctx->best;
+	spin_unlock_irqrestore(&ctx->lock, flags);
+
+	vplic_ctx_notify(vplic, context_id, old, best);
+	if (irq != 0U) {
+		vplic_sync_source(vplic, irq);
+	}
 
-		if (!pending_enabled_not_claimed)
-			continue;
+	return irq;
+}
 
-		for (int j = 0; j < 32; j++) {
-			uint32_t irq = (i << 5) + j;
-			uint32_t prio = regs->source_priority[irq];
-			bool enabled = !!(pending_enabled_not_claimed & (1 << j));
+static void vplic_write_enable(struct acrn_vplic *vplic, uint32_t context_id, uint32_t word, uint32_t val)
+{
+	struct vplic_context *ctx = &vplic->ctx[context_id];
+	uint32_t changed, irq, old, best;
+	uint64_t flags;
 
-			if (enabled && prio > max_prio) {
-				max_irq = irq;
-				max_prio = prio;
-			}
-		}
+	spin_lock_irqsave(&ctx->lock, &flags);
+	changed = vplic->regs.enable[context_id][word] ^ val;
+	vplic->regs.enable[context_id][word] = val;
+	/* enable store before the pending loads, see vplic_sync_source() */
+	smp_mb();
+	while (changed != 0U) {
+		irq = (word << 5U) + (uint32_t)ffs(changed) - 1U;
+		changed &= changed - 1U;
+		vplic_ctx_update(vplic, context_id, irq);
 	}
+	old = vplic_ctx_refresh(vplic, context_id);
+	best = ctx->best;
+	spin_unlock_irqrestore(&ctx->lock, flags);
 
-	return max_irq;
+	vplic_ctx_notify(vplic, context_id, old, best);
 }
 
-static void vplic_set_intr(struct acrn_vcpu *vcpu)
+static void vplic_write_threshold(struct acrn_vplic *vplic, uint32_t context_id, uint32_t val)
 {
-        signal_event(&(vcpu->events[VCPU_EVENT_VIRTUAL_INTERRUPT]));
-        vcpu_make_request(vcpu, ACRN_REQUEST_EXTINT);
+	struct vplic_context *ctx = &vplic->ctx[context_id];
+	uint32_t old, best;
+	uint64_t flags;
+
+	spin_lock_irqsave(&ctx->lock, &flags);
+	vplic->regs.target_priority[context_id] = val;
+	old = vplic_ctx_refresh(vplic, context_id);
+	best = ctx->best;
+	spin_unlock_irqrestore(&ctx->lock, flags);
+
+	vplic_ctx_notify(vplic, context_id, old, best);
 }
 
-static void vplic_update(struct acrn_vplic *vplic)
+/* pCPU behind a context, the BSP for contexts without a vCPU */
+static uint16_t vplic_context_pcpu(const struct acrn_vplic *vplic, uint32_t context_id)
 {
-        for (uint32_t context_id = 0; context_id < vplic->vm->hw.created_vcpus; context_id++) {
-		struct acrn_vcpu *vcpu = &vplic->vm->hw.vcpu[context_id];
-		vplic_set_intr(vcpu);
+	uint16_t pcpu_id = BSP_CPU_ID;
+
+	if (vplic_context_valid(vplic, context_id)) {
+		pcpu_id = pcpuid_from_vcpu(vcpu_from_vid(vplic->vm, (uint16_t)context_id));
 	}
+
+	return pcpu_id;
 }
 
 static bool offset_between(uint32_t offset, uint32_t base, uint32_t num)
@@ -149,11 +286,9 @@ static int32_t vplic_read(struct acrn_vplic *vplic, uint32_t offset, uint64_t *d
 {
 	int32_t ret = 0;
 	struct plic_regs *regs = &vplic->regs;
-	uint64_t flags;
 
 	*data = 0UL;
 
-	spin_lock_irqsave(&vplic->lock, &flags);
 	if (offset_between(offset, vplic->priority_base, PLIC_NUM_SOURCES << 2)) {
 		uint32_t src_index = (offset - vplic->priority_base) >> 2;
 
@@ -177,16 +312,7 @@ static int32_t vplic_read(struct acrn_vplic *vplic, uint32_t offset, uint64_t *d
 		if (reg_id == 0) { // Target priority threshold register
 			*data = regs->target_priority[context_index];
 		} else if (reg_id == 4) { // Claim/complete register
-			uint32_t irq = 0;
-
-			irq = vplic_get_deliverable_irq(vplic, context_index);
-			if (irq) {
-				vplic_clear_pending(regs, irq);
-				vplic_set_claimed(regs, irq);
-			}
-			vplic_update(vplic);
-
-			*data = irq;
+			*data = vplic_claim(vplic, context_index);
 		} else {
 			dev_dbg(DBG_LEVEL_VPLIC, "vplic read: invalid  context reg id %x\n", reg_id);
 			ret = -EACCES;
@@ -195,7 +321,6 @@ static int32_t vplic_read(struct acrn_vplic *vplic, uint32_t offset, uint64_t *d
 		dev_dbg(DBG_LEVEL_VPLIC, "vplic read: invalid offset %x\n", offset);
 		ret = -EACCES;
 	}
-	spin_unlock_irqrestore(&vplic->lock, flags);
 
 	dev_dbg(DBG_LEVEL_VPLIC, "vplic read offset %x, data %lx\n", offset, *data);
 	vplic_dump_regs(vplic);
@@ -207,17 +332,15 @@ static int32_t vplic_write(struct acrn_vplic *vplic, uint32_t offset, uint64_t d
 {
 	int32_t ret = 0;
 	struct plic_regs *regs = &vplic->regs;
-	uint64_t flags;
 
 	dev_dbg(DBG_LEVEL_VPLIC, "vplic write offset %#x, data %#lx", offset, data);
 
-	spin_lock_irqsave(&vplic->lock, &flags);
 	if (offset_between(offset, vplic->priority_base, PLIC_NUM_SOURCES << 2)) {
 		uint32_t src_index = (offset - vplic->priority_base) >> 2;
 
                 if (data <= PLIC_NUM_PRIORITY) {
 			regs->source_priority[src_index] = data;
-                        vplic_update(vplic);
+			vplic_sync_source(vplic, src_index);
                 } else {
 			dev_dbg(DBG_LEVEL_VPLIC, "vplic write: invalid source priority value %x\n", data);
 		}
@@ -232,34 +355,33 @@ static int32_t vplic_write(struct acrn_vplic *vplic, uint32_t offset, uint64_t d
 		uint32_t word_index = (offset & (PLIC_ENABLE_STRIDE - 1)) >> 2;
 
 		if (word_index < PLIC_NUM_FIELDS)
-			regs->enable[context_index][word_index] = data;
+			vplic_write_enable(vplic, context_index, word_index, data);
 		else
 			dev_dbg(DBG_LEVEL_VPLIC, "vplic write: invalid enable reg write %x\n", offset);
 
-		if (is_service_vm(vplic->vm))
-			plic_write32(data, PLIC_IER + (word_index << 2)); // Deliver phy irq to context 0
+		// Deliver phy irq to the hart of the vCPU owning the context
+		if (is_service_vm(vplic->vm) && (word_index < PLIC_NUM_FIELDS))
+			plic_guest_enable(vplic_context_pcpu(vplic, context_index), word_index, data);
 	} else if (offset_between(offset, vplic->dst_prio_base,
 				  PLIC_NUM_CONTEXT * PLIC_DST_PRIO_STRIDE)) {
 		uint32_t context_index = (offset - vplic->dst_prio_base) / PLIC_DST_PRIO_STRIDE;
 		uint32_t reg_id = (offset & (PLIC_DST_PRIO_STRIDE - 1));
 
 		if (reg_id == 0) { // Target priority threshold register
-			if (data <= PLIC_NUM_PRIORITY) {
-				regs->target_priority[context_index] = data;
-				vplic_update(vplic);
-			}
+			if (data <= PLIC_NUM_PRIORITY)
+				vplic_write_threshold(vplic, context_index, data);
 
 			if (is_service_vm(vplic->vm))
-				plic_write32(data, PLIC_THR);
+				plic_guest_threshold(vplic_context_pcpu(vplic, context_index), data);
 		} else if (reg_id == 4) { // Claim/complete register
 			if (data < PLIC_NUM_SOURCES) {
 				// Update the claimed reg
-				vplic_clear_claimed(regs, data);
-				vplic_update(vplic);
+				bitmap32_clear_lock((uint16_t)(data & 31U), &regs->claimed[data >> 5U]);
+				vplic_sync_source(vplic, data);
 			}
 
 			if (is_service_vm(vplic->vm))
-				plic_write32(data, PLIC_EOIR);
+				plic_guest_complete(data);
 		} else {
 			dev_dbg(DBG_LEVEL_VPLIC, "vplic write: invalid  context reg id %x\n", reg_id);
 			ret = -EACCES;
@@ -268,7 +390,6 @@ static int32_t vplic_write(struct acrn_vplic *vplic, uint32_t offset, uint64_t d
 		dev_dbg(DBG_LEVEL_VPLIC, "vplic write: invalid offset %x\n", offset);
 		ret = -EACCES;
 	}
-	spin_unlock_irqrestore(&vplic->lock, flags);
 
 	vplic_dump_regs(vplic);
 
@@ -282,6 +403,7 @@ void
 vplic_reset(struct acrn_vplic *vplic, const struct acrn_vplic_ops *ops, enum reset_mode mode)
 {
         struct plic_regs *regs;
+        uint32_t i;
 
         if (mode == INIT_RESET) {
                 vplic->plic_base = DEFAULT_PLIC_BASE;
@@ -289,6 +411,13 @@ vplic_reset(struct acrn_vplic *vplic, const struct acrn_vplic_ops *ops, enum res
 
         regs = &(vplic->regs);
         memset((void *)regs, 0U, sizeof(struct plic_regs));
+        for (i = 0U; i < PLIC_NUM_CONTEXT; i++) {
+                spinlock_init_class(&vplic->ctx[i].lock, LOCK_CLASS_VPLIC);
+                memset((void *)vplic->ctx[i].ready, 0U, sizeof(vplic->ctx[i].ready));
+                memset((void *)vplic->ctx[i].prio, 0U, sizeof(vplic->ctx[i].prio));
+                vplic->ctx[i].levels = 0U;
+                vplic->ctx[i].best = 0U;
+        }
 
         vplic->ops = ops;
 }
@@ -296,30 +425,55 @@ vplic_reset(struct acrn_vplic *vplic, const struct acrn_vplic_ops *ops, enum res
 void vplic_accept_intr(struct acrn_vcpu *vcpu, uint32_t vector, bool level)
 {
 	struct acrn_vplic *vplic;
-	uint64_t flags;
+
+	if (vcpu->vm->vaplic.enabled) {
+		vaplic_accept_intr(vcpu->vm, vector, level);
+		return;
+	}
 
 	vplic = vcpu_vplic(vcpu);
 
 	if (!vplic->enabled)
 		return;
-	spin_lock_irqsave(&vplic->lock, &flags);
 	if (vector < PLIC_NUM_SOURCES) {
 		if (level)
-			vplic_set_pending(&vplic->regs, vector);
+			bitmap32_set_lock((uint16_t)(vector & 31U), &vplic->regs.pending[vector >> 5U]);
 		else
-			vplic_clear_pending(&vplic->regs, vector);
+			bitmap32_clear_lock((uint16_t)(vector & 31U), &vplic->regs.pending[vector >> 5U]);
 
-		vplic_update(vplic);
+		vplic_sync_source(vplic, vector);
 	} else {
 		dev_dbg(DBG_LEVEL_VPLIC, "vplic ignoring interrupt to vector %u", vector);
 	}
-	spin_unlock_irqrestore(&vplic->lock, flags);
+}
+
+/*
+ * Steer every passthrough interrupt the Service VM enabled to the pCPU of
+ * the vCPU it is enabled for, e.g. after vCPUs moved or the guest changed
+ * affinities behind our back.
+ */
+void vplic_rebalance_irqs(struct acrn_vm *vm)
+{
+	struct acrn_vplic *vplic = &vm->vplic;
+	uint32_t context_id, word;
+
+	if (vplic->enabled && is_service_vm(vm)) {
+		for (context_id = 0U; context_id < vm->hw.created_vcpus; context_id++) {
+			for (word = 0U; word < PLIC_NUM_FIELDS; word++) {
+				if (vplic->regs.enable[context_id][word] != 0U) {
+					plic_guest_enable(vplic_context_pcpu(vplic, context_id), word,
+						vplic->regs.enable[context_id][word]);
+				}
+			}
+		}
+	}
 }
 
 void vcpu_inject_extint(struct acrn_vcpu *vcpu)
 {
 	struct guest_cpu_context *ctx = &vcpu->arch.contexts[vcpu->arch.cur_context];
 	struct acrn_vplic *vplic = vcpu_vplic(vcpu);
+	struct vplic_context *vctx = &vplic->ctx[vcpu->vcpu_id];
 	uint32_t irq;
 #ifdef CONFIG_MACRN
 	uint64_t value = cpu_csr_read(mip);
@@ -328,8 +482,8 @@ void vcpu_inject_extint(struct acrn_vcpu *vcpu)
 
 	if (!vplic->enabled)
 		return;
-	spin_lock_irqsave(&vplic->lock, &flags);
-	irq = vplic_get_deliverable_irq(vplic, vcpu->vcpu_id);
+	spin_lock_irqsave(&vctx->lock, &flags);
+	irq = vctx->best;
 	if (irq) {
 		ctx->run_ctx.sip |= CLINT_VECTOR_SEI;
 #ifdef CONFIG_MACRN
@@ -341,7 +495,7 @@ void vcpu_inject_extint(struct acrn_vcpu *vcpu)
 		cpu_csr_write(mip, value & ~CLINT_VECTOR_SEI);
 #endif
 	}
-	spin_unlock_irqrestore(&vplic->lock, flags);
+	spin_unlock_irqrestore(&vctx->lock, flags);
 }
 
 static bool vplic_read_access_may_valid(__unused uint32_t offset)
@@ -383,10 +537,8 @@ void vplic_init(struct acrn_vm *vm)
 {
 	struct acrn_vplic *vplic = &vm->vplic;
 
-	spinlock_init(&vplic->lock);
 	vplic->vm = vm;
-	vplic->plic_base = DEFAULT_PLIC_BASE;
-	vplic->ops = &acrn_vplic_ops;
+	vplic_reset(vplic, &acrn_vplic_ops, INIT_RESET);
 
 	vplic->priority_base = PLIC_SRC_PRIORITY_BASE;
 	vplic->pending_base = PLIC_PENDING_BASE;
@@ -396,6 +548,5 @@ void vplic_init(struct acrn_vm *vm)
 	register_mmio_emulation_handler(vm, vplic_access_handler, (uint64_t)vplic->plic_base,
 		(uint64_t)vplic->plic_base + DEFAULT_PLIC_SIZE, (void *)vplic, false);
 
-	memset(&vplic->regs, 0U, sizeof(struct plic_regs));
 	vplic->enabled = 1;
 }
@@ -0,0 +1,527 @@
+/*
+ * Copyright (C) 2025 Intel Corporation. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <types.h>
+#include <asm/cpu.h>
+#include <asm/per_cpu.h>
+#include <asm/aia.h>
+#include <asm/lib/bits.h>
+#include <asm/lib/atomic.h>
+#include <asm/guest/vcpu.h>
+#include <asm/guest/virq.h>
+#include <asm/guest/vpmu.h>
+#include <logmsg.h>
+
+#define CSR_HVIEN		0x608
+
+/* cycle, time and instret stay readable whatever the guest configured */
+#define HCOUNTEREN_FIXED	0x7UL
+
+/* firmware counters are 64 bits wide, counter_info.width is bits - 1 */
+#define VPMU_FW_CTR_INFO	(SBI_PMU_CTR_INFO_FW | (63UL << 12U))
+
+/* guest flags that are passed through, the inhibit bits are the hypervisor's */
+#define VPMU_CFG_PASS_FLAGS	(SBI_PMU_CFG_FLAG_SKIP_MATCH | SBI_PMU_CFG_FLAG_CLEAR_VALUE | \
+				 SBI_PMU_CFG_FLAG_AUTO_START)
+#define VPMU_CFG_HOST_INH	(SBI_PMU_CFG_FLAG_SET_UINH | SBI_PMU_CFG_FLAG_SET_SINH | \
+				 SBI_PMU_CFG_FLAG_SET_MINH)
+
+bool has_sscofpmf;
+
+/*
+ * Host hardware counters given to guests, the same on every hart. They keep
+ * their host index, which may leave holes (e.g. time on OpenSBI), and the
+ * firmware counters are numbered from vpmu_fw_base, past the highest one.
+ */
+static uint64_t vpmu_hw_valid;
+static uint32_t vpmu_fw_base;
+static uint64_t vpmu_hw_info[VPMU_MAX_HW_COUNTERS];
+
+/* overflows reach guests as a virtual LCOFI, through hvien/hvip */
+static bool vpmu_lcofi;
+
+static inline uint32_t vpmu_num_counters(void)
+{
+	return vpmu_fw_base + VPMU_NUM_FW_COUNTERS;
+}
+
+static inline bool is_fw_counter(uint32_t idx)
+{
+	return (idx >= vpmu_fw_base);
+}
+
+static inline uint64_t hw_counter_mask(void)
+{
+	return vpmu_hw_valid;
+}
+
+static inline uint64_t fw_counter_mask(void)
+{
+	return ((1UL << VPMU_NUM_FW_COUNTERS) - 1UL) << vpmu_fw_base;
+}
+
+/* guest counters base + n for each bit n of mask, if all exist */
+static bool vpmu_counter_mask(uint64_t base, uint64_t mask, uint64_t *out)
+{
+	uint32_t num = vpmu_num_counters();
+	bool valid = (base < num) && ((mask >> (num - base)) == 0UL);
+
+	if (valid) {
+		*out = mask << base;
+	}
+
+	return valid;
+}
+
+/*
+ * Guest SINH/UINH become VSINH/VUINH, and the host's own modes are always
+ * inhibited: a counter only counts while its vCPU runs.
+ */
+static uint64_t vpmu_host_flags(uint64_t flags)
+{
+	uint64_t host = (flags & VPMU_CFG_PASS_FLAGS) | VPMU_CFG_HOST_INH;
+
+	if ((flags & SBI_PMU_CFG_FLAG_SET_SINH) != 0UL) {
+		host |= SBI_PMU_CFG_FLAG_SET_VSINH;
+	}
+	if ((flags & SBI_PMU_CFG_FLAG_SET_UINH) != 0UL) {
+		host |= SBI_PMU_CFG_FLAG_SET_VUINH;
+	}
+
+	return host;
+}
+
+#ifndef CONFIG_MACRN
+/* counter CSRs are immediates in csrr, so each one gets its own case */
+#define HPM_READ_CASE(n)						\
+	case (CSR_CYCLE_BASE + n##UL):					\
+		value = cpu_csr_read(hpmcounter##n);			\
+		break
+
+static uint64_t read_hw_counter(uint64_t info)
+{
+	uint64_t value = 0UL;
+
+	switch (info & SBI_PMU_CTR_INFO_CSR_MASK) {
+	case CSR_CYCLE_BASE:
+		value = cpu_csr_read(cycle);
+		break;
+	case CSR_CYCLE_BASE + 2UL:
+		value = cpu_csr_read(instret);
+		break;
+	HPM_READ_CASE(3);
+	HPM_READ_CASE(4);
+	HPM_READ_CASE(5);
+	HPM_READ_CASE(6);
+	HPM_READ_CASE(7);
+	HPM_READ_CASE(8);
+	HPM_READ_CASE(9);
+	HPM_READ_CASE(10);
+	HPM_READ_CASE(11);
+	HPM_READ_CASE(12);
+	HPM_READ_CASE(13);
+	HPM_READ_CASE(14);
+	HPM_READ_CASE(15);
+	HPM_READ_CASE(16);
+	HPM_READ_CASE(17);
+	HPM_READ_CASE(18);
+	HPM_READ_CASE(19);
+	HPM_READ_CASE(20);
+	HPM_READ_CASE(21);
+	HPM_READ_CASE(22);
+	HPM_READ_CASE(23);
+	HPM_READ_CASE(24);
+	HPM_READ_CASE(25);
+	HPM_READ_CASE(26);
+	HPM_READ_CASE(27);
+	HPM_READ_CASE(28);
+	HPM_READ_CASE(29);
+	HPM_READ_CASE(30);
+	HPM_READ_CASE(31);
+	default:
+		break;
+	}
+
+	return value;
+}
+
+/* hcounteren bits of the hardware counters in mask */
+static uint64_t hw_counteren(uint64_t mask)
+{
+	uint64_t bits = HCOUNTEREN_FIXED;
+	uint64_t m = mask;
+	uint16_t idx;
+
+	idx = ffs64(m);
+	while (idx < vpmu_fw_base) {
+		clear_bit(idx, &m);
+		bits |= 1UL << ((vpmu_hw_info[idx] & SBI_PMU_CTR_INFO_CSR_MASK) - CSR_CYCLE_BASE);
+		idx = ffs64(m);
+	}
+
+	return bits;
+}
+
+static void vpmu_update_counteren(void)
+{
+	cpu_csr_write(hcounteren, hw_counteren(get_cpu_var(pmu_active)));
+}
+
+/*
+ * The counters only count in VS/VU, so they are frozen while the
+ * hypervisor runs and can be read without stopping them first.
+ */
+static void vpmu_save_hw(struct acrn_vcpu *vcpu)
+{
+	struct acrn_vpmu *vpmu = &vcpu->arch.vpmu;
+	uint64_t m = vpmu->configured & hw_counter_mask();
+	uint16_t idx;
+
+	idx = ffs64(m);
+	while (idx < vpmu_fw_base) {
+		clear_bit(idx, &m);
+		vpmu->ctr[idx].value = read_hw_counter(vpmu_hw_info[idx]);
+		idx = ffs64(m);
+	}
+}
+
+/* set the counters of vcpu up again on this hart, each one at its own index */
+static uint64_t vpmu_restore_hw(struct acrn_vcpu *vcpu)
+{
+	struct acrn_vpmu *vpmu = &vcpu->arch.vpmu;
+	struct vpmu_counter *ctr;
+	uint64_t m = vpmu->configured & hw_counter_mask();
+	uint64_t active = 0UL;
+	uint64_t flags;
+	uint16_t idx;
+	sbi_ret ret;
+
+	idx = ffs64(m);
+	while (idx < vpmu_fw_base) {
+		clear_bit(idx, &m);
+		ctr = &vpmu->ctr[idx];
+		flags = ctr->flags & ~VPMU_CFG_PASS_FLAGS;
+		ret = sbi_pmu_ecall(SBI_TYPE_PMU_COUNTER_CFG_MATCH, idx, 1UL, flags, ctr->event_idx, ctr->event_data);
+		if ((ret.error != SBI_SUCCESS) || (ret.value != (int64_t)idx)) {
+			pr_err("vpmu: vcpu %hu lost counter %hu", vcpu->vcpu_id, idx);
+			clear_bit(idx, &vpmu->configured);
+			clear_bit(idx, &vpmu->started);
+		} else {
+			set_bit(idx, &active);
+			/* start is the only way to load a value */
+			(void)sbi_pmu_ecall(SBI_TYPE_PMU_COUNTER_START, idx, 1UL,
+				SBI_PMU_START_FLAG_SET_INIT_VALUE, ctr->value, 0UL);
+			if (!test_bit(idx, vpmu->started)) {
+				(void)sbi_pmu_ecall(SBI_TYPE_PMU_COUNTER_STOP, idx, 1UL, 0UL, 0UL, 0UL);
+			}
+		}
+		idx = ffs64(m);
+	}
+
+	return active;
+}
+
+/*
+ * Called on every VM entry. Hardware counters are switched lazily: they
+ * stay set up for the last vCPU that used them on this hart (pmu_owner)
+ * and are only saved, released and set up again when another vCPU enters.
+ */
+void vpmu_load(struct acrn_vcpu *vcpu)
+{
+	struct acrn_vcpu **owner = &get_cpu_var(pmu_owner);
+	uint64_t *active = &get_cpu_var(pmu_active);
+
+	if ((*owner == vcpu) || (vpmu_hw_valid == 0UL)) {
+		return;
+	}
+
+	if (*owner != NULL) {
+		vpmu_save_hw(*owner);
+	}
+	if (*active != 0UL) {
+		(void)sbi_pmu_ecall(SBI_TYPE_PMU_COUNTER_STOP, 0UL, *active, SBI_PMU_STOP_FLAG_RESET, 0UL, 0UL);
+	}
+	*owner = vcpu;
+	*active = vpmu_restore_hw(vcpu);
+	vpmu_update_counteren();
+}
+
+/*
+ * Overflow of a counter of the running vCPU. The OF bit stays set until
+ * the guest starts the counter again, so clearing LCOFIP here is enough.
+ */
+void vpmu_handle_overflow(void)
+{
+	struct acrn_vcpu *owner = get_cpu_var(pmu_owner);
+	uint64_t ovf = cpu_csr_read(CSR_SCOUNTOVF);
+
+	cpu_csr_clear(sip, SIP_LCOFIP);
+	if ((owner != NULL) && ((ovf & hw_counteren(get_cpu_var(pmu_active)) & ~HCOUNTEREN_FIXED) != 0UL)) {
+		vcpu_make_request(owner, ACRN_REQUEST_LCOFI);
+	}
+}
+
+/* find the hardware counters the host can give away, they are the same on all harts */
+static void vpmu_probe_hw(void)
+{
+	sbi_ret ret;
+	uint32_t i, num;
+
+	if (!sbi_probe_extension(SBI_ID_PMU)) {
+		return;
+	}
+
+	ret = sbi_pmu_ecall(SBI_TYPE_PMU_NUM_COUNTERS, 0UL, 0UL, 0UL, 0UL, 0UL);
+	num = (ret.error == SBI_SUCCESS) ? min((uint32_t)ret.value, VPMU_MAX_HW_COUNTERS) : 0U;
+	for (i = 0U; i < num; i++) {
+		/* indices the firmware does not implement just error out */
+		ret = sbi_pmu_ecall(SBI_TYPE_PMU_COUNTER_GET_INFO, i, 0UL, 0UL, 0UL, 0UL);
+		if ((ret.error == SBI_SUCCESS) && (((uint64_t)ret.value & SBI_PMU_CTR_INFO_FW) == 0UL)) {
+			vpmu_hw_info[i] = (uint64_t)ret.value;
+			vpmu_hw_valid |= 1UL << i;
+			vpmu_fw_base = i + 1U;
+		}
+	}
+
+	vpmu_lcofi = (vpmu_hw_valid != 0UL) && has_sscofpmf && aia_available();
+}
+
+void vpmu_init_hart(void)
+{
+	if (vpmu_lcofi) {
+		cpu_csr_set(CSR_HVIEN, SIP_LCOFIP);
+		cpu_csr_set(sie, SIP_LCOFIP);
+	}
+}
+#else
+static inline void vpmu_update_counteren(void) {}
+
+/* M-mode hardware counters are not virtualized, guests only get the firmware ones */
+static inline void vpmu_probe_hw(void) {}
+
+void vpmu_init_hart(void) {}
+#endif
+
+void vpmu_init(void)
+{
+	vpmu_probe_hw();
+	pr_info("vpmu: %u hardware counters, overflow interrupt %d", bit_weight(vpmu_hw_valid), vpmu_lcofi);
+	vpmu_init_hart();
+}
+
+/*
+ * Drop the counters. Host counters the vCPU still holds on its hart are
+ * released when the next vCPU enters there, see vpmu_load().
+ */
+void vpmu_reset(struct acrn_vcpu *vcpu)
+{
+	uint16_t pcpu_id = pcpuid_from_vcpu(vcpu);
+
+	if (per_cpu(pmu_owner, pcpu_id) == vcpu) {
+		per_cpu(pmu_owner, pcpu_id) = NULL;
+	}
+	(void)memset(&vcpu->arch.vpmu, 0U, sizeof(vcpu->arch.vpmu));
+}
+
+/* Count a hypervisor emulated event in the started firmware counters of vcpu */
+void vpmu_fw_event(struct acrn_vcpu *vcpu, enum sbi_pmu_fw_event event)
+{
+	struct acrn_vpmu *vpmu = &vcpu->arch.vpmu;
+	uint64_t m = vpmu->started & fw_counter_mask();
+	uint16_t idx;
+
+	idx = ffs64(m);
+	while (idx < vpmu_num_counters()) {
+		clear_bit(idx, &m);
+		if (SBI_PMU_EVENT_CODE(vpmu->ctr[idx].event_idx) == (uint64_t)event) {
+			(void)atomic_inc64_return((int64_t *)&vpmu->ctr[idx].value);
+		}
+		idx = ffs64(m);
+	}
+}
+
+static int64_t vpmu_cfg_match(struct acrn_vcpu *vcpu, uint64_t mask, uint64_t flags,
+		uint64_t event_idx, uint64_t event_data, uint64_t *out)
+{
+	struct acrn_vpmu *vpmu = &vcpu->arch.vpmu;
+	bool fw = (SBI_PMU_EVENT_TYPE(event_idx) == SBI_PMU_EVENT_TYPE_FW);
+	uint64_t host_flags = vpmu_host_flags(flags);
+	uint64_t free;
+	uint16_t idx;
+	sbi_ret ret;
+
+	if ((flags & SBI_PMU_CFG_FLAG_SKIP_MATCH) != 0UL) {
+		free = mask & vpmu->configured;
+	} else {
+		free = mask & ~vpmu->configured;
+	}
+	free &= fw ? fw_counter_mask() : hw_counter_mask();
+	if (free == 0UL) {
+		return SBI_ENOTSUPP;
+	}
+
+	if (fw) {
+		if (SBI_PMU_EVENT_CODE(event_idx) >= (uint64_t)SBI_PMU_FW_MAX) {
+			return SBI_EINVAL_PARAM;
+		}
+		idx = ffs64(free);
+	} else {
+		/* the hypervisor entered this vCPU last, see vpmu_load() */
+		ret = sbi_pmu_ecall(SBI_TYPE_PMU_COUNTER_CFG_MATCH, 0UL, free, host_flags, event_idx, event_data);
+		if (ret.error != SBI_SUCCESS) {
+			return ret.error;
+		}
+		idx = (uint16_t)ret.value;
+		set_bit(idx, &get_cpu_var(pmu_active));
+		vpmu_update_counteren();
+	}
+
+	vpmu->ctr[idx].event_idx = event_idx;
+	vpmu->ctr[idx].event_data = event_data;
+	vpmu->ctr[idx].flags = host_flags;
+	if (fw && ((flags & SBI_PMU_CFG_FLAG_CLEAR_VALUE) != 0UL)) {
+		vpmu->ctr[idx].value = 0UL;
+	}
+	set_bit(idx, &vpmu->configured);
+	if ((flags & SBI_PMU_CFG_FLAG_AUTO_START) != 0UL) {
+		set_bit(idx, &vpmu->started);
+	}
+	*out = idx;
+
+	return SBI_SUCCESS;
+}
+
+static int64_t vpmu_start(struct acrn_vcpu *vcpu, uint64_t mask, uint64_t flags, uint64_t init)
+{
+	struct acrn_vpmu *vpmu = &vcpu->arch.vpmu;
+	uint64_t hw = mask & hw_counter_mask();
+	uint64_t m = mask & fw_counter_mask();
+	uint16_t idx;
+	sbi_ret ret;
+
+	if ((mask & ~vpmu->configured) != 0UL) {
+		return SBI_EINVAL_PARAM;
+	}
+	if ((mask & vpmu->started) != 0UL) {
+		return SBI_ESTARTED;
+	}
+
+	if (hw != 0UL) {
+		ret = sbi_pmu_ecall(SBI_TYPE_PMU_COUNTER_START, 0UL, hw, flags, init, 0UL);
+		if (ret.error != SBI_SUCCESS) {
+			return ret.error;
+		}
+	}
+	if ((flags & SBI_PMU_START_FLAG_SET_INIT_VALUE) != 0UL) {
+		idx = ffs64(m);
+		while (idx < vpmu_num_counters()) {
+			clear_bit(idx, &m);
+			vpmu->ctr[idx].value = init;
+			idx = ffs64(m);
+		}
+	}
+	vpmu->started |= mask;
+
+	return SBI_SUCCESS;
+}
+
+static int64_t vpmu_stop(struct acrn_vcpu *vcpu, uint64_t mask, uint64_t flags)
+{
+	struct acrn_vpmu *vpmu = &vcpu->arch.vpmu;
+	uint64_t hw = mask & hw_counter_mask();
+	int64_t err = SBI_SUCCESS;
+	sbi_ret ret;
+
+	if ((mask & ~vpmu->configured) != 0UL) {
+		return SBI_EINVAL_PARAM;
+	}
+	if ((mask & ~vpmu->started) != 0UL) {
+		err = SBI_ESTOPPED;
+	}
+
+	if (hw != 0UL) {
+		ret = sbi_pmu_ecall(SBI_TYPE_PMU_COUNTER_STOP, 0UL, hw, flags & SBI_PMU_STOP_FLAG_RESET, 0UL, 0UL);
+		if ((ret.error != SBI_SUCCESS) && (ret.error != SBI_ESTOPPED)) {
+			return ret.error;
+		}
+	}
+	vpmu->started &= ~mask;
+	if ((flags & SBI_PMU_STOP_FLAG_RESET) != 0UL) {
+		vpmu->configured &= ~mask;
+		if (hw != 0UL) {
+			get_cpu_var(pmu_active) &= ~hw;
+			vpmu_update_counteren();
+		}
+	}
+
+	return err;
+}
+
+void vpmu_sbi_handler(struct acrn_vcpu *vcpu, struct cpu_regs *regs)
+{
+	struct acrn_vpmu *vpmu = &vcpu->arch.vpmu;
+	uint64_t funcid = regs->a6;
+	uint64_t idx = regs->a0;
+	uint64_t value = 0UL;
+	uint64_t mask = 0UL;
+	int64_t err = SBI_SUCCESS;
+
+	switch (funcid) {
+	case SBI_TYPE_PMU_NUM_COUNTERS:
+		value = vpmu_num_counters();
+		break;
+	case SBI_TYPE_PMU_COUNTER_GET_INFO:
+		if (idx >= vpmu_num_counters()) {
+			err = SBI_EINVAL_PARAM;
+		} else if (is_fw_counter((uint32_t)idx)) {
+			value = VPMU_FW_CTR_INFO;
+		} else if (test_bit((uint16_t)idx, vpmu_hw_valid)) {
+			value = vpmu_hw_info[idx];
+		} else {
+			err = SBI_EINVAL_PARAM;
+		}
+		break;
+	case SBI_TYPE_PMU_COUNTER_CFG_MATCH:
+		if (!vpmu_counter_mask(regs->a0, regs->a1, &mask)) {
+			err = SBI_EINVAL_PARAM;
+		} else {
+			err = vpmu_cfg_match(vcpu, mask, regs->a2, regs->a3, regs->a4, &value);
+		}
+		break;
+	case SBI_TYPE_PMU_COUNTER_START:
+		if (!vpmu_counter_mask(regs->a0, regs->a1, &mask)) {
+			err = SBI_EINVAL_PARAM;
+		} else {
+			err = vpmu_start(vcpu, mask, regs->a2, regs->a3);
+		}
+		break;
+	case SBI_TYPE_PMU_COUNTER_STOP:
+		if (!vpmu_counter_mask(regs->a0, regs->a1, &mask)) {
+			err = SBI_EINVAL_PARAM;
+		} else {
+			err = vpmu_stop(vcpu, mask, regs->a2);
+		}
+		break;
+	case SBI_TYPE_PMU_COUNTER_FW_READ:
+	case SBI_TYPE_PMU_COUNTER_FW_READ_HI:
+		if ((idx >= vpmu_num_counters()) || !is_fw_counter((uint32_t)idx) ||
+				!test_bit((uint16_t)idx, vpmu->configured)) {
+			err = SBI_EINVAL_PARAM;
+		} else if (funcid == SBI_TYPE_PMU_COUNTER_FW_READ) {
+			value = vpmu->ctr[idx].value;
+		} else {
+			/* RV64: the whole value fits in fw_read */
+			value = 0UL;
+		}
+		break;
+	default:
+		err = SBI_ENOTSUPP;
+		break;
+	}
+
+	regs->a0 = (uint64_t)err;
+	regs->a1 = value;
+}
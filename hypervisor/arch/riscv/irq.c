@@ -140,6 +140,41 @@ out:
 
 struct acrn_irqchip_ops *acrn_irqchip;
 
+/*
+ * Take @irq on @pcpu_id from now on. The interrupt keeps its enable state,
+ * it is only moved to the interrupt context of the other hart.
+ */
+int32_t irq_set_affinity(uint32_t irq, uint16_t pcpu_id)
+{
+	struct irq_desc *desc;
+	uint64_t flags;
+	int32_t ret = -EINVAL;
+
+	if ((irq < NR_IRQS) && (pcpu_id < NR_CPUS) &&
+			(acrn_irqchip != NULL) && (acrn_irqchip->set_affinity != NULL)) {
+		desc = irq_to_desc(irq);
+		spin_lock_irqsave(&desc->lock, &flags);
+		irq_data[irq].affinity = 1UL << pcpu_id;
+		acrn_irqchip->set_affinity(desc, pcpu_id);
+		spin_unlock_irqrestore(&desc->lock, flags);
+		ret = 0;
+	}
+
+	return ret;
+}
+
+/* interrupts nobody steered are taken on the BSP */
+uint16_t irq_get_affinity(uint32_t irq)
+{
+	uint16_t pcpu_id = BSP_CPU_ID;
+
+	if ((irq < NR_IRQS) && (irq_data[irq].affinity != 0UL)) {
+		pcpu_id = (uint16_t)ffs64(irq_data[irq].affinity);
+	}
+
+	return pcpu_id;
+}
+
 /* must be called after IRQ setup */
 void setup_irqs_arch(void)
 {
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2023-2024 Intel Corporation. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <types.h>
+#include <rtl.h>
+#include <timer.h>
+#include <ticks.h>
+#include <asm/page.h>
+#include <asm/cache.h>
+#include <asm/float.h>
+#include <asm/lib/string.h>
+#include <debug/logmsg.h>
+#include "bench.h"
+
+#define BENCH_TIMERS		96U
+#define BENCH_ROUNDS		64U
+
+/* each size class moves at least this many bytes */
+#define BENCH_MEM_BYTES		(4UL << 20U)
+#define BENCH_MEM_MAX		(64UL << 10U)
+
+static struct hv_timer bench_timers[BENCH_TIMERS];
+static struct page bench_src[BENCH_MEM_MAX / PAGE_SIZE];
+static struct page bench_dst[BENCH_MEM_MAX / PAGE_SIZE];
+
+static void bench_timer_fn(__unused void *data)
+{
+}
+
+/* xorshift, so that timeouts arrive in no particular order */
+static uint64_t bench_next(uint64_t *seed)
+{
+	uint64_t x = *seed;
+
+	x ^= x << 13U;
+	x ^= x >> 7U;
+	x ^= x << 17U;
+	*seed = x;
+
+	return x;
+}
+
+static uint64_t bench_ns_per_op(uint64_t ticks, uint64_t ops)
+{
+	return (ticks_to_us(ticks) * 1000UL) / ops;
+}
+
+/*
+ * Time add_timer/del_timer with BENCH_TIMERS timers active on this CPU, the
+ * sched tick, vclint and vuart timers of a loaded pCPU. The timeouts lie far
+ * in the future so that none of them expires while being measured.
+ */
+void ktest_timer_bench(void)
+{
+	uint64_t seed = 0x9e3779b97f4a7c15UL;
+	uint64_t base = cpu_ticks() + (60UL * 1000UL * TICKS_PER_MS);
+	uint64_t t_add = 0UL, t_del = 0UL, t_mod = 0UL, start;
+	uint32_t i, round;
+
+	for (i = 0U; i < BENCH_TIMERS; i++) {
+		initialize_timer(&bench_timers[i], bench_timer_fn, NULL, 0UL, 0UL);
+	}
+
+	for (round = 0U; round < BENCH_ROUNDS; round++) {
+		for (i = 0U; i < BENCH_TIMERS; i++) {
+			bench_timers[i].timeout = base + (bench_next(&seed) & 0xffffffUL);
+		}
+
+		start = cpu_ticks();
+		for (i = 0U; i < BENCH_TIMERS; i++) {
+			(void)add_timer(&bench_timers[i]);
+		}
+		t_add += cpu_ticks() - start;
+
+		/* what a guest reprogramming its timer does: delete, then add again */
+		start = cpu_ticks();
+		for (i = 0U; i < BENCH_TIMERS; i++) {
+			del_timer(&bench_timers[i]);
+			bench_timers[i].timeout = base + (bench_next(&seed) & 0xffffffUL);
+			(void)add_timer(&bench_timers[i]);
+		}
+		t_mod += cpu_ticks() - start;
+
+		start = cpu_ticks();
+		for (i = 0U; i < BENCH_TIMERS; i++) {
+			del_timer(&bench_timers[i]);
+		}
+		t_del += cpu_ticks() - start;
+	}
+
+	pr_info("ktest: %u timers: add %lu ns, del %lu ns, del+add %lu ns per op", BENCH_TIMERS,
+		bench_ns_per_op(t_add, BENCH_TIMERS * BENCH_ROUNDS),
+		bench_ns_per_op(t_del, BENCH_TIMERS * BENCH_ROUNDS),
+		bench_ns_per_op(t_mod, BENCH_TIMERS * BENCH_ROUNDS));
+}
+
+/* what memcpy used to be, the baseline the other numbers compare with */
+static void bench_memcpy_bytewise(void *d, const void *s, size_t slen)
+{
+	uint8_t *dst = (uint8_t *)d;
+	const uint8_t *src = (const uint8_t *)s;
+	size_t i;
+
+	for (i = 0U; i < slen; i++) {
+		dst[i] = src[i];
+	}
+}
+
+/* MB/s, which is bytes per us */
+static uint64_t bench_mbps(uint64_t bytes, uint64_t ticks)
+{
+	uint64_t us = ticks_to_us(ticks);
+
+	return bytes / ((us != 0UL) ? us : 1UL);
+}
+
+/*
+ * Throughput of memcpy (word-wide, or RVV from MEMCPY_RVV_THRESHOLD on if
+ * the harts have V), memset and clear_page per size class, against a byte
+ * loop. Copies are offset by 8 bytes from the page start, as most callers'
+ * buffers are only 8-byte aligned.
+ */
+void ktest_mem_bench(void)
+{
+	static const size_t sizes[] = { 16U, 64U, 256U, 1024U, 4096U, 16384U, 65528U };
+	uint8_t *src = (uint8_t *)bench_src + 8U;
+	uint8_t *dst = (uint8_t *)bench_dst + 8U;
+	uint64_t start, t_byte, t_copy, t_set, iters, i;
+	uint32_t idx;
+	size_t size;
+
+	pr_info("ktest: mem bench, memcpy %s, cbo.zero block %lu", has_vector() ? "rvv/word" : "word",
+		cboz_block_size);
+	pr_info("ktest: %-6s %-10s %-10s %-10s (MB/s)", "size", "bytewise", "memcpy", "memset");
+	for (idx = 0U; idx < ARRAY_SIZE(sizes); idx++) {
+		size = sizes[idx];
+		iters = BENCH_MEM_BYTES / size;
+
+		start = cpu_ticks();
+		for (i = 0UL; i < iters; i++) {
+			bench_memcpy_bytewise(dst, src, size);
+		}
+		t_byte = cpu_ticks() - start;
+
+		start = cpu_ticks();
+		for (i = 0UL; i < iters; i++) {
+			memcpy(dst, src, size);
+		}
+		t_copy = cpu_ticks() - start;
+
+		start = cpu_ticks();
+		for (i = 0UL; i < iters; i++) {
+			(void)memset(dst, (uint8_t)i, size);
+		}
+		t_set = cpu_ticks() - start;
+
+		pr_info("ktest: %-6lu %-10lu %-10lu %-10lu", size, bench_mbps(iters * size, t_byte),
+			bench_mbps(iters * size, t_copy), bench_mbps(iters * size, t_set));
+	}
+
+	iters = BENCH_MEM_BYTES / PAGE_SIZE;
+	start = cpu_ticks();
+	for (i = 0UL; i < iters; i++) {
+		(void)memset(&bench_dst[i % ARRAY_SIZE(bench_dst)], 0U, PAGE_SIZE);
+	}
+	t_set = cpu_ticks() - start;
+
+	start = cpu_ticks();
+	for (i = 0UL; i < iters; i++) {
+		clear_page(&bench_dst[i % ARRAY_SIZE(bench_dst)]);
+	}
+	t_copy = cpu_ticks() - start;
+
+	pr_info("ktest: page clear: memset %lu MB/s, clear_page %lu MB/s", bench_mbps(iters * PAGE_SIZE, t_set),
+		bench_mbps(iters * PAGE_SIZE, t_copy));
+}
@@ -0,0 +1,14 @@
+/*
+ * Copyright (C) 2023-2024 Intel Corporation. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef __RISCV_KTEST_BENCH_H__
+#define __RISCV_KTEST_BENCH_H__
+
+/* hypervisor side microbenchmarks, run once on the BSP before any VM starts */
+extern void ktest_timer_bench(void);
+extern void ktest_mem_bench(void);
+
+#endif
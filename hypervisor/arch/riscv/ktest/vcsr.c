@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2025 Intel Corporation. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <types.h>
+#include <asm/cpu.h>
+#include <asm/per_cpu.h>
+#include <asm/guest/vcpu.h>
+#include <asm/guest/vmcs.h>
+#include <debug/logmsg.h>
+#include "vcsr.h"
+
+#define KTEST_VS_CSRS		3U
+
+/* CSRs the guest does not depend on before it runs, so nothing has to be put back */
+static const uint32_t ktest_vs_idx[KTEST_VS_CSRS] = { VS_CSR_SSCRATCH, VS_CSR_STVAL, VS_CSR_SEPC };
+
+static uint64_t ktest_read_hart(uint32_t idx)
+{
+	uint64_t value;
+
+	switch (idx) {
+	case VS_CSR_SSCRATCH:
+		value = cpu_csr_read(vsscratch);
+		break;
+	case VS_CSR_STVAL:
+		value = cpu_csr_read(vstval);
+		break;
+	default:
+		value = cpu_csr_read(vsepc);
+		break;
+	}
+
+	return value;
+}
+
+/*
+ * Queue a write with vcpu_set_vs_csr(), let load_vmcs() write it back as on
+ * a VM entry and check that the hart now holds it. The old values are
+ * queued again afterwards, init_vmcs() rewrites all of them anyway.
+ */
+void ktest_vs_csr(struct acrn_vcpu *vcpu)
+{
+	uint64_t old[KTEST_VS_CSRS], expect, actual;
+	uint32_t i, failed = 0U;
+
+	if (pcpuid_from_vcpu(vcpu) != get_pcpu_id()) {
+		pr_info("ktest: vs csr skipped, vcpu%hu is not on this pCPU", vcpu->vcpu_id);
+		return;
+	}
+
+	/* give up ownership, so that every lazily switched CSR is written */
+	get_cpu_var(vs_owner) = NULL;
+	for (i = 0U; i < KTEST_VS_CSRS; i++) {
+		old[i] = vcpu_get_vs_csr(vcpu, ktest_vs_idx[i]);
+		vcpu_set_vs_csr(vcpu, ktest_vs_idx[i], 0x5a5a0000a5a50000UL | ktest_vs_idx[i]);
+	}
+	load_vmcs(vcpu);
+
+	for (i = 0U; i < KTEST_VS_CSRS; i++) {
+		expect = 0x5a5a0000a5a50000UL | ktest_vs_idx[i];
+		actual = ktest_read_hart(ktest_vs_idx[i]);
+		if (actual != expect) {
+			pr_err("ktest: vs csr %u: wrote 0x%lx, read 0x%lx", ktest_vs_idx[i], expect, actual);
+			failed++;
+		}
+		vcpu_set_vs_csr(vcpu, ktest_vs_idx[i], old[i]);
+	}
+
+	pr_info("ktest: vs csr lazy write-back %s", (failed == 0U) ? "passed" : "FAILED");
+}
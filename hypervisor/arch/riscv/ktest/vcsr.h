@@ -0,0 +1,15 @@
+/*
+ * Copyright (C) 2025 Intel Corporation. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef __RISCV_KTEST_VCSR_H__
+#define __RISCV_KTEST_VCSR_H__
+
+struct acrn_vcpu;
+
+/* lazy VS CSR switch check, run on the pCPU of @vcpu before it first runs */
+extern void ktest_vs_csr(struct acrn_vcpu *vcpu);
+
+#endif
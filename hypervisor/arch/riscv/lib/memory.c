@@ -7,13 +7,53 @@
  *   Haicheng Li <haicheng.li@intel.com>
  */
 #include <types.h>
+#include <asm/system.h>
+#include <asm/cache.h>
+#include <asm/page.h>
+#include <asm/float.h>
+#include <asm/lib/string.h>
+
+/* below this, setting up the vector unit costs more than it saves */
+#define MEMCPY_RVV_THRESHOLD	1024U
+
+/* cache block size cbo.zero clears, 0 without Zicboz */
+size_t cboz_block_size;
+
+static inline bool mem_aligned(const void *p)
+{
+	return (((uint64_t)p) & 7UL) == 0UL;
+}
 
 void *memset(void *base, uint8_t v, size_t n)
 {
-	void *p = base;
+	uint8_t *p = (uint8_t *)base;
+	uint64_t *q;
+	uint64_t word = 0x0101010101010101UL * v;
+	size_t left = n;
 
-	for (size_t i = 0; i < n; i++) {
-		*(uint8_t *)p++ = v;
+	while ((left != 0U) && !mem_aligned(p)) {
+		*p++ = v;
+		left--;
+	}
+
+	q = (uint64_t *)p;
+	while (left >= 32U) {
+		q[0] = word;
+		q[1] = word;
+		q[2] = word;
+		q[3] = word;
+		q += 4;
+		left -= 32U;
+	}
+	while (left >= 8U) {
+		*q++ = word;
+		left -= 8U;
+	}
+
+	p = (uint8_t *)q;
+	while (left != 0U) {
+		*p++ = v;
+		left--;
 	}
 
 	return base;
@@ -28,10 +68,82 @@ void *memset_s(void *base, uint8_t v, size_t n)
 	return base;
 }
 
+/*
+ * Interrupts stay off while the vector registers hold hypervisor data, and
+ * the vCPU whose vector state was live in them gets it back on its next
+ * entry. Restoring sstatus also turns sstatus.VS back off.
+ */
+static void memcpy_rvv(void *d, const void *s, size_t slen)
+{
+	uint64_t rflags, vl;
+	uint8_t *dst = (uint8_t *)d;
+	const uint8_t *src = (const uint8_t *)s;
+	size_t left = slen;
+
+	CPU_INT_ALL_DISABLE(&rflags);
+	release_fp_state();
+	asm volatile (
+		".option push\n\t"
+		".option arch, +v\n\t"
+		"csrs sstatus, %4\n\t"
+		"1:\n\t"
+		"vsetvli %3, %2, e8, m8, ta, ma\n\t"
+		"vle8.v v0, (%1)\n\t"
+		"vse8.v v0, (%0)\n\t"
+		"add %1, %1, %3\n\t"
+		"add %0, %0, %3\n\t"
+		"sub %2, %2, %3\n\t"
+		"bnez %2, 1b\n\t"
+		".option pop\n\t"
+		: "+r"(dst), "+r"(src), "+r"(left), "=&r"(vl)
+		: "r"(SSTATUS_VS_INITIAL)
+		: "memory"
+	);
+	CPU_INT_ALL_RESTORE(rflags);
+}
+
 void memcpy(void *d, const void *s, size_t slen)
 {
-	for (size_t i = 0; i < slen; i++) {
-		*(uint8_t *)d++ = *(uint8_t *)s++;
+	uint8_t *dst = (uint8_t *)d;
+	const uint8_t *src = (const uint8_t *)s;
+	uint64_t *qd;
+	const uint64_t *qs;
+	size_t left = slen;
+
+	if (has_vector() && (slen >= MEMCPY_RVV_THRESHOLD)) {
+		memcpy_rvv(d, s, slen);
+		left = 0U;
+	} else if (((((uint64_t)dst) ^ ((uint64_t)src)) & 7UL) == 0UL) {
+		/* same misalignment, so both become aligned after the head */
+		while ((left != 0U) && !mem_aligned(dst)) {
+			*dst++ = *src++;
+			left--;
+		}
+
+		qd = (uint64_t *)dst;
+		qs = (const uint64_t *)src;
+		while (left >= 32U) {
+			qd[0] = qs[0];
+			qd[1] = qs[1];
+			qd[2] = qs[2];
+			qd[3] = qs[3];
+			qd += 4;
+			qs += 4;
+			left -= 32U;
+		}
+		while (left >= 8U) {
+			*qd++ = *qs++;
+			left -= 8U;
+		}
+		dst = (uint8_t *)qd;
+		src = (const uint8_t *)qs;
+	} else {
+		/* misaligned word accesses may trap to firmware, copy bytewise */
+	}
+
+	while (left != 0U) {
+		*dst++ = *src++;
+		left--;
 	}
 }
 
@@ -50,3 +162,23 @@ int32_t memcpy_s(void *d, size_t dmax, const void *s, size_t slen)
 
 	return ret;
 }
+
+/*
+ * Zero a page of normal, cacheable memory. With Zicboz, whole cache blocks
+ * are zeroed without reading them in first.
+ *
+ * @pre page is PAGE_SIZE aligned
+ */
+void clear_page(void *page)
+{
+	uint8_t *p = (uint8_t *)page;
+	uint8_t *end = p + PAGE_SIZE;
+
+	if (cboz_block_size != 0U) {
+		for (; p < end; p += cboz_block_size) {
+			zero_dcache(p);
+		}
+	} else {
+		(void)memset(page, 0U, PAGE_SIZE);
+	}
+}
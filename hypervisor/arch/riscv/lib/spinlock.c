@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2023-2024 Intel Corporation. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <types.h>
+#include <ticks.h>
+#include <asm/cpu.h>
+#include <asm/current.h>
+#include <asm/lib/bits.h>
+#include <asm/lib/atomic.h>
+#include <asm/lib/spinlock.h>
+
+/* queue nodes a pCPU may use at once: locks nested in thread and IRQ context */
+#define MCS_NODES_PER_CPU	8U
+
+/* a waiter k tickets away from the lock pauses k times this before looking again */
+#define TICKET_BACKOFF_PAUSES	16U
+
+struct mcs_node {
+	struct mcs_node *next;
+	uint64_t locked;
+} __aligned(1UL << CONFIG_RISCV_L1_CACHE_SHIFT);
+
+static struct mcs_node mcs_nodes[NR_CPUS][MCS_NODES_PER_CPU];
+static uint64_t mcs_nodes_used[NR_CPUS];
+
+/* the lock type of each class is chosen here */
+struct spinlock_class spinlock_classes[LOCK_CLASS_NUM] = {
+	[LOCK_CLASS_SCHED]	= { .name = "sched",		.type = SPINLOCK_TICKET },
+	[LOCK_CLASS_TIMER]	= { .name = "timer",		.type = SPINLOCK_TICKET },
+	[LOCK_CLASS_EMUL_MMIO]	= { .name = "emul_mmio",	.type = SPINLOCK_MCS },
+	[LOCK_CLASS_VPLIC]	= { .name = "vplic",		.type = SPINLOCK_TICKET },
+	[LOCK_CLASS_VAPLIC]	= { .name = "vaplic",		.type = SPINLOCK_MCS },
+	[LOCK_CLASS_VCLINT]	= { .name = "vclint",		.type = SPINLOCK_MCS },
+	[LOCK_CLASS_S2PT]	= { .name = "s2pt",		.type = SPINLOCK_MCS },
+};
+
+void spinlock_init_class(spinlock_t *lock, enum spinlock_class_id id)
+{
+	spinlock_init(lock);
+	lock->cls = &spinlock_classes[id];
+}
+
+/* interrupts taking a node in between make test_and_set fail, try again */
+static struct mcs_node *mcs_node_get(void)
+{
+	uint16_t pcpu_id = get_pcpu_id();
+	uint16_t idx;
+
+	do {
+		idx = ffz64(mcs_nodes_used[pcpu_id]);
+		ASSERT(idx < MCS_NODES_PER_CPU, "out of MCS nodes");
+	} while (bitmap_test_and_set_lock(idx, &mcs_nodes_used[pcpu_id]));
+
+	return &mcs_nodes[pcpu_id][idx];
+}
+
+static void mcs_node_put(const struct mcs_node *node)
+{
+	uint64_t idx = (uint64_t)(node - &mcs_nodes[0][0]);
+
+	bitmap_clear_lock((uint16_t)(idx % MCS_NODES_PER_CPU), &mcs_nodes_used[idx / MCS_NODES_PER_CPU]);
+}
+
+/* swap in new if *p is still old, with release semantics on success */
+static inline bool mcs_cmpxchg(struct mcs_node **p, struct mcs_node *old, struct mcs_node *new)
+{
+	uint64_t ret, rc;
+
+	asm volatile (
+		"0: lr.d %0, %2\n\t"
+		"   bne %0, %3, 1f\n\t"
+		"   sc.d.rl %1, %4, %2\n\t"
+		"   bnez %1, 0b\n\t"
+		"1:\n"
+		: "=&r"(ret), "=&r"(rc), "+A"(*p)
+		: "r"(old), "r"(new)
+		: "memory");
+
+	return (ret == (uint64_t)old);
+}
+
+/* return true if the lock was contended */
+static bool mcs_obtain(spinlock_t *lock)
+{
+	struct mcs_node *node = mcs_node_get();
+	struct mcs_node *prev;
+	bool contended = false;
+
+	node->next = NULL;
+	node->locked = 0UL;
+	prev = (struct mcs_node *)atomic_swap64((volatile uint64_t *)&lock->mcs_tail, (uint64_t)node);
+	if (prev != NULL) {
+		contended = true;
+		*(struct mcs_node * volatile *)&prev->next = node;
+		while (*(volatile uint64_t *)&node->locked == 0UL) {
+			cpu_relax();
+		}
+		asm volatile ("fence r, rw" ::: "memory");
+	}
+	lock->mcs_owner = node;
+
+	return contended;
+}
+
+static void mcs_release(spinlock_t *lock)
+{
+	struct mcs_node *node = lock->mcs_owner;
+	struct mcs_node *next = *(struct mcs_node * volatile *)&node->next;
+
+	if ((next == NULL) && !mcs_cmpxchg(&lock->mcs_tail, node, NULL)) {
+		/* a waiter swapped itself in, but has not linked to us yet */
+		do {
+			cpu_relax();
+			next = *(struct mcs_node * volatile *)&node->next;
+		} while (next == NULL);
+	}
+
+	if (next != NULL) {
+		asm volatile ("fence rw, w" ::: "memory");
+		*(volatile uint64_t *)&next->locked = 1UL;
+	}
+	mcs_node_put(node);
+}
+
+/* ticket lock which backs off in proportion to its place in the queue */
+static bool ticket_obtain(spinlock_t *lock)
+{
+	uint64_t ticket = (uint64_t)atomic_add64_return(1L, (int64_t *)&lock->head) - 1UL;
+	uint64_t owner, i;
+	bool contended = false;
+
+	while (true) {
+		owner = *(volatile uint64_t *)&lock->tail;
+		if (owner == ticket) {
+			break;
+		}
+		contended = true;
+		for (i = (ticket - owner) * TICKET_BACKOFF_PAUSES; i > 0UL; i--) {
+			cpu_relax();
+		}
+	}
+	asm volatile ("fence r, rw" ::: "memory");
+
+	return contended;
+}
+
+#ifdef CONFIG_LOCK_STATS
+static inline void lock_stat_add(uint64_t *stat, uint64_t val)
+{
+	asm volatile ("amoadd.d zero, %1, %0" : "+A"(*stat) : "r"(val) : "memory");
+}
+
+static inline void lock_stat_max(uint64_t *stat, uint64_t val)
+{
+	asm volatile ("amomaxu.d zero, %1, %0" : "+A"(*stat) : "r"(val) : "memory");
+}
+#endif
+
+void spinlock_class_obtain(spinlock_t *lock)
+{
+	struct spinlock_class *cls = lock->cls;
+	bool contended;
+#ifdef CONFIG_LOCK_STATS
+	uint64_t start = cpu_ticks();
+#endif
+
+	if (cls->type == SPINLOCK_MCS) {
+		contended = mcs_obtain(lock);
+	} else {
+		contended = ticket_obtain(lock);
+	}
+
+#ifdef CONFIG_LOCK_STATS
+	lock_stat_add(&cls->acquired, 1UL);
+	if (contended) {
+		lock_stat_add(&cls->contended, 1UL);
+		lock_stat_max(&cls->max_wait, cpu_ticks() - start);
+	}
+#endif
+}
+
+void spinlock_class_release(spinlock_t *lock)
+{
+	if (lock->cls->type == SPINLOCK_MCS) {
+		mcs_release(lock);
+	} else {
+		asm volatile ("amoadd.d.rl zero, %1, %0" : "+A"(lock->tail) : "r"(1UL) : "memory");
+	}
+}
+
+void spinlock_class_reset_stats(void)
+{
+	uint32_t i;
+
+	for (i = 0U; i < LOCK_CLASS_NUM; i++) {
+		spinlock_classes[i].acquired = 0UL;
+		spinlock_classes[i].contended = 0UL;
+		spinlock_classes[i].max_wait = 0UL;
+	}
+}
@@ -18,6 +18,8 @@
 #include <asm/board.h>
 #include <asm/cache.h>
 #include <asm/page.h>
+#include <asm/smp.h>
+#include <asm/cpumask.h>
 
 #ifndef CONFIG_MACRN
 
@@ -105,16 +107,26 @@ static void map_hv(uint64_t boot_phys_offset)
 	switch_satp(init_satp);
 }
 
+static void tlb_all_sync(void)
+{
+	if (!smp_ops)
+		return;
+
+	return smp_ops->rfence(cpu_online_map, 0, 0);
+}
+
 static void map_mem(void)
 {
-	mmu_add((uint64_t *)acrn_vpn3, BOARD_HV_DEVICE_START,
+	(void)mmu_add((uint64_t *)acrn_vpn3, BOARD_HV_DEVICE_START,
 		BOARD_HV_DEVICE_START, BOARD_HV_DEVICE_SIZE,
 		PAGE_V | PAGE_ATTR_IO,
 		&ppt_mem_ops);
 
-	mmu_add((uint64_t *)acrn_vpn3, BOARD_HV_RAM_START, BOARD_HV_RAM_START, BOARD_HV_RAM_SIZE,
+	(void)mmu_add((uint64_t *)acrn_vpn3, BOARD_HV_RAM_START, BOARD_HV_RAM_START, BOARD_HV_RAM_SIZE,
 		PAGE_V | PAGE_ATTR_PMA | PAGE_U,
 		&ppt_mem_ops);
+
+	tlb_all_sync();
 }
 
 static void clear_table(void *table)
@@ -17,6 +17,7 @@
 #include <asm/lib/bits.h>
 #include <debug/logmsg.h>
 #include <softirq.h>
+#include <trace.h>
 #include "uart.h"
 #include "trap.h"
 
@@ -71,11 +72,11 @@ static void mswi_handler(void)
 		:: "r"(off): "memory"
 	);
 
+	TRACE_2L(TRACE_IPI_RECV, per_cpu(swi_vector, cpu).type, 0UL);
 	if (test_bit(NOTIFY_VCPU_SWI, per_cpu(swi_vector, cpu).type))
 		clear_bit(NOTIFY_VCPU_SWI, &(per_cpu(swi_vector, cpu).type));
 
-	if (test_bit(SMP_FUNC_CALL, per_cpu(swi_vector, cpu).type)) {
-		clear_bit(SMP_FUNC_CALL, &(per_cpu(swi_vector, cpu).type));
+	if (bitmap_test_and_clear_lock(SMP_FUNC_CALL, &(per_cpu(swi_vector, cpu).type))) {
 		kick_notification();
 	}
 }
@@ -92,6 +93,7 @@ static void mtimer_handler(void)
 		:: "r"(addr), "r"(CLINT_DISABLE_TIMER), "r"(val): "memory"
 	);
 #ifdef CONFIG_MACRN
+	TRACE_2L(TRACE_TIMER_IRQ, 0UL, 0UL);
 	hv_timer_handler();
 #endif
 }
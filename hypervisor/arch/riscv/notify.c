@@ -16,30 +16,97 @@
 #include <asm/smp.h>
 #include <asm/current.h>
 #include <asm/cpumask.h>
-#include <asm/lib/spinlock.h>
+#include <asm/lib/atomic.h>
 
-static volatile uint64_t smp_call_mask;
-spinlock_t smpcall_lock;
+/*
+ * Each pCPU owns a multi-producer, single-consumer call queue. Producers
+ * reserve a slot by bumping tail and publish it through the slot seq,
+ * so any number of cross calls may be in flight towards any set of pCPUs
+ * without a global lock. Only the owning pCPU consumes its queue, either
+ * from the SMP_FUNC_CALL software interrupt or while it is itself
+ * waiting for a cross call to complete.
+ */
+
+static void smp_call_complete(struct smp_call_token *token)
+{
+	if (token != NULL) {
+		(void)atomic_dec64_return((int64_t *)&token->pending);
+	}
+}
+
+static void drain_call_queue(struct smp_call_queue *q)
+{
+	struct smp_call_slot *slot;
+	smp_call_func_t func;
+	struct smp_call_token *token;
+	void *data;
+	uint64_t head = q->head;
+
+	while (true) {
+		slot = &q->slots[head & (SMP_CALL_QUEUE_SIZE - 1U)];
+		if (slot->seq != (head + 1UL)) {
+			break;
+		}
+		cpu_memory_barrier();
+		func = slot->func;
+		data = slot->data;
+		token = slot->token;
+		cpu_memory_barrier();
+		/* hand the slot back to the producer of the next lap */
+		slot->seq = head + SMP_CALL_QUEUE_SIZE;
+		head++;
+		q->head = head;
+
+		func(data);
+		smp_call_complete(token);
+	}
+}
 
 /* run in interrupt context */
 void kick_notification(void)
 {
-	uint16_t pcpu_id = get_pcpu_id();
+	drain_call_queue(&get_cpu_var(smp_call_queue));
+}
+
+/*
+ * Drain the local queue with interrupts masked so that it never races
+ * with kick_notification() on this pCPU. Called from every busy wait in
+ * this file: a pCPU that waits on a remote pCPU must keep serving calls
+ * aimed at itself, otherwise two pCPUs calling each other with
+ * interrupts disabled would deadlock.
+ */
+static void poll_local_calls(void)
+{
 	uint64_t flags;
 
-	spin_lock_irqsave(&smpcall_lock, &flags);
-	if (test_bit(pcpu_id, smp_call_mask)) {
-		struct smp_call_info_data *smp_call =
-			&per_cpu(smp_call_info, pcpu_id);
+	CPU_INT_ALL_DISABLE(&flags);
+	drain_call_queue(&get_cpu_var(smp_call_queue));
+	CPU_INT_ALL_RESTORE(flags);
+}
+
+static void smp_call_enqueue(uint16_t pcpu_id, smp_call_func_t func, void *data,
+		struct smp_call_token *token)
+{
+	struct smp_call_queue *q = &per_cpu(smp_call_queue, pcpu_id);
+	struct smp_call_slot *slot;
+	uint64_t pos;
 
-		if (smp_call->func != NULL) {
-			smp_call->func(smp_call->data);
-		}
-		smp_call->func = NULL;
-		smp_call->data = NULL;
-		clear_bit(pcpu_id, &smp_call_mask);
+	pos = (uint64_t)atomic_inc64_return((int64_t *)&q->tail) - 1UL;
+	slot = &q->slots[pos & (SMP_CALL_QUEUE_SIZE - 1U)];
+
+	/* the queue is full until the target consumes the previous lap */
+	while (slot->seq != pos) {
+		poll_local_calls();
+		cpu_relax();
 	}
-	spin_unlock_irqrestore(&smpcall_lock, flags);
+
+	slot->func = func;
+	slot->data = data;
+	slot->token = token;
+	cpu_write_memory_barrier();
+	slot->seq = pos + 1UL;
+
+	smp_ops->send_single_swi(pcpu_id, SMP_FUNC_CALL);
 }
 
 /* wait until *sync == wake_sync */
@@ -50,43 +117,142 @@ void wait_sync_change(volatile const uint64_t *sync, uint64_t wake_sync)
 	}
 }
 
-void smp_call_function(uint64_t mask, smp_call_func_t func, void *data)
+/*
+ * Queue func(data) on every pCPU in mask and return without waiting.
+ * The function runs synchronously if the current pCPU is in mask.
+ * data must stay valid until smp_call_done(token) becomes true.
+ */
+void smp_call_function_async(uint64_t mask, smp_call_func_t func, void *data,
+		struct smp_call_token *token)
 {
 	uint16_t pcpu_id;
-	struct smp_call_info_data *smp_call;
-	uint64_t flags;
+	uint16_t self = get_pcpu_id();
+	uint64_t targets = 0UL;
+	bool run_local = false;
 
-	/* wait for previous smp call complete, which may run on other cpus */
-	while (smp_call_mask);
-	spin_lock_irqsave(&smpcall_lock, &flags);
-	smp_call_mask |= mask;
+	token->pending = 0;
 
 	pcpu_id = ffs64(mask);
 	while (pcpu_id < CONFIG_NR_CPUS) {
 		__clear_bit(pcpu_id, &mask);
-		if (pcpu_id == get_pcpu_id()) {
-			func(data);
-			__clear_bit(pcpu_id, &mask);
-			__clear_bit(pcpu_id, &smp_call_mask);
+		if (pcpu_id == self) {
+			run_local = true;
 		} else if (cpu_online(pcpu_id)) {
-			smp_call = &per_cpu(smp_call_info, pcpu_id);
-			smp_call->func = func;
-			smp_call->data = data;
-			smp_ops->send_single_swi(pcpu_id, SMP_FUNC_CALL);
+			__set_bit(pcpu_id, &targets);
+			token->pending++;
 		} else {
 			/* pcpu is not in active, print error */
 			pr_err("pcpu_id %d not in active!", pcpu_id);
-			__clear_bit(pcpu_id, &smp_call_mask);
 		}
 		pcpu_id = ffs64(mask);
 	}
-	spin_unlock_irqrestore(&smpcall_lock, flags);
-	/* wait for current smp call complete */
-	wait_sync_change(&smp_call_mask, 0UL);
+	/* publish the count before any target can decrement it */
+	cpu_memory_barrier();
+
+	pcpu_id = ffs64(targets);
+	while (pcpu_id < CONFIG_NR_CPUS) {
+		__clear_bit(pcpu_id, &targets);
+		smp_call_enqueue(pcpu_id, func, data, token);
+		pcpu_id = ffs64(targets);
+	}
+
+	/* overlap the local run with the remote ones */
+	if (run_local) {
+		func(data);
+	}
+}
+
+bool smp_call_done(const struct smp_call_token *token)
+{
+	return (token->pending == 0);
+}
+
+void smp_call_wait(const struct smp_call_token *token)
+{
+	while (!smp_call_done(token)) {
+		poll_local_calls();
+		cpu_relax();
+	}
+	cpu_memory_barrier();
+}
+
+void smp_call_function(uint64_t mask, smp_call_func_t func, void *data)
+{
+	struct smp_call_token token;
+
+	smp_call_function_async(mask, func, data, &token);
+	smp_call_wait(&token);
+}
+
+/*
+ * Queued runner of a coalesced call. queued is cleared before sampling
+ * req_gen, so a request that arrives after the sample queues a new run.
+ */
+static void smp_call_coalesced_run(void *data)
+{
+	struct smp_call_coalesced *call = (struct smp_call_coalesced *)data;
+	uint16_t pcpu_id = get_pcpu_id();
+	uint64_t gen;
+
+	call->cpu[pcpu_id].queued = 0UL;
+	cpu_memory_barrier();
+	gen = call->cpu[pcpu_id].req_gen;
+
+	call->func(NULL);
+
+	cpu_memory_barrier();
+	call->cpu[pcpu_id].done_gen = gen;
+}
+
+void smp_call_function_coalesced(uint64_t mask, struct smp_call_coalesced *call)
+{
+	uint64_t gen[CONFIG_NR_CPUS];
+	uint64_t targets = 0UL;
+	uint16_t self = get_pcpu_id();
+	uint16_t pcpu_id;
+
+	pcpu_id = ffs64(mask);
+	while (pcpu_id < CONFIG_NR_CPUS) {
+		__clear_bit(pcpu_id, &mask);
+		if ((pcpu_id != self) && cpu_online(pcpu_id)) {
+			gen[pcpu_id] = (uint64_t)atomic_inc64_return(
+					(int64_t *)&call->cpu[pcpu_id].req_gen);
+			if (atomic_swap64(&call->cpu[pcpu_id].queued, 1UL) == 0UL) {
+				smp_call_enqueue(pcpu_id, smp_call_coalesced_run, call, NULL);
+			}
+			__set_bit(pcpu_id, &targets);
+		} else if (pcpu_id == self) {
+			call->func(NULL);
+		} else {
+			pr_err("pcpu_id %d not in active!", pcpu_id);
+		}
+		pcpu_id = ffs64(mask);
+	}
+
+	pcpu_id = ffs64(targets);
+	while (pcpu_id < CONFIG_NR_CPUS) {
+		__clear_bit(pcpu_id, &targets);
+		while ((int64_t)(call->cpu[pcpu_id].done_gen - gen[pcpu_id]) < 0) {
+			poll_local_calls();
+			cpu_relax();
+		}
+		pcpu_id = ffs64(targets);
+	}
+	cpu_memory_barrier();
 }
 
 void smp_call_init(void)
 {
-	spinlock_init(&smpcall_lock);
-	smp_call_mask = 0UL;
+	uint16_t pcpu_id;
+	uint32_t i;
+
+	for (pcpu_id = 0U; pcpu_id < CONFIG_NR_CPUS; pcpu_id++) {
+		struct smp_call_queue *q = &per_cpu(smp_call_queue, pcpu_id);
+
+		q->head = 0UL;
+		q->tail = 0UL;
+		for (i = 0U; i < SMP_CALL_QUEUE_SIZE; i++) {
+			q->slots[i].seq = i;
+		}
+	}
 }
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2023-2024 Intel Corporation. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <types.h>
+#include <asm/lib/bits.h>
+#include <asm/lib/string.h>
+#include <asm/page.h>
+#include <logmsg.h>
+
+/* NULL once the pool is exhausted */
+struct page *alloc_page(struct page_pool *pool)
+{
+	struct page *page = NULL;
+	uint64_t loop_idx, idx, bit;
+
+	spinlock_obtain(&pool->lock);
+	for (loop_idx = pool->last_hint_id;
+		loop_idx < (pool->last_hint_id + pool->bitmap_size); loop_idx++) {
+		idx = loop_idx % pool->bitmap_size;
+		if (*(pool->bitmap + idx) != ~0UL) {
+			bit = ffz64(*(pool->bitmap + idx));
+			bitmap_set_nolock(bit, pool->bitmap + idx);
+			page = pool->start_page + ((idx << 6U) + bit);
+
+			pool->last_hint_id = idx;
+			pool->used_pages++;
+			if (pool->used_pages > pool->peak_pages) {
+				pool->peak_pages = pool->used_pages;
+			}
+			break;
+		}
+	}
+	if (page == NULL) {
+		pool->failed_allocs++;
+	}
+	spinlock_release(&pool->lock);
+
+	if (page == NULL) {
+		pr_err("%s: page pool exhausted, %lu pages in use", __func__, pool->used_pages);
+	} else {
+		clear_page(page);
+	}
+	return page;
+}
+
+/*
+ *@pre: ((page - pool->start_page) >> 6U) < pool->bitmap_size
+ */
+void free_page(struct page_pool *pool, struct page *page)
+{
+	uint64_t idx, bit;
+
+	ASSERT((page >= pool->start_page) && (page < (pool->start_page + (pool->bitmap_size << 6U))),
+		"page %p is not in the pool", page);
+
+	spinlock_obtain(&pool->lock);
+	idx = (page - pool->start_page) >> 6U;
+	bit = (page - pool->start_page) & 0x3fUL;
+	ASSERT(bitmap_test((uint16_t)bit, pool->bitmap + idx), "page %p freed twice", page);
+	bitmap_clear_nolock(bit, pool->bitmap + idx);
+	pool->used_pages--;
+	spinlock_release(&pool->lock);
+}
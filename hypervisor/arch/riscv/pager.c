@@ -15,17 +15,26 @@
 #include <asm/vm_config.h>
 
 #define VPN3_PAGE_NUM(size)	1UL
-#define VPN2_PAGE_NUM(size)	(((size) + VPN3_SIZE - 1UL) >> VPN3_SHIFT)
-#define VPN1_PAGE_NUM(size)	(((size) + VPN2_SIZE - 1UL) >> VPN2_SHIFT)
-#define VPN0_PAGE_NUM(size)	(((size) + VPN1_SIZE - 1UL) >> VPN1_SHIFT)
 
 #ifndef CONFIG_MACRN
 static struct page vm_vpn3_pages[CONFIG_MAX_VM_NUM][VPN3_PAGE_NUM(CONFIG_GUEST_ADDRESS_SPACE_SIZE)] __aligned(PAGE_SIZE << 2);
-static struct page vm_vpn2_pages[CONFIG_MAX_VM_NUM][VPN2_PAGE_NUM(CONFIG_GUEST_ADDRESS_SPACE_SIZE)] __aligned(PAGE_SIZE);
-static struct page vm_vpn1_pages[CONFIG_MAX_VM_NUM][VPN1_PAGE_NUM(CONFIG_GUEST_ADDRESS_SPACE_SIZE)] __aligned(PAGE_SIZE);
-static struct page vm_vpn0_pages[CONFIG_MAX_VM_NUM][VPN0_PAGE_NUM(CONFIG_GUEST_ADDRESS_SPACE_SIZE)] __aligned(PAGE_SIZE);
+
+/*
+ * The non-root stage-2 table pages of all VMs come from one shared pool and
+ * are only taken when a GPA range gets populated.
+ */
+static struct page s2pt_pages[CONFIG_S2PT_PAGE_NUM];
+static uint64_t s2pt_page_bitmap[CONFIG_S2PT_PAGE_NUM >> 6U];
+
+static struct page_pool s2pt_page_pool = {
+	.start_page = s2pt_pages,
+	.bitmap_size = CONFIG_S2PT_PAGE_NUM >> 6U,
+	.bitmap = s2pt_page_bitmap,
+	.last_hint_id = 0UL,
+};
 
 static union pgtable_pages_info s2pt_pages_info[CONFIG_MAX_VM_NUM];
+static struct pgtable_stats s2pt_stats[CONFIG_MAX_VM_NUM];
 #endif
 
 static inline bool large_page_support(enum _page_table_level level)
@@ -53,14 +62,14 @@ static inline uint64_t ppt_pgentry_present(uint64_t pte)
 static inline struct page *ppt_get_vpn3_page(const union pgtable_pages_info *info)
 {
 	struct page *vpn3_page = info->ppt.vpn3_base;
-	(void)memset(vpn3_page, 0U, PAGE_SIZE);
+	clear_page(vpn3_page);
 	return vpn3_page;
 }
 
 static inline struct page *ppt_get_vpn2_page(const union pgtable_pages_info *info, uint64_t gpa)
 {
 	struct page *vpn2_page = info->ppt.vpn2_base + ((gpa & VPN3_MASK) >> VPN3_SHIFT);
-	(void)memset(vpn2_page, 0U, PAGE_SIZE);
+	clear_page(vpn2_page);
 	return vpn2_page;
 }
 
@@ -68,7 +77,7 @@ static inline struct page *ppt_get_vpn1_page(const union pgtable_pages_info *inf
 {
 
 	struct page *vpn1_page = info->ppt.vpn1_base + ((gpa &  VPN2_MASK) >> VPN2_SHIFT);
-	(void)memset(vpn1_page, 0U, PAGE_SIZE);
+	clear_page(vpn1_page);
 	return vpn1_page;
 }
 
@@ -76,7 +85,7 @@ static inline struct page *ppt_get_vpn0_page(const union pgtable_pages_info *inf
 {
 
 	struct page *vpn0_page = info->ppt.vpn0_base + ((gpa &  VPN1_MASK) >> VPN1_SHIFT);
-	(void)memset(vpn0_page, 0U, PAGE_SIZE);
+	clear_page(vpn0_page);
 	return vpn0_page;
 }
 
@@ -128,30 +137,28 @@ const struct memory_ops ppt_mem_ops = {
 static inline struct page *s2pt_get_vpn3_page(const union pgtable_pages_info *info)
 {
 	struct page *vpn3_page = info->s2pt.vpn3_base;
-	(void)memset(vpn3_page, 0U, PAGE_SIZE);
+	clear_page(vpn3_page);
 	return vpn3_page;
 }
 
-static inline struct page *s2pt_get_vpn2_page(const union pgtable_pages_info *info, uint64_t gpa)
+static inline struct page *s2pt_get_vpn2_page(const union pgtable_pages_info *info, __unused uint64_t gpa)
 {
-	struct page *vpn2_page = info->s2pt.vpn2_base + ((gpa & VPN3_MASK) >> VPN3_SHIFT);
-	(void)memset(vpn2_page, 0U, PAGE_SIZE);
-	return vpn2_page;
+	return alloc_page(info->s2pt.pool);
 }
 
-static inline struct page *s2pt_get_vpn1_page(const union pgtable_pages_info *info, uint64_t gpa)
+static inline struct page *s2pt_get_vpn1_page(const union pgtable_pages_info *info, __unused uint64_t gpa)
 {
+	return alloc_page(info->s2pt.pool);
+}
 
-	struct page *vpn1_page = info->s2pt.vpn1_base + ((gpa & VPN2_MASK) >> VPN2_SHIFT);
-	(void)memset(vpn1_page, 0U, PAGE_SIZE);
-	return vpn1_page;
+static inline struct page *s2pt_get_vpn0_page(const union pgtable_pages_info *info, __unused uint64_t gpa)
+{
+	return alloc_page(info->s2pt.pool);
 }
 
-static inline struct page *s2pt_get_vpn0_page(const union pgtable_pages_info *info, uint64_t gpa)
+static inline void s2pt_free_pt_page(const union pgtable_pages_info *info, struct page *page)
 {
-	struct page *vpn0_page = info->s2pt.vpn0_base + ((gpa & VPN1_MASK) >> VPN1_SHIFT);
-	(void)memset(vpn0_page, 0U, PAGE_SIZE);
-	return vpn0_page;
+	free_page(info->s2pt.pool, page);
 }
 
 static inline void s2pt_clflush_pagewalk(const void* entry)
@@ -168,24 +175,42 @@ static inline uint64_t s2pt_pgentry_present(uint64_t pte)
 	return pte & PAGE_V;
 }
 
+/* once at boot, before any VM takes table pages from the pool */
+void init_s2pt_page_pool(void)
+{
+	spinlock_init(&s2pt_page_pool.lock);
+}
+
 void init_s2pt_mem_ops(struct memory_ops *mem_ops, uint16_t vm_id)
 {
 	s2pt_pages_info[vm_id].s2pt.top_address_space = CONFIG_GUEST_ADDRESS_SPACE_SIZE;
 	s2pt_pages_info[vm_id].s2pt.vpn3_base = vm_vpn3_pages[vm_id];
-	s2pt_pages_info[vm_id].s2pt.vpn2_base = vm_vpn2_pages[vm_id];
-	s2pt_pages_info[vm_id].s2pt.vpn1_base = vm_vpn1_pages[vm_id];
-	s2pt_pages_info[vm_id].s2pt.vpn0_base = vm_vpn0_pages[vm_id];
+	s2pt_pages_info[vm_id].s2pt.pool = &s2pt_page_pool;
+
+	(void)memset(&s2pt_stats[vm_id], 0U, sizeof(struct pgtable_stats));
 
 	mem_ops->info = &s2pt_pages_info[vm_id];
+	mem_ops->stats = &s2pt_stats[vm_id];
 	mem_ops->get_default_access_right = s2pt_get_default_access_right;
 	mem_ops->pgentry_present = s2pt_pgentry_present;
 	mem_ops->get_pml4_page = s2pt_get_vpn3_page;
 	mem_ops->get_pdpt_page = s2pt_get_vpn2_page;
 	mem_ops->get_pd_page = s2pt_get_vpn1_page;
 	mem_ops->get_pt_page = s2pt_get_vpn0_page;
+	mem_ops->free_pt_page = s2pt_free_pt_page;
 	mem_ops->clflush_pagewalk = s2pt_clflush_pagewalk;
 	mem_ops->large_page_support = large_page_support;
 	mem_ops->tweak_exe_right = nop_tweak_exe_right;
 	mem_ops->recover_exe_right = nop_recover_exe_right;
 }
+
+const struct page_pool *get_s2pt_page_pool(void)
+{
+	return &s2pt_page_pool;
+}
+
+const struct pgtable_stats *get_s2pt_stats(uint16_t vm_id)
+{
+	return &s2pt_stats[vm_id];
+}
 #endif
@@ -8,6 +8,7 @@
  */
 
 #include <types.h>
+#include <errno.h>
 #include <util.h>
 #include <asm/init.h>
 #include <asm/mem.h>
@@ -49,48 +50,78 @@ static inline void construct_pte(uint64_t *ptep, uint64_t paddr, uint64_t prot,
 
 /*
  * Split a large page table into next level page table.
+ * Returns -ENOMEM, leaving the large page alone, if no table page is left.
  *
  * @pre: level could only VPN2 or VPN1
  */
-static void split_large_page(uint64_t *pte, enum _page_table_level level,
+static int32_t split_large_page(uint64_t *pte, enum _page_table_level level,
 		uint64_t vaddr, const struct memory_ops *mem_ops)
 {
 	uint64_t *pbase;
 	uint64_t ref_paddr, paddr, paddrinc;
 	uint64_t i, ref_prot;
 
+	ref_paddr = pgentry_paddr(*pte);
+	ref_prot = pgentry_prot(*pte);
+
 	switch (level) {
 	case VPN2:
-		ref_paddr = (*pte) & VPN2_PFN_MASK;
 		paddrinc = VPN1_SIZE;
-		ref_prot = (*pte) & ~VPN2_PFN_MASK;
 		pbase = (uint64_t *)mem_ops->get_pd_page(mem_ops->info, vaddr);
 		break;
 	default:	/* VPN1 */
-		ref_paddr = (*pte) & VPN1_PFN_MASK;
 		paddrinc = PTE_SIZE;
-		ref_prot = (*pte) & ~VPN1_PFN_MASK;
 		mem_ops->recover_exe_right(&ref_prot);
 		pbase = (uint64_t *)mem_ops->get_pt_page(mem_ops->info, vaddr);
 		break;
 	}
+	if (pbase == NULL) {
+		return -ENOMEM;
+	}
 
 	pr_dbg("%s, paddr: 0x%lx, pbase: 0x%lx", __func__, ref_paddr, pbase);
 
+	/* every entry of the new table is a leaf inheriting the large page's attributes */
 	paddr = ref_paddr;
 	for (i = 0UL; i < PTRS_PER_PTE; i++) {
-		if (level == VPN1) {
-			construct_pgentry(pbase + i, (void *)paddr, ref_prot, mem_ops);
-		} else {
-			construct_pte(pbase + i, paddr, ref_prot, mem_ops);
-		}
+		set_pgentry(pbase + i, (paddr >> (PAGE_SHIFT - PTE_PPN_SHIFT)) | ref_prot, mem_ops);
 		paddr += paddrinc;
 	}
 
 	ref_prot = mem_ops->get_default_access_right();
 	construct_pgentry(pte, (void *)pbase, ref_prot, mem_ops);
 
-	/* TODO: flush the TLB */
+	if (mem_ops->stats != NULL) {
+		mem_ops->stats->splits++;
+	}
+	return 0;
+}
+
+/*
+ * On MR_DEL, hand a page-table page that no longer holds any present entry
+ * back to its allocator and clear the entry that referenced it.
+ */
+static void try_to_free_pgtable_page(const struct memory_ops *mem_ops,
+		uint64_t *pde, uint64_t *pt_page, uint32_t type)
+{
+	if ((type == MR_DEL) && (mem_ops->free_pt_page != NULL)) {
+		uint64_t index;
+
+		for (index = 0UL; index < PTRS_PER_PTE; index++) {
+			uint64_t *pte = pt_page + index;
+			if (mem_ops->pgentry_present(*pte) != 0UL) {
+				break;
+			}
+		}
+
+		if (index == PTRS_PER_PTE) {
+			set_pgentry(pde, 0UL, mem_ops);
+			mem_ops->free_pt_page(mem_ops->info, (struct page *)pt_page);
+			if (mem_ops->stats != NULL) {
+				mem_ops->stats->frees++;
+			}
+		}
+	}
 }
 
 static inline void local_modify_or_del_pte(uint64_t *pte,
@@ -115,7 +146,7 @@ static inline void local_modify_or_del_pte(uint64_t *pte,
  * type: MR_DEL
  * delete [vaddr_start, vaddr_end) MT PT mapping
  */
-static void modify_or_del_pte(const uint64_t *vpn1, uint64_t vaddr_start, uint64_t vaddr_end,
+static void modify_or_del_pte(uint64_t *vpn1, uint64_t vaddr_start, uint64_t vaddr_end,
 		uint64_t prot_set, uint64_t prot_clr, const struct memory_ops *mem_ops, uint32_t type)
 {
 	uint64_t *pt_page = vpn_to_vaddr(vpn1);
@@ -139,6 +170,8 @@ static void modify_or_del_pte(const uint64_t *vpn1, uint64_t vaddr_start, uint64
 			break;
 		}
 	}
+
+	try_to_free_pgtable_page(mem_ops, vpn1, pt_page, type);
 }
 
 /*
@@ -148,12 +181,13 @@ static void modify_or_del_pte(const uint64_t *vpn1, uint64_t vaddr_start, uint64
  * type: MR_DEL
  * delete [vaddr_start, vaddr_end) MT PT mapping
  */
-static void modify_or_del_vpn1(const uint64_t *vpn2, uint64_t vaddr_start, uint64_t vaddr_end,
+static int32_t modify_or_del_vpn1(uint64_t *vpn2, uint64_t vaddr_start, uint64_t vaddr_end,
 		uint64_t prot_set, uint64_t prot_clr, const struct memory_ops *mem_ops, uint32_t type)
 {
 	uint64_t *pd_page = vpn_to_vaddr(vpn2);
 	uint64_t vaddr = vaddr_start;
 	uint64_t index = vpn1_index(vaddr);
+	int32_t ret = 0;
 
 	pr_dbg("%s, vaddr: [0x%lx - 0x%lx]", __func__, vaddr, vaddr_end);
 	for (; index < PTRS_PER_VPN1; index++) {
@@ -167,7 +201,10 @@ static void modify_or_del_vpn1(const uint64_t *vpn2, uint64_t vaddr_start, uint6
 		} else {
 			if (vpn_large(*vpn1) != 0UL) {
 				if ((vaddr_next > vaddr_end) || (!mem_aligned_check(vaddr, VPN1_SIZE))) {
-					split_large_page(vpn1, VPN1, vaddr, mem_ops);
+					ret = split_large_page(vpn1, VPN1, vaddr, mem_ops);
+					if (ret != 0) {
+						break;
+					}
 				} else {
 					local_modify_or_del_pte(vpn1, prot_set, prot_clr, type, mem_ops);
 					if (vaddr_next < vaddr_end) {
@@ -184,6 +221,9 @@ static void modify_or_del_vpn1(const uint64_t *vpn2, uint64_t vaddr_start, uint6
 		}
 		vaddr = vaddr_next;
 	}
+
+	try_to_free_pgtable_page(mem_ops, vpn2, pd_page, type);
+	return ret;
 }
 
 /*
@@ -193,12 +233,13 @@ static void modify_or_del_vpn1(const uint64_t *vpn2, uint64_t vaddr_start, uint6
  * type: MR_DEL
  * delete [vaddr_start, vaddr_end) MT PT mapping
  */
-static void modify_or_del_vpn2(const uint64_t *vpn3, uint64_t vaddr_start, uint64_t vaddr_end,
+static int32_t modify_or_del_vpn2(uint64_t *vpn3, uint64_t vaddr_start, uint64_t vaddr_end,
 		uint64_t prot_set, uint64_t prot_clr, const struct memory_ops *mem_ops, uint32_t type)
 {
 	uint64_t *vpn2_page = vpn_to_vaddr(vpn3);
 	uint64_t vaddr = vaddr_start;
 	uint64_t index = vpn2_index(vaddr);
+	int32_t ret = 0;
 
 	pr_dbg("%s, vaddr: [0x%lx - 0x%lx]", __func__, vaddr, vaddr_end);
 	for (; index < PTRS_PER_VPN2; index++) {
@@ -213,7 +254,10 @@ static void modify_or_del_vpn2(const uint64_t *vpn3, uint64_t vaddr_start, uint6
 			if (vpn_large(*vpn2) != 0UL) {
 				if ((vaddr_next > vaddr_end) ||
 						(!mem_aligned_check(vaddr, VPN2_SIZE))) {
-					split_large_page(vpn2, VPN3, vaddr, mem_ops);
+					ret = split_large_page(vpn2, VPN2, vaddr, mem_ops);
+					if (ret != 0) {
+						break;
+					}
 				} else {
 					local_modify_or_del_pte(vpn2, prot_set, prot_clr, type, mem_ops);
 					if (vaddr_next < vaddr_end) {
@@ -223,13 +267,19 @@ static void modify_or_del_vpn2(const uint64_t *vpn3, uint64_t vaddr_start, uint6
 					break;	/* done */
 				}
 			}
-			modify_or_del_vpn1(vpn2, vaddr, vaddr_end, prot_set, prot_clr, mem_ops, type);
+			ret = modify_or_del_vpn1(vpn2, vaddr, vaddr_end, prot_set, prot_clr, mem_ops, type);
+			if (ret != 0) {
+				break;
+			}
 		}
 		if (vaddr_next >= vaddr_end) {
 			break;	/* done */
 		}
 		vaddr = vaddr_next;
 	}
+
+	try_to_free_pgtable_page(mem_ops, vpn3, vpn2_page, type);
+	return ret;
 }
 
 /*
@@ -244,27 +294,127 @@ static void modify_or_del_vpn2(const uint64_t *vpn3, uint64_t vaddr_start, uint6
  * to set, prot_clr to the MT mask.
  * type: MR_DEL
  * delete [vaddr_base, vaddr_base + size ) memory region page table mapping.
+ * Returns -ENOMEM if a large page needed splitting and no table page was left.
  */
-void mmu_modify_or_del(uint64_t *vpn3_page, uint64_t vaddr_base, uint64_t size,
+int32_t mmu_modify_or_del(uint64_t *vpn3_page, uint64_t vaddr_base, uint64_t size,
 		uint64_t prot_set, uint64_t prot_clr, const struct memory_ops *mem_ops, uint32_t type)
 {
 	uint64_t vaddr = round_page_up(vaddr_base);
 	uint64_t vaddr_next, vaddr_end;
 	uint64_t *vpn3;
+	int32_t ret = 0;
 
 	vaddr_end = vaddr + round_page_down(size);
 	pr_dbg("%s, vaddr: 0x%lx, size: 0x%lx",
 		__func__, vaddr, size);
 
-	while (vaddr < vaddr_end) {
+	while ((vaddr < vaddr_end) && (ret == 0)) {
 		vaddr_next = (vaddr & VPN3_MASK) + VPN3_SIZE;
 		vpn3 = vpn3_offset(vpn3_page, vaddr);
-		if ((mem_ops->pgentry_present(*vpn3) == 0UL) && (type == MR_MODIFY)) {
-			ASSERT(false);
+		if (mem_ops->pgentry_present(*vpn3) == 0UL) {
+			ASSERT(type != MR_MODIFY);
 		} else {
-			modify_or_del_vpn2(vpn3, vaddr, vaddr_end, prot_set, prot_clr, mem_ops, type);
-			vaddr = vaddr_next;
+			ret = modify_or_del_vpn2(vpn3, vaddr, vaddr_end, prot_set, prot_clr, mem_ops, type);
+		}
+		vaddr = vaddr_next;
+	}
+
+	return ret;
+}
+
+/*
+ * A table can collapse into a single leaf of the level above when all of its
+ * entries are leaves with the same attributes, mapping one physically
+ * contiguous range that is aligned to the size of that leaf. The accessed and
+ * dirty bits are not compared.
+ */
+static bool pgtable_page_promotable(const uint64_t *pt_page, uint64_t entry_size,
+		const struct memory_ops *mem_ops)
+{
+	uint64_t first = *pt_page;
+	uint64_t paddr = pgentry_paddr(first);
+	uint64_t prot = pgentry_prot(first) & ~(PAGE_A | PAGE_D);
+	uint64_t i;
+	bool ret = false;
+
+	if ((mem_ops->pgentry_present(first) != 0UL) && (vpn_large(first) != 0UL) &&
+			mem_aligned_check(paddr, entry_size * PTRS_PER_PTE)) {
+		for (i = 1UL; i < PTRS_PER_PTE; i++) {
+			uint64_t pte = pt_page[i];
+
+			if (((pgentry_prot(pte) & ~(PAGE_A | PAGE_D)) != prot) ||
+					(pgentry_paddr(pte) != (paddr + (i * entry_size)))) {
+				break;
+			}
 		}
+		ret = (i == PTRS_PER_PTE);
+	}
+
+	return ret;
+}
+
+/*
+ * Replace the table referenced by pde with a large leaf if the table allows
+ * it, and give the table page back to its allocator.
+ *
+ * @pre: level could only VPN2 or VPN1
+ */
+static void try_to_promote_pgtable_page(uint64_t *pde, enum _page_table_level level,
+		const struct memory_ops *mem_ops)
+{
+	uint64_t *pt_page = vpn_to_vaddr(pde);
+	uint64_t entry_size = (level == VPN2) ? VPN1_SIZE : PTE_SIZE;
+
+	if (mem_ops->large_page_support(level) && (mem_ops->free_pt_page != NULL) &&
+			pgtable_page_promotable(pt_page, entry_size, mem_ops)) {
+		uint64_t leaf = *pt_page;
+
+		mem_ops->tweak_exe_right(&leaf);
+		set_pgentry(pde, leaf, mem_ops);
+		mem_ops->free_pt_page(mem_ops->info, (struct page *)pt_page);
+
+		if (mem_ops->stats != NULL) {
+			mem_ops->stats->merges++;
+		}
+	}
+}
+
+/*
+ * Collapse the tables under [vaddr_base, vaddr_base + size) back into large
+ * pages wherever that is possible, typically after a split_large_page() whose
+ * reason went away. The caller is responsible for the TLB invalidation.
+ */
+void mmu_promote(uint64_t *vpn3_page, uint64_t vaddr_base, uint64_t size,
+		const struct memory_ops *mem_ops)
+{
+	uint64_t vaddr = round_vpn1_down(vaddr_base);
+	uint64_t vaddr_end = round_vpn1_up(vaddr_base + size);
+	uint64_t vaddr_next, vaddr_vpn1;
+	uint64_t *vpn3, *vpn2, *vpn1;
+
+	pr_dbg("%s, vaddr: 0x%lx, size: 0x%lx", __func__, vaddr_base, size);
+
+	while (vaddr < vaddr_end) {
+		vpn3 = vpn3_offset(vpn3_page, vaddr);
+		if (mem_ops->pgentry_present(*vpn3) == 0UL) {
+			vaddr = (vaddr & VPN3_MASK) + VPN3_SIZE;
+			continue;
+		}
+
+		vpn2 = vpn2_offset(vpn3, vaddr);
+		vaddr_next = (vaddr & VPN2_MASK) + VPN2_SIZE;
+		if ((mem_ops->pgentry_present(*vpn2) != 0UL) && (vpn_large(*vpn2) == 0UL)) {
+			for (vaddr_vpn1 = vaddr; (vaddr_vpn1 < vaddr_next) && (vaddr_vpn1 < vaddr_end);
+					vaddr_vpn1 += VPN1_SIZE) {
+				vpn1 = vpn1_offset(vpn2, vaddr_vpn1);
+				if ((mem_ops->pgentry_present(*vpn1) != 0UL) && (vpn_large(*vpn1) == 0UL)) {
+					try_to_promote_pgtable_page(vpn1, VPN1, mem_ops);
+				}
+			}
+			/* only succeeds once every VPN1 entry of the table is a 2M leaf */
+			try_to_promote_pgtable_page(vpn2, VPN2, mem_ops);
+		}
+		vaddr = vaddr_next;
 	}
 }
 
@@ -303,13 +453,14 @@ static void add_pte(const uint64_t *vpn1, uint64_t paddr_start, uint64_t vaddr_s
  * In PD level,
  * add [vaddr_start, vaddr_end) to [paddr_base, ...) MT PT mapping
  */
-static void add_vpn1(const uint64_t *vpn2, uint64_t paddr_start, uint64_t vaddr_start, uint64_t vaddr_end,
+static int32_t add_vpn1(const uint64_t *vpn2, uint64_t paddr_start, uint64_t vaddr_start, uint64_t vaddr_end,
 		uint64_t prot, const struct memory_ops *mem_ops)
 {
 	uint64_t *pd_page = vpn_to_vaddr(vpn2);
 	uint64_t vaddr = vaddr_start;
 	uint64_t paddr = paddr_start;
 	uint64_t index = vpn1_index(vaddr);
+	int32_t ret = 0;
 
 	pr_dbg("%s, paddr: 0x%lx, vaddr: [0x%lx - 0x%lx]",
 		__func__, paddr, vaddr, vaddr_end);
@@ -335,6 +486,10 @@ static void add_vpn1(const uint64_t *vpn2, uint64_t paddr_start, uint64_t vaddr_
 					break;	/* done */
 				} else {
 					void *pt_page = mem_ops->get_pt_page(mem_ops->info, vaddr);
+					if (pt_page == NULL) {
+						ret = -ENOMEM;
+						break;
+					}
 					construct_pgentry(vpn1, (void *)pt_page, mem_ops->get_default_access_right(), mem_ops);
 				}
 			}
@@ -346,19 +501,22 @@ static void add_vpn1(const uint64_t *vpn2, uint64_t paddr_start, uint64_t vaddr_
 		paddr += (vaddr_next - vaddr);
 		vaddr = vaddr_next;
 	}
+
+	return ret;
 }
 
 /*
  * In PDPT level,
  * add [vaddr_start, vaddr_end) to [paddr_base, ...) MT PT mapping
  */
-static void add_vpn2(const uint64_t *vpn3, uint64_t paddr_start, uint64_t vaddr_start, uint64_t vaddr_end,
+static int32_t add_vpn2(const uint64_t *vpn3, uint64_t paddr_start, uint64_t vaddr_start, uint64_t vaddr_end,
 		uint64_t prot, const struct memory_ops *mem_ops)
 {
 	uint64_t *vpn2_page = vpn_to_vaddr(vpn3);
 	uint64_t vaddr = vaddr_start;
 	uint64_t paddr = paddr_start;
 	uint64_t index = vpn2_index(vaddr);
+	int32_t ret = 0;
 
 	pr_dbg("%s, paddr: 0x%lx, vaddr: [0x%lx - 0x%lx]", __func__, paddr, vaddr, vaddr_end);
 	for (; index < PTRS_PER_VPN2; index++) {
@@ -383,10 +541,17 @@ static void add_vpn2(const uint64_t *vpn3, uint64_t paddr_start, uint64_t vaddr_
 					break;	/* done */
 				} else {
 					void *pd_page = mem_ops->get_pd_page(mem_ops->info, vaddr);
+					if (pd_page == NULL) {
+						ret = -ENOMEM;
+						break;
+					}
 					construct_pgentry(vpn2, pd_page, mem_ops->get_default_access_right(), mem_ops);
 				}
 			}
-			add_vpn1(vpn2, paddr, vaddr, vaddr_end, prot, mem_ops);
+			ret = add_vpn1(vpn2, paddr, vaddr, vaddr_end, prot, mem_ops);
+			if (ret != 0) {
+				break;
+			}
 		}
 		if (vaddr_next >= vaddr_end) {
 			break;	/* done */
@@ -394,22 +559,21 @@ static void add_vpn2(const uint64_t *vpn3, uint64_t paddr_start, uint64_t vaddr_
 		paddr += (vaddr_next - vaddr);
 		vaddr = vaddr_next;
 	}
-}
-
-static void tlb_all_sync(void)
-{
-	if (!smp_ops)
-		return;
 
-	return smp_ops->rfence(cpu_online_map, 0, 0);
+	return ret;
 }
 
-void mmu_add(uint64_t *vpn3_page, uint64_t paddr_base, uint64_t vaddr_base, uint64_t size, uint64_t prot,
+/*
+ * Returns -ENOMEM if a table page could not be allocated. The part of the
+ * range mapped until then stays mapped.
+ */
+int32_t mmu_add(uint64_t *vpn3_page, uint64_t paddr_base, uint64_t vaddr_base, uint64_t size, uint64_t prot,
 		const struct memory_ops *mem_ops)
 {
 	uint64_t vaddr, vaddr_next, vaddr_end;
 	uint64_t paddr;
 	uint64_t *vpn3;
+	int32_t ret = 0;
 
 	pr_dbg("%s, paddr 0x%lx, vaddr 0x%lx, size 0x%lx", __func__, paddr_base, vaddr_base, size);
 
@@ -418,20 +582,24 @@ void mmu_add(uint64_t *vpn3_page, uint64_t paddr_base, uint64_t vaddr_base, uint
 	paddr = round_page_up(paddr_base);
 	vaddr_end = vaddr + round_page_down(size);
 
-	while (vaddr < vaddr_end) {
+	while ((vaddr < vaddr_end) && (ret == 0)) {
 		vaddr_next = (vaddr & VPN3_MASK) + VPN3_SIZE;
 		vpn3 = vpn3_offset(vpn3_page, vaddr);
 		if (mem_ops->pgentry_present(*vpn3) == 0UL) {
 			void *vpn2_page = mem_ops->get_pdpt_page(mem_ops->info, vaddr);
+			if (vpn2_page == NULL) {
+				ret = -ENOMEM;
+				break;
+			}
 			construct_pgentry(vpn3, vpn2_page, mem_ops->get_default_access_right(), mem_ops);
 		}
-		add_vpn2(vpn3, paddr, vaddr, vaddr_end, prot, mem_ops);
+		ret = add_vpn2(vpn3, paddr, vaddr, vaddr_end, prot, mem_ops);
 
 		paddr += (vaddr_next - vaddr);
 		vaddr = vaddr_next;
 	}
 
-	tlb_all_sync();
+	return ret;
 }
 
 const uint64_t *lookup_address(uint64_t *vpn3_page, uint64_t addr, uint64_t *pg_size, const struct memory_ops *mem_ops)
@@ -16,6 +16,9 @@
 #include <asm/lib/spinlock.h>
 #include <asm/lib/bits.h>
 #include <asm/io.h>
+#include <asm/fdt.h>
+#include <asm/current.h>
+#include <rtl.h>
 
 struct acrn_plic phy_plic;
 struct acrn_plic *plic = &phy_plic;
@@ -35,26 +38,27 @@ uint32_t plic_read32(uint32_t offset)
 	return mmio_readl(plic->map_base + offset);
 }
 
-static void plic_set_irq(struct irq_desc *irqd, uint32_t offset)
+/* interrupt context of the hart @pcpu_id runs on */
+static inline uint32_t plic_ctx(uint16_t pcpu_id)
 {
-	uint32_t base, val;
+	return plic->hart_ctx[pcpu_id];
+}
+
+static void plic_set_bit(uint32_t irq, uint32_t offset)
+{
+	uint32_t base = offset + (irq / 32U) * 4U;
 
-	base = offset + (irqd->irq / 32) * 4;
-	val = plic_read32(base);
-	val |= 1U << (irqd->irq % 32);
 	// 1bits/IRQ
-	plic_write32(val, base);
+	plic_write32(plic_read32(base) | (1U << (irq % 32U)), base);
 }
 
-static void plic_clear_irq(struct irq_desc *irqd, uint32_t offset)
+static bool plic_clear_bit(uint32_t irq, uint32_t offset)
 {
-	uint32_t base, val;
+	uint32_t base = offset + (irq / 32U) * 4U;
+	uint32_t val = plic_read32(base);
 
-	base = offset + (irqd->irq / 32) * 4;
-	val = plic_read32(base);
-	val &= ~(1U << (irqd->irq % 32));
-	// 1bits/IRQ
-	plic_write32(val, base);
+	plic_write32(val & ~(1U << (irq % 32U)), base);
+	return (val & (1U << (irq % 32U))) != 0U;
 }
 
 void plic_set_address(void)
@@ -72,7 +76,7 @@ static void plic_set_irq_mask(struct irq_desc *desc, uint32_t priority)
 	uint64_t flags;
 
 	spin_lock_irqsave(&plic->lock, &flags);
-	plic_write32(priority & 0x7, PLIC_THR);
+	plic_write32(priority & 0x7, PLIC_CTX_THR(plic_ctx(get_pcpu_id())));
 	spin_unlock_irqrestore(&plic->lock, flags);
 }
 
@@ -91,7 +95,7 @@ static void plic_irq_enable(struct irq_desc *desc)
 	uint64_t flags;
 
 	spin_lock_irqsave(&plic->lock, &flags);
-	plic_set_irq(desc, PLIC_IER);
+	plic_set_bit(desc->irq, PLIC_CTX_IER(plic_ctx(irq_get_affinity(desc->irq))));
 	clear_bit(IRQ_DISABLED, &((struct arch_irq_desc *)desc->arch_data)->status);
 	dsb();
 	spin_unlock_irqrestore(&plic->lock, flags);
@@ -102,20 +106,89 @@ static void plic_irq_disable(struct irq_desc *desc)
 	uint64_t flags;
 
 	spin_lock_irqsave(&plic->lock, &flags);
-	plic_clear_irq(desc, PLIC_IER);
+	plic_clear_bit(desc->irq, PLIC_CTX_IER(plic_ctx(irq_get_affinity(desc->irq))));
 	set_bit(IRQ_DISABLED, &((struct arch_irq_desc *)desc->arch_data)->status);
 	dsb();
 	spin_unlock_irqrestore(&plic->lock, flags);
 }
 
+/* @pre plic->lock is held */
+static void plic_move_irq(uint32_t irq, uint16_t pcpu_id)
+{
+	uint16_t i;
+	bool enabled = false;
+
+	/* an interrupt is enabled in at most one hart context at a time */
+	for (i = 0U; i < NR_CPUS; i++) {
+		if (plic_ctx(i) != plic_ctx(pcpu_id)) {
+			enabled = plic_clear_bit(irq, PLIC_CTX_IER(plic_ctx(i))) || enabled;
+		}
+	}
+	if (enabled) {
+		plic_set_bit(irq, PLIC_CTX_IER(plic_ctx(pcpu_id)));
+	}
+}
+
+static void plic_irq_set_affinity(struct irq_desc *desc, uint16_t pcpu_id)
+{
+	uint64_t flags;
+
+	spin_lock_irqsave(&plic->lock, &flags);
+	plic_move_irq(desc->irq, pcpu_id);
+	spin_unlock_irqrestore(&plic->lock, flags);
+}
+
 static uint32_t plic_get_irq(void)
 {
-	return plic_read32(PLIC_EOIR);
+	return plic_read32(PLIC_CTX_EOIR(plic_ctx(get_pcpu_id())));
 }
 
 static void plic_eoi_irq(struct irq_desc *desc)
 {
-	plic_write32(desc->irq, PLIC_EOIR);
+	plic_write32(desc->irq, PLIC_CTX_EOIR(plic_ctx(get_pcpu_id())));
+}
+
+/*
+ * A Service VM vCPU running on @pcpu_id changed enable word @word of its
+ * context. The sources the hypervisor does not own follow the vCPU that
+ * enabled them, so that they are taken on its hart rather than funneled
+ * through the BSP and then kicked over.
+ */
+void plic_guest_enable(uint16_t pcpu_id, uint32_t word, uint32_t val)
+{
+	uint32_t bit, irq;
+	uint64_t flags;
+
+	for (bit = 0U; bit < 32U; bit++) {
+		irq = (word << 5U) + bit;
+		if ((irq == 0U) || (irq >= NR_IRQS) || irq_is_host_owned(irq)) {
+			continue;
+		}
+
+		if ((val & (1U << bit)) != 0U) {
+			(void)irq_set_affinity(irq, pcpu_id);
+			spin_lock_irqsave(&plic->lock, &flags);
+			plic_set_bit(irq, PLIC_CTX_IER(plic_ctx(pcpu_id)));
+			spin_unlock_irqrestore(&plic->lock, flags);
+		} else if (irq_get_affinity(irq) == pcpu_id) {
+			spin_lock_irqsave(&plic->lock, &flags);
+			(void)plic_clear_bit(irq, PLIC_CTX_IER(plic_ctx(pcpu_id)));
+			spin_unlock_irqrestore(&plic->lock, flags);
+		} else {
+			/* enabled for another vCPU */
+		}
+	}
+}
+
+void plic_guest_threshold(uint16_t pcpu_id, uint32_t val)
+{
+	plic_write32(val, PLIC_CTX_THR(plic_ctx(pcpu_id)));
+}
+
+/* the guest completes on the hart it claimed on, the one its vCPU runs on */
+void plic_guest_complete(uint32_t irq)
+{
+	plic_write32(irq, PLIC_CTX_EOIR(plic_ctx(get_pcpu_id())));
 }
 
 struct acrn_irqchip_ops plic_ops = {
@@ -127,10 +200,104 @@ struct acrn_irqchip_ops plic_ops = {
 	.enable       		= plic_irq_enable,
 	.disable      		= plic_irq_disable,
 	.eoi			= plic_eoi_irq,
+	.set_affinity		= plic_irq_set_affinity,
+};
+
+struct plic_probe {
+	/* node being parsed */
+	const char *node;
+	bool plic;
+	uint64_t base;
+	const uint32_t *contexts;
+	uint32_t nr_contexts;
+
+	/* phandle of the interrupt controller of each hart */
+	uint32_t intc[NR_CPUS];
+	const uint32_t *hart_contexts;
+	uint32_t nr_hart_contexts;
 };
 
+static void commit_plic_node(struct plic_probe *probe)
+{
+	if ((probe->node != NULL) && probe->plic && (probe->base == CONFIG_PLIC_BASE)) {
+		probe->hart_contexts = probe->contexts;
+		probe->nr_hart_contexts = probe->nr_contexts;
+	}
+	probe->node = NULL;
+}
+
+static void probe_plic_prop(const struct fdt_prop *prop, void *data)
+{
+	struct plic_probe *probe = (struct plic_probe *)data;
+	const uint32_t *cells = (const uint32_t *)prop->value;
+	uint64_t hart;
+
+	if (prop->nodes[prop->depth] != probe->node) {
+		commit_plic_node(probe);
+		probe->node = prop->nodes[prop->depth];
+		probe->plic = false;
+		probe->base = 0UL;
+		probe->contexts = NULL;
+		probe->nr_contexts = 0U;
+	}
+
+	if ((prop->depth == 3U) && fdt_node_is(prop, 1U, "cpus") && fdt_node_is(prop, 2U, "cpu") &&
+			fdt_node_is(prop, 3U, "interrupt-controller") &&
+			(strcmp(prop->name, "phandle") == 0) && (prop->len == 4U)) {
+		hart = fdt_unit_address(prop->nodes[2]);
+		if (hart < NR_CPUS) {
+			probe->intc[hart] = fdt32_to_cpu(cells[0]);
+		}
+	} else if (strcmp(prop->name, "compatible") == 0) {
+		probe->plic = fdt_prop_has_string(prop, "riscv,plic0") ||
+			fdt_prop_has_string(prop, "sifive,plic-1.0.0");
+	} else if ((strcmp(prop->name, "reg") == 0) && (prop->len >= 8U)) {
+		/* #address-cells is 2 under /soc on QEMU virt */
+		probe->base = ((uint64_t)fdt32_to_cpu(cells[0]) << 32U) | fdt32_to_cpu(cells[1]);
+	} else if (strcmp(prop->name, "interrupts-extended") == 0) {
+		/* <intc phandle, line> per context, in context order */
+		probe->contexts = cells;
+		probe->nr_contexts = prop->len / 8U;
+	} else {
+		/* not interesting */
+	}
+}
+
+/*
+ * Find the context of each hart: the index of its external interrupt line
+ * in the interrupts-extended of the PLIC. Harts the device tree does not
+ * tell about share context 0, as before.
+ */
+static void plic_probe_contexts(void)
+{
+	const void *fdt = get_host_fdt();
+	struct plic_probe probe;
+	uint32_t ctx, phandle, line;
+	uint16_t hart;
+
+	for (hart = 0U; hart < NR_CPUS; hart++) {
+		plic->hart_ctx[hart] = 0U;
+	}
+
+	(void)memset(&probe, 0U, sizeof(probe));
+	if ((fdt != NULL) && (fdt_walk(fdt, probe_plic_prop, &probe) == 0)) {
+		commit_plic_node(&probe);
+		for (ctx = 0U; ctx < probe.nr_hart_contexts; ctx++) {
+			phandle = fdt32_to_cpu(probe.hart_contexts[ctx * 2U]);
+			line = fdt32_to_cpu(probe.hart_contexts[(ctx * 2U) + 1U]);
+			for (hart = 0U; hart < NR_CPUS; hart++) {
+				if ((line == PLIC_HART_EXT_IRQ) && (probe.intc[hart] == phandle) && (phandle != 0U)) {
+					plic->hart_ctx[hart] = ctx;
+				}
+			}
+		}
+	}
+}
+
 void plic_init(void)
 {
+	uint16_t i;
+
 	acrn_irqchip = &plic_ops;
 	plic_set_address();
 	pr_info("plic base: %lx size: %lx", plic->base, plic->size);
@@ -138,4 +305,9 @@ void plic_init(void)
 	spin_lock(&plic->lock);
 	plic_init_map();
 	spin_unlock(&plic->lock);
+
+	plic_probe_contexts();
+	for (i = 0U; i < NR_CPUS; i++) {
+		pr_info("plic: hart %hu uses context %u", i, plic_ctx(i));
+	}
 }
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2025 Intel Corporation. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <types.h>
+#include <errno.h>
+#include <asm/cpu.h>
+#include <asm/cpumask.h>
+#include <asm/per_cpu.h>
+#include <asm/notify.h>
+#include <asm/sbi.h>
+#include <asm/vmx.h>
+#include <asm/profiling.h>
+#include <asm/guest/vcpu.h>
+#include <asm/guest/vm.h>
+#include <asm/guest/vpmu.h>
+#include <profiling.h>
+#include <trace.h>
+#include <logmsg.h>
+
+#ifndef CONFIG_MACRN
+/*
+ * Sampling profiler. Each pCPU gets one host counter for the chosen event
+ * from the SBI PMU, loaded so that it overflows every period events. The
+ * overflow interrupt (Sscofpmf LCOFI) records the interrupted PC into the
+ * ACRN_TRACE sbuf of the pCPU, as a TRACE_PROF_SAMPLE entry.
+ */
+
+struct prof_cpu {
+	/* vCPU from VM entry until its exit is handled, see profiling_pre_vmexit_handler() */
+	struct acrn_vcpu *guest;
+	bool sampling;
+	/* host counter */
+	uint64_t ctr;
+	/* its bit in scountovf */
+	uint64_t ovf_mask;
+	/* start value, period events before the overflow */
+	uint64_t init;
+	uint64_t samples;
+};
+
+static struct prof_cpu prof_cpus[NR_CPUS];
+
+struct prof_config {
+	uint64_t event_idx;
+	uint64_t period;
+	bool running;
+};
+
+static struct prof_config prof_cfg;
+
+static void prof_start_local(__unused void *data)
+{
+	struct prof_cpu *pc = &prof_cpus[get_pcpu_id()];
+	uint64_t flags, mask, info;
+	uint32_t num;
+	sbi_ret ret;
+
+	ret = sbi_pmu_ecall(SBI_TYPE_PMU_NUM_COUNTERS, 0UL, 0UL, 0UL, 0UL, 0UL);
+	num = (ret.error == SBI_SUCCESS) ? min((uint32_t)ret.value, 64U) : 0U;
+	mask = (num < 64U) ? ((1UL << num) - 1UL) : ~0UL;
+
+	/* count in HS, VS and VU, which is the hypervisor and its guests */
+	flags = SBI_PMU_CFG_FLAG_CLEAR_VALUE | SBI_PMU_CFG_FLAG_SET_UINH | SBI_PMU_CFG_FLAG_SET_MINH;
+	ret = sbi_pmu_ecall(SBI_TYPE_PMU_COUNTER_CFG_MATCH, 0UL, mask, flags, prof_cfg.event_idx, 0UL);
+	if (ret.error != SBI_SUCCESS) {
+		pr_err("profiling: no counter for event 0x%lx on cpu %hu (%ld)", prof_cfg.event_idx,
+			get_pcpu_id(), ret.error);
+		return;
+	}
+
+	info = (uint64_t)sbi_pmu_ecall(SBI_TYPE_PMU_COUNTER_GET_INFO, (uint64_t)ret.value, 0UL, 0UL, 0UL, 0UL).value;
+	pc->ctr = (uint64_t)ret.value;
+	pc->ovf_mask = 1UL << ((info & SBI_PMU_CTR_INFO_CSR_MASK) - CSR_CYCLE_BASE);
+	if (SBI_PMU_CTR_INFO_WIDTH(info) < 64UL) {
+		pc->init = (1UL << SBI_PMU_CTR_INFO_WIDTH(info)) - prof_cfg.period;
+	} else {
+		pc->init = 0UL - prof_cfg.period;
+	}
+	pc->samples = 0UL;
+
+	/* stays enabled after a stop, the handlers check scountovf */
+	cpu_csr_set(sie, SIP_LCOFIP);
+	(void)sbi_pmu_ecall(SBI_TYPE_PMU_COUNTER_START, pc->ctr, 1UL, SBI_PMU_START_FLAG_SET_INIT_VALUE, pc->init, 0UL);
+	pc->sampling = true;
+}
+
+static void prof_stop_local(__unused void *data)
+{
+	struct prof_cpu *pc = &prof_cpus[get_pcpu_id()];
+
+	if (pc->sampling) {
+		pc->sampling = false;
+		(void)sbi_pmu_ecall(SBI_TYPE_PMU_COUNTER_STOP, pc->ctr, 1UL, SBI_PMU_STOP_FLAG_RESET, 0UL, 0UL);
+	}
+}
+
+/*
+ * Sample event_idx (an SBI PMU event, e.g. SBI_PMU_HW_CPU_CYCLES) on all
+ * pCPUs, once every period events. Needs Sscofpmf for the overflow
+ * interrupt and acrntrace running in the Service VM for the sbufs.
+ */
+int32_t profiling_sample_start(uint64_t event_idx, uint64_t period)
+{
+	if (!has_sscofpmf || !sbi_probe_extension(SBI_ID_PMU)) {
+		return -ENODEV;
+	}
+	if (prof_cfg.running || (period == 0UL)) {
+		return -EINVAL;
+	}
+
+	prof_cfg.event_idx = event_idx;
+	prof_cfg.period = period;
+	prof_cfg.running = true;
+	smp_call_function(cpu_online_map, prof_start_local, NULL);
+
+	return 0;
+}
+
+void profiling_sample_stop(void)
+{
+	if (prof_cfg.running) {
+		smp_call_function(cpu_online_map, prof_stop_local, NULL);
+		prof_cfg.running = false;
+	}
+}
+
+uint64_t profiling_sample_count(uint16_t pcpu_id)
+{
+	return prof_cpus[pcpu_id].samples;
+}
+
+/*
+ * Overflow interrupt, pc is where it was taken. One that fires in the
+ * guest exits to the hypervisor and is taken as soon as vmx_vmrun()
+ * enables interrupts again, so it is charged to the guest PC saved at the
+ * exit instead.
+ */
+void profiling_lcofi_handler(uint64_t pc)
+{
+	struct prof_cpu *p = &prof_cpus[get_pcpu_id()];
+	struct acrn_vcpu *vcpu = p->guest;
+	const struct cpu_regs *regs;
+
+	if (!p->sampling || ((cpu_csr_read(CSR_SCOUNTOVF) & p->ovf_mask) == 0UL)) {
+		return;
+	}
+
+	cpu_csr_clear(sip, SIP_LCOFIP);
+	regs = (vcpu != NULL) ? &vcpu->arch.contexts[vcpu->arch.cur_context].run_ctx.cpu_gp_regs.regs : NULL;
+	if ((regs != NULL) && (regs->cause == ((1UL << 63U) | HX_EXIT_IRQ_LCOF))) {
+		TRACE_2L(TRACE_PROF_SAMPLE, regs->ip, PROF_SAMPLE_GUEST |
+			((uint64_t)vcpu->vcpu_id << PROF_SAMPLE_VCPU_SHIFT) | vcpu->vm->vm_id);
+	} else {
+		TRACE_2L(TRACE_PROF_SAMPLE, pc, 0UL);
+	}
+	p->samples++;
+
+	/* loading the start value also clears the OF bit */
+	(void)sbi_pmu_ecall(SBI_TYPE_PMU_COUNTER_STOP, p->ctr, 1UL, 0UL, 0UL, 0UL);
+	(void)sbi_pmu_ecall(SBI_TYPE_PMU_COUNTER_START, p->ctr, 1UL, SBI_PMU_START_FLAG_SET_INIT_VALUE, p->init, 0UL);
+}
+
+void profiling_vmenter_handler(struct acrn_vcpu *vcpu)
+{
+	prof_cpus[pcpuid_from_vcpu(vcpu)].guest = vcpu;
+}
+
+void profiling_pre_vmexit_handler(struct acrn_vcpu *vcpu)
+{
+	prof_cpus[pcpuid_from_vcpu(vcpu)].guest = NULL;
+}
+#else
+void profiling_vmenter_handler(__unused struct acrn_vcpu *vcpu) {}
+void profiling_pre_vmexit_handler(__unused struct acrn_vcpu *vcpu) {}
+#endif
+
+void profiling_post_vmexit_handler(__unused struct acrn_vcpu *vcpu) {}
+void profiling_setup(void) {}
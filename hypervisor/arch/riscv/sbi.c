@@ -10,6 +10,7 @@
 #include <asm/lib/bits.h>
 #include <asm/cpu.h>
 #include <asm/per_cpu.h>
+#include <trace.h>
 #include <asm/smp.h>
 #include <asm/sbi.h>
 
@@ -55,7 +56,8 @@ static int do_swi(int cpu)
 
 static void send_single_swi(uint16_t pcpu_id, uint64_t vector)
 {
-	set_bit(vector, &per_cpu(swi_vector, pcpu_id).type);
+	TRACE_2L(TRACE_IPI_SEND, pcpu_id, vector);
+	bitmap_set_lock((uint16_t)vector, &per_cpu(swi_vector, pcpu_id).type);
 	do_swi(pcpu_id);
 }
 
@@ -97,15 +99,43 @@ static void send_hfence_mask(uint64_t dest_mask, uint64_t addr, uint64_t size)
 {
 	sbi_ret ret;
 
-	ret = sbi_ecall(dest_mask, 0, 0, 0, 0, 0, SBI_TYPE_RFENCE_HFNECE_GVMA, SBI_ID_RFENCE);
+	ret = sbi_ecall(dest_mask, 0, addr, size, 0, 0, SBI_TYPE_RFENCE_HFENCE_GVMA, SBI_ID_RFENCE);
 	if (ret.error != SBI_SUCCESS)
 		pr_err("%s: %lx", __func__, ret.error);
 
 	return;
 }
 
+static void send_hfence_vmid_mask(uint64_t dest_mask, uint64_t addr, uint64_t size, uint16_t vmid)
+{
+	sbi_ret ret;
+
+	ret = sbi_ecall(dest_mask, 0, addr, size, vmid, 0, SBI_TYPE_RFENCE_HFENCE_GVMA_VMID, SBI_ID_RFENCE);
+	if (ret.error != SBI_SUCCESS)
+		pr_err("%s: %lx", __func__, ret.error);
+
+	return;
+}
+
+bool sbi_probe_extension(enum sbi_id id)
+{
+	sbi_ret ret;
+
+	ret = sbi_ecall((uint64_t)id, 0, 0, 0, 0, 0, SBI_TYPE_BASE_PROBE_EXT, SBI_ID_BASE);
+
+	return (ret.error == SBI_SUCCESS) && (ret.value != 0);
+}
+
+/* PMU calls for the hypervisor's own hart, errors are left to the caller */
+sbi_ret sbi_pmu_ecall(uint64_t func, uint64_t arg0, uint64_t arg1, uint64_t arg2,
+			uint64_t arg3, uint64_t arg4)
+{
+	return sbi_ecall(arg0, arg1, arg2, arg3, arg4, 0, func, SBI_ID_PMU);
+}
+
 static struct smp_ops sbi_smp_ops =
-	{do_swi, send_single_swi, send_dest_ipi_mask, ipi_start_cpu, send_rfence_mask, send_hfence_mask};
+	{do_swi, send_single_swi, send_dest_ipi_mask, ipi_start_cpu, send_rfence_mask, send_hfence_mask,
+	 send_hfence_vmid_mask};
 
 void init_sbi_ipi(void)
 {
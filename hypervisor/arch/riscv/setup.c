@@ -15,15 +15,21 @@
 #include <asm/cpumask.h>
 #include <asm/mem.h>
 #include <asm/float.h>
+#include <asm/aia.h>
 #include <asm/early_printk.h>
 #include <asm/smp.h>
 #include <asm/per_cpu.h>
 #include <asm/notify.h>
 #include <asm/guest/vm.h>
 #include <asm/guest/s2vm.h>
+#include <asm/guest/vpmu.h>
 #include <debug/console.h>
 #include <debug/logmsg.h>
 #include <debug/shell.h>
+#ifdef CONFIG_KTEST
+#include "ktest/bench.h"
+#include "ktest/vcsr.h"
+#endif
 
 size_t dcache_block_size;
 
@@ -48,29 +54,44 @@ void start_acrn(uint32_t cpu, unsigned long boot_phys_offset,
 	init_mtrap();
 #else
 	init_trap();
+	probe_float_caps();
 	init_float();
 #endif
 	init_interrupt(BSP_CPU_ID);
 	preinit_timer();
-	plic_init();
+	if (aia_probe()) {
+		aia_init();
+	} else {
+		plic_init();
+	}
+	vpmu_init();
 //	init_pcpu_capabilities();
 //	ASSERT(detect_hardware_support() == 0);
 
 	timer_init();
 	pr_info("init timer\r\n");
 
+	/* secondary harts poll their call queue as soon as they are up */
+	smp_call_init();
 	smp_platform_init();
 	start_pcpus(cpu);
 	pr_info("Brought up %ld CPUs\n", (long)num_online_cpus());
-	smp_call_init();
 
 	setup_virt_paging();
 	init_sched(cpu);
 
+#ifdef CONFIG_KTEST
+	ktest_timer_bench();
+	ktest_mem_bench();
+#endif
+
 	pr_info("prepare sos");
 	prepare_sos_vm();
 	pr_info("create vm");
 	create_vm(sos_vm);
+#if defined(CONFIG_KTEST) && !defined(CONFIG_MACRN)
+	ktest_vs_csr(vcpu_from_vid(sos_vm, 0U));
+#endif
 	// currently, direct run sos.
 	start_vm(sos_vm);
 
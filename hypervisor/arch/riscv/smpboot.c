@@ -17,10 +17,12 @@
 #include <asm/setup.h>
 #include <asm/smp.h>
 #include <asm/float.h>
+#include <asm/aia.h>
 #include <asm/mem.h>
 #include <asm/cache.h>
 #include <asm/pgtable.h>
 #include <asm/guest/vcpu.h>
+#include <asm/guest/vpmu.h>
 
 #include <errno.h>
 #include <debug/console.h>
@@ -79,6 +81,8 @@ void start_secondary(uint32_t cpu)
 	switch_satp(init_satp);
 	init_trap();
 	init_float();
+	aia_init_hart();
+	vpmu_init_hart();
 #else
 	init_mtrap();
 #endif
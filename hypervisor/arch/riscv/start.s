@@ -63,6 +63,8 @@ _boot:
 	csrw sie, t0
 	li t0, 0xC0000
 	csrw sstatus, t0
+	la t0, fw_dtb
+	sd a1, 0(t0)
 	jal init_stack
 	li a1, 0
 	call kernel_init
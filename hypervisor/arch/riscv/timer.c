@@ -13,6 +13,7 @@
 #include <asm/per_cpu.h>
 #include <asm/current.h>
 #include <debug/logmsg.h>
+#include <trace.h>
 #include <asm/system.h>
 #include <asm/io.h>
 #include <lib/errno.h>
@@ -107,13 +108,11 @@ void udelay(uint32_t us)
 
 void update_physical_timer(struct per_cpu_timers *cpu_timer)
 {
-	struct hv_timer *timer = NULL;
+	struct hv_timer *timer = get_next_timer(cpu_timer);
 
 	/* find the next event timer */
-	if (!list_empty(&cpu_timer->timer_list)) {
-		timer = container_of((&cpu_timer->timer_list)->next,
-			struct hv_timer, node);
-
+	if (timer != NULL) {
+		TRACE_2L(TRACE_TIMER_ACTION_UPDAT, timer->timeout, 0UL);
 		/* it is okay to program a expired time */
 		set_deadline(timer->timeout);
 	}
@@ -15,7 +15,10 @@
 #include <asm/notify.h>
 #include <asm/irq.h>
 #include <asm/lib/bits.h>
+#include <asm/profiling.h>
+#include <asm/guest/vaplic.h>
 #include <softirq.h>
+#include <trace.h>
 #include "uart.h"
 #include "trap.h"
 
@@ -35,11 +38,11 @@ void sswi_handler(void)
 	early_printk(s);
 #endif
 	asm volatile ("csrwi sip, 0\n\t"::);
+	TRACE_2L(TRACE_IPI_RECV, per_cpu(swi_vector, cpu).type, 0UL);
 	if (test_bit(NOTIFY_VCPU_SWI, per_cpu(swi_vector, cpu).type))
 		clear_bit(NOTIFY_VCPU_SWI, &(per_cpu(swi_vector, cpu).type));
 
-	if (test_bit(SMP_FUNC_CALL, per_cpu(swi_vector, cpu).type)) {
-		clear_bit(SMP_FUNC_CALL, &(per_cpu(swi_vector, cpu).type));
+	if (bitmap_test_and_clear_lock(SMP_FUNC_CALL, &(per_cpu(swi_vector, cpu).type))) {
 		kick_notification();
 	}
 }
@@ -52,6 +55,7 @@ void reset_stimer(void)
 void stimer_handler(void)
 {
 //	printk("stimer_handler\n");
+	TRACE_2L(TRACE_TIMER_IRQ, 0UL, 0UL);
 	reset_stimer();
 	hv_timer_handler();
 }
@@ -67,6 +71,17 @@ void sexti_handler(void)
 	handle_mexti();
 }
 
+void sgei_handler(void)
+{
+	vaplic_handle_sgei();
+}
+
+void slcofi_handler(void)
+{
+	profiling_lcofi_handler(cpu_csr_read(sepc));
+	vpmu_handle_overflow();
+}
+
 static irq_handler_t sirq_handler[] = {
 	sexpt_handler,
 	sswi_handler,
@@ -78,16 +93,20 @@ static irq_handler_t sirq_handler[] = {
 	sexpt_handler,
 	sexpt_handler,
 	sexti_handler,
+	sexpt_handler,
+	sexpt_handler,
+	sgei_handler,
+	slcofi_handler,
 	sexpt_handler
 };
 
 void sint_handler(int irq)
 {
 	//printk("sint handler\n");
-	if (irq < 10)
+	if (irq <= 13)
 		sirq_handler[irq]();
 	else
-		sirq_handler[10]();
+		sirq_handler[14]();
 
 	do_softirq();
 }
@@ -83,6 +83,7 @@ static void sched_tick_handler(void *param)
 	uint64_t rflags;
 
 	obtain_schedule_lock(pcpu_id, &rflags);
+	iorr_ctl->ticks_taken++;
 	current = ctl->curr_obj;
 	/* If no vCPU start scheduling, ignore this tick */
 	if (current != NULL ) {
@@ -102,28 +103,84 @@ static void sched_tick_handler(void *param)
 	release_schedule_lock(pcpu_id, rflags);
 }
 
+#ifdef CONFIG_SCHED_IORR_TICKLESS
+/*
+ * Dynamic tick: with at most one runnable thread_object there is nothing to
+ * preempt, so the tick is stopped. Otherwise it fires once, when the slice
+ * of next runs out, instead of every millisecond.
+ *
+ * @pre iorr_ctl belongs to get_pcpu_id() and its schedule lock is held
+ * @pre next is idle or has left_cycles > 0
+ */
+static void sched_iorr_update_tick(struct sched_iorr_control *iorr_ctl, const struct thread_object *next,
+		uint64_t now)
+{
+	const struct sched_iorr_data *data = (const struct sched_iorr_data *)next->data;
+	struct hv_timer *tick = &iorr_ctl->tick_timer;
+	uint64_t deadline;
+
+	/* more than one item if the first one is not also the last one */
+	if (iorr_ctl->runqueue.next != iorr_ctl->runqueue.prev) {
+		deadline = now + (uint64_t)data->left_cycles;
+		if (!timer_is_started(tick) || (tick->timeout != deadline)) {
+			del_timer(tick);
+			update_timer(tick, deadline, 0UL);
+			(void)add_timer(tick);
+		}
+		iorr_ctl->tick_stopped = false;
+	} else {
+		del_timer(tick);
+		if (!iorr_ctl->tick_stopped) {
+			iorr_ctl->tick_stopped = true;
+			iorr_ctl->tick_stops++;
+		}
+	}
+}
+#endif
+
+/*
+ * Ticks a periodic 1 ms tick would have taken on @pcpu_id since the scheduler
+ * started there, but that did not happen. Always 0 without dynamic tick.
+ */
+uint64_t sched_iorr_ticks_avoided(uint16_t pcpu_id)
+{
+	const struct sched_iorr_control *iorr_ctl = &per_cpu(sched_iorr_ctl, pcpu_id);
+	uint64_t periodic = (cpu_ticks() - iorr_ctl->tick_base) / TICKS_PER_MS;
+
+	return (periodic > iorr_ctl->ticks_taken) ? (periodic - iorr_ctl->ticks_taken) : 0UL;
+}
+
 /*
  * @pre ctl->pcpu_id == get_pcpu_id()
  */
 int sched_iorr_init(struct sched_control *ctl)
 {
 	struct sched_iorr_control *iorr_ctl = &per_cpu(sched_iorr_ctl, ctl->pcpu_id);
-	uint64_t tick_period = TICKS_PER_MS;
 	int ret = 0;
 
 	ASSERT(get_pcpu_id() == ctl->pcpu_id, "Init scheduler on wrong CPU!");
 
 	ctl->priv = iorr_ctl;
 	INIT_LIST_HEAD(&iorr_ctl->runqueue);
+	iorr_ctl->tick_base = cpu_ticks();
+	iorr_ctl->ticks_taken = 0UL;
+	iorr_ctl->tick_stops = 0UL;
 
+#ifdef CONFIG_SCHED_IORR_TICKLESS
+	/* The tick_timer is one-shot, armed by pick_next only while it is needed */
+	initialize_timer(&iorr_ctl->tick_timer, sched_tick_handler, ctl, 0UL, 0UL);
+	iorr_ctl->tick_stopped = true;
+#else
 	/* The tick_timer is periodically */
 	initialize_timer(&iorr_ctl->tick_timer, sched_tick_handler, ctl,
-			cpu_ticks() + tick_period, tick_period);
+			iorr_ctl->tick_base + TICKS_PER_MS, TICKS_PER_MS);
+	iorr_ctl->tick_stopped = false;
 
 	if (add_timer(&iorr_ctl->tick_timer) < 0) {
 		pr_err("Failed to add schedule tick timer!");
 		ret = -1;
 	}
+#endif
 	return ret;
 }
 
@@ -154,7 +211,12 @@ static struct thread_object *sched_iorr_pick_next(struct sched_control *ctl)
 	data = (struct sched_iorr_data *)current->data;
 	/* Ignore the idle object, inactive objects */
 	if (!is_idle_thread(current) && is_inqueue(current)) {
-		data->left_cycles -= now - data->last_cycles;
+		if (iorr_ctl->tick_stopped) {
+			/* it ran alone without a tick, there was nobody to share the time with */
+			data->left_cycles = (int64_t)data->slice_cycles;
+		} else {
+			data->left_cycles -= now - data->last_cycles;
+		}
 		if (data->left_cycles <= 0) {
 			/*  replenish thread_object with slice_cycles */
 			data->left_cycles += data->slice_cycles;
@@ -181,6 +243,9 @@ static struct thread_object *sched_iorr_pick_next(struct sched_control *ctl)
 		next = &get_cpu_var(idle);
 	}
 
+#ifdef CONFIG_SCHED_IORR_TICKLESS
+	sched_iorr_update_tick(iorr_ctl, next, now);
+#endif
 	return next;
 }
 
@@ -70,7 +70,11 @@ void init_sched(uint16_t pcpu_id)
 	per_cpu(mode_to_idle, pcpu_id) = IDLE_MODE_HLT;
 	per_cpu(mode_to_kick_pcpu, pcpu_id) = DEL_MODE_IPI;
 
+#ifdef CONFIG_RISCV64
+	spinlock_init_class(&ctl->scheduler_lock, LOCK_CLASS_SCHED);
+#else
 	spinlock_init(&ctl->scheduler_lock);
+#endif
 	ctl->flags = 0UL;
 	ctl->curr_obj = NULL;
 	ctl->pcpu_id = pcpu_id;
@@ -21,6 +21,7 @@
 
 #define MAX_TIMER_ACTIONS	32U
 #define MIN_TIMER_PERIOD_US	500U
+#define TIMER_HEAP_ARITY	4U
 
 bool timer_expired(const struct hv_timer *timer, uint64_t now, uint64_t *delta)
 {
@@ -41,7 +42,7 @@ bool timer_expired(const struct hv_timer *timer, uint64_t now, uint64_t *delta)
 
 bool timer_is_started(const struct hv_timer *timer)
 {
-	return (!list_empty(&timer->node));
+	return (timer->heap_idx != TIMER_NOT_QUEUED);
 }
 
 static void run_timer(const struct hv_timer *timer)
@@ -57,42 +58,96 @@ static void run_timer(const struct hv_timer *timer)
 #ifndef CONFIG_RISCV64
 static inline void update_physical_timer(struct per_cpu_timers *cpu_timer)
 {
-	struct hv_timer *timer = NULL;
+	struct hv_timer *timer = get_next_timer(cpu_timer);
 
 	/* find the next event timer */
-	if (!list_empty(&cpu_timer->timer_list)) {
-		timer = container_of((&cpu_timer->timer_list)->next,
-			struct hv_timer, node);
-
+	if (timer != NULL) {
 		/* it is okay to program a expired time */
 		msr_write(MSR_IA32_TSC_DEADLINE, timer->timeout);
 	}
 }
 #endif
 
-/*
- * return true if we add the timer on the timer_list head
- */
-static bool local_add_timer(struct per_cpu_timers *cpu_timer,
-			struct hv_timer *timer)
-{
-	struct list_head *pos, *prev;
-	struct hv_timer *tmp;
-	uint64_t tsc = timer->timeout;
-
-	prev = &cpu_timer->timer_list;
-	list_for_each(pos, &cpu_timer->timer_list) {
-		tmp = container_of(pos, struct hv_timer, node);
-		if (tmp->timeout < tsc) {
-			prev = &tmp->node;
-		} else {
+static inline void heap_place(struct per_cpu_timers *cpu_timer, struct hv_timer *timer, uint32_t idx)
+{
+	cpu_timer->heap[idx] = timer;
+	timer->heap_idx = idx;
+}
+
+/* move timer from slot idx towards the root while its parent expires later */
+static void heap_sift_up(struct per_cpu_timers *cpu_timer, struct hv_timer *timer, uint32_t idx)
+{
+	uint32_t pos = idx, parent;
+
+	while (pos > 0U) {
+		parent = (pos - 1U) / TIMER_HEAP_ARITY;
+		if (cpu_timer->heap[parent]->timeout <= timer->timeout) {
 			break;
 		}
+		heap_place(cpu_timer, cpu_timer->heap[parent], pos);
+		pos = parent;
 	}
+	heap_place(cpu_timer, timer, pos);
+}
 
-	list_add(&timer->node, prev);
+/* move timer from slot idx towards the leaves while a child expires earlier */
+static void heap_sift_down(struct per_cpu_timers *cpu_timer, struct hv_timer *timer, uint32_t idx)
+{
+	uint32_t pos = idx, child, first, last, next;
 
-	return (prev == &cpu_timer->timer_list);
+	while (true) {
+		first = (pos * TIMER_HEAP_ARITY) + 1U;
+		if (first >= cpu_timer->nr) {
+			break;
+		}
+		last = min(first + TIMER_HEAP_ARITY, cpu_timer->nr);
+		next = first;
+		for (child = first + 1U; child < last; child++) {
+			if (cpu_timer->heap[child]->timeout < cpu_timer->heap[next]->timeout) {
+				next = child;
+			}
+		}
+		if (cpu_timer->heap[next]->timeout >= timer->timeout) {
+			break;
+		}
+		heap_place(cpu_timer, cpu_timer->heap[next], pos);
+		pos = next;
+	}
+	heap_place(cpu_timer, timer, pos);
+}
+
+/*
+ * return true if the timer became the first one to expire
+ * @pre cpu_timer->nr < MAX_TIMERS_PER_CPU
+ */
+static bool heap_insert(struct per_cpu_timers *cpu_timer, struct hv_timer *timer)
+{
+	cpu_timer->nr++;
+	heap_sift_up(cpu_timer, timer, cpu_timer->nr - 1U);
+
+	return (timer->heap_idx == 0U);
+}
+
+/*
+ * fill the hole with the last timer, which may belong either above or
+ * below it
+ */
+static void heap_remove(struct per_cpu_timers *cpu_timer, struct hv_timer *timer)
+{
+	uint32_t idx = timer->heap_idx;
+	struct hv_timer *last;
+
+	cpu_timer->nr--;
+	if (idx != cpu_timer->nr) {
+		last = cpu_timer->heap[cpu_timer->nr];
+		if ((idx > 0U) && (last->timeout < cpu_timer->heap[(idx - 1U) / TIMER_HEAP_ARITY]->timeout)) {
+			heap_sift_up(cpu_timer, last, idx);
+		} else {
+			heap_sift_down(cpu_timer, last, idx);
+		}
+	}
+	cpu_timer->heap[cpu_timer->nr] = NULL;
+	timer->heap_idx = TIMER_NOT_QUEUED;
 }
 
 int32_t add_timer(struct hv_timer *timer)
@@ -105,7 +160,7 @@ int32_t add_timer(struct hv_timer *timer)
 	if ((timer == NULL) || (timer->func == NULL) || (timer->timeout == 0UL)) {
 		ret = -EINVAL;
 	} else {
-		ASSERT(list_empty(&timer->node), "add timer again!\n");
+		ASSERT(!timer_is_started(timer), "add timer again!\n");
 
 		/* limit minimal periodic timer cycle period */
 		if (timer->mode == TICK_MODE_PERIODIC) {
@@ -115,14 +170,23 @@ int32_t add_timer(struct hv_timer *timer)
 		pcpu_id  = get_pcpu_id();
 		cpu_timer = &per_cpu(cpu_timers, pcpu_id);
 
-		CPU_INT_ALL_DISABLE(&rflags);
-		/* update the physical timer if we're on the timer_list head */
-		if (local_add_timer(cpu_timer, timer)) {
-			update_physical_timer(cpu_timer);
+		spinlock_irqsave_obtain(&cpu_timer->lock, &rflags);
+		if (cpu_timer->nr < MAX_TIMERS_PER_CPU) {
+			timer->pcpu_id = pcpu_id;
+			/* update the physical timer if we're on the heap top */
+			if (heap_insert(cpu_timer, timer)) {
+				update_physical_timer(cpu_timer);
+			}
+		} else {
+			ret = -ENOMEM;
 		}
-		CPU_INT_ALL_RESTORE(rflags);
+		spinlock_irqrestore_release(&cpu_timer->lock, rflags);
 
-		TRACE_2L(TRACE_TIMER_ACTION_ADDED, timer->timeout, 0UL);
+		if (ret == 0) {
+			TRACE_2L(TRACE_TIMER_ACTION_ADDED, timer->timeout, 0UL);
+		} else {
+			pr_err("%s: too many timers on cpu%hu", __func__, pcpu_id);
+		}
 	}
 
 	return ret;
@@ -144,7 +208,8 @@ void initialize_timer(struct hv_timer *timer,
 			timer->mode = TICK_MODE_ONESHOT;
 			timer->period_in_cycle = 0UL;
 		}
-		INIT_LIST_HEAD(&timer->node);
+		timer->heap_idx = TIMER_NOT_QUEUED;
+		timer->pcpu_id = INVALID_CPU_ID;
 	}
 }
 
@@ -164,13 +229,19 @@ void update_timer(struct hv_timer *timer, uint64_t timeout, uint64_t period)
 
 void del_timer(struct hv_timer *timer)
 {
+	struct per_cpu_timers *cpu_timer;
 	uint64_t rflags;
 
-	CPU_INT_ALL_DISABLE(&rflags);
-	if ((timer != NULL) && !list_empty(&timer->node)) {
-		list_del_init(&timer->node);
+	if ((timer != NULL) && timer_is_started(timer)) {
+		cpu_timer = &per_cpu(cpu_timers, timer->pcpu_id);
+
+		spinlock_irqsave_obtain(&cpu_timer->lock, &rflags);
+		/* it may have expired meanwhile */
+		if (timer_is_started(timer) && (cpu_timer->heap[timer->heap_idx] == timer)) {
+			heap_remove(cpu_timer, timer);
+		}
+		spinlock_irqrestore_release(&cpu_timer->lock, rflags);
 	}
-	CPU_INT_ALL_RESTORE(rflags);
 }
 
 static void init_percpu_timer(uint16_t pcpu_id)
@@ -178,49 +249,65 @@ static void init_percpu_timer(uint16_t pcpu_id)
 	struct per_cpu_timers *cpu_timer;
 
 	cpu_timer = &per_cpu(cpu_timers, pcpu_id);
-	INIT_LIST_HEAD(&cpu_timer->timer_list);
+#ifdef CONFIG_RISCV64
+	spinlock_init_class(&cpu_timer->lock, LOCK_CLASS_TIMER);
+#else
+	spinlock_init(&cpu_timer->lock);
+#endif
+	cpu_timer->nr = 0U;
 }
 
 static void timer_softirq(uint16_t pcpu_id)
 {
 	struct per_cpu_timers *cpu_timer;
 	struct hv_timer *timer;
-	const struct list_head *pos, *n;
 	uint32_t tries = MAX_TIMER_ACTIONS;
 	uint64_t current_tsc = cpu_ticks();
+	uint64_t rflags;
 
 	/* handle passed timer */
 	cpu_timer = &per_cpu(cpu_timers, pcpu_id);
 
 	/* This is to make sure we are not blocked due to delay inside func()
 	 * force to exit irq handler after we serviced >31 timers
-	 * caller used to local_add_timer() for periodic timer, if there is a delay
+	 * caller used to add the periodic timer back, if there is a delay
 	 * inside func(), it will infinitely loop here, because new added timer
 	 * already passed due to previously func()'s delay.
 	 */
-	list_for_each_safe(pos, n, &cpu_timer->timer_list) {
-		timer = container_of(pos, struct hv_timer, node);
+	spinlock_irqsave_obtain(&cpu_timer->lock, &rflags);
+	while (true) {
+		timer = get_next_timer(cpu_timer);
 		/* timer expried */
 		tries--;
-		if ((timer->timeout <= current_tsc) && (tries != 0U)) {
-			del_timer(timer);
+		if ((timer == NULL) || (timer->timeout > current_tsc) || (tries == 0U)) {
+			break;
+		}
+
+		heap_remove(cpu_timer, timer);
+		spinlock_irqrestore_release(&cpu_timer->lock, rflags);
 
-			run_timer(timer);
+		run_timer(timer);
 
-			if (timer->mode == TICK_MODE_PERIODIC) {
+		spinlock_irqsave_obtain(&cpu_timer->lock, &rflags);
+		/* func() may have added it again by itself */
+		if (!timer_is_started(timer)) {
+			if ((timer->mode == TICK_MODE_PERIODIC) && (cpu_timer->nr < MAX_TIMERS_PER_CPU)) {
 				/* update periodic timer fire tsc */
 				timer->timeout += timer->period_in_cycle;
-				(void)local_add_timer(cpu_timer, timer);
+				(void)heap_insert(cpu_timer, timer);
 			} else {
+				/* func() may have filled the heap with other timers */
+				if (timer->mode == TICK_MODE_PERIODIC) {
+					pr_err("%s: too many timers on cpu%hu, periodic timer dropped", __func__, pcpu_id);
+				}
 				timer->timeout = 0UL;
 			}
-		} else {
-			break;
 		}
 	}
 
 	/* update nearest timer */
 	update_physical_timer(cpu_timer);
+	spinlock_irqrestore_release(&cpu_timer->lock, rflags);
 }
 
 void timer_init(void)
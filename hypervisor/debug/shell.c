@@ -19,6 +19,9 @@
 #else
 #include <asm/lib/string.h>
 #include <asm/plicreg.h>
+#include <asm/guest/vmexit.h>
+#include <asm/cpumask.h>
+#include <asm/profiling.h>
 #endif
 #include <ptdev.h>
 #include <asm/guest/vm.h>
@@ -56,6 +59,14 @@ static int32_t shell_cpuid(int32_t argc, char **argv);
 static int32_t shell_reboot(int32_t argc, char **argv);
 static int32_t shell_rdmsr(int32_t argc, char **argv);
 static int32_t shell_wrmsr(int32_t argc, char **argv);
+#ifdef CONFIG_RISCV64
+static int32_t shell_show_s2pt_pool(__unused int32_t argc, __unused char **argv);
+static int32_t shell_irq_rebalance(__unused int32_t argc, __unused char **argv);
+static int32_t shell_sched_ticks(__unused int32_t argc, __unused char **argv);
+static int32_t shell_lock_stats(int32_t argc, char **argv);
+static int32_t shell_exit_stats(int32_t argc, char **argv);
+static int32_t shell_profile(int32_t argc, char **argv);
+#endif
 
 static struct shell_cmd shell_cmds[] = {
 	{
@@ -160,6 +171,44 @@ static struct shell_cmd shell_cmds[] = {
 		.help_str	= SHELL_CMD_WRMSR_HELP,
 		.fcn		= shell_wrmsr,
 	},
+#ifdef CONFIG_RISCV64
+	{
+		.str		= SHELL_CMD_S2PT_POOL,
+		.cmd_param	= SHELL_CMD_S2PT_POOL_PARAM,
+		.help_str	= SHELL_CMD_S2PT_POOL_HELP,
+		.fcn		= shell_show_s2pt_pool,
+	},
+	{
+		.str		= SHELL_CMD_IRQ_REBALANCE,
+		.cmd_param	= SHELL_CMD_IRQ_REBALANCE_PARAM,
+		.help_str	= SHELL_CMD_IRQ_REBALANCE_HELP,
+		.fcn		= shell_irq_rebalance,
+	},
+	{
+		.str		= SHELL_CMD_SCHED_TICKS,
+		.cmd_param	= SHELL_CMD_SCHED_TICKS_PARAM,
+		.help_str	= SHELL_CMD_SCHED_TICKS_HELP,
+		.fcn		= shell_sched_ticks,
+	},
+	{
+		.str		= SHELL_CMD_LOCK_STATS,
+		.cmd_param	= SHELL_CMD_LOCK_STATS_PARAM,
+		.help_str	= SHELL_CMD_LOCK_STATS_HELP,
+		.fcn		= shell_lock_stats,
+	},
+	{
+		.str		= SHELL_CMD_EXIT_STATS,
+		.cmd_param	= SHELL_CMD_EXIT_STATS_PARAM,
+		.help_str	= SHELL_CMD_EXIT_STATS_HELP,
+		.fcn		= shell_exit_stats,
+	},
+	{
+		.str		= SHELL_CMD_PROFILE,
+		.cmd_param	= SHELL_CMD_PROFILE_PARAM,
+		.help_str	= SHELL_CMD_PROFILE_HELP,
+		.fcn		= shell_profile,
+	},
+#endif
 };
 
 /* for function key: up/down/right/left/home/end and delete key */
@@ -1320,6 +1369,239 @@ static int32_t shell_cpuid(int32_t argc, char **argv) { return 0; }
 static int32_t shell_reboot(__unused int32_t argc, __unused char **argv) { return 0; }
 static int32_t shell_rdmsr(int32_t argc, char **argv) { return 0; }
 static int32_t shell_wrmsr(int32_t argc, char **argv) { return 0; }
+
+static int32_t shell_show_s2pt_pool(__unused int32_t argc, __unused char **argv)
+{
+#ifndef CONFIG_MACRN
+	char temp_str[MAX_STR_SIZE];
+	const struct page_pool *pool = get_s2pt_page_pool();
+
+	const struct pgtable_stats *stats;
+	struct acrn_vm *vm;
+	uint16_t vm_id;
+
+	snprintf(temp_str, MAX_STR_SIZE, "\r\nTOTAL   USED    PEAK    FAILED"
+		"\r\n%-7lu %-7lu %-7lu %-7lu\r\n",
+		pool->bitmap_size << 6U, pool->used_pages, pool->peak_pages, pool->failed_allocs);
+	shell_puts(temp_str);
+
+	shell_puts("\r\nVM_ID SPLITS     MERGES"
+		   "\r\n===== ========== ==========\r\n");
+	for (vm_id = 0U; vm_id < CONFIG_MAX_VM_NUM; vm_id++) {
+		vm = get_vm_from_vmid(vm_id);
+		if (!is_poweroff_vm(vm)) {
+			stats = get_s2pt_stats(vm_id);
+			snprintf(temp_str, MAX_STR_SIZE, "  %-3d %-10lu %-10lu\r\n",
+				vm_id, stats->splits, stats->merges);
+			shell_puts(temp_str);
+		}
+	}
+#else
+	shell_puts("\r\nNo stage-2 page table in M-mode ACRN\r\n");
+#endif
+	return 0;
+}
+
+static int32_t shell_irq_rebalance(__unused int32_t argc, __unused char **argv)
+{
+	char temp_str[MAX_STR_SIZE];
+	uint32_t irq;
+	uint16_t pcpu_id;
+
+	if (aia_available()) {
+		shell_puts("\r\nAIA: pass-through interrupts are delivered to guest interrupt files\r\n");
+		return 0;
+	}
+
+	vplic_rebalance_irqs(get_sos_vm());
+
+	shell_puts("\r\nIRQ  PCPU OWNER"
+		   "\r\n==== ==== =====\r\n");
+	for (irq = 1U; irq < PLIC_NUM_SOURCES; irq++) {
+		pcpu_id = irq_get_affinity(irq);
+		if ((pcpu_id != BSP_CPU_ID) || irq_is_host_owned(irq)) {
+			snprintf(temp_str, MAX_STR_SIZE, "%-4u %-4hu %s\r\n", irq, pcpu_id,
+				irq_is_host_owned(irq) ? "HV" : "SOS");
+			shell_puts(temp_str);
+		}
+	}
+	return 0;
+}
+
+static int32_t shell_sched_ticks(__unused int32_t argc, __unused char **argv)
+{
+#ifdef CONFIG_SCHED_IORR
+	char temp_str[MAX_STR_SIZE];
+	const struct sched_iorr_control *iorr_ctl;
+	uint16_t pcpu_id;
+
+	shell_puts("\r\nPCPU TAKEN      AVOIDED    STOPS      TICK"
+		   "\r\n==== ========== ========== ========== =======\r\n");
+	for (pcpu_id = 0U; pcpu_id < NR_CPUS; pcpu_id++) {
+		if (per_cpu(sched_ctl, pcpu_id).priv == NULL) {
+			continue;
+		}
+		iorr_ctl = &per_cpu(sched_iorr_ctl, pcpu_id);
+		snprintf(temp_str, MAX_STR_SIZE, "%-4hu %-10lu %-10lu %-10lu %s\r\n", pcpu_id,
+			iorr_ctl->ticks_taken, sched_iorr_ticks_avoided(pcpu_id), iorr_ctl->tick_stops,
+			iorr_ctl->tick_stopped ? "stopped" : "running");
+		shell_puts(temp_str);
+	}
+#else
+	shell_puts("\r\nOnly the IORR scheduler keeps tick statistics\r\n");
+#endif
+	return 0;
+}
+
+static int32_t shell_lock_stats(int32_t argc, char **argv)
+{
+	char temp_str[MAX_STR_SIZE];
+	const struct spinlock_class *cls;
+	uint32_t i;
+
+	if ((argc == 2) && (strcmp(argv[1], "reset") == 0)) {
+		spinlock_class_reset_stats();
+		return 0;
+	} else if (argc != 1) {
+		return -EINVAL;
+	}
+
+#ifndef CONFIG_LOCK_STATS
+	shell_puts("\r\nBuilt without CONFIG_LOCK_STATS, counts stay 0\r\n");
+#endif
+	shell_puts("\r\nCLASS      TYPE   ACQUIRED     CONTENDED    MAX_WAIT"
+		   "\r\n========== ====== ============ ============ ==========\r\n");
+	for (i = 0U; i < LOCK_CLASS_NUM; i++) {
+		cls = &spinlock_classes[i];
+		snprintf(temp_str, MAX_STR_SIZE, "%-10s %-6s %-12lu %-12lu %-10lu\r\n", cls->name,
+			(cls->type == SPINLOCK_MCS) ? "mcs" : "ticket", cls->acquired, cls->contended, cls->max_wait);
+		shell_puts(temp_str);
+	}
+	return 0;
+}
+
+static void shell_exit_stats_counts(const char *kind, const uint64_t counts[], uint32_t num)
+{
+	char temp_str[MAX_STR_SIZE];
+	uint32_t i;
+
+	for (i = 0U; i < num; i++) {
+		if (counts[i] != 0UL) {
+			snprintf(temp_str, MAX_STR_SIZE, "%-4s %-10u %-12lu\r\n", kind, i, counts[i]);
+			shell_puts(temp_str);
+		}
+	}
+}
+
+static int32_t shell_exit_stats(int32_t argc, char **argv)
+{
+	static struct acrn_vcpu_exit_stats stats;
+	char temp_str[MAX_STR_SIZE];
+	struct acrn_vm *vm;
+	struct acrn_vcpu *vcpu;
+	uint16_t vm_id, vcpu_id;
+	uint32_t i;
+
+	if ((argc != 3) && ((argc != 4) || (strcmp(argv[3], "reset") != 0))) {
+		return -EINVAL;
+	}
+
+	vm_id = sanitize_vmid((uint16_t)strtol_deci(argv[1]));
+	vcpu_id = (uint16_t)strtol_deci(argv[2]);
+	vm = get_vm_from_vmid(vm_id);
+	if (is_poweroff_vm(vm) || (vcpu_id >= vm->hw.created_vcpus)) {
+		shell_puts("No vcpu found in the input <vm_id, vcpu_id>\r\n");
+		return -EINVAL;
+	}
+	vcpu = vcpu_from_vid(vm, vcpu_id);
+
+	if (argc == 4) {
+		vcpu_exit_stats_reset(vcpu);
+		return 0;
+	}
+
+	vcpu_exit_stats_snapshot(vcpu, &stats);
+	shell_puts("\r\nTYPE CODE       EXITS"
+		   "\r\n==== ========== ============\r\n");
+	shell_exit_stats_counts("exc", stats.exception, ACRN_EXIT_STATS_EXCP_NUM);
+	shell_exit_stats_counts("irq", stats.interrupt, ACRN_EXIT_STATS_IRQ_NUM);
+	for (i = 0U; i < ACRN_EXIT_STATS_SBI_NUM; i++) {
+		if (stats.sbi_calls[i] != 0UL) {
+			snprintf(temp_str, MAX_STR_SIZE, "%-4s 0x%-8lx %-12lu\r\n", "sbi",
+				stats.sbi_ext_id[i], stats.sbi_calls[i]);
+			shell_puts(temp_str);
+		}
+	}
+
+	snprintf(temp_str, MAX_STR_SIZE, "\r\nHALT POLL: %lu hits, %lu misses, window %lu ticks\r\n",
+		stats.halt_poll_hits, stats.halt_poll_misses, stats.halt_poll_window);
+	shell_puts(temp_str);
+
+	shell_puts("\r\nTICKS <    HANDLER      ROUNDTRIP"
+		   "\r\n========== ============ ============\r\n");
+	for (i = 0U; i < ACRN_EXIT_STATS_HIST_NUM; i++) {
+		if ((stats.handler_hist[i] != 0UL) || (stats.roundtrip_hist[i] != 0UL)) {
+			if (i == (ACRN_EXIT_STATS_HIST_NUM - 1U)) {
+				snprintf(temp_str, MAX_STR_SIZE, "%-10s %-12lu %-12lu\r\n", "max",
+					stats.handler_hist[i], stats.roundtrip_hist[i]);
+			} else {
+				snprintf(temp_str, MAX_STR_SIZE, "%-10lu %-12lu %-12lu\r\n", 1UL << i,
+					stats.handler_hist[i], stats.roundtrip_hist[i]);
+			}
+			shell_puts(temp_str);
+		}
+	}
+	return 0;
+}
+
+#define PROFILE_DEFAULT_PERIOD	1000000UL
+
+static int32_t shell_profile(int32_t argc, char **argv)
+{
+	char temp_str[MAX_STR_SIZE];
+	uint64_t event_idx, period = PROFILE_DEFAULT_PERIOD;
+	uint16_t pcpu_id;
+	int32_t ret;
+
+	if (argc == 1) {
+		shell_puts("\r\nPCPU SAMPLES"
+			   "\r\n==== ============\r\n");
+		for (pcpu_id = 0U; pcpu_id < NR_CPUS; pcpu_id++) {
+			if (cpu_online(pcpu_id)) {
+				snprintf(temp_str, MAX_STR_SIZE, "%-4hu %-12lu\r\n", pcpu_id,
+					profiling_sample_count(pcpu_id));
+				shell_puts(temp_str);
+			}
+		}
+		return 0;
+	}
+
+	if ((argc == 2) && (strcmp(argv[1], "stop") == 0)) {
+		profiling_sample_stop();
+		return 0;
+	}
+
+	if (strcmp(argv[1], "cycles") == 0) {
+		event_idx = SBI_PMU_HW_CPU_CYCLES;
+	} else if (strcmp(argv[1], "instret") == 0) {
+		event_idx = SBI_PMU_HW_INSTRUCTIONS;
+	} else {
+		return -EINVAL;
+	}
+	if (argc == 3) {
+		period = (uint64_t)strtol_deci(argv[2]);
+	} else if (argc != 2) {
+		return -EINVAL;
+	}
+
+	ret = profiling_sample_start(event_idx, period);
+	if (ret == -ENODEV) {
+		shell_puts("Sampling needs Sscofpmf and the SBI PMU extension\r\n");
+	} else if (ret != 0) {
+		shell_puts("Profiler already running or period 0\r\n");
+	}
+	return ret;
+}
 #else
 static void get_ptdev_info(char *str_arg, size_t str_max)
 {
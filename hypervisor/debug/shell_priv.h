@@ -113,4 +113,31 @@ struct shell {
 #define SHELL_CMD_WRMSR_PARAM		"[-p<pcpu_id>]	<msr_index> <value>"
 #define SHELL_CMD_WRMSR_HELP		"Write value (in hexadecimal) to the MSR at msr_index (in hexadecimal) for CPU"\
 					" ID pcpu_id"
+
+#define SHELL_CMD_S2PT_POOL		"s2pt_pool"
+#define SHELL_CMD_S2PT_POOL_PARAM	NULL
+#define SHELL_CMD_S2PT_POOL_HELP	"Show usage of the stage-2 page-table page pool and per-VM large page split/merge counts"
+
+#define SHELL_CMD_IRQ_REBALANCE		"irq_rebalance"
+#define SHELL_CMD_IRQ_REBALANCE_PARAM	NULL
+#define SHELL_CMD_IRQ_REBALANCE_HELP	"Steer pass-through interrupts to the pCPU of the vCPU enabling them, then list steered interrupts"
+
+#define SHELL_CMD_SCHED_TICKS		"sched_ticks"
+#define SHELL_CMD_SCHED_TICKS_PARAM	NULL
+#define SHELL_CMD_SCHED_TICKS_HELP	"Show per-pCPU scheduler ticks taken, ticks avoided by the dynamic tick and tick stops"
+
+#define SHELL_CMD_LOCK_STATS		"lock_stats"
+#define SHELL_CMD_LOCK_STATS_PARAM	"[reset]"
+#define SHELL_CMD_LOCK_STATS_HELP	"Show acquisitions, contended acquisitions and maximum wait (ticks) per lock class, "\
+	"or reset them"
+
+#define SHELL_CMD_EXIT_STATS		"exit_stats"
+#define SHELL_CMD_EXIT_STATS_PARAM	"<vm id, vcpu id> [reset]"
+#define SHELL_CMD_EXIT_STATS_HELP	"Show VM exits per scause and SBI extension, log2 histograms of handler and "\
+	"exit-to-entry time (ticks) and halt-polling hits and misses of a vCPU, or reset them"
+
+#define SHELL_CMD_PROFILE		"profile"
+#define SHELL_CMD_PROFILE_PARAM		"[<cycles|instret> [period] | stop]"
+#define SHELL_CMD_PROFILE_HELP		"Sample the PC every period events (default 1000000) into the acrntrace "\
+	"buffers, stop sampling, or show samples taken per pCPU"
 #endif /* SHELL_PRIV_H */
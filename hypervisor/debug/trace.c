@@ -5,8 +5,10 @@
  */
 
 #include <types.h>
+#include <asm/cpu.h>
 #include <asm/per_cpu.h>
 #include <ticks.h>
+#include <common/sbuf.h>
 #include <trace.h>
 
 #define TRACE_CUSTOM			0xFCU
@@ -48,15 +50,19 @@ static inline bool trace_check(uint16_t cpu_id)
 	return true;
 }
 
+/* trace points run in interrupt context too, keep them off a half-done sbuf_put */
 static inline void trace_put(uint16_t cpu_id, uint32_t evid, uint32_t n_data, struct trace_entry *entry)
 {
 	struct shared_buf *sbuf = per_cpu(sbuf, cpu_id)[ACRN_TRACE];
+	uint64_t rflags;
 
-	entry->tsc = cpu_ticks();
 	entry->id = evid;
 	entry->n_data = (uint8_t)n_data;
 	entry->cpu = (uint8_t)cpu_id;
+	CPU_INT_ALL_DISABLE(&rflags);
+	entry->tsc = cpu_ticks();
 	(void)sbuf_put(sbuf, (uint8_t *)entry);
+	CPU_INT_ALL_RESTORE(rflags);
 }
 
 void TRACE_2L(uint32_t evid, uint64_t e, uint64_t f)
@@ -598,10 +598,100 @@ hv_emulate_pio(struct acrn_vcpu *vcpu, struct io_request *io_req)
 }
 #endif
 
+/**
+ * @brief Search the sorted MMIO index for the region covering an access
+ *
+ * Binary search for the last region starting at or below \p address. The
+ * emulated regions of a VM do not overlap, so only that region and the one
+ * after it can intersect [address, address + size).
+ *
+ * @retval 0 \p hit holds a copy of the region fully covering the access.
+ * @retval -ENODEV No region intersects the access.
+ * @retval -EIO The access spans more than one region.
+ */
+static int32_t search_mmio_index(const struct acrn_vm *vm, uint64_t address, uint64_t size,
+		struct mmio_hit_cache *hit)
+{
+	const struct mmio_range_index *index = &vm->emul_mmio_index;
+	const struct mem_io_node *mmio_node;
+	uint16_t nr = min(index->nr, (uint16_t)CONFIG_MAX_EMULATED_MMIO_REGIONS);
+	uint16_t lo = 0U, hi = nr, mid;
+	int32_t status = -ENODEV;
+
+	while (lo < hi) {
+		mid = (lo + hi) >> 1U;
+		if (vm->emul_mmio[index->node[mid]].range_start <= address) {
+			lo = mid + 1U;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (lo > 0U) {
+		mmio_node = &vm->emul_mmio[index->node[lo - 1U]];
+		if (address < mmio_node->range_end) {
+			if ((address + size) <= mmio_node->range_end) {
+				hit->hold_lock = mmio_node->hold_lock;
+				hit->read_write = mmio_node->read_write;
+				hit->handler_private_data = mmio_node->handler_private_data;
+				hit->range_start = mmio_node->range_start;
+				hit->range_end = mmio_node->range_end;
+				status = 0;
+			} else {
+				status = -EIO;
+			}
+		}
+	}
+
+	if ((status == -ENODEV) && (lo < nr)) {
+		mmio_node = &vm->emul_mmio[index->node[lo]];
+		if ((address + size) > mmio_node->range_start) {
+			status = -EIO;
+		}
+	}
+
+	return status;
+}
+
+/**
+ * @brief Look up the MMIO index without holding emul_mmio_lock
+ *
+ * The search is retried until it ran against a stable index, \p hit->seq
+ * records the version it was taken from.
+ */
+static int32_t find_mmio_region(const struct acrn_vm *vm, uint64_t address, uint64_t size,
+		struct mmio_hit_cache *hit)
+{
+	const struct mmio_range_index *index = &vm->emul_mmio_index;
+	int32_t status = -ENODEV;
+	bool stable = false;
+	uint32_t seq;
+
+	while (!stable) {
+		seq = index->seq;
+		if ((seq & 1U) == 0U) {
+			cpu_memory_barrier();
+			status = search_mmio_index(vm, address, size, hit);
+			cpu_memory_barrier();
+			stable = (index->seq == seq);
+		}
+		if (!stable) {
+			asm_pause();
+		}
+	}
+	hit->seq = seq;
+
+	return status;
+}
+
 /**
  * Use registered MMIO handlers on the given request if it falls in the range of
  * any of them.
  *
+ * The region is taken from the vCPU's last-hit cache when that is still
+ * current, otherwise from a lockless lookup of the sorted MMIO index.
+ * emul_mmio_lock is only taken for handlers registered with hold_lock.
+ *
  * @pre io_req->io_type == ACRN_IOREQ_TYPE_MMIO
  *
  * @retval 0 Successfully emulated by registered handlers.
@@ -611,58 +701,53 @@ hv_emulate_pio(struct acrn_vcpu *vcpu, struct io_request *io_req)
 static int32_t
 hv_emulate_mmio(struct acrn_vcpu *vcpu, struct io_request *io_req)
 {
-	int32_t status = -ENODEV;
-	bool hold_lock = true;
-	uint16_t idx;
-	uint64_t address, size, base, end;
+	int32_t status;
+	uint64_t address, size;
+	struct acrn_vm *vm = vcpu->vm;
 	struct acrn_mmio_request *mmio_req = &io_req->reqs.mmio_request;
-	struct mem_io_node *mmio_handler = NULL;
-	hv_mem_io_handler_t read_write = NULL;
-	void *handler_private_data = NULL;
-
-	if (is_service_vm(vcpu->vm) || is_prelaunched_vm(vcpu->vm)) {
-		read_write = mmio_default_access_handler;
-	}
+	struct mmio_hit_cache *cache = &vcpu->mmio_cache;
+	struct mmio_hit_cache hit;
 
 	address = mmio_req->address;
 	size = mmio_req->size;
 
-	spinlock_obtain(&vcpu->vm->emul_mmio_lock);
-	for (idx = 0U; idx <= vcpu->vm->nr_emul_mmio_regions; idx++) {
-		mmio_handler = &(vcpu->vm->emul_mmio[idx]);
-		if (mmio_handler->read_write != NULL) {
-			base = mmio_handler->range_start;
-			end = mmio_handler->range_end;
-
-			if (((address + size) <= base) || (address >= end)) {
-				continue;
-			} else {
-				 if ((address >= base) && ((address + size) <= end)) {
-					hold_lock = mmio_handler->hold_lock;
-					read_write = mmio_handler->read_write;
-					handler_private_data = mmio_handler->handler_private_data;
-				} else {
-					pr_fatal("Err MMIO, address:0x%lx, size:%x", address, size);
-					status = -EIO;
-				}
-				break;
-			}
+	if ((cache->read_write != NULL) && (cache->seq == vm->emul_mmio_index.seq) &&
+			(address >= cache->range_start) && ((address + size) <= cache->range_end)) {
+		hit = *cache;
+		status = 0;
+	} else {
+		status = find_mmio_region(vm, address, size, &hit);
+		if (status == 0) {
+			*cache = hit;
 		}
 	}
 
-	if ((status == -ENODEV) && (read_write != NULL)) {
-		/* This mmio_handler will never modify once register, so we don't
-		 * need to hold the lock when handling the MMIO access.
-		 */
-		if (!hold_lock) {
-			spinlock_release(&vcpu->vm->emul_mmio_lock);
-		}
-		status = read_write(io_req, handler_private_data);
-		if (!hold_lock) {
-			spinlock_obtain(&vcpu->vm->emul_mmio_lock);
+	if (status == 0) {
+		if (hit.hold_lock) {
+			spinlock_obtain(&vm->emul_mmio_lock);
+			/* the region may have changed since it was looked up */
+			if (vm->emul_mmio_index.seq != hit.seq) {
+				status = search_mmio_index(vm, address, size, &hit);
+			}
+			if (status == 0) {
+				status = hit.read_write(io_req, hit.handler_private_data);
+			}
+			spinlock_release(&vm->emul_mmio_lock);
+		} else {
+			/* This mmio_handler will never modify once register, so we don't
+			 * need to hold the lock when handling the MMIO access.
+			 */
+			status = hit.read_write(io_req, hit.handler_private_data);
 		}
+	} else if (status == -EIO) {
+		pr_fatal("Err MMIO, address:0x%lx, size:%x", address, size);
+	} else if (is_service_vm(vm) || is_prelaunched_vm(vm)) {
+		spinlock_obtain(&vm->emul_mmio_lock);
+		status = mmio_default_access_handler(io_req, NULL);
+		spinlock_release(&vm->emul_mmio_lock);
+	} else {
+		/* no handler, deliver to HSM */
 	}
-	spinlock_release(&vcpu->vm->emul_mmio_lock);
 
 	return status;
 }
@@ -825,6 +910,49 @@ static inline struct mem_io_node *find_free_mmio_node(struct acrn_vm *vm)
 	return mmio_node;
 }
 
+/**
+ * @brief Start changing the MMIO nodes of \p vm
+ *
+ * Makes lockless readers of the MMIO index retry until
+ * mmio_index_update_end() is called.
+ *
+ * @pre The caller holds vm->emul_mmio_lock, or no vCPU of \p vm is running.
+ */
+static void mmio_index_update_begin(struct acrn_vm *vm)
+{
+	vm->emul_mmio_index.seq++;
+	cpu_write_memory_barrier();
+}
+
+/**
+ * @brief Rebuild the sorted MMIO index of \p vm and publish it
+ *
+ * An insertion sort is enough for CONFIG_MAX_EMULATED_MMIO_REGIONS nodes.
+ */
+static void mmio_index_update_end(struct acrn_vm *vm)
+{
+	struct mmio_range_index *index = &vm->emul_mmio_index;
+	uint16_t idx, pos, nr = 0U;
+	uint64_t start;
+
+	for (idx = 0U; idx < CONFIG_MAX_EMULATED_MMIO_REGIONS; idx++) {
+		if (vm->emul_mmio[idx].read_write != NULL) {
+			start = vm->emul_mmio[idx].range_start;
+			pos = nr;
+			while ((pos > 0U) && (vm->emul_mmio[index->node[pos - 1U]].range_start > start)) {
+				index->node[pos] = index->node[pos - 1U];
+				pos--;
+			}
+			index->node[pos] = idx;
+			nr++;
+		}
+	}
+	index->nr = nr;
+
+	cpu_write_memory_barrier();
+	index->seq++;
+}
+
 /**
  * @brief Register a MMIO handler
  *
@@ -847,12 +975,14 @@ void register_mmio_emulation_handler(struct acrn_vm *vm,
 		spinlock_obtain(&vm->emul_mmio_lock);
 		mmio_node = find_free_mmio_node(vm);
 		if (mmio_node != NULL) {
+			mmio_index_update_begin(vm);
 			/* Fill in information for this node */
 			mmio_node->hold_lock = hold_lock;
 			mmio_node->read_write = read_write;
 			mmio_node->handler_private_data = handler_private_data;
 			mmio_node->range_start = start;
 			mmio_node->range_end = end;
+			mmio_index_update_end(vm);
 		}
 		spinlock_release(&vm->emul_mmio_lock);
 	}
@@ -876,13 +1006,17 @@ void unregister_mmio_emulation_handler(struct acrn_vm *vm,
 	spinlock_obtain(&vm->emul_mmio_lock);
 	mmio_node = find_match_mmio_node(vm, start, end);
 	if (mmio_node != NULL) {
+		mmio_index_update_begin(vm);
 		(void)memset(mmio_node, 0U, sizeof(struct mem_io_node));
+		mmio_index_update_end(vm);
 	}
 	spinlock_release(&vm->emul_mmio_lock);
 }
 
 void deinit_emul_io(struct acrn_vm *vm)
 {
+	mmio_index_update_begin(vm);
 	(void)memset(vm->emul_mmio, 0U, sizeof(vm->emul_mmio));
+	mmio_index_update_end(vm);
 	(void)memset(vm->emul_pio, 0U, sizeof(vm->emul_pio));
 }
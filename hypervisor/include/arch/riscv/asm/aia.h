@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2023-2024 Intel Corporation. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef __RISCV_AIA_H__
+#define __RISCV_AIA_H__
+
+#include <types.h>
+#include <asm/page.h>
+
+#ifndef CONFIG_IMSIC_BASE
+/* boards without AIA, aia_probe() fails on them */
+#define CONFIG_APLIC_BASE		0UL
+#define CONFIG_APLIC_SIZE		0
+#define CONFIG_IMSIC_BASE		0UL
+#endif
+
+/* AIA CSRs by number, so that the assembler need not know Ssaia */
+#define CSR_SISELECT		0x150
+#define CSR_SIREG		0x151
+
+#define SIE_SGEIE		(1UL << 12)
+#define HSTATUS_VGEIN_SHIFT	12U
+#define HSTATUS_VGEIN_MASK	(0x3fUL << HSTATUS_VGEIN_SHIFT)
+
+/* IMSIC registers behind siselect/sireg */
+#define IMSIC_EIDELIVERY	0x70U
+#define IMSIC_EITHRESHOLD	0x72U
+#define IMSIC_EIP0		0x80U
+#define IMSIC_EIE0		0xc0U
+#define IMSIC_TOPEI_ID_SHIFT	16U
+
+/* interrupt identities of each interrupt file, as on QEMU virt */
+#define IMSIC_NR_IDS		255U
+#define IMSIC_SETEIPNUM_LE	0x0U
+#define IMSIC_MAX_GUEST_FILES	63U
+
+/* APLIC registers, MSI delivery mode */
+#define APLIC_DOMAINCFG			0x0000U
+#define APLIC_DOMAINCFG_RDONLY		0x80000000U
+#define APLIC_DOMAINCFG_IE		(1U << 8)
+#define APLIC_DOMAINCFG_DM		(1U << 2)
+#define APLIC_SOURCECFG_BASE		0x0004U
+#define APLIC_SOURCECFG_D		(1U << 10)
+#define APLIC_SOURCECFG_SM_MASK		0x7U
+#define APLIC_SM_INACTIVE		0U
+#define APLIC_SM_DETACHED		1U
+#define APLIC_SM_EDGE_RISE		4U
+#define APLIC_SM_EDGE_FALL		5U
+#define APLIC_SM_LEVEL_HIGH		6U
+#define APLIC_SM_LEVEL_LOW		7U
+#define APLIC_MSIADDRCFG_BASE		0x1bc0U
+#define APLIC_SETIP_BASE		0x1c00U
+#define APLIC_SETIPNUM			0x1cdcU
+#define APLIC_CLRIP_BASE		0x1d00U
+#define APLIC_CLRIPNUM			0x1ddcU
+#define APLIC_SETIE_BASE		0x1e00U
+#define APLIC_SETIENUM			0x1edcU
+#define APLIC_CLRIE_BASE		0x1f00U
+#define APLIC_CLRIENUM			0x1fdcU
+#define APLIC_SETIPNUM_LE		0x2000U
+#define APLIC_SETIPNUM_BE		0x2004U
+#define APLIC_GENMSI			0x3000U
+#define APLIC_TARGET_BASE		0x3004U
+#define APLIC_TARGET_HART_SHIFT		18U
+#define APLIC_TARGET_GUEST_SHIFT	12U
+#define APLIC_TARGET_GUEST_MASK		0x3fU
+#define APLIC_TARGET_EIID_MASK		0x7ffU
+
+/* sources of the S-level APLIC on QEMU virt */
+#define APLIC_NUM_SOURCES		0x60U
+#define APLIC_NUM_WORDS			((APLIC_NUM_SOURCES + 31U) / 32U)
+
+static inline bool aplic_sm_is_level(uint32_t sm)
+{
+	return (sm == APLIC_SM_LEVEL_HIGH) || (sm == APLIC_SM_LEVEL_LOW);
+}
+
+#ifndef CONFIG_MACRN
+extern bool aia_available(void);
+extern bool aia_probe(void);
+extern void aia_init(void);
+extern void aia_init_hart(void);
+
+extern uint32_t imsic_guest_index_bits(void);
+extern uint32_t imsic_alloc_guest_file(uint16_t pcpu_id);
+extern void imsic_free_guest_file(uint16_t pcpu_id, uint32_t file);
+extern uint64_t imsic_file_hpa(uint16_t pcpu_id, uint32_t file);
+extern void imsic_send_msi(uint16_t pcpu_id, uint32_t file, uint32_t eiid);
+
+extern void aplic_route(uint32_t irq, uint32_t sm, uint16_t pcpu_id, uint32_t file, uint32_t eiid);
+extern void aplic_release(uint32_t irq);
+extern void aplic_set_enable(uint32_t irq, bool enable);
+extern void aplic_retrigger(uint32_t irq);
+extern void aplic_clear_pending(uint32_t irq);
+extern uint32_t aplic_read_pending(uint32_t word);
+#else
+static inline bool aia_available(void)
+{
+	return false;
+}
+static inline bool aia_probe(void)
+{
+	return false;
+}
+static inline void aia_init(void) {}
+static inline void aia_init_hart(void) {}
+#endif
+
+#endif /* __RISCV_AIA_H__ */
@@ -17,6 +17,8 @@
 #define RISCV_L1_CACHE_SHIFT	CONFIG_RISCV_L1_CACHE_SHIFT
 
 extern size_t dcache_block_size;
+/* 0 if cbo.zero can't be used */
+extern size_t cboz_block_size;
 static inline size_t get_dcache_block_size(void)
 {
 	return 1 << RISCV_L1_CACHE_SHIFT;
@@ -34,6 +36,13 @@ static inline size_t get_dcache_block_size(void)
 	asm volatile ("cbo.flush 0(%0)"::"r"(x):"memory");	\
 } while(0)
 
+#define zero_dcache(x) do {					\
+	asm volatile (".option push\n\t"				\
+		      ".option arch, +zicboz\n\t"		\
+		      "cbo.zero 0(%0)\n\t"			\
+		      ".option pop"::"r"(x):"memory");		\
+} while(0)
+
 static inline void invalidate_icache_local(void)
 {
 	asm volatile ("fence.i");
@@ -8,6 +8,12 @@
 #define CONFIG_RISCV64 1
 #define CONFIG_RISCV_L1_CACHE_SHIFT 7
 #define CONFIG_SCHED_IORR 1
+/* stop the IORR tick while a pCPU has at most one runnable thread */
+#define CONFIG_SCHED_IORR_TICKLESS 1
+/* let guests program vstimecmp directly on harts with Sstc */
+#define CONFIG_GUEST_SSTC 1
+/* longest a trapped guest WFI polls for a wake-up before the vCPU sleeps, 0 disables polling */
+#define CONFIG_HALT_POLL_MAX_US 200U
 #define CONFIG_HAS_FAST_MULTIPLY 1
 #define CONFIG_CC_HAS_VISIBILITY_ATTRIBUTE 1
 #define CONFIG_DEBUG_LOCKS 1
@@ -27,6 +33,14 @@
 #define CONFIG_UOS_VIRTIO_NET_IRQ 80
 
 #define CONFIG_GUEST_ADDRESS_SPACE_SIZE  0x100000000
+/* stage-2 invalidations larger than this flush the whole VMID */
+#define CONFIG_S2PT_FLUSH_THRESHOLD	0x40000UL
+/* guest SBI remote sfence.vma over more pages than this flushes the whole ASID/VMID */
+#define CONFIG_RFENCE_FLUSH_THRESHOLD	64UL
+/* stage-2 table pages shared by all VMs, must be a multiple of 64 */
+#define CONFIG_S2PT_PAGE_NUM		2048UL
+/* largest vector register (VLEN/8 bytes) guests may use, sizes each vCPU's save area */
+#define CONFIG_MAX_VLENB		64UL
 #define CONFIG_MAX_EMULATED_MMIO_REGIONS 32
 #define CONFIG_MAX_MSIX_TABLE_NUM	64U
 #define CONFIG_MAX_PCI_DEV_NUM		96U
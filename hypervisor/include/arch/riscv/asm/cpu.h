@@ -21,6 +21,7 @@
 #include <util.h>
 #include <asm/offset.h>
 #include <asm/types.h>
+#include <asm/system.h>
 
 extern uint16_t console_loglevel;
 extern uint16_t mem_loglevel;
@@ -175,7 +176,7 @@ extern void cpu_dead(void);
 extern void cpu_do_idle(void);
 
 #define barrier()	__asm__ __volatile__("fence": : :"memory")
-#define cpu_relax()	barrier() /* TODO: replace with yield instruction */
+#define cpu_relax()	asm volatile(ASM_PAUSE : : : "memory")
 
 #define ASM_STR(x)	#x
 
@@ -188,14 +189,20 @@ extern void cpu_do_idle(void);
 	v;								\
 })
 
-/* Write CSR */
+/* Write CSR, the local must not shadow a caller variable named in csr_val */
 #define cpu_csr_write(reg, csr_val)					\
 ({									\
-	uint64_t val = (uint64_t)csr_val;				\
+	uint64_t __csr_v = (uint64_t)(csr_val);				\
 	asm volatile (" csrw " ASM_STR(reg) ", %0 \n\t"			\
-			:: "r"(val): "memory");	 			\
+			:: "r"(__csr_v): "memory");			\
 })
 
+/* Sstc CSRs by number, so that the assembler need not know the extension */
+#define CSR_VSTIMECMP		0x24d
+
+#define HENVCFG_STCE		(1UL << 63)
+#define HENVCFG_PBMTE		(1UL << 62)
+
 /* Set CSR */
 #define cpu_csr_set(reg, csr_val)					\
 ({									\
@@ -215,7 +222,7 @@ extern void cpu_do_idle(void);
 
 static inline void asm_pause(void)
 {
-	asm volatile ("fence; nop");
+	cpu_relax();
 }
 
 static inline void asm_hlt(void)
@@ -278,6 +285,9 @@ struct run_context {
 	uint64_t stval;
 	uint64_t scause;
 	uint64_t satp;
+	/* guest timer compare in guest time, live in vstimecmp when Sstc is used */
+	uint64_t vstimecmp;
+	uint64_t htimedelta;
 };
 
 struct cpu_context {
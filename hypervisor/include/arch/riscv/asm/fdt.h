@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2023-2024 Intel Corporation. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef __RISCV_FDT_H__
+#define __RISCV_FDT_H__
+
+#include <types.h>
+
+#define FDT_MAGIC		0xd00dfeedU
+
+#define FDT_BEGIN_NODE		0x1U
+#define FDT_END_NODE		0x2U
+#define FDT_PROP		0x3U
+#define FDT_NOP			0x4U
+#define FDT_END			0x9U
+
+/* node names are at most 31 characters, unit address included */
+#define FDT_NODE_NAME_MAX	32U
+
+/* deepest node nesting the walker keeps track of */
+#define FDT_MAX_DEPTH		8U
+
+/* all fields are big-endian */
+struct fdt_header {
+	uint32_t magic;
+	uint32_t totalsize;
+	uint32_t off_dt_struct;
+	uint32_t off_dt_strings;
+	uint32_t off_mem_rsvmap;
+	uint32_t version;
+	uint32_t last_comp_version;
+	uint32_t boot_cpuid_phys;
+	uint32_t size_dt_strings;
+	uint32_t size_dt_struct;
+};
+
+struct fdt_prop {
+	/* names of the enclosing nodes, nodes[0] is the root ("") */
+	const char *nodes[FDT_MAX_DEPTH];
+	/* index of the node holding this property in nodes[] */
+	uint32_t depth;
+	const char *name;
+	const void *value;
+	uint32_t len;
+};
+
+typedef void (*fdt_prop_cb_t)(const struct fdt_prop *prop, void *data);
+
+static inline uint32_t fdt32_to_cpu(uint32_t val)
+{
+	return __builtin_bswap32(val);
+}
+
+extern const void *get_host_fdt(void);
+extern int32_t fdt_walk(const void *fdt, fdt_prop_cb_t cb, void *data);
+extern bool fdt_node_is(const struct fdt_prop *prop, uint32_t depth, const char *name);
+extern bool fdt_prop_has_string(const struct fdt_prop *prop, const char *str);
+extern uint64_t fdt_unit_address(const char *node);
+
+#endif /* __RISCV_FDT_H__ */
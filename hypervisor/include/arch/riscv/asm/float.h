@@ -10,9 +10,62 @@
 #ifndef __RISCV_FLOAT_H__
 #define __RISCV_FLOAT_H__
 
+#include <types.h>
+#include <asm/config.h>
+
+/* sstatus.FS/VS, the same encoding is used for both fields */
+#define SSTATUS_VS		(3UL << 9)
+#define SSTATUS_VS_INITIAL	(1UL << 9)
+#define SSTATUS_VS_CLEAN	(2UL << 9)
+#define SSTATUS_VS_DIRTY	(3UL << 9)
+#define SSTATUS_FS		(3UL << 13)
+#define SSTATUS_FS_INITIAL	(1UL << 13)
+#define SSTATUS_FS_CLEAN	(2UL << 13)
+#define SSTATUS_FS_DIRTY	(3UL << 13)
+
+struct fp_context {
+	uint64_t f[32];
+	uint64_t fcsr;
+};
+
+struct vector_context {
+	uint64_t vstart;
+	uint64_t vl;
+	uint64_t vtype;
+	uint64_t vcsr;
+	uint8_t v[32UL * CONFIG_MAX_VLENB] __aligned(16);
+};
+
+struct float_caps {
+	bool fpu;
+	/* only set if vlenb fits in struct vector_context */
+	bool vector;
+	uint64_t vlenb;
+};
+
+extern struct float_caps float_caps;
+
+static inline bool has_fpu(void)
+{
+	return float_caps.fpu;
+}
+
+static inline bool has_vector(void)
+{
+	return float_caps.vector;
+}
+
+extern void fp_save(struct fp_context *ctx);
+extern void fp_restore(const struct fp_context *ctx);
+extern void vector_save(struct vector_context *ctx);
+extern void vector_restore(const struct vector_context *ctx);
+extern void release_fp_state(void);
+
 #ifdef CONFIG_MACRN
+static inline void probe_float_caps(void) {};
 static inline void init_float(void) {};
 #else
+extern void probe_float_caps(void);
 extern void init_float(void);
 #endif
 
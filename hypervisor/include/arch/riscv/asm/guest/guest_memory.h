@@ -18,10 +18,10 @@ struct acrn_vcpu;
 struct acrn_vm;
 /* Use # of paging level to identify paging mode */
 enum vm_paging_mode {
-	PAGING_MODE_0_LEVEL = 0U,	/* Flat */
-	PAGING_MODE_2_LEVEL = 2U,	/* 32bit paging, 2-level */
-	PAGING_MODE_3_LEVEL = 3U,	/* PAE paging, 3-level */
-	PAGING_MODE_4_LEVEL = 4U,	/* 64bit paging, 4-level */
+	PAGING_MODE_0_LEVEL = 0U,	/* Bare */
+	PAGING_MODE_3_LEVEL = 3U,	/* Sv39, 3-level */
+	PAGING_MODE_4_LEVEL = 4U,	/* Sv48, 4-level */
+	PAGING_MODE_5_LEVEL = 5U,	/* Sv57, 5-level */
 	PAGING_MODE_NUM,
 };
 
@@ -32,6 +32,12 @@ extern int32_t gva2gpa(struct acrn_vcpu *vcpu, uint64_t gva, uint64_t *gpa, uint
 
 extern enum vm_paging_mode get_vcpu_paging_mode(struct acrn_vcpu *vcpu);
 
+extern void gva_cache_flush(struct acrn_vcpu *vcpu);
+
+#ifndef CONFIG_MACRN
+extern uint32_t fetch_guest_instruction(uint64_t guest_hstatus, uint64_t pc);
+#endif
+
 /* gpa --> hpa -->hva */
 extern void *gpa2hva(struct acrn_vm *vm, uint64_t x);
 
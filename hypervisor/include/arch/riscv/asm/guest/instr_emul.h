@@ -73,9 +73,23 @@ struct instr_emul_ctxt {
 	struct instr_emul_vie vie;
 };
 
-extern uint32_t get_instruction(struct run_context *, uint32_t *xlen);
+/* decoded MMIO descriptors cached per vCPU, must be a power of 2 */
+#define MMIO_DESC_CACHE_SIZE	4U
+
+/* A decoded guest load/store that trapped on an MMIO access */
+struct mmio_access_desc {
+	uint64_t pc;		/* guest PC of the instruction */
+	uint32_t ins;		/* instruction word, as reported in htinst or fetched */
+	uint8_t size;		/* access width in bytes */
+	uint8_t ins_len;	/* 2 if compressed, 4 otherwise, 0 for pseudo-instructions */
+	uint8_t reg;		/* rd of a load, rs2 of a store */
+	bool is_write;
+	bool sign_extend;	/* lb/lh/lw and their compressed forms */
+	bool pseudo;		/* implicit access of a guest page-table walk */
+};
+
+extern uint32_t get_instruction(struct run_context *ctx, bool *transformed);
 extern int32_t emulate_instruction(struct acrn_vcpu *vcpu);
-extern int32_t decode_instruction(struct acrn_vcpu *vcpu, uint32_t ins,
-				   uint32_t xlen);
+extern int32_t decode_instruction(struct acrn_vcpu *vcpu, uint32_t ins, bool transformed);
 
 #endif /* __RISCV_INSTR_EMUL_H__ */
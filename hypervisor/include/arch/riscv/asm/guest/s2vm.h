@@ -20,18 +20,52 @@ struct acrn_vm;
 struct acrn_vcpu;
 
 typedef void (*pge_handler)(uint64_t *pgentry, uint64_t size);
+
+#define S2PT_TXN_MAX_OPS	16U
+
+struct s2pt_op {
+	uint32_t type;		/* MR_ADD, MR_MODIFY or MR_DEL */
+	uint64_t hpa;
+	uint64_t gpa;
+	uint64_t size;
+	uint64_t prot_set;	/* prot for MR_ADD */
+	uint64_t prot_clr;
+};
+
+/*
+ * A batch of stage-2 mapping updates applied under one s2pt_lock hold and
+ * followed by a single TLB invalidation covering all of them.
+ */
+struct s2pt_txn {
+	struct acrn_vm *vm;
+	uint64_t *vpn3_page;
+	uint32_t nr_ops;
+	/* sticky error of the commits so far */
+	int32_t ret;
+	struct s2pt_op ops[S2PT_TXN_MAX_OPS];
+};
+
 #ifndef CONFIG_MACRN
 extern void setup_virt_paging(void);
 extern uint64_t local_gpa2hpa(struct acrn_vm *vm, uint64_t gpa, uint32_t *size);
 extern uint64_t gpa2hpa(struct acrn_vm *vm, uint64_t gpa);
 extern int s2pt_init(struct acrn_vm *vm);
-extern void s2pt_add_mr(struct acrn_vm *vm, uint64_t *pml4_page, uint64_t hpa,
+extern void s2pt_deinit(struct acrn_vm *vm);
+extern int32_t s2pt_add_mr(struct acrn_vm *vm, uint64_t *pml4_page, uint64_t hpa,
 			uint64_t gpa, uint64_t size, uint64_t prot_orig);
-extern void s2pt_del_mr(struct acrn_vm *vm, uint64_t *pml4_page, uint64_t gpa, uint64_t size);
-extern void s2pt_modify_mr(struct acrn_vm *vm, uint64_t *vpn3_page, uint64_t gpa,
+extern int32_t s2pt_del_mr(struct acrn_vm *vm, uint64_t *pml4_page, uint64_t gpa, uint64_t size);
+extern int32_t s2pt_modify_mr(struct acrn_vm *vm, uint64_t *vpn3_page, uint64_t gpa,
 				uint64_t size, uint64_t prot_set, uint64_t prot_clr);
 extern void s2vm_restore_state(struct acrn_vcpu *vcpu);
 extern void s2pt_flush_guest(struct acrn_vm *vm);
+extern void s2pt_flush_range(struct acrn_vm *vm, uint64_t gpa, uint64_t size);
+extern void s2pt_txn_begin(struct s2pt_txn *txn, struct acrn_vm *vm, uint64_t *vpn3_page);
+extern void s2pt_txn_add_mr(struct s2pt_txn *txn, uint64_t hpa, uint64_t gpa,
+				uint64_t size, uint64_t prot);
+extern void s2pt_txn_modify_mr(struct s2pt_txn *txn, uint64_t gpa, uint64_t size,
+				uint64_t prot_set, uint64_t prot_clr);
+extern void s2pt_txn_del_mr(struct s2pt_txn *txn, uint64_t gpa, uint64_t size);
+extern int32_t s2pt_txn_commit(struct s2pt_txn *txn);
 #else
 static inline void setup_virt_paging(void) {}
 static inline uint64_t local_gpa2hpa(struct acrn_vm *vm, uint64_t gpa, uint32_t *size)
@@ -43,17 +77,38 @@ static inline uint64_t gpa2hpa(struct acrn_vm *vm, uint64_t gpa)
 	return gpa;
 }
 
+static inline void s2pt_deinit(struct acrn_vm *vm) {}
 static inline int s2pt_init(struct acrn_vm *vm)
 {
 	return 0;
 }
-static inline void s2pt_add_mr(struct acrn_vm *vm, uint64_t *pml4_page, uint64_t hpa,
-			uint64_t gpa, uint64_t size, uint64_t prot_orig) {}
-static inline void s2pt_del_mr(struct acrn_vm *vm, uint64_t *pml4_page, uint64_t gpa, uint64_t size) {}
-static inline void s2pt_modify_mr(struct acrn_vm *vm, uint64_t *vpn3_page, uint64_t gpa,
-				uint64_t size, uint64_t prot_set, uint64_t prot_clr) {}
+static inline int32_t s2pt_add_mr(struct acrn_vm *vm, uint64_t *pml4_page, uint64_t hpa,
+			uint64_t gpa, uint64_t size, uint64_t prot_orig)
+{
+	return 0;
+}
+static inline int32_t s2pt_del_mr(struct acrn_vm *vm, uint64_t *pml4_page, uint64_t gpa, uint64_t size)
+{
+	return 0;
+}
+static inline int32_t s2pt_modify_mr(struct acrn_vm *vm, uint64_t *vpn3_page, uint64_t gpa,
+				uint64_t size, uint64_t prot_set, uint64_t prot_clr)
+{
+	return 0;
+}
 static inline void s2vm_restore_state(struct acrn_vcpu *vcpu) {}
 static inline void s2pt_flush_guest(struct acrn_vm *vm) {}
+static inline void s2pt_flush_range(struct acrn_vm *vm, uint64_t gpa, uint64_t size) {}
+static inline void s2pt_txn_begin(struct s2pt_txn *txn, struct acrn_vm *vm, uint64_t *vpn3_page) {}
+static inline void s2pt_txn_add_mr(struct s2pt_txn *txn, uint64_t hpa, uint64_t gpa,
+				uint64_t size, uint64_t prot) {}
+static inline void s2pt_txn_modify_mr(struct s2pt_txn *txn, uint64_t gpa, uint64_t size,
+				uint64_t prot_set, uint64_t prot_clr) {}
+static inline void s2pt_txn_del_mr(struct s2pt_txn *txn, uint64_t gpa, uint64_t size) {}
+static inline int32_t s2pt_txn_commit(struct s2pt_txn *txn)
+{
+	return 0;
+}
 #endif
 
 #endif /* __RISCV_S2VM_H__ */
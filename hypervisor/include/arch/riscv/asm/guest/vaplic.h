@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2023-2024 Intel Corporation. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef __RISCV_VAPLIC_H__
+#define __RISCV_VAPLIC_H__
+
+#include <types.h>
+#include <asm/lib/spinlock.h>
+#include <asm/aia.h>
+
+/*
+ * Virtual S-level APLIC, MSI delivery mode only. Interrupts are written
+ * into the guest interrupt file of the target vCPU, which the guest then
+ * takes without any VM exit.
+ */
+struct acrn_vaplic {
+	bool enabled;
+	spinlock_t lock;
+	struct acrn_vm *vm;
+	uint64_t base;
+
+	uint32_t domaincfg;
+	uint32_t sourcecfg[APLIC_NUM_SOURCES];
+	uint32_t target[APLIC_NUM_SOURCES];
+	uint32_t pending[APLIC_NUM_WORDS];
+	uint32_t ie[APLIC_NUM_WORDS];
+	/* sources the physical APLIC delivers straight to guest files */
+	uint32_t passthru[APLIC_NUM_WORDS];
+};
+
+struct acrn_vm;
+struct acrn_vcpu;
+
+#ifndef CONFIG_MACRN
+extern void vaplic_init(struct acrn_vm *vm);
+extern void vaplic_free_vcpu(struct acrn_vcpu *vcpu);
+extern void vaplic_accept_intr(struct acrn_vm *vm, uint32_t irq, bool level);
+extern bool vaplic_arm_wakeup(struct acrn_vcpu *vcpu);
+extern bool vaplic_has_pending(const struct acrn_vcpu *vcpu);
+extern void vaplic_cancel_wakeup(struct acrn_vcpu *vcpu);
+extern void vaplic_handle_sgei(void);
+#else
+static inline void vaplic_init(__unused struct acrn_vm *vm) {}
+static inline void vaplic_free_vcpu(__unused struct acrn_vcpu *vcpu) {}
+static inline void vaplic_accept_intr(__unused struct acrn_vm *vm, __unused uint32_t irq, __unused bool level) {}
+static inline bool vaplic_arm_wakeup(__unused struct acrn_vcpu *vcpu)
+{
+	return true;
+}
+static inline bool vaplic_has_pending(__unused const struct acrn_vcpu *vcpu)
+{
+	return false;
+}
+static inline void vaplic_cancel_wakeup(__unused struct acrn_vcpu *vcpu) {}
+static inline void vaplic_handle_sgei(void) {}
+#endif
+
+#endif /* __RISCV_VAPLIC_H__ */
@@ -18,6 +18,8 @@
 
 struct vclint_timer {
 	struct hv_timer timer;
+	/* wakes a halted vCPU whose timer lives in vstimecmp */
+	struct hv_timer wakeup;
 	uint32_t tmr_idx;
 };
 
@@ -57,5 +59,9 @@ extern uint64_t vclint_get_clint_access_addr(void);
 extern uint64_t vclint_get_clint_page_addr(struct acrn_vclint*vclint);
 extern bool vclint_has_pending_intr(struct acrn_vcpu *vcpu);
 extern void vclint_send_ipi(struct acrn_vclint *vclint, uint32_t cpu);
+extern void vclint_send_ipi_mask(struct acrn_vclint *vclint, uint64_t vcpu_mask);
 extern void vclint_write_tmr(struct acrn_vclint *vclint, uint32_t index, uint64_t data);
+extern bool vclint_deadline_passed(struct acrn_vcpu *vcpu);
+extern bool vclint_arm_wakeup(struct acrn_vcpu *vcpu);
+extern void vclint_cancel_wakeup(struct acrn_vcpu *vcpu);
 #endif /* __RISCV_VCLINT_H__ */
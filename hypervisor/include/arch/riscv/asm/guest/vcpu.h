@@ -13,13 +13,17 @@
 #ifndef __ASSEMBLY__
 
 #include <acrn_common.h>
+#include <acrn_hv_defs.h>
 #include <schedule.h>
 #include <event.h>
 #include <io_req.h>
 #include <asm/cpu.h>
 #include <asm/mem.h>
+#include <asm/float.h>
 #include <asm/guest/guest_memory.h>
 #include <asm/guest/vclint.h>
+#include <asm/guest/vpmu.h>
+#include <asm/guest/instr_emul.h>
 
 #define ACRN_REQUEST_EXCP			0U
 #define ACRN_REQUEST_EVENT			1U
@@ -31,6 +35,23 @@
 #define ACRN_REQUEST_VPID_FLUSH			7U
 #define ACRN_REQUEST_INIT_VMCS			8U
 #define ACRN_REQUEST_WAIT_WBINVD		9U
+#define ACRN_REQUEST_LCOFI			10U
+
+/*
+ * VS-level CSRs tracked in reg_cached/reg_updated after the GPRs, see
+ * vcpu_get_vs_csr(). vsstatus keeps using CPU_REG_STATUS.
+ */
+enum vs_csr_name {
+	VS_CSR_SEPC = NUM_GPRS,
+	VS_CSR_SIE,
+	VS_CSR_STVEC,
+	VS_CSR_SSCRATCH,
+	VS_CSR_STVAL,
+	VS_CSR_SCAUSE,
+	VS_CSR_SATP,
+	VS_CSR_TIMECMP,
+	VS_CSR_TIMEDELTA,
+};
 
 #define foreach_vcpu(idx, vm, t_vcpu)				\
 	for ((idx) = 0U, (t_vcpu) = &((vm)->hw.vcpu[(idx)]);	\
@@ -92,6 +113,37 @@ struct csr_store_area {
 	uint32_t count;	/* actual count of entries to be loaded/restored during VMEntry/VMExit */
 };
 
+/* always-on exit accounting, only written on the pCPU running the vCPU */
+struct vcpu_exit_stats {
+	uint64_t exception[ACRN_EXIT_STATS_EXCP_NUM];
+	uint64_t interrupt[ACRN_EXIT_STATS_IRQ_NUM];
+	uint64_t sbi_calls[ACRN_EXIT_STATS_SBI_NUM];
+	uint64_t handler_hist[ACRN_EXIT_STATS_HIST_NUM];
+	uint64_t roundtrip_hist[ACRN_EXIT_STATS_HIST_NUM];
+	uint64_t halt_poll_hits;
+	uint64_t halt_poll_misses;
+
+	/* when the vCPU last exited, 0 until it has */
+	uint64_t exit_tsc;
+};
+
+/* GVA to GPA translations, kept until the vCPU next enters the guest */
+#define GVA_CACHE_SIZE	8U
+
+struct gva_cache_entry {
+	uint64_t vpn;		/* GVA >> PAGE_SHIFT */
+	uint64_t gpa;		/* page aligned */
+	uint64_t pte;		/* leaf PTE, to check permissions on a hit */
+	uint64_t satp;
+	uint64_t epoch;
+};
+
+struct gva_cache {
+	/* entries from another epoch are invalid, gva_cache_flush() bumps it */
+	uint64_t epoch;
+	struct gva_cache_entry entries[GVA_CACHE_SIZE];
+};
+
 struct acrn_vcpu_arch {
 	struct guest_cpu_context contexts[NR_WORLD];
 	struct cpu_info cpu_info;
@@ -121,6 +173,8 @@ struct acrn_vcpu_arch {
 	uint64_t exit_reason;
 	uint64_t exit_qualification;
 	uint32_t inst_len;
+	struct vcpu_exit_stats exit_stats;
+	struct gva_cache gva_cache;
 
 	/* Information related to secondary / AP VCPU start-up */
 	enum vm_cpu_mode cpu_mode;
@@ -129,10 +183,30 @@ struct acrn_vcpu_arch {
 	/* interrupt injection information */
 	uint64_t pending_req;
 
+	/* guest timer programmed straight into vstimecmp (Sstc) */
+	bool direct_timer;
+
+	/* ticks a trapped WFI polls for a wake-up before sleeping, see hlt_vmexit_handler() */
+	uint64_t halt_poll_window;
+
 	struct csr_store_area csr_area;
 
 	/* EOI_EXIT_BITMAP buffer, for the bitmap update */
 	uint64_t eoi_exit_bitmap[EOI_EXIT_BITMAP_SIZE >> 6U];
+
+	/* MMIO access being emulated, and recently decoded ones */
+	struct mmio_access_desc mmio_desc;
+	struct mmio_access_desc mmio_desc_cache[MMIO_DESC_CACHE_SIZE];
+
+	/* FP/vector registers, only up to date while not live in a hart (fp_owner) */
+	struct fp_context fp;
+	struct vector_context vec;
+
+	/* SBI PMU counters */
+	struct acrn_vpmu vpmu;
+
+	/* guest interrupt file on the pCPU (hstatus.VGEIN), 0 without AIA */
+	uint32_t imsic_file;
 } __aligned(8);
 
 struct sbi_mpxy_shm {
@@ -156,6 +230,7 @@ struct acrn_vcpu {
 
 	//struct instr_emul_ctxt inst_ctxt;
 	struct io_request req; /* used by io/ept emulation */
+	struct mmio_hit_cache mmio_cache; /* last emulated MMIO region hit */
 	struct sbi_mpxy_shm mpxy; /* used by tee communication */
 
 	uint64_t reg_cached;
@@ -208,6 +283,8 @@ extern uint64_t vcpu_get_sp(const struct acrn_vcpu *vcpu);
 extern void vcpu_set_sp(struct acrn_vcpu *vcpu, uint64_t val);
 extern uint64_t vcpu_get_status(struct acrn_vcpu *vcpu);
 extern void vcpu_set_status(struct acrn_vcpu *vcpu, uint64_t val);
+extern uint64_t vcpu_get_vs_csr(struct acrn_vcpu *vcpu, uint32_t idx);
+extern void vcpu_set_vs_csr(struct acrn_vcpu *vcpu, uint32_t idx, uint64_t val);
 extern uint64_t vcpu_get_guest_csr(const struct acrn_vcpu *vcpu, uint32_t csr);
 extern void vcpu_set_guest_csr(struct acrn_vcpu *vcpu, uint32_t csr, uint64_t val);
 extern void vcpu_set_vmcs_eoi_exit(const struct acrn_vcpu *vcpu);
@@ -219,21 +296,6 @@ extern void reset_vcpu_regs(struct acrn_vcpu *vcpu);
 extern void init_vcpu_protect_mode_regs(struct acrn_vcpu *vcpu, uint64_t vgdt_base_gpa);
 extern void set_vcpu_startup_entry(struct acrn_vcpu *vcpu, uint64_t entry);
 
-static inline bool is_long_mode(struct acrn_vcpu *vcpu)
-{
-	return true;
-}
-
-static inline bool is_paging_enabled(struct acrn_vcpu *vcpu)
-{
-	return true;
-}
-
-static inline bool is_pae(struct acrn_vcpu *vcpu)
-{
-	return false;
-}
-
 extern struct acrn_vcpu *get_running_vcpu(uint16_t pcpu_id);
 extern struct acrn_vcpu *get_ever_run_vcpu(uint16_t pcpu_id);
 extern int create_vcpu(struct acrn_vm *vm, uint16_t vcpu_id);
@@ -243,6 +305,7 @@ extern void reset_vcpu(struct acrn_vcpu *vcpu, enum reset_mode mode);
 extern void zombie_vcpu(struct acrn_vcpu *vcpu, enum vcpu_state new_state);
 extern void launch_vcpu(struct acrn_vcpu *vcpu);
 extern void kick_vcpu(struct acrn_vcpu *vcpu);
+extern void kick_pcpus(uint64_t pcpu_mask);
 extern int32_t prepare_vcpu(struct acrn_vm *vm, uint16_t pcpu_id);
 extern uint64_t vcpumask2pcpumask(struct acrn_vm *vm, uint64_t vdmask);
 extern bool is_lapic_pt_enabled(struct acrn_vcpu *vcpu);
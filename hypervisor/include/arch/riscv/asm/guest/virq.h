@@ -16,6 +16,9 @@ extern void vcpu_inject_gp(struct acrn_vcpu *vcpu, uint32_t err_code);
 extern void vcpu_inject_pf(struct acrn_vcpu *vcpu, uint64_t addr, uint32_t err_code);
 extern void vcpu_inject_ud(struct acrn_vcpu *vcpu);
 extern void vcpu_inject_ss(struct acrn_vcpu *vcpu);
+#ifndef CONFIG_MACRN
+extern void vcpu_redirect_exception(struct acrn_vcpu *vcpu, uint64_t cause, uint64_t tval);
+#endif
 extern int32_t interrupt_window_vmexit_handler(struct acrn_vcpu *vcpu);
 extern int32_t external_interrupt_vmexit_handler(struct acrn_vcpu *vcpu);
 extern int32_t mexti_vmexit_handler(struct acrn_vcpu *vcpu);
@@ -17,6 +17,7 @@
 #include <asm/guest/vcpu.h>
 #include <asm/guest/vclint.h>
 #include <asm/guest/vplic.h>
+#include <asm/guest/vaplic.h>
 #include <vpic.h>
 #include <errno.h>
 #include <asm/guest/vio.h>
@@ -117,6 +118,10 @@ struct vm_arch {
 	void *sworld_s2ptp;
 	uint64_t s2pt_satp;
 	struct memory_ops s2pt_mem_ops;
+	/* pCPUs that have run this VMID and may hold its G-stage TLB entries */
+	volatile uint64_t s2pt_cpu_mask;
+	/* guest time minus host time, loaded into htimedelta on VM entry */
+	uint64_t htimedelta;
 
 	struct acrn_vpic vpic;      /* Virtual PIC */
 	enum vm_vlapic_mode vlapic_mode; /* Represents vLAPIC mode across vCPUs*/
@@ -139,6 +144,7 @@ struct acrn_vm {
 	/* per vm clint */
 	struct acrn_vclint vclint;
 	struct acrn_vplic vplic;
+	struct acrn_vaplic vaplic;
 	struct acrn_vuart vuart[MAX_VUART_NUM_PER_VM];		/* Virtual UART */
 	struct asyncio_desc	aio_desc[ACRN_ASYNCIO_MAX];
 	struct list_head aiodesc_queue;
@@ -150,6 +156,7 @@ struct acrn_vm {
 	spinlock_t emul_mmio_lock;	/* Used to protect emulation mmio_node concurrent access for a VM */
 	uint16_t nr_emul_mmio_regions;	/* max index of the emulated mmio_region */
 	struct mem_io_node emul_mmio[CONFIG_MAX_EMULATED_MMIO_REGIONS];
+	struct mmio_range_index emul_mmio_index;	/* sorted view of emul_mmio for lockless lookup */
 
 	struct vm_io_handler_desc emul_pio[EMUL_PIO_IDX_MAX];
 
@@ -10,11 +10,31 @@
 #ifndef __RISCV_VMEXIT_H__
 #define __RISCV_VMEXIT_H__
 
+#include <asm/lib/bits.h>
+#include <asm/guest/vcpu.h>
+
 struct vm_exit_dispatch {
 	int32_t (*handler)(struct acrn_vcpu *);
 	uint32_t need_exit_qualification;
 };
 
+/* count ticks in a log2 histogram of ACRN_EXIT_STATS_HIST_NUM buckets */
+static inline void exit_stats_hist_add(uint64_t hist[], uint64_t ticks)
+{
+	uint32_t bucket = 0U;
+
+	if (ticks != 0UL) {
+		bucket = (uint32_t)flsl(ticks) + 1U;
+		if (bucket >= ACRN_EXIT_STATS_HIST_NUM) {
+			bucket = ACRN_EXIT_STATS_HIST_NUM - 1U;
+		}
+	}
+	hist[bucket]++;
+}
+
+extern void vcpu_exit_stats_snapshot(const struct acrn_vcpu *vcpu, struct acrn_vcpu_exit_stats *stats);
+extern void vcpu_exit_stats_reset(struct acrn_vcpu *vcpu);
+extern uint64_t sbi_exit_stats_ext_id(uint32_t slot);
 extern int32_t vmexit_handler(struct acrn_vcpu *vcpu);
 extern int32_t vmcall_vmexit_handler(struct acrn_vcpu *vcpu);
 extern int32_t sbi_ecall_vmexit_handler(struct acrn_vcpu *vcpu);
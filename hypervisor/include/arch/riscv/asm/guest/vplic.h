@@ -14,10 +14,27 @@
 #include <asm/page.h>
 #include <asm/apicreg.h>
 
+/*
+ * What a context (one per vCPU) can be given: the sources that are pending,
+ * enabled for it and not claimed, bucketed by priority so that the best
+ * one is found with two bit scans.
+ */
+struct vplic_context {
+	spinlock_t lock;
+	uint32_t ready[PLIC_NUM_PRIORITY + 1][PLIC_NUM_FIELDS];
+	/* bit n is set while ready[n] is not empty */
+	uint32_t levels;
+	/* bucket each source is in, 0 for none */
+	uint8_t prio[PLIC_NUM_SOURCES];
+	/* best deliverable source, 0 if there is none */
+	uint32_t best;
+};
+
 struct acrn_vplic {
 	uint32_t enabled;
-	spinlock_t lock;
+	/* pending and claimed are updated atomically, the rest per context */
 	struct plic_regs regs;
+	struct vplic_context ctx[PLIC_NUM_CONTEXT];
 	struct acrn_vm *vm;
 	uint64_t plic_base;
 	uint32_t priority_base;
@@ -42,5 +59,6 @@ enum reset_mode;
 void vplic_init(struct acrn_vm *vm);
 void vplic_accept_intr(struct acrn_vcpu *vcpu, uint32_t vector, bool level);
 void vcpu_inject_extint(struct acrn_vcpu *vcpu);
+void vplic_rebalance_irqs(struct acrn_vm *vm);
 
 #endif /* __RISCV_VLAPIC_H__ */
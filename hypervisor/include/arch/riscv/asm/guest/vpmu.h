@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2025 Intel Corporation. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef __RISCV_VPMU_H__
+#define __RISCV_VPMU_H__
+
+#include <types.h>
+#include <asm/sbi.h>
+
+/* local counter overflow interrupt (Sscofpmf) */
+#define IRQ_LCOFI		13U
+#define SIP_LCOFIP		(1UL << IRQ_LCOFI)
+/* OF bits of the counters, by CSR number - 0xc00 */
+#define CSR_SCOUNTOVF		0xda0
+#define CSR_CYCLE_BASE		0xc00UL
+
+/* hardware counters come first, as on the host, then the firmware ones */
+#define VPMU_MAX_HW_COUNTERS	32U
+#define VPMU_NUM_FW_COUNTERS	((uint32_t)SBI_PMU_FW_MAX)
+#define VPMU_MAX_COUNTERS	(VPMU_MAX_HW_COUNTERS + VPMU_NUM_FW_COUNTERS)
+
+struct acrn_vcpu;
+struct cpu_regs;
+
+struct vpmu_counter {
+	uint64_t event_idx;
+	uint64_t event_data;
+	/* counter_cfg_match flags as passed to the host, inhibit bits included */
+	uint64_t flags;
+	/* firmware counters count here, hardware ones only while not live */
+	uint64_t value;
+};
+
+struct acrn_vpmu {
+	/* bitmaps of guest counter indices */
+	uint64_t configured;
+	uint64_t started;
+	struct vpmu_counter ctr[VPMU_MAX_COUNTERS];
+};
+
+/* every hart has Sscofpmf, set by the ISA probe */
+extern bool has_sscofpmf;
+
+extern void vpmu_init(void);
+extern void vpmu_init_hart(void);
+extern void vpmu_reset(struct acrn_vcpu *vcpu);
+extern void vpmu_fw_event(struct acrn_vcpu *vcpu, enum sbi_pmu_fw_event event);
+extern void vpmu_sbi_handler(struct acrn_vcpu *vcpu, struct cpu_regs *regs);
+#ifndef CONFIG_MACRN
+extern void vpmu_load(struct acrn_vcpu *vcpu);
+extern void vpmu_handle_overflow(void);
+#else
+static inline void vpmu_load(__unused struct acrn_vcpu *vcpu) {}
+static inline void vpmu_handle_overflow(void) {}
+#endif
+
+#endif /* __RISCV_VPMU_H__ */
@@ -32,6 +32,8 @@ struct acrn_irqchip_ops {
 	void (*enable)(struct irq_desc *);
 	void (*disable)(struct irq_desc *);
 	void (*eoi)(struct irq_desc *desc);
+	/* route the interrupt to one pCPU, NULL if the chip cannot */
+	void (*set_affinity)(struct irq_desc *desc, uint16_t pcpu_id);
 };
 
 extern struct acrn_irqchip_ops dummy_irqchip;
@@ -89,5 +91,7 @@ extern void init_interrupt_arch(uint16_t pcpu_id);
 extern void setup_irqs_arch(void);
 extern void dispatch_interrupt(struct cpu_regs *regs);
 extern void handle_mexti(void);
+extern int32_t irq_set_affinity(uint32_t irq, uint16_t pcpu_id);
+extern uint16_t irq_get_affinity(uint32_t irq);
 
 #endif /* __RISCV_IRQ_H__ */
@@ -89,4 +89,17 @@ static inline int32_t atomic_dec_return(int32_t *v)
 	return atomic_sub_return(1, v);
 }
 
+static inline uint64_t atomic_swap64(volatile uint64_t *p, uint64_t v)
+{
+	uint64_t ret;
+
+	asm volatile (
+		"amoswap.d.aqrl %1, %2, %0\n\t"
+		: "+A"(*p), "=r"(ret)
+		: "r"(v)
+		: "memory"
+	);
+	return ret;
+}
+
 #endif /* __RISCV_LIB_ATOMIC_H__ */
@@ -85,75 +85,117 @@ static inline uint32_t find_first_set_bit(uint64_t word)
 
 static inline void bitmap_set_lock(uint16_t nr_arg, volatile uint64_t *addr)
 {
-	*addr |= 1 << (uint64_t)nr_arg;
+	asm volatile ("amoor.d zero, %1, %0"
+		: "+A" (*addr)
+		: "r" (1UL << nr_arg)
+		: "memory");
 }
 
 static inline void bitmap_clear_lock(uint16_t nr_arg, volatile uint64_t *addr)
 {
-	*addr &= ~(1 << (uint64_t)nr_arg);
+	asm volatile ("amoand.d zero, %1, %0"
+		: "+A" (*addr)
+		: "r" (~(1UL << nr_arg))
+		: "memory");
 }
 
 static inline void bitmap_set_nolock(uint16_t nr_arg, volatile uint64_t *addr)
-{}
+{
+	*addr |= (1UL << nr_arg);
+}
 
 static inline bool bitmap_clear_nolock(uint16_t nr_arg, volatile uint64_t *addr)
 {
+	*addr &= ~(1UL << nr_arg);
 	return true;
 }
 
 static inline bool bitmap_test_and_set_lock(uint16_t nr_arg, volatile uint64_t *addr)
 {
-	return true;
+	uint64_t mask = 1UL << nr_arg;
+	uint64_t old;
+
+	asm volatile ("amoor.d %1, %2, %0"
+		: "+A" (*addr), "=r" (old)
+		: "r" (mask)
+		: "memory");
+
+	return ((old & mask) != 0UL);
 }
 
 static inline bool bitmap_test_and_clear_lock(uint16_t nr_arg, volatile uint64_t *addr)
 {
-	if (!!(*addr & (1 << nr_arg))) {
-		*addr &= ~(1 << nr_arg);
-		return true;
-	} else {
-		return false;
-	}
+	uint64_t mask = 1UL << nr_arg;
+	uint64_t old;
+
+	asm volatile ("amoand.d %1, %2, %0"
+		: "+A" (*addr), "=r" (old)
+		: "r" (~mask)
+		: "memory");
+
+	return ((old & mask) != 0UL);
 }
 
 static inline bool bitmap_test(uint16_t nr, const volatile uint64_t *addr)
 {
-	return !!(*addr & (1 << nr));
+	return !!(*addr & (1UL << nr));
 }
 
-static inline bool bitmap32_set_lock(uint16_t nr_arg, volatile uint64_t *addr)
+static inline void bitmap32_set_lock(uint16_t nr_arg, volatile uint32_t *addr)
 {
-	return true;
+	asm volatile ("amoor.w zero, %1, %0"
+		: "+A" (*addr)
+		: "r" (1U << nr_arg)
+		: "memory");
 }
 
-static inline bool bitmap32_clear_lock(uint16_t nr_arg, volatile uint64_t *addr)
+static inline void bitmap32_clear_lock(uint16_t nr_arg, volatile uint32_t *addr)
 {
-	return true;
+	asm volatile ("amoand.w zero, %1, %0"
+		: "+A" (*addr)
+		: "r" (~(1U << nr_arg))
+		: "memory");
 }
 
-static inline bool bitmap32_set_nolock(uint16_t nr_arg, volatile uint64_t *addr)
+static inline void bitmap32_set_nolock(uint16_t nr_arg, volatile uint32_t *addr)
 {
-	return true;
+	*addr |= (1U << nr_arg);
 }
 
-static inline bool bitmap32_clear_nolock(uint16_t nr_arg, volatile uint64_t *addr)
+static inline void bitmap32_clear_nolock(uint16_t nr_arg, volatile uint32_t *addr)
 {
-	return true;
+	*addr &= ~(1U << nr_arg);
 }
 
-static inline bool bitmap32_test_and_set_lock(uint16_t nr_arg, volatile uint64_t *addr)
+static inline bool bitmap32_test_and_set_lock(uint16_t nr_arg, volatile uint32_t *addr)
 {
-	return true;
+	uint32_t mask = 1U << nr_arg;
+	uint32_t old;
+
+	asm volatile ("amoor.w %1, %2, %0"
+		: "+A" (*addr), "=r" (old)
+		: "r" (mask)
+		: "memory");
+
+	return ((old & mask) != 0U);
 }
 
-static inline bool bitmap32_test_and_clear_lock(uint16_t nr_arg, volatile uint64_t *addr)
+static inline bool bitmap32_test_and_clear_lock(uint16_t nr_arg, volatile uint32_t *addr)
 {
-	return true;
+	uint32_t mask = 1U << nr_arg;
+	uint32_t old;
+
+	asm volatile ("amoand.w %1, %2, %0"
+		: "+A" (*addr), "=r" (old)
+		: "r" (~mask)
+		: "memory");
+
+	return ((old & mask) != 0U);
 }
 
 static inline bool bitmap32_test(uint16_t nr, const volatile uint32_t *addr)
 {
-	return true;
+	return !!(*addr & (1U << nr));
 }
 
 uint32_t bit_weight(uint64_t bits);
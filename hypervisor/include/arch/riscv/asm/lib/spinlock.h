@@ -15,11 +15,54 @@
 #include <asm/types.h>
 #include <asm/system.h>
 
+/*
+ * Ticket locks suit locks which are rarely contended. Locks that many
+ * harts fight for can be given a class with the MCS type instead: each
+ * waiter then spins on its own queue node, not on the lock's cache line.
+ */
+enum spinlock_type {
+	SPINLOCK_TICKET = 0,
+	SPINLOCK_MCS,
+};
+
+enum spinlock_class_id {
+	LOCK_CLASS_SCHED = 0,
+	LOCK_CLASS_TIMER,
+	LOCK_CLASS_EMUL_MMIO,
+	LOCK_CLASS_VPLIC,
+	LOCK_CLASS_VAPLIC,
+	LOCK_CLASS_VCLINT,
+	LOCK_CLASS_S2PT,
+	LOCK_CLASS_NUM
+};
+
+struct spinlock_class {
+	const char *name;
+	enum spinlock_type type;
+	/* updated with CONFIG_LOCK_STATS only, wait time is in cpu_ticks() */
+	uint64_t acquired;
+	uint64_t contended;
+	uint64_t max_wait;
+};
+
+struct mcs_node;
+
 typedef struct _spinlock {
 	uint64_t head;
 	uint64_t tail;
+	/* NULL for a plain ticket lock, see spinlock_init_class() */
+	struct spinlock_class *cls;
+	/* last waiter in the queue and node of the holder, MCS only */
+	struct mcs_node *mcs_tail;
+	struct mcs_node *mcs_owner;
 } spinlock_t;
 
+extern struct spinlock_class spinlock_classes[LOCK_CLASS_NUM];
+extern void spinlock_init_class(spinlock_t *lock, enum spinlock_class_id id);
+extern void spinlock_class_obtain(spinlock_t *lock);
+extern void spinlock_class_release(spinlock_t *lock);
+extern void spinlock_class_reset_stats(void);
+
 static inline void spinlock_init(spinlock_t *lock)
 {
 	(void)memset(lock, 0U, sizeof(spinlock_t));
@@ -27,26 +70,35 @@ static inline void spinlock_init(spinlock_t *lock)
 
 static inline void spinlock_obtain(spinlock_t *lock)
 {
-	asm volatile ("   li t0, 0x1\n\t"
-		      "   amoadd.d t1, t0, (%[head])\n\t"
-		      "2: ld t0, (%[tail])\n\t"
-		      "   beq t1, t0, 1f\n\t"
-		      "   j 2b\n\t"
-		      "1:\n"
-		      :
-		      :
-		      [head] "r"(&lock->head),
-		      [tail] "r"(&lock->tail)
-		      : "cc", "memory", "t0", "t1");
+	if (lock->cls != NULL) {
+		spinlock_class_obtain(lock);
+	} else {
+		asm volatile ("   li t0, 0x1\n\t"
+			      "   amoadd.d t1, t0, (%[head])\n\t"
+			      "   j 2f\n\t"
+			      "3: " ASM_PAUSE "\n\t"
+			      "2: ld t0, (%[tail])\n\t"
+			      "   bne t1, t0, 3b\n\t"
+			      "   fence r, rw\n"
+			      :
+			      :
+			      [head] "r"(&lock->head),
+			      [tail] "r"(&lock->tail)
+			      : "cc", "memory", "t0", "t1");
+	}
 }
 
 static inline void spinlock_release(spinlock_t *lock)
 {
-	asm volatile ("   li t0, 0x1\n\t"
-		      "   amoadd.d t1, t0, (%[tail])\n"
-		      :
-		      : [tail] "r" (&lock->tail)
-		      : "cc", "memory", "t0", "t1");
+	if (lock->cls != NULL) {
+		spinlock_class_release(lock);
+	} else {
+		asm volatile ("   li t0, 0x1\n\t"
+			      "   amoadd.d.rl t1, t0, (%[tail])\n"
+			      :
+			      : [tail] "r" (&lock->tail)
+			      : "cc", "memory", "t0", "t1");
+	}
 }
 
 #else /* __ASSEMBLY__ */
@@ -60,6 +112,7 @@ static inline void spinlock_release(spinlock_t *lock)
 	amoadd.d t1, t0, SPINLOCK_HEAD_OFFSET(t2)
 2:	ld t0, SPINLOCK_TAIL_OFFSET(t2)
 	beq t1, t0, 1f
+	.insn i 0x0f, 0, x0, x0, 0x010
 	j 2b
 1 :
 .endm
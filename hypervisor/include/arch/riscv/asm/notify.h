@@ -10,13 +10,61 @@
 #ifndef __RISCV_NOTIFY_H__
 #define __RISCV_NOTIFY_H__
 
+#include <asm/config.h>
+
+/* entries per pCPU call queue, must be a power of 2 */
+#define SMP_CALL_QUEUE_SIZE	16U
+
 typedef void (*smp_call_func_t)(void *data);
-struct smp_call_info_data {
+
+/*
+ * Completion token of an asynchronous cross call: pending counts the
+ * target pCPUs which have not yet run the function.
+ */
+struct smp_call_token {
+	volatile int64_t pending;
+};
+
+/*
+ * One queue entry. seq implements the slot hand-off between producers
+ * and the owning pCPU: seq == pos means free for the producer which got
+ * ticket pos, seq == pos + 1 means filled and ready to be consumed.
+ */
+struct smp_call_slot {
+	volatile uint64_t seq;
 	smp_call_func_t func;
 	void *data;
+	struct smp_call_token *token;
+};
+
+/* multi-producer, single-consumer ring owned by one pCPU */
+struct smp_call_queue {
+	volatile uint64_t tail;
+	volatile uint64_t head;
+	struct smp_call_slot slots[SMP_CALL_QUEUE_SIZE];
+};
+
+/*
+ * A coalesced cross call: requests for the same function that are
+ * raised while an earlier one is still queued on a pCPU are folded into
+ * that single queued run. Only suitable for functions without per-call
+ * data, e.g. full TLB or icache flushes.
+ */
+struct smp_call_coalesced {
+	smp_call_func_t func;
+	struct {
+		volatile uint64_t req_gen;
+		volatile uint64_t done_gen;
+		volatile uint64_t queued;
+	} cpu[CONFIG_NR_CPUS];
 };
 
 extern void smp_call_function(uint64_t mask, smp_call_func_t func, void *data);
+extern void smp_call_function_async(uint64_t mask, smp_call_func_t func, void *data,
+		struct smp_call_token *token);
+extern bool smp_call_done(const struct smp_call_token *token);
+extern void smp_call_wait(const struct smp_call_token *token);
+extern void smp_call_function_coalesced(uint64_t mask, struct smp_call_coalesced *call);
 extern void smp_call_init(void);
 extern void kick_notification(void);
 
@@ -15,6 +15,31 @@
 #define PAGE_MASK		(~(PAGE_SIZE-1))
 #define PAGE_FLAG_MASK		(~0)
 
-#define clear_page(page)	( {memset((void *)(page), 0, PAGE_SIZE);} )
+#ifndef __ASSEMBLY__
+#include <asm/lib/spinlock.h>
+
+/* uses cbo.zero where available, see lib/memory.c */
+extern void clear_page(void *page);
+
+struct page {
+	uint8_t contents[PAGE_SIZE];
+} __aligned(PAGE_SIZE);
+
+struct page_pool {
+	struct page *start_page;
+	spinlock_t lock;
+	uint64_t bitmap_size;
+	uint64_t *bitmap;
+	uint64_t last_hint_id;
+
+	/* usage counters, in pages */
+	uint64_t used_pages;
+	uint64_t peak_pages;
+	uint64_t failed_allocs;
+};
+
+struct page *alloc_page(struct page_pool *pool);
+void free_page(struct page_pool *pool, struct page *page);
+#endif /* __ASSEMBLY__ */
 
 #endif /* __RISCV_PAGE_H__ */
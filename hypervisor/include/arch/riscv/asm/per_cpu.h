@@ -35,9 +35,16 @@ struct per_cpu_region {
 	struct acrn_vcpu *vcpu_array[CONFIG_MAX_VM_NUM];
 	struct acrn_vcpu *ever_run_vcpu;
 	void *vcpu_run;
+	/* vCPU whose VS CSRs are currently live in this hart */
+	struct acrn_vcpu *vs_owner;
+	/* vCPU whose FP/vector registers are currently live in this hart */
+	struct acrn_vcpu *fp_owner;
+	/* vCPU whose counters are set up in this hart's PMU, and those host counters */
+	struct acrn_vcpu *pmu_owner;
+	uint64_t pmu_active;
 	struct sched_control sched_ctl;
 	uint32_t lapic_id;
-	struct smp_call_info_data smp_call_info;
+	struct smp_call_queue smp_call_queue;
 	uint32_t cpu_id;
 	struct per_cpu_timers cpu_timers;
 	struct thread_object idle;
@@ -93,6 +93,10 @@ pgtable_t __aligned(PAGE_SIZE) name[PG_TABLE_ENTRIES * (nr)]
 #define VPN3_MASK		(~(VPN3_SIZE - 1UL))
 
 
+/* PPN field of a leaf or table entry */
+#define PTE_PPN_SHIFT		10
+#define PTE_PPN_MASK		0x003FFFFFFFFFFC00UL
+
 /* TODO: PAGE_MASK & PHYSICAL_MASK */
 #define VPN3_PFN_MASK		0x0000FFFFFFFFF000UL
 #define VPN2_PFN_MASK		0x0000FFFFFFFFF000UL
@@ -107,10 +111,6 @@ pgtable_t __aligned(PAGE_SIZE) name[PG_TABLE_ENTRIES * (nr)]
 #include <asm/page.h>
 #include <asm/mem.h>
 
-struct page {
-	uint8_t contents[PAGE_SIZE];
-} __aligned(PAGE_SIZE);
-
 enum _page_table_level {
 	/**
 	 * @brief The PML4 level in the page tables
@@ -177,14 +177,21 @@ union pgtable_pages_info {
 	struct {
 		uint64_t top_address_space;
 		struct page *vpn3_base;
-		struct page *vpn2_base;
-		struct page *vpn1_base;
-		struct page *vpn0_base;
+		struct page_pool *pool;
 	} s2pt;
 };
 
+/* large page split/merge events of one page table */
+struct pgtable_stats {
+	uint64_t splits;
+	uint64_t merges;
+	/* empty table pages given back on MR_DEL */
+	uint64_t frees;
+};
+
 struct memory_ops {
 	union pgtable_pages_info *info;
+	struct pgtable_stats *stats;
 	bool (*large_page_support)(enum _page_table_level level);
 	uint64_t (*get_default_access_right)(void);
 	uint64_t (*pgentry_present)(uint64_t pte);
@@ -193,6 +200,7 @@ struct memory_ops {
 	struct page *(*get_pd_page)(const union pgtable_pages_info *info, uint64_t gpa);
 	struct page *(*get_pt_page)(const union pgtable_pages_info *info, uint64_t gpa);
 	void *(*get_sworld_memory_base)(const union pgtable_pages_info *info);
+	void (*free_pt_page)(const union pgtable_pages_info *info, struct page *page);
 	void (*clflush_pagewalk)(const void *p);
 	void (*tweak_exe_right)(uint64_t *entry);
 	void (*recover_exe_right)(uint64_t *entry);
@@ -286,12 +294,25 @@ static inline uint64_t vpn_large(uint64_t vpn)
 	return (vpn & PAGE_V) && ((vpn & PAGE_TYPE_MASK) != PAGE_TYPE_TABLE);
 }
 
-extern void mmu_add(uint64_t *pml4_page, uint64_t paddr_base, uint64_t vaddr_base,
+static inline uint64_t pgentry_paddr(uint64_t pte)
+{
+	return ((pte & PTE_PPN_MASK) >> PTE_PPN_SHIFT) << PAGE_SHIFT;
+}
+
+static inline uint64_t pgentry_prot(uint64_t pte)
+{
+	return pte & ~PTE_PPN_MASK;
+}
+
+extern int32_t mmu_add(uint64_t *pml4_page, uint64_t paddr_base, uint64_t vaddr_base,
 		uint64_t size, uint64_t prot, const struct memory_ops *mem_ops);
 
-extern void mmu_modify_or_del(uint64_t *pml4_page, uint64_t vaddr_base, uint64_t size,
+extern int32_t mmu_modify_or_del(uint64_t *pml4_page, uint64_t vaddr_base, uint64_t size,
 		uint64_t prot_set, uint64_t prot_clr, const struct memory_ops *mem_ops, uint32_t type);
 
+extern void mmu_promote(uint64_t *vpn3_page, uint64_t vaddr_base, uint64_t size,
+		const struct memory_ops *mem_ops);
+
 extern const uint64_t *lookup_address(uint64_t *vpn3_page, uint64_t addr, uint64_t *pg_size,
 					const struct memory_ops *mem_ops);
 
@@ -396,7 +417,10 @@ static inline pgtable_t mfn_to_acrn_entry(mfn_t mfn, uint8_t attr, bool table)
  */
 #define PAGE_FAULT_ID_FLAG	 0x00000010U
 
+extern void init_s2pt_page_pool(void);
 extern void init_s2pt_mem_ops(struct memory_ops *mem_ops, uint16_t vm_id);
+extern const struct page_pool *get_s2pt_page_pool(void);
+extern const struct pgtable_stats *get_s2pt_stats(uint16_t vm_id);
 #endif /* __ASSEMBLY__ */
 
 #endif /* __RISCV_PGTABLE_H__ */
@@ -12,6 +12,7 @@
 
 #include <types.h>
 #include <asm/lib/spinlock.h>
+#include <asm/cpu.h>
 #include <asm/mem.h>
 #include <irq.h>
 
@@ -23,14 +24,31 @@
 
 #define PLIC_IRQ_MASK 	(0xFFFFFFFE)
 
+/* per interrupt context register blocks, PLIC_IER/THR/EOIR are context 0 */
+#define PLIC_CTX_IER(ctx)	(PLIC_IER + ((ctx) * 0x80U))
+#define PLIC_CTX_THR(ctx)	(PLIC_THR + ((ctx) * 0x1000U))
+#define PLIC_CTX_EOIR(ctx)	(PLIC_EOIR + ((ctx) * 0x1000U))
+
+/* external interrupt line of a hart the hypervisor takes PLIC interrupts on */
+#ifdef CONFIG_MACRN
+#define PLIC_HART_EXT_IRQ	11U
+#else
+#define PLIC_HART_EXT_IRQ	9U
+#endif
+
 struct acrn_plic {
 	spinlock_t lock;
 	paddr_t base;
 	void *map_base;
 	uint32_t size;
+	/* interrupt context of each hart, from the device tree */
+	uint32_t hart_ctx[NR_CPUS];
 };
 
 void plic_write32(uint32_t value, uint32_t offset);
 uint32_t plic_read32(uint32_t offset);
+void plic_guest_enable(uint16_t pcpu_id, uint32_t word, uint32_t val);
+void plic_guest_threshold(uint16_t pcpu_id, uint32_t val);
+void plic_guest_complete(uint32_t irq);
 
 #endif /* __RISCV_PLIC_H__ */
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2025 Intel Corporation. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef __RISCV_PROFILING_H__
+#define __RISCV_PROFILING_H__
+
+#include <types.h>
+#include <errno.h>
+
+/* second word of a TRACE_PROF_SAMPLE entry, 0 for a hypervisor sample */
+#define PROF_SAMPLE_GUEST		(1UL << 63U)
+#define PROF_SAMPLE_VCPU_SHIFT		16U
+
+#ifndef CONFIG_MACRN
+extern int32_t profiling_sample_start(uint64_t event_idx, uint64_t period);
+extern void profiling_sample_stop(void);
+extern uint64_t profiling_sample_count(uint16_t pcpu_id);
+extern void profiling_lcofi_handler(uint64_t pc);
+#else
+static inline int32_t profiling_sample_start(__unused uint64_t event_idx, __unused uint64_t period)
+{
+	return -ENODEV;
+}
+static inline void profiling_sample_stop(void) {}
+static inline uint64_t profiling_sample_count(__unused uint16_t pcpu_id)
+{
+	return 0UL;
+}
+static inline void profiling_lcofi_handler(__unused uint64_t pc) {}
+#endif
+
+#endif /* __RISCV_PROFILING_H__ */
@@ -26,6 +26,10 @@
 #define CONFIG_UART_SIZE		0x100
 #define CONFIG_PLIC_BASE		0x0C000000UL
 #define CONFIG_PLIC_SIZE		0x04000000
+/* S-level AIA, used instead of the PLIC with -machine virt,aia=aplic-imsic */
+#define CONFIG_APLIC_BASE		0x0D000000UL
+#define CONFIG_APLIC_SIZE		0x8000
+#define CONFIG_IMSIC_BASE		0x28000000UL
 #define CONFIG_CLINT_BASE		0x02000000UL
 #define CONFIG_CLINT_TM_BASE		0x02004000UL
 #define CONFIG_CLINT_SIZE		0x10000
@@ -47,10 +47,10 @@ enum sbi_id {
 #define SBI_TYPE_RFENCE_FNECE_I			0x0
 #define SBI_TYPE_RFENCE_SFNECE_VMA		0x1
 #define SBI_TYPE_RFENCE_SFNECE_VMA_ASID		0x2
-#define SBI_TYPE_RFENCE_HFNECE_GVMA		0x3
-#define SBI_TYPE_RFENCE_HFNECE_GVMA_ASID	0x4
-#define SBI_TYPE_RFENCE_HFNECE_VVMA		0x5
-#define SBI_TYPE_RFENCE_HFNECE_VVMA_ASID	0x6
+#define SBI_TYPE_RFENCE_HFENCE_GVMA_VMID	0x3
+#define SBI_TYPE_RFENCE_HFENCE_GVMA		0x4
+#define SBI_TYPE_RFENCE_HFENCE_VVMA_ASID	0x5
+#define SBI_TYPE_RFENCE_HFENCE_VVMA		0x6
 
 /* SBI function IDs for HSM extension*/
 #define SBI_TYPE_HSM_HART_START			0x0
@@ -58,6 +58,66 @@ enum sbi_id {
 #define SBI_TYPE_HSM_HART_GET_STATUS		0x2
 #define SBI_EXT_HSM_HART_SUSPEND		0x3
 
+/* SBI function IDs for PMU extension*/
+#define SBI_TYPE_PMU_NUM_COUNTERS		0x0
+#define SBI_TYPE_PMU_COUNTER_GET_INFO		0x1
+#define SBI_TYPE_PMU_COUNTER_CFG_MATCH		0x2
+#define SBI_TYPE_PMU_COUNTER_START		0x3
+#define SBI_TYPE_PMU_COUNTER_STOP		0x4
+#define SBI_TYPE_PMU_COUNTER_FW_READ		0x5
+#define SBI_TYPE_PMU_COUNTER_FW_READ_HI		0x6
+
+/* PMU counter_cfg_match/start/stop flags */
+#define SBI_PMU_CFG_FLAG_SKIP_MATCH		(1UL << 0)
+#define SBI_PMU_CFG_FLAG_CLEAR_VALUE		(1UL << 1)
+#define SBI_PMU_CFG_FLAG_AUTO_START		(1UL << 2)
+#define SBI_PMU_CFG_FLAG_SET_VUINH		(1UL << 3)
+#define SBI_PMU_CFG_FLAG_SET_VSINH		(1UL << 4)
+#define SBI_PMU_CFG_FLAG_SET_UINH		(1UL << 5)
+#define SBI_PMU_CFG_FLAG_SET_SINH		(1UL << 6)
+#define SBI_PMU_CFG_FLAG_SET_MINH		(1UL << 7)
+#define SBI_PMU_START_FLAG_SET_INIT_VALUE	(1UL << 0)
+#define SBI_PMU_STOP_FLAG_RESET			(1UL << 0)
+
+/* PMU event_idx is type[19:16] and code[15:0], counter_info bit 63 is a firmware counter */
+#define SBI_PMU_EVENT_TYPE(idx)			(((idx) >> 16) & 0xfUL)
+#define SBI_PMU_EVENT_CODE(idx)			((idx) & 0xffffUL)
+#define SBI_PMU_EVENT_TYPE_FW			0xfUL
+#define SBI_PMU_CTR_INFO_FW			(1UL << 63)
+#define SBI_PMU_CTR_INFO_CSR_MASK		0xfffUL
+#define SBI_PMU_CTR_INFO_WIDTH(info)		((((info) >> 12) & 0x3fUL) + 1UL)
+
+/* PMU hardware general events, event type 0 */
+#define SBI_PMU_HW_CPU_CYCLES			0x1UL
+#define SBI_PMU_HW_INSTRUCTIONS			0x2UL
+
+/* PMU firmware event codes */
+enum sbi_pmu_fw_event {
+	SBI_PMU_FW_MISALIGNED_LOAD = 0,
+	SBI_PMU_FW_MISALIGNED_STORE,
+	SBI_PMU_FW_ACCESS_LOAD,
+	SBI_PMU_FW_ACCESS_STORE,
+	SBI_PMU_FW_ILLEGAL_INSN,
+	SBI_PMU_FW_SET_TIMER,
+	SBI_PMU_FW_IPI_SENT,
+	SBI_PMU_FW_IPI_RECVD,
+	SBI_PMU_FW_FENCE_I_SENT,
+	SBI_PMU_FW_FENCE_I_RECVD,
+	SBI_PMU_FW_SFENCE_VMA_SENT,
+	SBI_PMU_FW_SFENCE_VMA_RCVD,
+	SBI_PMU_FW_SFENCE_VMA_ASID_SENT,
+	SBI_PMU_FW_SFENCE_VMA_ASID_RCVD,
+	SBI_PMU_FW_HFENCE_GVMA_SENT,
+	SBI_PMU_FW_HFENCE_GVMA_RCVD,
+	SBI_PMU_FW_HFENCE_GVMA_VMID_SENT,
+	SBI_PMU_FW_HFENCE_GVMA_VMID_RCVD,
+	SBI_PMU_FW_HFENCE_VVMA_SENT,
+	SBI_PMU_FW_HFENCE_VVMA_RCVD,
+	SBI_PMU_FW_HFENCE_VVMA_ASID_SENT,
+	SBI_PMU_FW_HFENCE_VVMA_ASID_RCVD,
+	SBI_PMU_FW_MAX,
+};
+
 /* SBI function IDs for MPXY extension*/
 #define SBI_TYPE_MPXY_GET_SHM_SIZE		0x0
 #define SBI_TYPE_MPXY_SET_SHM			0x1
@@ -88,5 +148,8 @@ typedef struct {
 
 extern void init_sbi_ipi(void);
 extern void init_sbi_timer(void);
+extern bool sbi_probe_extension(enum sbi_id id);
+extern sbi_ret sbi_pmu_ecall(uint64_t func, uint64_t arg0, uint64_t arg1, uint64_t arg2,
+				uint64_t arg3, uint64_t arg4);
 
 #endif /*  __RISCV_SBI_H__ */
@@ -38,6 +38,7 @@ struct smp_ops {
 	int (*ipi_start_cpu)(int cpu, uint64_t addr, uint64_t arg);
 	void (*rfence)(uint64_t dest_mask, uint64_t addr, uint64_t size);
 	void (*hfence)(uint64_t dest_mask, uint64_t addr, uint64_t size);
+	void (*hfence_vmid)(uint64_t dest_mask, uint64_t addr, uint64_t size, uint16_t vmid);
 };
 
 extern void register_smp_ops(struct smp_ops *ops);
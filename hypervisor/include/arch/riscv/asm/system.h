@@ -23,6 +23,12 @@
 #define rmb()           dsb()
 #define wmb()           dsb()
 
+/*
+ * pause (Zihintpause). It is encoded as fence w,0, so harts without the
+ * extension take it as a no-op.
+ */
+#define ASM_PAUSE	".insn i 0x0f, 0, x0, x0, 0x010"
+
 #define smp_mb()        dmb()
 #define smp_rmb()       dmb()
 #define smp_wmb()       dmb()
@@ -32,11 +32,78 @@ static inline void name(void)		\
 #ifdef CONFIG_MACRN
 STLB_HELPER(flush_guest_tlb_local);
 
+/* the guest runs in real S-mode, so its translations are plain S-mode ones */
+static inline void flush_vs_tlb_all(void)
+{
+	asm volatile("sfence.vma" : : : "memory");
+}
+
+static inline void flush_vs_tlb_addr(uint64_t va)
+{
+	asm volatile("sfence.vma %0" : : "r" (va) : "memory");
+}
+
+static inline void flush_vs_tlb_asid(uint64_t asid)
+{
+	asm volatile("sfence.vma zero, %0" : : "r" (asid) : "memory");
+}
+
+static inline void flush_vs_tlb_addr_asid(uint64_t va, uint64_t asid)
+{
+	asm volatile("sfence.vma %0, %1" : : "r" (va), "r" (asid) : "memory");
+}
+
 #else /* !CONFIG_MACRN */
 
 HTLB_HELPER(flush_guest_tlb_local);
 STLB_HELPER(flush_acrn_tlb_local);
 
+/* hfence.gvma takes the guest physical address shifted right by 2 */
+static inline void flush_guest_tlb_vmid(uint16_t vmid)
+{
+	asm volatile("hfence.gvma zero, %0" : : "r" ((uint64_t)vmid) : "memory");
+}
+
+static inline void flush_guest_tlb_gpa_vmid(uint64_t gpa, uint16_t vmid)
+{
+	asm volatile("hfence.gvma %0, %1" : : "r" (gpa >> 2), "r" ((uint64_t)vmid) : "memory");
+}
+
+static inline void flush_guest_tlb_range_vmid(uint64_t gpa, uint64_t size, uint16_t vmid)
+{
+	uint64_t end = gpa + size;
+
+	gpa &= PAGE_MASK;
+	while (gpa < end) {
+		flush_guest_tlb_gpa_vmid(gpa, vmid);
+		gpa += PAGE_SIZE;
+	}
+}
+
+/*
+ * VS-stage (guest virtual) invalidations. hfence.vvma applies to the VMID
+ * currently in hgatp, so the caller must have the target VM loaded.
+ */
+static inline void flush_vs_tlb_all(void)
+{
+	asm volatile("hfence.vvma" : : : "memory");
+}
+
+static inline void flush_vs_tlb_addr(uint64_t va)
+{
+	asm volatile("hfence.vvma %0" : : "r" (va) : "memory");
+}
+
+static inline void flush_vs_tlb_asid(uint64_t asid)
+{
+	asm volatile("hfence.vvma zero, %0" : : "r" (asid) : "memory");
+}
+
+static inline void flush_vs_tlb_addr_asid(uint64_t va, uint64_t asid)
+{
+	asm volatile("hfence.vvma %0, %1" : : "r" (va), "r" (asid) : "memory");
+}
+
 static inline void  __flush_acrn_tlb_entry(uint64_t va)
 {
 	asm volatile("sfence.vma;" : : "r" (va>>PAGE_SHIFT) : "memory");
@@ -318,6 +318,7 @@ struct acrn_vcpu {
 
 	struct instr_emul_ctxt inst_ctxt;
 	struct io_request req; /* used by io/ept emulation */
+	struct mmio_hit_cache mmio_cache; /* last emulated MMIO region hit */
 
 	uint64_t reg_cached;
 	uint64_t reg_updated;
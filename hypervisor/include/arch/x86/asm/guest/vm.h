@@ -159,6 +159,7 @@ struct acrn_vm {
 	spinlock_t emul_mmio_lock;	/* Used to protect emulation mmio_node concurrent access for a VM */
 	uint16_t nr_emul_mmio_regions;	/* the emulated mmio_region number */
 	struct mem_io_node emul_mmio[CONFIG_MAX_EMULATED_MMIO_REGIONS];
+	struct mmio_range_index emul_mmio_index;	/* sorted view of emul_mmio for lockless lookup */
 
 	struct vm_io_handler_desc emul_pio[EMUL_PIO_IDX_MAX];
 
@@ -751,10 +751,10 @@ static inline int32_t hcall_set_callback_vector(struct acrn_vcpu *vcpu, struct a
 	return -1;
 }
 
-static inline int32_t hcall_setup_sbuf(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm, uint64_t param1, uint64_t param2)
-{
-	return -1;
-}
+//static inline int32_t hcall_setup_sbuf(struct acrn_vcpu *vcpu, struct acrn_vm *target_vm, uint64_t param1, uint64_t param2)
+//{
+//	return -1;
+//}
 
 static inline int32_t hcall_asyncio_assign(__unused struct acrn_vcpu *vcpu, struct acrn_vm *target_vm,
 		 __unused uint64_t param1, uint64_t param2)
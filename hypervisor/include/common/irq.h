@@ -27,6 +27,12 @@
 
 extern uint64_t irq_alloc_bitmap[IRQ_ALLOC_BITMAP_SIZE];
 
+/* whether the hypervisor itself allocated @irq, i.e. it is not passed through */
+static inline bool irq_is_host_owned(uint32_t irq)
+{
+	return (irq_alloc_bitmap[irq >> 6U] & (1UL << (irq & 0x3fU))) != 0UL;
+}
+
 typedef void (*irq_action_t)(uint32_t irq, void *priv_data);
 
 /**
@@ -110,7 +110,13 @@ struct sched_noop_control {
 struct sched_iorr_control {
 	struct list_head runqueue;
 	struct hv_timer tick_timer;
+	/* no tick armed, at most one runnable thread (dynamic tick only) */
+	bool tick_stopped;
+	uint64_t tick_base;	/* when the scheduler started on this pCPU */
+	uint64_t ticks_taken;
+	uint64_t tick_stops;
 };
+uint64_t sched_iorr_ticks_avoided(uint16_t pcpu_id);
 
 extern struct acrn_scheduler sched_bvt;
 struct sched_bvt_control {
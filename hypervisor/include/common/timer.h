@@ -9,6 +9,7 @@
 
 #include <list.h>
 #include <ticks.h>
+#include <asm/lib/spinlock.h>
 
 /**
  * @brief Timer
@@ -27,18 +28,36 @@ enum tick_mode {
 	TICK_MODE_PERIODIC,	/**< periodic mode */
 };
 
+/**
+ * @brief Maximum number of timers active on one CPU at the same time
+ */
+#define MAX_TIMERS_PER_CPU	128U
+
+/**
+ * @brief heap_idx of a timer which is not on any CPU
+ */
+#define TIMER_NOT_QUEUED	0xffffffffU
+
+struct hv_timer;
+
 /**
  * @brief Definition of timers for per-cpu
+ *
+ * Active timers form a 4-ary min-heap ordered by timeout, so the next timer
+ * to expire is always heap[0].
  */
 struct per_cpu_timers {
-	struct list_head timer_list;	/**< it's for runtime active timer list */
+	spinlock_t lock;		/**< protects the heap, also against del_timer from other CPUs */
+	uint32_t nr;			/**< number of active timers */
+	struct hv_timer *heap[MAX_TIMERS_PER_CPU];	/**< runtime active timers */
 };
 
 /**
  * @brief Definition of timer
  */
 struct hv_timer {
-	struct list_head node;		/**< link all timers */
+	uint32_t heap_idx;		/**< index in the heap of its CPU, TIMER_NOT_QUEUED if not active */
+	uint16_t pcpu_id;		/**< CPU the timer was added on */
 	enum tick_mode mode;		/**< timer mode: one-shot or periodic */
 	uint64_t timeout;		/**< tsc deadline to interrupt */
 	uint64_t period_in_cycle;	/**< period of the periodic timer in CPU ticks */
@@ -46,6 +65,20 @@ struct hv_timer {
 	void *priv_data;		/**< func private data */
 };
 
+/**
+ * @brief Get the next timer to expire on a CPU.
+ *
+ * @param[in] cpu_timer Pointer to the timers of the CPU.
+ *
+ * @return the active timer with the earliest timeout, NULL if there is none.
+ *
+ * @pre the caller holds cpu_timer->lock
+ */
+static inline struct hv_timer *get_next_timer(const struct per_cpu_timers *cpu_timer)
+{
+	return (cpu_timer->nr != 0U) ? cpu_timer->heap[0] : NULL;
+}
+
 /* External Interfaces */
 
 /**
@@ -100,6 +133,7 @@ void update_timer(struct hv_timer *timer, uint64_t timeout, uint64_t period);
  *
  * @retval 0 on success
  * @retval -EINVAL timer has an invalid value
+ * @retval -ENOMEM MAX_TIMERS_PER_CPU timers are already active on this CPU
  *
  * @remark Don't call it in the timer callback function or interrupt content.
  */
@@ -18,6 +18,10 @@
 #define TRACE_TIMER_ACTION_UPDAT	0x3U
 #define TRACE_TIMER_IRQ			0x4U
 
+ /* IPI EVENT */
+#define TRACE_IPI_SEND			0x5U
+#define TRACE_IPI_RECV			0x6U
+
 #define TRACE_VM_EXIT			0x10U
 #define TRACE_VM_ENTER			0X11U
 #define TRACE_VMEXIT_ENTRY		0x10000U
@@ -39,8 +43,22 @@
 #define TRACE_VMEXIT_APICV_ACCESS	    (TRACE_VMEXIT_ENTRY + 0x00000039U)
 #define TRACE_VMEXIT_APICV_VIRT_EOI	    (TRACE_VMEXIT_ENTRY + 0x0000003AU)
 
+/*
+ * RISC-V exits, one event per scause code: exceptions from
+ * TRACE_VMEXIT_RV_EXCP, interrupts from TRACE_VMEXIT_RV_IRQ.
+ */
+#define TRACE_VMEXIT_RV_EXCP		    (TRACE_VMEXIT_ENTRY + 0x00000100U)
+#define TRACE_VMEXIT_RV_IRQ		    (TRACE_VMEXIT_ENTRY + 0x00000180U)
+
 #define TRACE_VMEXIT_UNHANDLED		0x20000U
 
+/* details of the exit being handled, not exits by themselves */
+#define TRACE_VMEXIT_SBI		0x30000U
+#define TRACE_VMEXIT_MMIO		0x30001U
+#define TRACE_VMEXIT_VIPI		0x30002U
+/* sampling profiler, see arch/riscv/profiling.c */
+#define TRACE_PROF_SAMPLE		0x30003U
+
 void TRACE_2L(uint32_t evid, uint64_t e, uint64_t f);
 void TRACE_4I(uint32_t evid, uint32_t a, uint32_t b, uint32_t c, uint32_t d);
 void TRACE_6C(uint32_t evid, uint8_t a1, uint8_t a2, uint8_t a3, uint8_t a4, uint8_t b1, uint8_t b2);
@@ -176,6 +176,34 @@ struct mem_io_node {
 	uint64_t range_end;
 };
 
+/**
+ * @brief Sorted index of the emulated MMIO regions of a VM
+ *
+ * Holds the indices of the registered nodes in \p emul_mmio, sorted by
+ * \p range_start. It is rebuilt under emul_mmio_lock on every registration
+ * change and looked up without the lock: \p seq is odd while an update is in
+ * progress and readers retry whenever it changed under them.
+ */
+struct mmio_range_index {
+	volatile uint32_t seq;
+	uint16_t nr;
+	uint16_t node[CONFIG_MAX_EMULATED_MMIO_REGIONS];
+};
+
+/**
+ * @brief Copy of the MMIO region a vCPU accessed last
+ *
+ * Valid as long as \p seq matches the seq of the VM's mmio_range_index.
+ */
+struct mmio_hit_cache {
+	uint32_t seq;
+	bool hold_lock;
+	hv_mem_io_handler_t read_write;
+	void *handler_private_data;
+	uint64_t range_start;
+	uint64_t range_end;
+};
+
 /* External Interfaces */
 
 /**
@@ -80,6 +80,7 @@
 #define HC_SETUP_HV_NPK_LOG         BASE_HC_ID(HC_ID, HC_ID_DBG_BASE + 0x01UL)
 #define HC_PROFILING_OPS            BASE_HC_ID(HC_ID, HC_ID_DBG_BASE + 0x02UL)
 #define HC_GET_HW_INFO              BASE_HC_ID(HC_ID, HC_ID_DBG_BASE + 0x03UL)
+#define HC_GET_VCPU_EXIT_STATS      BASE_HC_ID(HC_ID, HC_ID_DBG_BASE + 0x04UL)
 
 /* Trusty */
 #define HC_ID_TRUSTY_BASE           0x70UL
@@ -233,6 +234,50 @@ struct acrn_hw_info {
 	uint16_t reserved[3];
 } __aligned(8);
 
+#define ACRN_EXIT_STATS_EXCP_NUM	32U
+#define ACRN_EXIT_STATS_IRQ_NUM		16U
+#define ACRN_EXIT_STATS_SBI_NUM		16U
+#define ACRN_EXIT_STATS_HIST_NUM	32U
+
+/**
+ * VM exit statistics of one vCPU, the parameter for HC_GET_VCPU_EXIT_STATS
+ * hypercall. Times are in timebase ticks; histogram bucket 0 counts zero
+ * ticks and bucket n counts [2^(n-1), 2^n) ticks, the last one everything
+ * above.
+ */
+struct acrn_vcpu_exit_stats {
+	/** the vCPU to read, filled in by the Service VM */
+	uint16_t vcpu_id;
+
+	/** Reserved */
+	uint16_t reserved[3];
+
+	/** exits per scause exception code */
+	uint64_t exception[ACRN_EXIT_STATS_EXCP_NUM];
+
+	/** exits per scause interrupt code */
+	uint64_t interrupt[ACRN_EXIT_STATS_IRQ_NUM];
+
+	/** SBI extension of each sbi_calls[] slot, ~0UL for all the others */
+	uint64_t sbi_ext_id[ACRN_EXIT_STATS_SBI_NUM];
+
+	/** guest ecalls per SBI extension */
+	uint64_t sbi_calls[ACRN_EXIT_STATS_SBI_NUM];
+
+	/** time spent in the exit handler */
+	uint64_t handler_hist[ACRN_EXIT_STATS_HIST_NUM];
+
+	/** time from a VM exit to the next VM entry of the vCPU */
+	uint64_t roundtrip_hist[ACRN_EXIT_STATS_HIST_NUM];
+
+	/** trapped WFIs woken up while polling, and those that slept anyway */
+	uint64_t halt_poll_hits;
+	uint64_t halt_poll_misses;
+
+	/** current halt-polling window */
+	uint64_t halt_poll_window;
+} __aligned(8);
+
 /**
  * Gpa to hpa translation parameter, used for HC_VM_GPA2HPA hypercall
  */
@@ -163,8 +163,10 @@ BOOT_C_SRCS += arch/riscv/sbi.c
 BOOT_C_SRCS += arch/riscv/plic.c
 BOOT_C_SRCS += arch/riscv/notify.c
 BOOT_C_SRCS += arch/riscv/boot.c
+BOOT_C_SRCS += arch/riscv/fdt.c
 BOOT_C_SRCS += arch/riscv/lib/bits.c
 BOOT_C_SRCS += arch/riscv/lib/memory.c
+BOOT_C_SRCS += arch/riscv/lib/spinlock.c
 
 BOOT_C_SRCS += arch/riscv/guest/vmcs.c
 BOOT_C_SRCS += arch/riscv/guest/vm.c
@@ -176,12 +178,15 @@ BOOT_C_SRCS += arch/riscv/guest/vpci/vdev.c
 BOOT_C_SRCS += arch/riscv/guest/vpci/vhostbridge.c
 
 BOOT_C_SRCS += arch/riscv/mem.c
+BOOT_C_SRCS += arch/riscv/page.c
 BOOT_C_SRCS += arch/riscv/pgtable.c
 BOOT_C_SRCS += arch/riscv/pager.c
 BOOT_C_SRCS += arch/riscv/float.c
 
 ifndef CONFIG_MACRN
 BOOT_C_SRCS += arch/riscv/guest/s2vm.c
+BOOT_C_SRCS += arch/riscv/aia.c
+BOOT_C_SRCS += arch/riscv/guest/vaplic.c
 endif
 
 BOOT_C_SRCS += arch/riscv/guest/vcpu.c
@@ -190,13 +195,20 @@ BOOT_C_SRCS += arch/riscv/guest/virq.c
 BOOT_C_SRCS += arch/riscv/guest/vclint.c
 BOOT_C_SRCS += arch/riscv/guest/vplic.c
 BOOT_C_SRCS += arch/riscv/guest/vmexit.c
+BOOT_C_SRCS += arch/riscv/guest/vpmu.c
 BOOT_C_SRCS += arch/riscv/guest/vmcall.c
 BOOT_C_SRCS += arch/riscv/guest/guest_memory.c
 BOOT_C_SRCS += arch/riscv/guest/instr_emul.c
 BOOT_C_SRCS += arch/riscv/guest/tee.c
 
-BOOT_C_SRCS += release/profiling.c
+BOOT_C_SRCS += arch/riscv/profiling.c
+ifeq ($(CONFIG_RELEASE),y)
 BOOT_C_SRCS += release/trace.c
+BOOT_C_SRCS += release/sbuf.c
+else
+BOOT_C_SRCS += debug/trace.c
+BOOT_C_SRCS += debug/sbuf.c
+endif
 BOOT_C_SRCS += lib/sprintf.c
 BOOT_C_SRCS += lib/string.c
 BOOT_C_SRCS += common/timer.c
@@ -210,7 +222,6 @@ BOOT_C_SRCS += common/ticks.c
 BOOT_C_SRCS += common/hv_main.c
 #BOOT_C_SRCS += common/hypercall.c
 BOOT_C_SRCS += debug/printf.c
-BOOT_C_SRCS += release/sbuf.c
 BOOT_C_SRCS += debug/shell.c
 BOOT_C_SRCS += debug/string.c
 BOOT_C_SRCS += debug/logmsg.c
@@ -224,6 +235,10 @@ BOOT_C_SRCS += dm/io_req.c
 ifdef CONFIG_KTEST
 BOOT_C_SRCS += arch/riscv/ktest/app.c
 BOOT_C_SRCS += arch/riscv/ktest/smp.c
+BOOT_C_SRCS += arch/riscv/ktest/bench.c
+ifndef CONFIG_MACRN
+BOOT_C_SRCS += arch/riscv/ktest/vcsr.c
+endif
 endif
 
 BOOT_C_OBJS := $(patsubst %.c,$(HV_OBJDIR)/%.o,$(BOOT_C_SRCS))
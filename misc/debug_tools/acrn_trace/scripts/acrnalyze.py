@@ -12,6 +12,7 @@ import getopt
 import os
 from vmexit_analyze import analyze_vm_exit
 from irq_analyze import analyze_irq
+from profile_analyze import analyze_profile
 
 def usage():
     """print the usage of the script
@@ -29,6 +30,9 @@ def usage():
     -f, --frequency=[unsigned int]: TSC frequency in MHz
     --vm_exit: to generate vm_exit report
     --irq: to generate irq related report
+    --profile: to generate a flat profile from the profiler samples
+    -s, --symbols=[string]: "nm -n" output of acrn.out, names the
+                            hypervisor functions in the profile
     ''')
 
 def do_analysis(ifile, ofile, analyzer, freq):
@@ -61,8 +65,10 @@ def main(argv):
     outputfile = ''
     # Default TSC frequency of MRB in MHz
     freq = 1881.6
-    opts_short = "hi:o:f:"
-    opts_long = ["ifile=", "ofile=", "frequency=", "vm_exit", "irq"]
+    symfile = None
+    profile = False
+    opts_short = "hi:o:f:s:"
+    opts_long = ["ifile=", "ofile=", "frequency=", "symbols=", "vm_exit", "irq", "profile"]
     analyzer = []
 
     try:
@@ -83,11 +89,18 @@ def main(argv):
             freq = arg
         elif opt == "--vm_exit":
             analyzer.append(analyze_vm_exit)
+        elif opt in ("-s", "--symbols"):
+            symfile = arg
         elif opt == "--irq":
             analyzer.append(analyze_irq)
+        elif opt == "--profile":
+            profile = True
         else:
             assert False, "unhandled option"
 
+    if profile:
+        analyzer.append(lambda ifile, ofile, freq: analyze_profile(ifile, ofile, freq, symfile))
+
     assert inputfile != '', "input file is required"
     assert outputfile != '', "output file is required"
     assert analyzer != '', 'MUST contain one of analyzer: ''vm_exit'
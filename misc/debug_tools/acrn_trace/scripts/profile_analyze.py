@@ -0,0 +1,148 @@
+#!/usr/bin/python3
+# -*- coding: UTF-8 -*-
+
+"""
+This script defines the function to build a flat profile from the samples
+of the hypervisor sampling profiler (the "profile" shell command)
+"""
+
+import bisect
+import csv
+import struct
+import sys
+
+TRACE_PROF_SAMPLE = 0x30003
+
+PROF_SAMPLE_GUEST = 1 << 63
+PROF_SAMPLE_VCPU_SHIFT = 16
+
+HV_SAMPLES = {}
+GUEST_SAMPLES = {}
+
+# 4 * 64bit per trace entry
+TRCREC = "QQQQ"
+
+def load_symbols(symfile):
+    """load the text symbols of the hypervisor image
+    Args:
+        symfile: output of "nm -n acrn.out"
+    Return:
+        sorted list of symbol addresses and the list of their names
+    """
+
+    addrs = []
+    names = []
+    try:
+        with open(symfile, 'r') as filep:
+            for line in filep:
+                fields = line.split()
+                if len(fields) != 3 or fields[1] not in "tTwW":
+                    continue
+                addrs.append(int(fields[0], 16))
+                names.append(fields[2])
+    except IOError as err:
+        print ("Symbol File Error: " + str(err))
+
+    return (addrs, names)
+
+def parse_trace(ifile):
+    """parse the trace data file
+    Args:
+        ifile: input trace data file
+    Return:
+        None
+    """
+
+    fd = open(ifile, 'rb')
+
+    while True:
+        try:
+            line = fd.read(struct.calcsize(TRCREC))
+            if not line:
+                break
+            (tsc, event, pc, guest) = struct.unpack(TRCREC, line)
+
+            event = event & 0xffffffffffff
+            if event != TRACE_PROF_SAMPLE:
+                continue
+
+            if guest & PROF_SAMPLE_GUEST:
+                vm_id = guest & 0xffff
+                vcpu_id = (guest >> PROF_SAMPLE_VCPU_SHIFT) & 0xffff
+                key = (vm_id, vcpu_id)
+                GUEST_SAMPLES[key] = GUEST_SAMPLES.get(key, 0) + 1
+            else:
+                HV_SAMPLES[pc] = HV_SAMPLES.get(pc, 0) + 1
+
+        except struct.error:
+            sys.exit()
+
+def symbolize(symbols):
+    """fold the hypervisor samples into the functions they hit
+    Args:
+        symbols: result of load_symbols(), or None
+    Return:
+        dict of samples per function
+    """
+
+    funcs = {}
+    for pc, count in HV_SAMPLES.items():
+        name = "0x%016x" % pc
+        if symbols is not None:
+            idx = bisect.bisect_right(symbols[0], pc) - 1
+            if idx >= 0:
+                name = symbols[1][idx]
+        funcs[name] = funcs.get(name, 0) + count
+
+    return funcs
+
+def generate_report(ofile, symbols):
+    """ generate analysis report
+    Args:
+        ofile: output report
+        symbols: result of load_symbols(), or None
+    Return:
+        None
+    """
+
+    rows = [("hv:" + name, count) for name, count in symbolize(symbols).items()]
+    rows += [("vm%d/vcpu%d" % key, count) for key, count in GUEST_SAMPLES.items()]
+    rows.sort(key=lambda row: row[1], reverse=True)
+    total = sum(row[1] for row in rows)
+    if total == 0:
+        print ("No profile samples found")
+        return
+
+    csv_name = ofile + '_profile.csv'
+    try:
+        with open(csv_name, 'w') as filep:
+            f_csv = csv.writer(filep)
+
+            print ("%-40s\t%-8s\t%-8s" % ("Function", "Samples", "Percent"))
+            f_csv.writerow(['Function', 'Samples', 'Percent'])
+            for name, count in rows:
+                pct = float(count) * 100 / total
+                print ("%-40s\t%-8d\t%-8.2f" % (name, count, pct))
+                f_csv.writerow([name, count, '%.2f' % pct])
+
+    except IOError as err:
+        print ("Output File Error: " + str(err))
+
+def analyze_profile(ifile, ofile, freq, symfile=None):
+    """do the profile analysis
+    Args:
+        ifile: input trace data file
+        ofile: output report file
+        freq: TSC frequency of the host where we capture the trace data
+        symfile: "nm -n" output of the hypervisor image to name the functions
+    Return:
+        None
+    """
+
+    print("Profile analysis started... \n\tinput file: %s\n"
+          "\toutput file: %s_profile.csv" % (ifile, ofile))
+
+    symbols = load_symbols(symfile) if symfile else None
+    parse_trace(ifile)
+    # save report to the output file
+    generate_report(ofile, symbols)
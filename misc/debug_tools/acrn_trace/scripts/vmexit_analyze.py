@@ -36,6 +36,29 @@ LIST_EVENTS = {
     'VMEXIT_UNHANDLED': 0x20000
 }
 
+# RISC-V exits are traced per scause code
+RV_EXCP = VMEXIT_ENTRY + 0x100
+RV_IRQ = VMEXIT_ENTRY + 0x180
+
+RV_EVENTS = {
+    'VMEXIT_RV_ILLEGAL_INSN':      RV_EXCP + 2,
+    'VMEXIT_RV_LOAD_ACCESS':       RV_EXCP + 5,
+    'VMEXIT_RV_STORE_ACCESS':      RV_EXCP + 7,
+    'VMEXIT_RV_ECALL_HS':          RV_EXCP + 9,
+    'VMEXIT_RV_ECALL_VS':          RV_EXCP + 10,
+    'VMEXIT_RV_GUEST_INSN_PF':     RV_EXCP + 20,
+    'VMEXIT_RV_GUEST_LOAD_PF':     RV_EXCP + 21,
+    'VMEXIT_RV_VIRTUAL_INSN':      RV_EXCP + 22,
+    'VMEXIT_RV_GUEST_STORE_PF':    RV_EXCP + 23,
+    'VMEXIT_RV_SSWI':              RV_IRQ + 1,
+    'VMEXIT_RV_STIMER':            RV_IRQ + 5,
+    'VMEXIT_RV_SEXT':              RV_IRQ + 9,
+    'VMEXIT_RV_SGEI':              RV_IRQ + 12,
+    'VMEXIT_RV_LCOFI':             RV_IRQ + 13
+}
+
+LIST_EVENTS.update(RV_EVENTS)
+
 NR_EXITS = {
     'VMEXIT_EXCEPTION_OR_NMI': 0,
     'VMEXIT_EXTERNAL_INTERRUPT': 0,
@@ -55,6 +78,7 @@ NR_EXITS = {
     'VMEXIT_APICV_WRITE': 0,
     'VMEXIT_UNHANDLED': 0
 }
+NR_EXITS.update(dict.fromkeys(RV_EVENTS, 0))
 
 TIME_IN_EXIT = {
     'VMEXIT_EXCEPTION_OR_NMI': 0,
@@ -75,6 +99,7 @@ TIME_IN_EXIT = {
     'VMEXIT_APICV_WRITE': 0,
     'VMEXIT_UNHANDLED': 0
 }
+TIME_IN_EXIT.update(dict.fromkeys(RV_EVENTS, 0))
 
 # 4 * 64bit per trace entry
 TRCREC = "QQQQ"